@@ -26,7 +26,32 @@ HEADERS += \
     stable.h \
     mgtexture2d.h \
     mgcamera.h \
-    mgbuffer.h
+    mgbuffer.h \
+    mgjobsystem.h \
+    mgscenesnapshot.h \
+    mgrenderthread.h \
+    vkc_commandallocator.h \
+    mgbarrierbatch.h \
+    vkc_rendergraph.h \
+    vkc_deletionqueue.h \
+    vkc_pipelinecache.h \
+    vkc_shaderreflection.h \
+    vkc_layoutcache.h \
+    vkc_renderpasscache.h \
+    vkc_descriptorallocator.h \
+    vkc_bindlesstable.h \
+    vkc_shaderwatcher.h \
+    mggeometrypool.h \
+    mgvertexformat.h \
+    mgmeshoptimizer.h \
+    mgmeshfile.h \
+    mgtexturecache.h \
+    mggltfimporter.h \
+    mgmeshsimplifier.h \
+    mgmeshlet.h \
+    vkc_computepipeline.h \
+    vkc_meshletculler.h \
+    vkc_occlusionculler.h
 
 SOURCES += \
     main.cpp \
@@ -40,14 +65,44 @@ SOURCES += \
     mgimage.cpp \
     mgtexture2d.cpp \
     mgcamera.cpp \
-    mgbuffer.cpp
+    mgbuffer.cpp \
+    mgjobsystem.cpp \
+    mgscenesnapshot.cpp \
+    mgrenderthread.cpp \
+    vkc_commandallocator.cpp \
+    mgbarrierbatch.cpp \
+    vkc_rendergraph.cpp \
+    vkc_deletionqueue.cpp \
+    vkc_pipelinecache.cpp \
+    vkc_shaderreflection.cpp \
+    vkc_layoutcache.cpp \
+    vkc_renderpasscache.cpp \
+    vkc_descriptorallocator.cpp \
+    vkc_bindlesstable.cpp \
+    vkc_shaderwatcher.cpp \
+    mggeometrypool.cpp \
+    mgvertexformat.cpp \
+    mgmeshoptimizer.cpp \
+    mgmeshfile.cpp \
+    mgtexturecache.cpp \
+    mggltfimporter.cpp \
+    mgmeshsimplifier.cpp \
+    mgmeshlet.cpp \
+    vkc_computepipeline.cpp \
+    vkc_meshletculler.cpp \
+    vkc_occlusionculler.cpp
 
 FORMS += \
     mgwindow.ui
 
 DISTFILES += \
     shader.vert \
-    shader.frag
+    shader_ubo.vert \
+    shader.frag \
+    shader_bindless.frag \
+    meshlet_cull.comp \
+    depth_pyramid.comp \
+    occlusion_cull.comp
 
 INCLUDEPATH += \
     $$(VULKAN_SDK)/Include/vulkan
@@ -1,4 +1,5 @@
 #include "mgwindow.h"
+#include "mgmeshfile.h"
 
 /**
  * Application entry point.
@@ -6,6 +7,14 @@
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+
+    // Convert a mesh offline: --convert <source> <mesh.mgm>
+    QStringList arguments = a.arguments();
+    int convert = arguments.indexOf("--convert");
+
+    if (convert >= 0 && convert + 2 < arguments.size())
+        return MgMeshFile::convert(arguments[convert + 1], arguments[convert + 2]) ? 0 : 1;
+
     MgWindow w;
 
     w.show();
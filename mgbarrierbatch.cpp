@@ -0,0 +1,72 @@
+#include "mgbarrierbatch.h"
+
+/**
+ * Add an image barrier to the batch.
+ */
+void MgBarrierBatch::addImageBarrier(VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages, const VkImageMemoryBarrier &barrier)
+{
+    this->srcStages |= srcStages;
+    this->dstStages |= dstStages;
+
+    imageBarriers.append(barrier);
+}
+
+/**
+ * Add a global memory barrier to the batch.
+ */
+void MgBarrierBatch::addMemoryBarrier(VkPipelineStageFlags srcStages, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess)
+{
+    this->srcStages |= srcStages;
+    this->dstStages |= dstStages;
+
+    // Fill memory barrier.
+    VkMemoryBarrier memoryBarrier =
+    {
+        VK_STRUCTURE_TYPE_MEMORY_BARRIER,   // VkStructureType    sType;
+        nullptr,                            // const void*        pNext;
+
+        srcAccess,                          // VkAccessFlags      srcAccessMask;
+        dstAccess                           // VkAccessFlags      dstAccessMask;
+    };
+
+    memoryBarriers.append(memoryBarrier);
+}
+
+/**
+ * Check if there is anything to record.
+ */
+bool MgBarrierBatch::isEmpty() const
+{
+    return imageBarriers.isEmpty() && memoryBarriers.isEmpty();
+}
+
+/**
+ * Record all gathered barriers as one pipeline barrier and clear the batch.
+ */
+void MgBarrierBatch::flush(VkCommandBuffer commandBuffer)
+{
+    if (isEmpty())
+        return;
+
+    // Stage masks must not be empty.
+    if (srcStages == 0)
+        srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    if (dstStages == 0)
+        dstStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+    // Register barriers in command buffer.
+    vkCmdPipelineBarrier(
+                commandBuffer,
+                srcStages,
+                dstStages,
+                0,
+                memoryBarriers.size(), memoryBarriers.data(),
+                0, nullptr,
+                imageBarriers.size(), imageBarriers.data()
+                );
+
+    srcStages = 0;
+    dstStages = 0;
+    imageBarriers.clear();
+    memoryBarriers.clear();
+}
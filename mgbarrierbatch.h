@@ -0,0 +1,40 @@
+#ifndef MGBARRIERBATCH_H
+#define MGBARRIERBATCH_H
+
+#include "stable.h"
+
+
+/**
+ * Class used to gather barriers and record them with a single call.
+ */
+class MgBarrierBatch
+{
+    // Objects:
+public:
+    VkPipelineStageFlags            srcStages =     0;
+    VkPipelineStageFlags            dstStages =     0;
+
+    QVector<VkImageMemoryBarrier>   imageBarriers;
+    QVector<VkMemoryBarrier>        memoryBarriers;
+
+    // Functions:
+public:
+    void addImageBarrier(
+            VkPipelineStageFlags    srcStages,
+            VkPipelineStageFlags    dstStages,
+            const VkImageMemoryBarrier &barrier
+            );
+    void addMemoryBarrier(
+            VkPipelineStageFlags    srcStages,
+            VkAccessFlags           srcAccess,
+            VkPipelineStageFlags    dstStages,
+            VkAccessFlags           dstAccess
+            );
+
+    bool isEmpty() const;
+    void flush(
+            VkCommandBuffer         commandBuffer
+            );
+};
+
+#endif // MGBARRIERBATCH_H
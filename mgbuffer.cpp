@@ -33,8 +33,10 @@ VkResult MgBuffer::create(VkDeviceSize size, VkBufferUsageFlags usageMask, const
     VkMemoryRequirements memoryRequirements;
     vkGetBufferMemoryRequirements(device->logical, handle, &memoryRequirements);
 
+    // Buffers are mapped and never flushed or invalidated, so host writes and
+    // the results read back from the GPU need coherent memory.
     uint32_t memoryTypeIdx = 0;
-    VkMemoryPropertyFlags memoryMask = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    VkMemoryPropertyFlags memoryMask = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
     mgAssert(device->getMemoryTypeIndex(memoryMask, memoryRequirements, &memoryTypeIdx));
 
     // Fill buffer memory allocate info.
@@ -57,16 +59,16 @@ VkResult MgBuffer::create(VkDeviceSize size, VkBufferUsageFlags usageMask, const
 }
 
 /**
- * Destroy the buffer.
+ * Destroy the buffer once the frames in flight no longer use it.
  */
 void MgBuffer::destroy()
 {
     if (device != nullptr)
     {
-        if (memory != VK_NULL_HANDLE)
-            vkFreeMemory(device->logical, memory, nullptr);
-
-        if (handle != VK_NULL_HANDLE)
-            vkDestroyBuffer(device->logical, handle, nullptr);
+        device->deletionQueue->retire(VKC_DELETION_BUFFER, (uint64_t)handle);
+        device->deletionQueue->retire(VKC_DELETION_MEMORY, (uint64_t)memory);
     }
+
+    handle = VK_NULL_HANDLE;
+    memory = VK_NULL_HANDLE;
 }
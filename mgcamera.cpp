@@ -86,3 +86,45 @@ void MgCamera::getViewProjectionMatrix(QMatrix4x4 *pVPMatrix)
 
     *pVPMatrix = projectionMatrix * viewMatrix;
 }
+
+
+/**
+ * Get the size in pixels of a unit at unit distance, for a viewport of the given height.
+ */
+float MgCamera::getPixelScale(uint32_t height) const
+{
+    return qAbs(projectionMatrix(1, 1)) * height * 0.5f;
+}
+
+
+/**
+ * Get the world space position of the camera.
+ */
+QVector3D MgCamera::getPosition() const
+{
+    return position;
+}
+
+
+/**
+ * Extract the world space frustum planes from a view-projection matrix.
+ *
+ * Planes are stored as (normal, distance) with normals pointing inwards.
+ */
+void MgCamera::getFrustumPlanes(const QMatrix4x4 &vpMatrix, QVector4D planes[6])
+{
+    QVector4D x = vpMatrix.row(0);
+    QVector4D y = vpMatrix.row(1);
+    QVector4D z = vpMatrix.row(2);
+    QVector4D w = vpMatrix.row(3);
+
+    planes[0] = w + x;      // Left.
+    planes[1] = w - x;      // Right.
+    planes[2] = w + y;      // Bottom.
+    planes[3] = w - y;      // Top.
+    planes[4] = w - z;      // Near (depth is reversed).
+    planes[5] = z;          // Far.
+
+    for (int i = 0; i < 6; i++)
+        planes[i] /= planes[i].toVector3D().length();
+}
@@ -32,6 +32,15 @@ public:
     void getViewProjectionMatrix(
             QMatrix4x4*     pVPMatrix
             );
+    float getPixelScale(
+            uint32_t        height
+            ) const;
+    QVector3D getPosition() const;
+
+    static void getFrustumPlanes(
+            const QMatrix4x4 &vpMatrix,
+            QVector4D       planes[6]
+            );
 };
 
 #endif // MGCAMERA_H
@@ -0,0 +1,332 @@
+#include "mggeometrypool.h"
+
+
+/**
+ * Start with the whole space free.
+ */
+MgRangeAllocator::MgRangeAllocator(uint32_t size)
+{
+    freeSize = size;
+
+    if (size > 0)
+        freeRanges.insert(0, size);
+}
+
+
+/**
+ * Take a range of the given size.
+ *
+ * Returns false if no free range is large enough.
+ */
+bool MgRangeAllocator::allocate(uint32_t size, uint32_t &offset)
+{
+    if (size == 0)
+    {
+        offset = 0;
+        return true;
+    }
+
+    // Find the smallest free range that fits, an exact fit ends the search.
+    auto best = freeRanges.end();
+
+    for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+    {
+        if (it.value() < size || (best != freeRanges.end() && it.value() >= best.value()))
+            continue;
+
+        best = it;
+
+        if (it.value() == size)
+            break;
+    }
+
+    if (best == freeRanges.end())
+        return false;
+
+    // Keep what is left of the range.
+    offset = best.key();
+    uint32_t remaining = best.value() - size;
+
+    freeRanges.erase(best);
+    if (remaining > 0)
+        freeRanges.insert(offset + size, remaining);
+
+    freeSize -= size;
+
+    return true;
+}
+
+
+/**
+ * Give back a range, merging it with the free ranges next to it.
+ */
+void MgRangeAllocator::free(uint32_t offset, uint32_t size)
+{
+    if (size == 0)
+        return;
+
+    freeSize += size;
+
+    // Merge with the following range.
+    auto next = freeRanges.find(offset + size);
+    if (next != freeRanges.end())
+    {
+        size += next.value();
+        freeRanges.erase(next);
+    }
+
+    // Merge with the preceding range.
+    auto it = freeRanges.lowerBound(offset);
+    if (it != freeRanges.begin())
+    {
+        --it;
+
+        if (it.key() + it.value() == offset)
+        {
+            it.value() += size;
+            return;
+        }
+    }
+
+    freeRanges.insert(offset, size);
+}
+
+
+/**
+ * Get the total size of the free ranges.
+ */
+uint32_t MgRangeAllocator::getFreeSize() const
+{
+    return freeSize;
+}
+
+
+/**
+ * Create and map the vertex and index buffers.
+ */
+MgGeometryPool::MgGeometryPool(const VkcDevice *device, MgVertexFormatType vertexFormat, uint32_t vertexCapacity, uint32_t indexCapacity,
+                               uint32_t meshletCapacity) :
+    vertexRanges(vertexCapacity),
+    indexRanges(indexCapacity),
+    shortIndexRanges(indexCapacity),
+    meshletRanges(meshletCapacity)
+{
+    this->device =          device;
+    this->vertexFormat =    vertexFormat;
+    this->vertexStride =    MgVertexFormat::getStride(vertexFormat);
+    this->vertexCapacity =  vertexCapacity;
+    this->indexCapacity =   indexCapacity;
+    this->meshletCapacity = meshletCapacity;
+
+    vertexData =    nullptr;
+    indexData =     nullptr;
+    shortIndexData = nullptr;
+    meshletData =   nullptr;
+
+    // Create the buffers, the culling shader reads the indices too.
+    VkBufferUsageFlags indexUsage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+    vertexBuffer.create((VkDeviceSize)vertexCapacity * vertexStride, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, device);
+    indexBuffer.create((VkDeviceSize)indexCapacity * sizeof(uint32_t), indexUsage, device);
+    shortIndexBuffer.create((VkDeviceSize)indexCapacity * sizeof(uint16_t), indexUsage, device);
+    meshletBuffer.create((VkDeviceSize)meshletCapacity * sizeof(MgMeshlet), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, device);
+
+    // Map them for their whole lifetime.
+    vkMapMemory(device->logical, vertexBuffer.memory, 0, VK_WHOLE_SIZE, 0, (void**)&vertexData);
+    vkMapMemory(device->logical, indexBuffer.memory, 0, VK_WHOLE_SIZE, 0, (void**)&indexData);
+    vkMapMemory(device->logical, shortIndexBuffer.memory, 0, VK_WHOLE_SIZE, 0, (void**)&shortIndexData);
+    vkMapMemory(device->logical, meshletBuffer.memory, 0, VK_WHOLE_SIZE, 0, (void**)&meshletData);
+}
+
+
+/**
+ * Destroy the buffers, this also unmaps them.
+ *
+ * The device must be idle.
+ */
+MgGeometryPool::~MgGeometryPool()
+{
+    // Run the pending range releases while the pool still exists.
+    device->deletionQueue->flush();
+
+    vertexBuffer.destroy();
+    indexBuffer.destroy();
+    shortIndexBuffer.destroy();
+    meshletBuffer.destroy();
+}
+
+
+/**
+ * Allocate a mesh and copy its geometry in.
+ *
+ * The vertices must be in the pool's format. Indices are relative to the
+ * mesh's first vertex, so they fit in 16 bits if the mesh has few enough
+ * vertices. Meshlets are relative to the mesh's first index.
+ */
+VkResult MgGeometryPool::upload(const void *vertices, uint32_t vertexCount, const QVector<uint32_t> &indices, MgMeshRange &range,
+                                const QVector<MgMeshlet> &meshlets)
+{
+    VkIndexType indexType = vertexCount <= MG_SHORT_INDEX_VERTICES ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+    mgAssert(allocate(vertexCount, (uint32_t)indices.size(), indexType, range, (uint32_t)meshlets.size()));
+
+    // The ranges are not used by any frame, so they are written directly.
+    memcpy(getVertexData(range), vertices, (size_t)vertexCount * vertexStride);
+
+    if (indexType == VK_INDEX_TYPE_UINT16)
+    {
+        uint16_t *shortIndices = (uint16_t*)getIndexData(range);
+
+        for (int i = 0; i < indices.size(); i++)
+            shortIndices[i] = (uint16_t)indices[i];
+    }
+    else
+    {
+        memcpy(getIndexData(range), indices.constData(), indices.size() * sizeof(uint32_t));
+    }
+
+    memcpy(getMeshletData(range), meshlets.constData(), meshlets.size() * sizeof(MgMeshlet));
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Take the vertex, index and meshlet ranges of a mesh.
+ *
+ * Returns VK_ERROR_OUT_OF_DEVICE_MEMORY if the pool is full.
+ */
+VkResult MgGeometryPool::allocate(uint32_t vertexCount, uint32_t indexCount, VkIndexType indexType, MgMeshRange &range,
+                                  uint32_t meshletCount)
+{
+    QMutexLocker locker(&mutex);
+
+    uint32_t vertexOffset;
+    uint32_t firstIndex;
+    uint32_t firstMeshlet;
+
+    if (!vertexRanges.allocate(vertexCount, vertexOffset))
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Geometry pool is out of vertex space.";
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+
+    if (!getIndexRanges(indexType).allocate(indexCount, firstIndex))
+    {
+        vertexRanges.free(vertexOffset, vertexCount);
+
+        qDebug() << "ERROR:   [@qDebug]              - Geometry pool is out of index space.";
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+
+    if (!meshletRanges.allocate(meshletCount, firstMeshlet))
+    {
+        vertexRanges.free(vertexOffset, vertexCount);
+        getIndexRanges(indexType).free(firstIndex, indexCount);
+
+        qDebug() << "ERROR:   [@qDebug]              - Geometry pool is out of meshlet space.";
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+
+    range.vertexOffset =    (int32_t)vertexOffset;
+    range.vertexCount =     vertexCount;
+    range.firstIndex =      firstIndex;
+    range.indexCount =      indexCount;
+    range.indexType =       indexType;
+    range.firstMeshlet =    firstMeshlet;
+    range.meshletCount =    meshletCount;
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Free the ranges of a mesh.
+ *
+ * Frames in flight may still draw it, so the ranges are reused only once
+ * they have completed.
+ */
+void MgGeometryPool::free(const MgMeshRange &range)
+{
+    if (range.vertexCount == 0 && range.indexCount == 0)
+        return;
+
+    device->deletionQueue->retire([this, range]()
+    {
+        QMutexLocker locker(&mutex);
+
+        vertexRanges.free((uint32_t)range.vertexOffset, range.vertexCount);
+        getIndexRanges(range.indexType).free(range.firstIndex, range.indexCount);
+        meshletRanges.free(range.firstMeshlet, range.meshletCount);
+    });
+}
+
+
+/**
+ * Bind the vertex buffer, shared by every mesh.
+ */
+void MgGeometryPool::bind(VkCommandBuffer commandBuffer) const
+{
+    VkDeviceSize vboOffsets[] = {0};
+
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.handle, vboOffsets);
+}
+
+
+/**
+ * Bind the index buffer shared by the meshes with the given index type.
+ */
+void MgGeometryPool::bindIndices(VkCommandBuffer commandBuffer, VkIndexType indexType) const
+{
+    const MgBuffer &buffer = indexType == VK_INDEX_TYPE_UINT16 ? shortIndexBuffer : indexBuffer;
+
+    vkCmdBindIndexBuffer(commandBuffer, buffer.handle, 0, indexType);
+}
+
+
+/**
+ * Draw a mesh, the pool and the index buffer of its type must be bound.
+ */
+void MgGeometryPool::draw(VkCommandBuffer commandBuffer, const MgMeshRange &range) const
+{
+    vkCmdDrawIndexed(commandBuffer, range.indexCount, 1, range.firstIndex, range.vertexOffset, 0);
+}
+
+
+/**
+ * Get the mapped vertices of a mesh.
+ */
+uint8_t* MgGeometryPool::getVertexData(const MgMeshRange &range) const
+{
+    return vertexData + (size_t)range.vertexOffset * vertexStride;
+}
+
+
+/**
+ * Get the mapped indices of a mesh, of its index type.
+ */
+void* MgGeometryPool::getIndexData(const MgMeshRange &range) const
+{
+    if (range.indexType == VK_INDEX_TYPE_UINT16)
+        return shortIndexData + range.firstIndex;
+
+    return indexData + range.firstIndex;
+}
+
+
+/**
+ * Get the mapped meshlets of a mesh.
+ */
+MgMeshlet* MgGeometryPool::getMeshletData(const MgMeshRange &range) const
+{
+    return meshletData + range.firstMeshlet;
+}
+
+
+/**
+ * Get the allocator of the index buffer for an index type.
+ */
+MgRangeAllocator& MgGeometryPool::getIndexRanges(VkIndexType indexType)
+{
+    return indexType == VK_INDEX_TYPE_UINT16 ? shortIndexRanges : indexRanges;
+}
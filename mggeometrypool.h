@@ -0,0 +1,184 @@
+#ifndef MGGEOMETRYPOOL_H
+#define MGGEOMETRYPOOL_H
+
+#include "stable.h"
+#include "vkc_device.h"
+#include "mgbuffer.h"
+#include "mgvertexformat.h"
+
+#define MG_GEOMETRY_POOL_VERTICES 262144
+#define MG_GEOMETRY_POOL_INDICES 1048576
+#define MG_GEOMETRY_POOL_MESHLETS 65536
+#define MG_SHORT_INDEX_VERTICES 65536
+
+
+/**
+ * Struct used for the part of the geometry pool holding one mesh.
+ *
+ * The offsets are in vertices and indices, as passed to vkCmdDrawIndexed().
+ * The first index is within the index buffer of the mesh's index type.
+ * Meshes split into meshlets also hold a range of the meshlet buffer.
+ */
+struct MgMeshRange
+{
+    int32_t                     vertexOffset =  0;
+    uint32_t                    vertexCount =   0;
+    uint32_t                    firstIndex =    0;
+    uint32_t                    indexCount =    0;
+    VkIndexType                 indexType =     VK_INDEX_TYPE_UINT32;
+
+    uint32_t                    firstMeshlet =  0;
+    uint32_t                    meshletCount =  0;
+};
+
+/**
+ * Struct used for a cluster of triangles of a mesh, as read by the culling shader.
+ *
+ * The triangles are a range of the index stream of the mesh, relative to its
+ * first index. The bounding sphere and normal cone are in model space; the
+ * whole cluster faces away from any point in the cone behind it, and a
+ * cutoff of 1 disables the cone.
+ */
+struct MgMeshlet
+{
+    float                       center[3];
+    float                       radius;
+    float                       coneAxis[3];
+    float                       coneCutoff;
+
+    uint32_t                    firstIndex;
+    uint32_t                    triangleCount;
+    uint32_t                    vertexCount;
+    uint32_t                    reserved;
+};
+
+
+/**
+ * Class used to sub-allocate ranges of a fixed size space.
+ *
+ * Free ranges are kept sorted by offset; allocations take the smallest one
+ * that fits, and freed ranges merge with their neighbours.
+ */
+class MgRangeAllocator
+{
+    // Objects:
+private:
+    QMap<uint32_t, uint32_t>    freeRanges;
+    uint32_t                    freeSize;
+
+    // Functions:
+public:
+    MgRangeAllocator(
+            uint32_t            size = 0
+            );
+
+    bool allocate(
+            uint32_t            size,
+            uint32_t            &offset
+            );
+    void free(
+            uint32_t            offset,
+            uint32_t            size
+            );
+    uint32_t getFreeSize() const;
+};
+
+
+/**
+ * Class used to keep the geometry of every mesh in shared vertex and index buffers.
+ *
+ * Meshes are ranges of the buffers, so the buffers are bound once per
+ * command buffer and draws only differ in their offsets, which also lets
+ * them be merged into indirect draws. Vertices are stored in one format.
+ * Meshes with few enough vertices get 16-bit indices, kept in a buffer of
+ * their own. The meshlets of every mesh share a storage buffer too, read by
+ * the culling shader along with the index buffers. The buffers stay mapped;
+ * a freed range is reused only once the frames in flight are done with it.
+ */
+class MgGeometryPool
+{
+    // Objects:
+public:
+    MgBuffer                    vertexBuffer;
+    MgBuffer                    indexBuffer;
+    MgBuffer                    shortIndexBuffer;
+    MgBuffer                    meshletBuffer;
+
+    MgVertexFormatType          vertexFormat;
+    uint32_t                    vertexStride;
+    uint32_t                    vertexCapacity;
+    uint32_t                    indexCapacity;
+    uint32_t                    meshletCapacity;
+
+private:
+    uint8_t                     *vertexData;
+    uint32_t                    *indexData;
+    uint16_t                    *shortIndexData;
+    MgMeshlet                   *meshletData;
+
+    QMutex                      mutex;
+    MgRangeAllocator            vertexRanges;
+    MgRangeAllocator            indexRanges;
+    MgRangeAllocator            shortIndexRanges;
+    MgRangeAllocator            meshletRanges;
+
+    const VkcDevice             *device;
+
+    // Functions:
+public:
+    MgGeometryPool(
+            const VkcDevice     *device,
+            MgVertexFormatType  vertexFormat,
+            uint32_t            vertexCapacity = MG_GEOMETRY_POOL_VERTICES,
+            uint32_t            indexCapacity = MG_GEOMETRY_POOL_INDICES,
+            uint32_t            meshletCapacity = MG_GEOMETRY_POOL_MESHLETS
+            );
+    ~MgGeometryPool();
+
+    VkResult upload(
+            const void          *vertices,
+            uint32_t            vertexCount,
+            const QVector<uint32_t> &indices,
+            MgMeshRange         &range,
+            const QVector<MgMeshlet> &meshlets = {}
+            );
+    VkResult allocate(
+            uint32_t            vertexCount,
+            uint32_t            indexCount,
+            VkIndexType         indexType,
+            MgMeshRange         &range,
+            uint32_t            meshletCount = 0
+            );
+    void free(
+            const MgMeshRange   &range
+            );
+
+    void bind(
+            VkCommandBuffer     commandBuffer
+            ) const;
+    void bindIndices(
+            VkCommandBuffer     commandBuffer,
+            VkIndexType         indexType
+            ) const;
+    void draw(
+            VkCommandBuffer     commandBuffer,
+            const MgMeshRange   &range
+            ) const;
+
+    uint8_t* getVertexData(
+            const MgMeshRange   &range
+            ) const;
+    void* getIndexData(
+            const MgMeshRange   &range
+            ) const;
+    MgMeshlet* getMeshletData(
+            const MgMeshRange   &range
+            ) const;
+
+private:
+    MgRangeAllocator& getIndexRanges(
+            VkIndexType         indexType
+            );
+};
+
+#endif // MGGEOMETRYPOOL_H
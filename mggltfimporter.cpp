@@ -0,0 +1,878 @@
+#include "mggltfimporter.h"
+#include "mgmeshoptimizer.h"
+#include "mgmeshsimplifier.h"
+#include "mgmeshlet.h"
+
+
+/**
+ * Initialize the importer.
+ */
+MgGltfImporter::MgGltfImporter(MgJobSystem *jobSystem, MgGeometryPool *geometryPool, MgTextureCache *textureCache)
+{
+    this->jobSystem =       jobSystem;
+    this->geometryPool =    geometryPool;
+    this->textureCache =    textureCache;
+
+    timer.start();
+}
+
+
+/**
+ * Wait for unfinished loads and drop what they made.
+ */
+MgGltfImporter::~MgGltfImporter()
+{
+    jobSystem->wait(&counter);
+
+    for (int i = 0; i < assets.size(); i++)
+    {
+        qDeleteAll(assets[i]->entities);
+        qDeleteAll(assets[i]->files);
+        delete assets[i];
+    }
+}
+
+
+/**
+ * Start loading assets on the workers.
+ *
+ * Returns at once; the entities are collected by finish().
+ */
+void MgGltfImporter::load(const QStringList &fileNames)
+{
+    for (int i = 0; i < fileNames.size(); i++)
+    {
+        MgGltfAsset *asset = new MgGltfAsset();
+        asset->fileName =   fileNames[i];
+        asset->directory =  QFileInfo(fileNames[i]).absoluteDir();
+        asset->stats.name = QFileInfo(fileNames[i]).fileName();
+        asset->startNs =    timer.nsecsElapsed();
+
+        // The parse job holds the asset until it has handed out the others.
+        asset->pendingJobs.store(1);
+        asset->geometryNs.store(0);
+        asset->textureNs.store(0);
+
+        assets.append(asset);
+        jobSystem->submit([this, asset]() { parse(asset); }, &counter, "parseAsset");
+    }
+}
+
+
+/**
+ * Wait for the assets to load and take their entities.
+ *
+ * The decoded textures still have to be created, see MgTextureCache::create().
+ * Returns false if any asset failed to load; the others are kept.
+ */
+bool MgGltfImporter::finish(QVector<VkcEntity*> &entities, QVector<MgAssetStats> &stats)
+{
+    // Help the workers rather than wait idle.
+    jobSystem->wait(&counter);
+
+    bool loaded = true;
+
+    for (int i = 0; i < assets.size(); i++)
+    {
+        MgGltfAsset *asset = assets[i];
+
+        for (int j = 0; j < asset->entities.size(); j++)
+        {
+            if (asset->entities[j] != nullptr)
+            {
+                entities.append(asset->entities[j]);
+                asset->stats.entityCount++;
+            }
+        }
+
+        asset->stats.geometryNs =   asset->geometryNs.load();
+        asset->stats.textureNs =    asset->textureNs.load();
+        stats.append(asset->stats);
+
+        loaded &= asset->stats.loaded;
+
+        // Every primitive is in the pool now, unmap the buffers.
+        qDeleteAll(asset->files);
+        delete asset;
+    }
+
+    assets.clear();
+
+    return loaded;
+}
+
+
+/**
+ * Read an asset and hand its images and primitives to jobs of their own.
+ */
+void MgGltfImporter::parse(MgGltfAsset *asset)
+{
+    QElapsedTimer parseTimer;
+    parseTimer.start();
+
+    if (readDocument(asset))
+    {
+        readImages(asset);
+
+        QVector<QVector<QMatrix4x4>> meshNodes;
+        readNodes(asset, meshNodes);
+
+        // Resolve the primitives of every mesh placed in the scene.
+        QJsonArray meshes = asset->document.value("meshes").toArray();
+        int entityCount = 0;
+
+        for (int i = 0; i < meshes.size(); i++)
+        {
+            if (meshNodes[i].isEmpty())
+                continue;
+
+            QJsonArray primitives = meshes[i].toObject().value("primitives").toArray();
+            asset->stats.meshCount++;
+
+            for (int j = 0; j < primitives.size(); j++)
+            {
+                MgGltfPrimitive primitive;
+
+                if (!readPrimitive(asset, primitives[j].toObject(), primitive))
+                    continue;
+
+                primitive.nodeMatrices =    meshNodes[i];
+                primitive.firstEntity =     entityCount;
+                entityCount += meshNodes[i].size();
+
+                asset->primitives.append(primitive);
+            }
+        }
+
+        asset->entities.fill(nullptr, entityCount);
+        asset->stats.primitiveCount = asset->primitives.size();
+        asset->stats.loaded = true;
+    }
+
+    asset->stats.parseNs = parseTimer.nsecsElapsed();
+
+    // The primitives are resolved, so their jobs need no JSON.
+    for (int i = 0; i < asset->primitives.size(); i++)
+    {
+        asset->pendingJobs.ref();
+        jobSystem->submit([this, asset, i]() { decodePrimitive(asset, i); }, &counter, "decodePrimitive");
+    }
+
+    finishJob(asset);
+}
+
+
+/**
+ * Read the JSON document of an asset, and its buffers.
+ *
+ * Binary .glb files are mapped, their JSON and binary chunks are read in place.
+ */
+bool MgGltfImporter::readDocument(MgGltfAsset *asset)
+{
+    QFile *file = new QFile(asset->fileName);
+    asset->files.append(file);
+
+    if (!file->open(QIODevice::ReadOnly))
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Asset \"" << asset->fileName << "\" not found.";
+        return false;
+    }
+
+    QByteArray json;
+    QByteArray binaryChunk;
+
+    if (QFileInfo(asset->fileName).suffix().toLower() == "glb")
+    {
+        qint64 size = file->size();
+        const uint8_t *data = file->map(0, size);
+
+        // The header holds the magic, version and length.
+        uint32_t header[3] = {};
+
+        if (data != nullptr && size >= (qint64)sizeof(header))
+            memcpy(header, data, sizeof(header));
+
+        if (header[0] != MG_GLTF_MAGIC || header[1] != MG_GLTF_VERSION || header[2] > size)
+        {
+            qDebug() << "ERROR:   [@qDebug]              - Asset \"" << asset->fileName << "\" is not a valid glTF 2.0 file.";
+            return false;
+        }
+
+        // Chunks are a length, a type and the data, padded to four bytes.
+        uint64_t offset = sizeof(header);
+
+        while (offset + 2 * sizeof(uint32_t) <= header[2])
+        {
+            uint32_t chunk[2];
+            memcpy(chunk, data + offset, sizeof(chunk));
+            offset += sizeof(chunk);
+
+            if (offset + chunk[0] > header[2])
+                break;
+
+            QByteArray contents = QByteArray::fromRawData((const char*)data + offset, chunk[0]);
+
+            if (chunk[1] == MG_GLTF_CHUNK_JSON && json.isEmpty())
+                json = contents;
+            else if (chunk[1] == MG_GLTF_CHUNK_BIN && binaryChunk.isEmpty())
+                binaryChunk = contents;
+
+            offset += chunk[0];
+        }
+    }
+    else
+    {
+        json = file->readAll();
+    }
+
+    QJsonDocument document = QJsonDocument::fromJson(json);
+    asset->document = document.object();
+
+    if (!document.isObject() || !asset->document.value("asset").toObject().value("version").toString().startsWith("2."))
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Asset \"" << asset->fileName << "\" is not a valid glTF 2.0 file.";
+        return false;
+    }
+
+    return readBuffers(asset, binaryChunk);
+}
+
+
+/**
+ * Get the contents of every buffer of an asset.
+ *
+ * External buffers are mapped and embedded ones decoded; the buffer without
+ * a URI of a .glb file is its binary chunk.
+ */
+bool MgGltfImporter::readBuffers(MgGltfAsset *asset, const QByteArray &binaryChunk)
+{
+    QJsonArray buffers = asset->document.value("buffers").toArray();
+
+    for (int i = 0; i < buffers.size(); i++)
+    {
+        QJsonObject buffer = buffers[i].toObject();
+        QString uri = buffer.value("uri").toString();
+        QByteArray data;
+
+        if (!buffer.contains("uri"))
+        {
+            data = i == 0 ? binaryChunk : QByteArray();
+        }
+        else if (uri.startsWith("data:"))
+        {
+            data = QByteArray::fromBase64(uri.mid(uri.indexOf(',') + 1).toLatin1());
+        }
+        else
+        {
+            QFile *file = new QFile(asset->directory.filePath(QUrl::fromPercentEncoding(uri.toUtf8())));
+            asset->files.append(file);
+
+            if (file->open(QIODevice::ReadOnly))
+            {
+                const char *mapped = (const char*)file->map(0, file->size());
+
+                if (mapped != nullptr)
+                    data = QByteArray::fromRawData(mapped, file->size());
+            }
+        }
+
+        if (data.size() < buffer.value("byteLength").toDouble())
+        {
+            qDebug() << "ERROR:   [@qDebug]              - Asset \"" << asset->fileName << "\" is missing buffer" << i << ".";
+            return false;
+        }
+
+        asset->buffers.append(data);
+    }
+
+    return true;
+}
+
+
+/**
+ * Get the texture of every image, decoding the ones new to the cache on jobs.
+ *
+ * Images in files are shared by path, embedded ones belong to their asset.
+ */
+void MgGltfImporter::readImages(MgGltfAsset *asset)
+{
+    QJsonArray images = asset->document.value("images").toArray();
+    QJsonArray bufferViews = asset->document.value("bufferViews").toArray();
+
+    for (int i = 0; i < images.size(); i++)
+    {
+        QJsonObject image = images[i].toObject();
+        QString uri = image.value("uri").toString();
+
+        QString key = QString("%1#image%2").arg(QFileInfo(asset->fileName).absoluteFilePath()).arg(i);
+        QString filePath;
+        QByteArray data;
+
+        if (image.contains("uri") && !uri.startsWith("data:"))
+        {
+            filePath = QFileInfo(asset->directory.filePath(QUrl::fromPercentEncoding(uri.toUtf8()))).absoluteFilePath();
+            key = filePath;
+        }
+        else if (image.contains("uri"))
+        {
+            data = QByteArray::fromBase64(uri.mid(uri.indexOf(',') + 1).toLatin1());
+        }
+        else
+        {
+            // Images in buffer views are read in place, the buffers stay mapped until finish().
+            int viewIndex = image.value("bufferView").toInt(-1);
+            QJsonObject view = viewIndex >= 0 && viewIndex < bufferViews.size() ? bufferViews[viewIndex].toObject() : QJsonObject();
+            int buffer = view.value("buffer").toInt(-1);
+            qint64 offset = view.value("byteOffset").toDouble();
+            qint64 length = view.value("byteLength").toDouble();
+
+            if (buffer >= 0 && buffer < asset->buffers.size() && offset + length <= asset->buffers[buffer].size())
+                data = QByteArray::fromRawData(asset->buffers[buffer].constData() + offset, length);
+        }
+
+        bool added;
+        MgTexture2D *texture = textureCache->acquire(key, added);
+        asset->images.append(texture);
+
+        if (added)
+        {
+            asset->stats.textureCount++;
+            asset->pendingJobs.ref();
+            jobSystem->submit([this, asset, texture, filePath, data]() { decodeImage(asset, texture, filePath, data); },
+                              &counter, "decodeImage");
+        }
+    }
+}
+
+
+/**
+ * Get the world matrices of the nodes holding every mesh.
+ *
+ * Without a scene, every node no other node holds is a root.
+ */
+void MgGltfImporter::readNodes(MgGltfAsset *asset, QVector<QVector<QMatrix4x4>> &meshNodes)
+{
+    QJsonArray nodes = asset->document.value("nodes").toArray();
+    QJsonArray scenes = asset->document.value("scenes").toArray();
+    int scene = asset->document.value("scene").toInt(0);
+
+    meshNodes.resize(asset->document.value("meshes").toArray().size());
+
+    QVector<int> roots;
+
+    if (scene >= 0 && scene < scenes.size())
+    {
+        QJsonArray sceneNodes = scenes[scene].toObject().value("nodes").toArray();
+
+        for (int i = 0; i < sceneNodes.size(); i++)
+            roots.append(sceneNodes[i].toInt());
+    }
+    else
+    {
+        QSet<int> children;
+
+        for (int i = 0; i < nodes.size(); i++)
+        {
+            QJsonArray nodeChildren = nodes[i].toObject().value("children").toArray();
+
+            for (int j = 0; j < nodeChildren.size(); j++)
+                children.insert(nodeChildren[j].toInt());
+        }
+
+        for (int i = 0; i < nodes.size(); i++)
+            if (!children.contains(i))
+                roots.append(i);
+    }
+
+    for (int i = 0; i < roots.size(); i++)
+        readNode(asset, roots[i], QMatrix4x4(), meshNodes, 0);
+}
+
+
+/**
+ * Place a node and its children under their parent.
+ *
+ * A valid hierarchy is never deeper than its node count, deeper ones loop.
+ */
+void MgGltfImporter::readNode(MgGltfAsset *asset, int node, const QMatrix4x4 &parentMatrix,
+                              QVector<QVector<QMatrix4x4>> &meshNodes, int depth)
+{
+    QJsonArray nodes = asset->document.value("nodes").toArray();
+
+    if (node < 0 || node >= nodes.size() || depth > nodes.size())
+        return;
+
+    QJsonObject object = nodes[node].toObject();
+    QMatrix4x4 matrix;
+
+    if (object.value("matrix").toArray().size() == 16)
+    {
+        QJsonArray values = object.value("matrix").toArray();
+        float elements[16];
+
+        for (int i = 0; i < 16; i++)
+            elements[i] = values[i].toDouble();
+
+        // glTF matrices are column-major, QMatrix4x4 takes rows.
+        matrix = QMatrix4x4(elements).transposed();
+    }
+    else
+    {
+        QJsonArray translation = object.value("translation").toArray();
+        QJsonArray rotation = object.value("rotation").toArray();
+        QJsonArray scale = object.value("scale").toArray();
+
+        if (translation.size() == 3)
+            matrix.translate(translation[0].toDouble(), translation[1].toDouble(), translation[2].toDouble());
+
+        if (rotation.size() == 4)
+            matrix.rotate(QQuaternion(rotation[3].toDouble(), rotation[0].toDouble(), rotation[1].toDouble(), rotation[2].toDouble()));
+
+        if (scale.size() == 3)
+            matrix.scale(scale[0].toDouble(), scale[1].toDouble(), scale[2].toDouble());
+    }
+
+    matrix = parentMatrix * matrix;
+
+    int mesh = object.value("mesh").toInt(-1);
+
+    if (mesh >= 0 && mesh < meshNodes.size())
+        meshNodes[mesh].append(matrix);
+
+    QJsonArray children = object.value("children").toArray();
+
+    for (int i = 0; i < children.size(); i++)
+        readNode(asset, children[i].toInt(), matrix, meshNodes, depth + 1);
+}
+
+
+/**
+ * Resolve the accessors and base color material of a primitive.
+ */
+bool MgGltfImporter::readPrimitive(MgGltfAsset *asset, const QJsonObject &primitiveObject, MgGltfPrimitive &primitive)
+{
+    // Only triangle lists are drawn.
+    if (primitiveObject.value("mode").toInt(4) != 4)
+    {
+        qDebug() << "WARNING: [@qDebug]              - Asset \"" << asset->fileName << "\" has a primitive that is not a triangle list.";
+        return false;
+    }
+
+    QJsonObject attributes = primitiveObject.value("attributes").toObject();
+    bool valid = getAccessor(asset, attributes.value("POSITION").toInt(-1), primitive.positions) &&
+            primitive.positions.componentCount == 3;
+
+    if (valid && attributes.contains("NORMAL"))
+        valid = getAccessor(asset, attributes.value("NORMAL").toInt(), primitive.normals) && primitive.normals.componentCount == 3;
+
+    if (valid && attributes.contains("TEXCOORD_0"))
+        valid = getAccessor(asset, attributes.value("TEXCOORD_0").toInt(), primitive.texCoords) && primitive.texCoords.componentCount == 2;
+
+    if (valid && primitiveObject.contains("indices"))
+        valid = getAccessor(asset, primitiveObject.value("indices").toInt(), primitive.indices) &&
+                primitive.indices.componentCount == 1 && primitive.indices.componentType != MG_GLTF_FLOAT;
+
+    if (!valid)
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Asset \"" << asset->fileName << "\" has an invalid primitive.";
+        return false;
+    }
+
+    // Get the base color factor and texture.
+    QJsonArray materials = asset->document.value("materials").toArray();
+    QJsonArray textures = asset->document.value("textures").toArray();
+    int material = primitiveObject.value("material").toInt(-1);
+
+    primitive.color = QVector4D(1.0f, 1.0f, 1.0f, 1.0f);
+
+    if (material >= 0 && material < materials.size())
+    {
+        QJsonObject pbr = materials[material].toObject().value("pbrMetallicRoughness").toObject();
+        QJsonArray factor = pbr.value("baseColorFactor").toArray();
+
+        if (factor.size() == 4)
+            primitive.color = QVector4D(factor[0].toDouble(), factor[1].toDouble(), factor[2].toDouble(), factor[3].toDouble());
+
+        int texture = pbr.value("baseColorTexture").toObject().value("index").toInt(-1);
+        int source = texture >= 0 && texture < textures.size() ? textures[texture].toObject().value("source").toInt(-1) : -1;
+
+        if (source >= 0 && source < asset->images.size())
+            primitive.texture = asset->images[source];
+    }
+
+    return true;
+}
+
+
+/**
+ * Get a view of the elements of an accessor, checked against its buffer.
+ *
+ * Sparse accessors and ones without a buffer view are not read.
+ */
+bool MgGltfImporter::getAccessor(const MgGltfAsset *asset, int index, MgGltfAccessor &accessor)
+{
+    QJsonArray accessors = asset->document.value("accessors").toArray();
+    QJsonArray bufferViews = asset->document.value("bufferViews").toArray();
+
+    if (index < 0 || index >= accessors.size())
+        return false;
+
+    QJsonObject object = accessors[index].toObject();
+    QString type = object.value("type").toString();
+    int view = object.value("bufferView").toInt(-1);
+
+    accessor.count =            object.value("count").toInt();
+    accessor.componentType =    object.value("componentType").toInt();
+    accessor.componentCount =   type == "SCALAR" ? 1 : type == "VEC2" ? 2 : type == "VEC3" ? 3 : type == "VEC4" ? 4 : 0;
+    accessor.normalized =       object.value("normalized").toBool();
+
+    uint32_t elementSize = getComponentSize(accessor.componentType) * accessor.componentCount;
+
+    if (elementSize == 0 || view < 0 || view >= bufferViews.size() || object.contains("sparse"))
+        return false;
+
+    QJsonObject viewObject = bufferViews[view].toObject();
+    int buffer = viewObject.value("buffer").toInt(-1);
+    uint64_t viewOffset = viewObject.value("byteOffset").toDouble();
+    uint64_t viewLength = viewObject.value("byteLength").toDouble();
+    uint64_t offset = viewOffset + (uint64_t)object.value("byteOffset").toDouble();
+
+    accessor.stride = viewObject.value("byteStride").toInt(elementSize);
+
+    // The last element must end within the view, and the view within the buffer.
+    if (buffer < 0 || buffer >= asset->buffers.size() || viewOffset + viewLength > (uint64_t)asset->buffers[buffer].size())
+        return false;
+
+    if (accessor.count > 0 && offset + (uint64_t)(accessor.count - 1) * accessor.stride + elementSize > viewOffset + viewLength)
+        return false;
+
+    accessor.data = (const uint8_t*)asset->buffers[buffer].constData() + offset;
+
+    return true;
+}
+
+
+/**
+ * Read the vertices and indices of a primitive.
+ *
+ * Missing normals are computed from the faces. Returns false if an index
+ * is past the vertices, or there is no triangle.
+ */
+bool MgGltfImporter::readGeometry(const MgGltfPrimitive &primitive, QVector<VkVertex> &vertices, QVector<uint32_t> &indices)
+{
+    uint32_t vertexCount = primitive.positions.count;
+
+    vertices = QVector<VkVertex>(vertexCount);
+    float values[4] = {};
+
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        VkVertex &vertex = vertices[i];
+
+        readElement(primitive.positions, i, values);
+        vertex.x = values[0];
+        vertex.y = values[1];
+        vertex.z = values[2];
+
+        if (primitive.normals.data != nullptr && i < primitive.normals.count)
+        {
+            readElement(primitive.normals, i, values);
+            vertex.nx = values[0];
+            vertex.ny = values[1];
+            vertex.nz = values[2];
+        }
+
+        // glTF rows go down, while decoded textures are mirrored.
+        if (primitive.texCoords.data != nullptr && i < primitive.texCoords.count)
+        {
+            readElement(primitive.texCoords, i, values);
+            vertex.u = values[0];
+            vertex.v = 1.0f - values[1];
+        }
+    }
+
+    // Without indices, every three vertices are a triangle.
+    uint32_t indexCount = primitive.indices.data != nullptr ? primitive.indices.count : vertexCount;
+    indices = QVector<uint32_t>(indexCount / 3 * 3);
+
+    for (int i = 0; i < indices.size(); i++)
+    {
+        indices[i] = primitive.indices.data != nullptr ? readIndex(primitive.indices, i) : i;
+
+        if (indices[i] >= vertexCount)
+            return false;
+    }
+
+    if (indices.isEmpty())
+        return false;
+
+    if (primitive.normals.data == nullptr)
+        MgVertexFormat::computeNormals(vertices, indices);
+
+    return true;
+}
+
+
+/**
+ * Read every primitive placed in the scene of an asset as one mesh.
+ *
+ * Node transforms are applied to the vertices, materials are dropped.
+ * Called by the mesh file converter, nothing is uploaded.
+ */
+bool MgGltfImporter::readMesh(const QString &fileName, QVector<VkVertex> &vertices, QVector<uint32_t> &indices)
+{
+    MgGltfAsset asset;
+    asset.fileName =    fileName;
+    asset.directory =   QFileInfo(fileName).absoluteDir();
+
+    bool valid = readDocument(&asset);
+
+    if (valid)
+    {
+        QVector<QVector<QMatrix4x4>> meshNodes;
+        readNodes(&asset, meshNodes);
+
+        QJsonArray meshes = asset.document.value("meshes").toArray();
+
+        for (int i = 0; i < meshes.size() && valid; i++)
+        {
+            QJsonArray primitives = meshes[i].toObject().value("primitives").toArray();
+
+            for (int j = 0; j < primitives.size() && valid && !meshNodes[i].isEmpty(); j++)
+            {
+                MgGltfPrimitive primitive;
+                QVector<VkVertex> primitiveVertices;
+                QVector<uint32_t> primitiveIndices;
+
+                if (!readPrimitive(&asset, primitives[j].toObject(), primitive))
+                    continue;
+
+                valid = readGeometry(primitive, primitiveVertices, primitiveIndices);
+
+                // Every node using the mesh places a copy of it.
+                for (int k = 0; k < meshNodes[i].size() && valid; k++)
+                {
+                    const QMatrix4x4 &matrix = meshNodes[i][k];
+                    QMatrix3x3 normalMatrix = matrix.normalMatrix();
+                    uint32_t baseVertex = vertices.size();
+
+                    for (int l = 0; l < primitiveVertices.size(); l++)
+                    {
+                        VkVertex vertex = primitiveVertices[l];
+                        QVector3D position = matrix.map(QVector3D(vertex.x, vertex.y, vertex.z));
+                        QVector3D normal(
+                                    normalMatrix(0, 0) * vertex.nx + normalMatrix(0, 1) * vertex.ny + normalMatrix(0, 2) * vertex.nz,
+                                    normalMatrix(1, 0) * vertex.nx + normalMatrix(1, 1) * vertex.ny + normalMatrix(1, 2) * vertex.nz,
+                                    normalMatrix(2, 0) * vertex.nx + normalMatrix(2, 1) * vertex.ny + normalMatrix(2, 2) * vertex.nz);
+                        normal.normalize();
+
+                        vertex.x =  position.x();
+                        vertex.y =  position.y();
+                        vertex.z =  position.z();
+                        vertex.nx = normal.x();
+                        vertex.ny = normal.y();
+                        vertex.nz = normal.z();
+
+                        vertices.append(vertex);
+                    }
+
+                    for (int l = 0; l < primitiveIndices.size(); l++)
+                        indices.append(baseVertex + primitiveIndices[l]);
+                }
+            }
+        }
+
+        if (!valid)
+            qDebug() << "ERROR:   [@qDebug]              - Asset \"" << fileName << "\" has a primitive with invalid indices.";
+    }
+
+    qDeleteAll(asset.files);
+
+    if (valid && indices.isEmpty())
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Asset \"" << fileName << "\" has no triangles to convert.";
+        valid = false;
+    }
+
+    return valid;
+}
+
+
+/**
+ * Decode and optimize a primitive, then make an entity for every node using it.
+ */
+void MgGltfImporter::decodePrimitive(MgGltfAsset *asset, int index)
+{
+    QElapsedTimer decodeTimer;
+    decodeTimer.start();
+
+    const MgGltfPrimitive &primitive = asset->primitives.at(index);
+
+    QVector<VkVertex> vertices;
+    QVector<uint32_t> indices;
+
+    if (readGeometry(primitive, vertices, indices))
+    {
+        MgMeshOptimizer::optimize(vertices, indices);
+
+        QVector<MgMeshLod> lods;
+        MgMeshSimplifier::buildLods(vertices, indices, lods);
+
+        QVector<MgMeshlet> meshlets;
+        MgMeshletBuilder::build(vertices, indices, lods, meshlets);
+
+        // The first node uploads the mesh, the others are instances drawing the same range of the pool.
+        VkcEntity *first = new VkcEntity(geometryPool, vertices, indices, lods, meshlets, primitive.nodeMatrices[0]);
+        first->color =      primitive.color;
+        first->texture =    primitive.texture;
+
+        asset->entities[primitive.firstEntity] = first;
+
+        for (int i = 1; i < primitive.nodeMatrices.size(); i++)
+            asset->entities[primitive.firstEntity + i] = new VkcEntity(*first, primitive.nodeMatrices[i]);
+    }
+    else
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Asset \"" << asset->fileName << "\" has a primitive with invalid indices.";
+    }
+
+    asset->geometryNs.fetchAndAddRelaxed(decodeTimer.nsecsElapsed());
+    finishJob(asset);
+}
+
+
+/**
+ * Decode an image file, or an image held in memory.
+ */
+void MgGltfImporter::decodeImage(MgGltfAsset *asset, MgTexture2D *texture, const QString &filePath, const QByteArray &data)
+{
+    QElapsedTimer decodeTimer;
+    decodeTimer.start();
+
+    VkResult result = filePath.isEmpty() ? texture->decodeData(data) : texture->decode(filePath);
+
+    if (result != VK_SUCCESS)
+        qDebug() << "WARNING: [@qDebug]              - Asset \"" << asset->fileName << "\" has an image that could not be decoded.";
+
+    asset->textureNs.fetchAndAddRelaxed(decodeTimer.nsecsElapsed());
+    finishJob(asset);
+}
+
+
+/**
+ * Mark a job of an asset done, the last one stops the asset's clock.
+ */
+void MgGltfImporter::finishJob(MgGltfAsset *asset)
+{
+    if (!asset->pendingJobs.deref())
+        asset->stats.totalNs = timer.nsecsElapsed() - asset->startNs;
+}
+
+
+/**
+ * Read an element of an accessor as floats, normalized if it says so.
+ */
+void MgGltfImporter::readElement(const MgGltfAccessor &accessor, uint32_t index, float values[4])
+{
+    const uint8_t *element = accessor.data + (size_t)index * accessor.stride;
+    uint32_t componentSize = getComponentSize(accessor.componentType);
+
+    for (uint32_t i = 0; i < accessor.componentCount && i < 4; i++)
+    {
+        const uint8_t *component = element + i * componentSize;
+
+        // Elements need not be aligned.
+        switch (accessor.componentType)
+        {
+        case MG_GLTF_BYTE:
+        {
+            int8_t value;
+            memcpy(&value, component, sizeof(value));
+            values[i] = accessor.normalized ? qMax(value / 127.0f, -1.0f) : value;
+            break;
+        }
+        case MG_GLTF_UNSIGNED_BYTE:
+        {
+            uint8_t value;
+            memcpy(&value, component, sizeof(value));
+            values[i] = accessor.normalized ? value / 255.0f : value;
+            break;
+        }
+        case MG_GLTF_SHORT:
+        {
+            int16_t value;
+            memcpy(&value, component, sizeof(value));
+            values[i] = accessor.normalized ? qMax(value / 32767.0f, -1.0f) : value;
+            break;
+        }
+        case MG_GLTF_UNSIGNED_SHORT:
+        {
+            uint16_t value;
+            memcpy(&value, component, sizeof(value));
+            values[i] = accessor.normalized ? value / 65535.0f : value;
+            break;
+        }
+        case MG_GLTF_UNSIGNED_INT:
+        {
+            uint32_t value;
+            memcpy(&value, component, sizeof(value));
+            values[i] = value;
+            break;
+        }
+        default:
+            memcpy(&values[i], component, sizeof(float));
+            break;
+        }
+    }
+}
+
+
+/**
+ * Read an element of an index accessor.
+ */
+uint32_t MgGltfImporter::readIndex(const MgGltfAccessor &accessor, uint32_t index)
+{
+    const uint8_t *element = accessor.data + (size_t)index * accessor.stride;
+
+    switch (accessor.componentType)
+    {
+    case MG_GLTF_UNSIGNED_BYTE:
+        return *element;
+    case MG_GLTF_UNSIGNED_SHORT:
+    {
+        uint16_t value;
+        memcpy(&value, element, sizeof(value));
+        return value;
+    }
+    case MG_GLTF_UNSIGNED_INT:
+    {
+        uint32_t value;
+        memcpy(&value, element, sizeof(value));
+        return value;
+    }
+    default:
+        return UINT32_MAX;
+    }
+}
+
+
+/**
+ * Get the size in bytes of an accessor component type, zero if unknown.
+ */
+uint32_t MgGltfImporter::getComponentSize(uint32_t componentType)
+{
+    switch (componentType)
+    {
+    case MG_GLTF_BYTE:
+    case MG_GLTF_UNSIGNED_BYTE:
+        return 1;
+    case MG_GLTF_SHORT:
+    case MG_GLTF_UNSIGNED_SHORT:
+        return 2;
+    case MG_GLTF_UNSIGNED_INT:
+    case MG_GLTF_FLOAT:
+        return 4;
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,222 @@
+#ifndef MGGLTFIMPORTER_H
+#define MGGLTFIMPORTER_H
+
+#include "stable.h"
+#include "mgjobsystem.h"
+#include "mggeometrypool.h"
+#include "mgtexturecache.h"
+#include "vkc_entity.h"
+
+#define MG_GLTF_MAGIC 0x46546c67
+#define MG_GLTF_VERSION 2
+#define MG_GLTF_CHUNK_JSON 0x4e4f534a
+#define MG_GLTF_CHUNK_BIN 0x004e4942
+
+
+enum MgGltfComponentType
+{
+    MG_GLTF_BYTE =              5120,
+    MG_GLTF_UNSIGNED_BYTE =     5121,
+    MG_GLTF_SHORT =             5122,
+    MG_GLTF_UNSIGNED_SHORT =    5123,
+    MG_GLTF_UNSIGNED_INT =      5125,
+    MG_GLTF_FLOAT =             5126
+};
+
+
+/**
+ * Struct used to report how long an asset took to load.
+ *
+ * Geometry and texture times are summed over the workers, the total is the
+ * time from the start of the load until the last job of the asset is done.
+ */
+struct MgAssetStats
+{
+    QString                     name =              "";
+    bool                        loaded =            false;
+
+    int                         meshCount =         0;
+    int                         primitiveCount =    0;
+    int                         textureCount =      0;
+    int                         entityCount =       0;
+
+    qint64                      parseNs =           0;
+    qint64                      geometryNs =        0;
+    qint64                      textureNs =         0;
+    qint64                      totalNs =           0;
+};
+
+/**
+ * Struct used for a typed view of the elements of a glTF accessor.
+ */
+struct MgGltfAccessor
+{
+    const uint8_t               *data =             nullptr;
+    uint32_t                    count =             0;
+    uint32_t                    stride =            0;
+    uint32_t                    componentType =     0;
+    uint32_t                    componentCount =    0;
+    bool                        normalized =        false;
+};
+
+/**
+ * Struct used for a glTF primitive, resolved so workers need no JSON.
+ *
+ * Every node using the mesh of the primitive becomes an entity.
+ */
+struct MgGltfPrimitive
+{
+    MgGltfAccessor              positions;
+    MgGltfAccessor              normals;
+    MgGltfAccessor              texCoords;
+    MgGltfAccessor              indices;
+
+    QVector4D                   color;
+    MgTexture2D                 *texture =          nullptr;
+
+    QVector<QMatrix4x4>         nodeMatrices;
+    int                         firstEntity =       0;
+};
+
+/**
+ * Struct used for an asset while it loads.
+ */
+struct MgGltfAsset
+{
+    QString                     fileName;
+    QDir                        directory;
+    QJsonObject                 document;
+
+    QVector<QFile*>             files;
+    QVector<QByteArray>         buffers;
+    QVector<MgTexture2D*>       images;
+    QVector<MgGltfPrimitive>    primitives;
+    QVector<VkcEntity*>         entities;
+
+    qint64                      startNs =           0;
+    QAtomicInt                  pendingJobs;
+    QAtomicInteger<qint64>      geometryNs;
+    QAtomicInteger<qint64>      textureNs;
+    MgAssetStats                stats;
+};
+
+
+/**
+ * Class used to import glTF 2.0 scenes as entities.
+ *
+ * Every asset is parsed on a worker, which then hands each primitive and
+ * image to a job of its own: primitives are decoded, optimized, given
+ * levels of detail, split into meshlets and copied into the geometry pool,
+ * images are decoded into textures shared through the texture cache. Buffers are memory-mapped rather than read. Assets
+ * load side by side, and load() returns at once so the caller can go on
+ * with other work until finish().
+ *
+ * Reads .gltf files with external or embedded buffers and .glb files, and
+ * triangle primitives with their base color material. readMesh() reads the
+ * geometry of a whole scene at once, for the mesh file converter.
+ */
+class MgGltfImporter
+{
+    // Objects:
+private:
+    MgJobSystem                 *jobSystem;
+    MgGeometryPool              *geometryPool;
+    MgTextureCache              *textureCache;
+
+    MgJobCounter                counter;
+    QElapsedTimer               timer;
+    QVector<MgGltfAsset*>       assets;
+
+    // Functions:
+public:
+    MgGltfImporter(
+            MgJobSystem         *jobSystem,
+            MgGeometryPool      *geometryPool,
+            MgTextureCache      *textureCache
+            );
+    ~MgGltfImporter();
+
+    void load(
+            const QStringList   &fileNames
+            );
+    bool finish(
+            QVector<VkcEntity*> &entities,
+            QVector<MgAssetStats> &stats
+            );
+
+    static bool readMesh(
+            const QString       &fileName,
+            QVector<VkVertex>   &vertices,
+            QVector<uint32_t>   &indices
+            );
+
+private:
+    void parse(
+            MgGltfAsset         *asset
+            );
+    static bool readDocument(
+            MgGltfAsset         *asset
+            );
+    static bool readBuffers(
+            MgGltfAsset         *asset,
+            const QByteArray    &binaryChunk
+            );
+    void readImages(
+            MgGltfAsset         *asset
+            );
+    static void readNodes(
+            MgGltfAsset         *asset,
+            QVector<QVector<QMatrix4x4>> &meshNodes
+            );
+    static void readNode(
+            MgGltfAsset         *asset,
+            int                 node,
+            const QMatrix4x4    &parentMatrix,
+            QVector<QVector<QMatrix4x4>> &meshNodes,
+            int                 depth
+            );
+    static bool readPrimitive(
+            MgGltfAsset         *asset,
+            const QJsonObject   &primitiveObject,
+            MgGltfPrimitive     &primitive
+            );
+    static bool getAccessor(
+            const MgGltfAsset   *asset,
+            int                 index,
+            MgGltfAccessor      &accessor
+            );
+    static bool readGeometry(
+            const MgGltfPrimitive &primitive,
+            QVector<VkVertex>   &vertices,
+            QVector<uint32_t>   &indices
+            );
+
+    void decodePrimitive(
+            MgGltfAsset         *asset,
+            int                 index
+            );
+    void decodeImage(
+            MgGltfAsset         *asset,
+            MgTexture2D         *texture,
+            const QString       &filePath,
+            const QByteArray    &data
+            );
+    void finishJob(
+            MgGltfAsset         *asset
+            );
+
+    static void readElement(
+            const MgGltfAccessor &accessor,
+            uint32_t            index,
+            float               values[4]
+            );
+    static uint32_t readIndex(
+            const MgGltfAccessor &accessor,
+            uint32_t            index
+            );
+    static uint32_t getComponentSize(
+            uint32_t            componentType
+            );
+};
+
+#endif // MGGLTFIMPORTER_H
@@ -8,6 +8,9 @@ VkResult MgImage::create(const VkcDevice *pDevice, MgImageInfo *pCreateInfo)
     handle = pCreateInfo->image;
     info = *pCreateInfo;
 
+    // Track every subresource, starting with undefined contents.
+    states.fill(MgImageState(), info.resourceRange.levelCount * info.resourceRange.layerCount);
+
     if (handle == VK_NULL_HANDLE)
     {
         // This image is unique and must be destroyed.
@@ -28,7 +31,7 @@ VkResult MgImage::create(const VkcDevice *pDevice, MgImageInfo *pCreateInfo)
             info.format,                            // VkFormat                 format;
 
             info.extent,                            // VkExtent3D               extent;
-            1,                                      // uint32_t                 mipLevels;
+            info.resourceRange.levelCount,          // uint32_t                 mipLevels;
             1,                                      // uint32_t                 arrayLayers;
 
             VK_SAMPLE_COUNT_1_BIT,                  // VkSampleCountFlagBits    samples;
@@ -135,35 +138,29 @@ VkResult MgImage::create(const VkcDevice *pDevice, MgImageInfo *pCreateInfo)
 }
 
 /**
- * Destroy the image.
+ * Destroy the image once the frames in flight no longer use it.
  */
 void MgImage::destroy(const VkcDevice* pDevice)
 {
-    if (view != VK_NULL_HANDLE)
-    {
-        vkDestroyImageView(pDevice->logical, view, nullptr);
-        view = VK_NULL_HANDLE;
-    }
+    VkcDeletionQueue *deletionQueue = pDevice->deletionQueue;
 
-    if (sampler != VK_NULL_HANDLE)
-    {
-        vkDestroySampler(pDevice->logical, sampler, nullptr);
-        sampler = VK_NULL_HANDLE;
-    }
+    deletionQueue->retire(VKC_DELETION_IMAGE_VIEW, (uint64_t)view);
+    deletionQueue->retire(VKC_DELETION_SAMPLER, (uint64_t)sampler);
 
-    if (memory != VK_NULL_HANDLE)
-    {
-        vkFreeMemory(pDevice->logical, memory, nullptr);
-        memory = VK_NULL_HANDLE;
-    }
+    view =      VK_NULL_HANDLE;
+    sampler =   VK_NULL_HANDLE;
 
     imageBuffer.destroy();
 
-    if (handle != VK_NULL_HANDLE && !sharedImage)
+    // The image goes before the memory bound to it.
+    if (!sharedImage)
     {
-        vkDestroyImage(pDevice->logical, handle, nullptr);
+        deletionQueue->retire(VKC_DELETION_IMAGE, (uint64_t)handle);
         handle = VK_NULL_HANDLE;
     }
+
+    deletionQueue->retire(VKC_DELETION_MEMORY, (uint64_t)memory);
+    memory = VK_NULL_HANDLE;
 }
 
 /**
@@ -171,8 +168,8 @@ void MgImage::destroy(const VkcDevice* pDevice)
  */
 void MgImage::getImageData(MgBuffer buffer, VkCommandBuffer commandBuffer)
 {
-    // Change image layout to transfer source.
-    changeLayout(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, commandBuffer);
+    // Change image layout to transfer source, keeping the contents.
+    changeLayout(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, commandBuffer);
 
     // Fill resource layer info.
     VkImageSubresourceLayers resourceLayer =
@@ -200,46 +197,235 @@ void MgImage::getImageData(MgBuffer buffer, VkCommandBuffer commandBuffer)
 }
 
 /**
- * Registers the commands to load image data and change image layout.
+ * Registers the commands to change the image layout.
+ */
+void MgImage::changeLayout(VkImageLayout newLayout, VkCommandBuffer commandBuffer)
+{
+    MgBarrierBatch batch;
+
+    transition(newLayout, batch);
+    batch.flush(commandBuffer);
+}
+
+/**
+ * Add the barrier that prepares the whole image for use in a layout.
+ *
+ * Stage and access masks are derived from the layout. If discard is set the
+ * current contents are not preserved.
+ */
+void MgImage::transition(VkImageLayout layout, MgBarrierBatch &batch, bool discard)
+{
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+
+    getLayoutMasks(layout, stages, access);
+    transition(layout, stages, access, batch, info.resourceRange, discard);
+}
+
+/**
+ * Add the barriers that prepare a subresource range for an access.
+ *
+ * No barrier is added for reads of a subresource already in the requested
+ * layout. Ranges whose subresources share the same state use a single barrier.
+ */
+void MgImage::transition(VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access,
+                         MgBarrierBatch &batch, const VkImageSubresourceRange &range, bool discard)
+{
+    const VkImageSubresourceRange &full = info.resourceRange;
+
+    // Resolve the range relative to the tracked subresources.
+    uint32_t baseLevel =    range.baseMipLevel - full.baseMipLevel;
+    uint32_t baseLayer =    range.baseArrayLayer - full.baseArrayLayer;
+    uint32_t levelCount =   range.levelCount == VK_REMAINING_MIP_LEVELS ? full.levelCount - baseLevel : range.levelCount;
+    uint32_t layerCount =   range.layerCount == VK_REMAINING_ARRAY_LAYERS ? full.layerCount - baseLayer : range.layerCount;
+
+    // Check whether every subresource of the range is in the same state.
+    const MgImageState &first = states[baseLayer * full.levelCount + baseLevel];
+    bool uniform = true;
+
+    for (uint32_t layer = baseLayer; layer < baseLayer + layerCount && uniform; layer++)
+    {
+        for (uint32_t level = baseLevel; level < baseLevel + levelCount && uniform; level++)
+        {
+            const MgImageState &state = states[layer * full.levelCount + level];
+
+            uniform = state.layout == first.layout && state.stages == first.stages && state.access == first.access &&
+                    state.writeStages == first.writeStages && state.writeAccess == first.writeAccess &&
+                    state.visibleStages == first.visibleStages && state.visibleAccess == first.visibleAccess;
+        }
+    }
+
+    if (uniform)
+    {
+        // One barrier covers the whole range.
+        MgImageState state = first;
+        VkImageSubresourceRange barrierRange =
+        {
+            range.aspectMask,                   // VkImageAspectFlags    aspectMask;
+            full.baseMipLevel + baseLevel,      // uint32_t              baseMipLevel;
+            levelCount,                         // uint32_t              levelCount;
+            full.baseArrayLayer + baseLayer,    // uint32_t              baseArrayLayer;
+            layerCount                          // uint32_t              layerCount;
+        };
+
+        transitionState(state, layout, stages, access, batch, barrierRange, discard);
+
+        for (uint32_t layer = baseLayer; layer < baseLayer + layerCount; layer++)
+            for (uint32_t level = baseLevel; level < baseLevel + levelCount; level++)
+                states[layer * full.levelCount + level] = state;
+    }
+    else
+    {
+        // Fall back to a barrier per subresource.
+        for (uint32_t layer = baseLayer; layer < baseLayer + layerCount; layer++)
+        {
+            for (uint32_t level = baseLevel; level < baseLevel + levelCount; level++)
+            {
+                VkImageSubresourceRange barrierRange =
+                {
+                    range.aspectMask,               // VkImageAspectFlags    aspectMask;
+                    full.baseMipLevel + level,      // uint32_t              baseMipLevel;
+                    1,                              // uint32_t              levelCount;
+                    full.baseArrayLayer + layer,    // uint32_t              baseArrayLayer;
+                    1                               // uint32_t              layerCount;
+                };
+
+                transitionState(states[layer * full.levelCount + level], layout, stages, access, batch, barrierRange, discard);
+            }
+        }
+    }
+}
+
+/**
+ * Overwrite the tracked state of the whole image without recording a barrier.
+ *
+ * Used when the layout is changed outside of the tracker, e.g. by a render
+ * pass or the presentation engine.
+ */
+void MgImage::reset(VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access)
+{
+    MgImageState state;
+    state.layout =  layout;
+    state.stages =  stages;
+    state.access =  access;
+
+    // Contents read in the new state are visible to its readers.
+    state.writeStages =     stages;
+    state.visibleStages =   stages;
+    state.visibleAccess =   access;
+
+    states.fill(state);
+}
+
+/**
+ * Get the tracked layout of the first subresource.
+ */
+VkImageLayout MgImage::getLayout() const
+{
+    return states.isEmpty() ? VK_IMAGE_LAYOUT_UNDEFINED : states[0].layout;
+}
+
+/**
+ * Get the tracked state of the first subresource.
+ */
+MgImageState MgImage::getState() const
+{
+    return states.isEmpty() ? MgImageState() : states[0];
+}
+
+/**
+ * Add the barrier between the tracked state of a subresource and a new access.
+ *
+ * Reads after reads in the same layout only need a barrier if the last
+ * write was not yet made visible to the new stages or access.
  */
-void MgImage::changeLayout(VkImageLayout oldLayout, VkImageLayout newLayout, VkCommandBuffer commandBuffer)
+void MgImage::transitionState(MgImageState &state, VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access,
+                              MgBarrierBatch &batch, const VkImageSubresourceRange &range, bool discard)
 {
-    // Setup access masks.
-    VkAccessFlags srcAccessMask;
-    VkAccessFlags dstAccessMask;
+    const VkAccessFlags writeMask =
+            VK_ACCESS_SHADER_WRITE_BIT |
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+            VK_ACCESS_TRANSFER_WRITE_BIT |
+            VK_ACCESS_HOST_WRITE_BIT |
+            VK_ACCESS_MEMORY_WRITE_BIT;
+
+    if (state.layout == layout && !(state.access & writeMask) && !(access & writeMask) && !discard)
+    {
+        // Make the last write visible to the new readers, waiting on the
+        // readers it was already visible to in case the layout changed then.
+        if ((stages & ~state.visibleStages) || (access & ~state.visibleAccess))
+        {
+            VkImageMemoryBarrier imageBarrier =
+            {
+                VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,     // VkStructureType            sType;
+                nullptr,                                    // const void*                pNext;
+
+                state.writeAccess,                          // VkAccessFlags              srcAccessMask;
+                access,                                     // VkAccessFlags              dstAccessMask;
+
+                layout,                                     // VkImageLayout              oldLayout;
+                layout,                                     // VkImageLayout              newLayout;
+
+                VK_QUEUE_FAMILY_IGNORED,                    // uint32_t                   srcQueueFamilyIndex;
+                VK_QUEUE_FAMILY_IGNORED,                    // uint32_t                   dstQueueFamilyIndex;
+
+                handle,                                     // VkImage                    image;
+                range                                       // VkImageSubresourceRange    subresourceRange;
+            };
 
-    getAccessMask(srcAccessMask, oldLayout);
-    getAccessMask(dstAccessMask, newLayout);
+            batch.addImageBarrier(state.writeStages | state.visibleStages, stages, imageBarrier);
 
-    // Setup image barrier.
+            state.visibleStages |= stages;
+            state.visibleAccess |= access;
+        }
+
+        // Remember the readers.
+        state.stages |= stages;
+        state.access |= access;
+        return;
+    }
+
+    // Fill image barrier, only previous writes have to be made available.
     VkImageMemoryBarrier imageBarrier =
     {
-        VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, // VkStructureType            sType;
-        nullptr,                                // const void*                pNext;
+        VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,             // VkStructureType            sType;
+        nullptr,                                            // const void*                pNext;
 
-        srcAccessMask,                          // VkAccessFlags              srcAccessMask;
-        dstAccessMask,                          // VkAccessFlags              dstAccessMask;
+        state.access & writeMask,                           // VkAccessFlags              srcAccessMask;
+        access,                                             // VkAccessFlags              dstAccessMask;
 
-        oldLayout,                              // VkImageLayout              oldLayout;
-        newLayout,                              // VkImageLayout              newLayout;
+        discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout, // VkImageLayout              oldLayout;
+        layout,                                             // VkImageLayout              newLayout;
 
-        VK_QUEUE_FAMILY_IGNORED,                // uint32_t                   srcQueueFamilyIndex;
-        VK_QUEUE_FAMILY_IGNORED,                // uint32_t                   dstQueueFamilyIndex;
+        VK_QUEUE_FAMILY_IGNORED,                            // uint32_t                   srcQueueFamilyIndex;
+        VK_QUEUE_FAMILY_IGNORED,                            // uint32_t                   dstQueueFamilyIndex;
 
-        handle,                                 // VkImage                    image;
-        info.resourceRange                      // VkImageSubresourceRange    subresourceRange;
+        handle,                                             // VkImage                    image;
+        range                                               // VkImageSubresourceRange    subresourceRange;
     };
 
-    // Register barrier in command buffer.
-    vkCmdPipelineBarrier(
-                commandBuffer,
-                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                0,
-                0, nullptr,
-                0, nullptr,
-                1, &imageBarrier
-                );
+    batch.addImageBarrier(state.stages, stages, imageBarrier);
+
+    // A read sees the previous write, a write starts a new one.
+    if (access & writeMask)
+    {
+        state.writeStages =     stages;
+        state.writeAccess =     access & writeMask;
+        state.visibleStages =   0;
+        state.visibleAccess =   0;
+    }
+    else
+    {
+        state.writeStages =     state.stages;
+        state.writeAccess =     state.access & writeMask;
+        state.visibleStages =   stages;
+        state.visibleAccess =   access;
+    }
+
+    state.layout =  layout;
+    state.stages =  stages;
+    state.access =  access;
 }
 
 /**
@@ -279,8 +465,10 @@ VkResult MgImage::loadImage(const VkcDevice *device)
     // If image data exists, load it.
     if(imageBuffer.handle != VK_NULL_HANDLE)
     {
-        // Change image layout to transfer destination.
-        changeLayout(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, commandBuffer);
+        // Change image layout to transfer destination, the old contents are overwritten.
+        MgBarrierBatch batch;
+        transition(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, batch, true);
+        batch.flush(commandBuffer);
 
         // Fill resource layer info.
         VkImageSubresourceLayers resourceLayer =
@@ -307,8 +495,8 @@ VkResult MgImage::loadImage(const VkcDevice *device)
         vkCmdCopyBufferToImage(commandBuffer, imageBuffer.handle, handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
     }
 
-    // Change image layout to optimal.
-    changeLayout(VK_IMAGE_LAYOUT_UNDEFINED, info.layout, commandBuffer);
+    // Change image layout to optimal, keeping the uploaded data.
+    changeLayout(info.layout, commandBuffer);
 
     // Stop command recording.
     vkEndCommandBuffer(commandBuffer);
@@ -347,51 +535,88 @@ VkResult MgImage::loadImage(const VkcDevice *device)
 }
 
 /**
- * Get the access mask specific to the image layout.
+ * Get the pipeline stages and access types that use an image in a layout.
  */
-void MgImage::getAccessMask(VkAccessFlags &accessMask, VkImageLayout layout)
+void MgImage::getLayoutMasks(VkImageLayout layout, VkPipelineStageFlags &stages, VkAccessFlags &access)
 {
     switch (layout)
     {
     case VK_IMAGE_LAYOUT_GENERAL:
-        accessMask =
+        stages =
+                VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        access =
                 VK_ACCESS_MEMORY_READ_BIT |
                 VK_ACCESS_MEMORY_WRITE_BIT;
         break;
 
     case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
-        accessMask =
+        stages =
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        access =
                 VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
                 VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
         break;
 
     case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
-        accessMask =
+        stages =
+                VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        access =
                 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
                 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
         break;
 
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+        stages =
+                VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        access =
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                VK_ACCESS_SHADER_READ_BIT;
+        break;
+
     case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
-        accessMask =
-                VK_ACCESS_MEMORY_READ_BIT;
+        stages =
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        access =
+                0;
         break;
 
     case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
-        accessMask =
+        stages =
+                VK_PIPELINE_STAGE_TRANSFER_BIT;
+        access =
                 VK_ACCESS_TRANSFER_READ_BIT;
         break;
 
     case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
-        accessMask =
+        stages =
+                VK_PIPELINE_STAGE_TRANSFER_BIT;
+        access =
                 VK_ACCESS_TRANSFER_WRITE_BIT;
         break;
 
     case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
-        accessMask =
+        stages =
+                VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        access =
                 VK_ACCESS_SHADER_READ_BIT;
         break;
 
+    case VK_IMAGE_LAYOUT_PREINITIALIZED:
+        stages =
+                VK_PIPELINE_STAGE_HOST_BIT;
+        access =
+                VK_ACCESS_HOST_WRITE_BIT;
+        break;
+
     default:
-        accessMask = 0;
+        stages =
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        access =
+                0;
     }
 }
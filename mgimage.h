@@ -4,6 +4,7 @@
 #include "stable.h"
 #include "vkc_device.h"
 #include "mgbuffer.h"
+#include "mgbarrierbatch.h"
 
 
 enum MgImageType
@@ -30,6 +31,25 @@ struct MgImageInfo
     bool                        createSampler;
 };
 
+/**
+ * Struct used to track the layout and last access of an image subresource.
+ *
+ * Stages and access hold every access since the last barrier. When these
+ * are reads, the write they read is tracked too, with the stages and access
+ * it was made visible to.
+ */
+struct MgImageState
+{
+    VkImageLayout               layout =        VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags        stages =        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    VkAccessFlags               access =        0;
+
+    VkPipelineStageFlags        writeStages =   0;
+    VkAccessFlags               writeAccess =   0;
+    VkPipelineStageFlags        visibleStages = 0;
+    VkAccessFlags               visibleAccess = 0;
+};
+
 /**
  * Class used for image handling.
  */
@@ -49,6 +69,8 @@ protected:
 
     bool                        sharedImage =   true;
 
+    QVector<MgImageState>       states;
+
     // Functions:
 public:
     VkResult create(
@@ -64,18 +86,49 @@ public:
             VkCommandBuffer     commandBuffer
             );
     void changeLayout(
-            VkImageLayout       oldLayout,
             VkImageLayout       newLayout,
             VkCommandBuffer     commandBuffer
             );
 
+    void transition(
+            VkImageLayout       layout,
+            MgBarrierBatch      &batch,
+            bool                discard = false
+            );
+    void transition(
+            VkImageLayout       layout,
+            VkPipelineStageFlags stages,
+            VkAccessFlags       access,
+            MgBarrierBatch      &batch,
+            const VkImageSubresourceRange &range,
+            bool                discard = false
+            );
+    void reset(
+            VkImageLayout       layout,
+            VkPipelineStageFlags stages,
+            VkAccessFlags       access
+            );
+    VkImageLayout getLayout() const;
+    MgImageState getState() const;
+
+    static void getLayoutMasks(
+            VkImageLayout       layout,
+            VkPipelineStageFlags &stages,
+            VkAccessFlags       &access
+            );
+
 protected:
     VkResult loadImage(
             const VkcDevice     *pDevice
             );
-    void getAccessMask(
-            VkAccessFlags       &accessMask,
-            VkImageLayout       layout
+    void transitionState(
+            MgImageState        &state,
+            VkImageLayout       layout,
+            VkPipelineStageFlags stages,
+            VkAccessFlags       access,
+            MgBarrierBatch      &batch,
+            const VkImageSubresourceRange &range,
+            bool                discard
             );
 };
 
@@ -0,0 +1,388 @@
+#include "mgjobsystem.h"
+
+/**
+ * Index of the worker running on the current thread, -1 for other threads.
+ */
+static thread_local int currentWorkerIdx = -1;
+
+
+/**
+ * Create the worker thread.
+ */
+MgJobWorker::MgJobWorker(MgJobSystem *jobSystem, int index)
+{
+    this->jobSystem =   jobSystem;
+    this->index =       index;
+}
+
+
+/**
+ * Run jobs until the job system is stopped.
+ */
+void MgJobWorker::run()
+{
+    currentWorkerIdx = index;
+
+    while (jobSystem->running.load())
+    {
+        MgJob job;
+
+        if (jobSystem->takeJob(index, job) || jobSystem->stealJob(index, job))
+            jobSystem->execute(job, stats, statsMutex);
+        else
+            jobSystem->sleep(index);
+    }
+
+    currentWorkerIdx = -1;
+}
+
+
+/**
+ * Create the job system and start its workers.
+ */
+MgJobSystem::MgJobSystem(int workerCount)
+{
+    // Leave one core for the thread that owns the job system.
+    if (workerCount <= 0)
+        workerCount = qMax(QThread::idealThreadCount() - 1, 1);
+
+    pendingJobs.store(0);
+    running.store(1);
+    nextWorker.store(0);
+
+    for (int i = 0; i < workerCount; i++)
+        workers.append(new MgJobWorker(this, i));
+
+    for (int i = 0; i < workers.size(); i++)
+        workers[i]->start();
+}
+
+
+/**
+ * Stop the workers and destroy the job system.
+ */
+MgJobSystem::~MgJobSystem()
+{
+    // Wake up every worker so it can see the stop request.
+    sleepMutex.lock();
+    running.store(0);
+    wakeCondition.wakeAll();
+    sleepMutex.unlock();
+
+    while (workers.size() > 0)
+    {
+        workers[0]->wait();
+        delete workers[0];
+        workers.removeFirst();
+    }
+}
+
+
+/**
+ * Get the number of worker threads.
+ */
+int MgJobSystem::workerCount() const
+{
+    return workers.size();
+}
+
+
+/**
+ * Get the index of the worker running on the calling thread, or -1.
+ */
+int MgJobSystem::currentWorker()
+{
+    return currentWorkerIdx;
+}
+
+
+/**
+ * Queue a job.
+ */
+void MgJobSystem::submit(const MgJob &job)
+{
+    if (job.counter != nullptr)
+        job.counter->value.ref();
+
+    if (job.affinity >= 0 && job.affinity < workers.size())
+    {
+        // Honor the affinity hint.
+        MgJobWorker *worker = workers[job.affinity];
+
+        worker->mutex.lock();
+        worker->pinned.append(job);
+        worker->mutex.unlock();
+    }
+    else
+    {
+        // Workers push to their own deque, other threads spread jobs evenly.
+        int workerIdx = currentWorkerIdx;
+        if (workerIdx < 0)
+            workerIdx = (nextWorker.fetchAndAddRelaxed(1) & 0x7fffffff) % workers.size();
+
+        MgJobWorker *worker = workers[workerIdx];
+
+        worker->mutex.lock();
+        worker->deque.append(job);
+        worker->mutex.unlock();
+    }
+
+    // Wake up a sleeping worker. Only jobs any worker can run are counted as
+    // pending, a pinned job wakes every worker so its owner sees it.
+    sleepMutex.lock();
+    if (job.affinity >= 0 && job.affinity < workers.size())
+    {
+        wakeCondition.wakeAll();
+    }
+    else
+    {
+        pendingJobs.ref();
+        wakeCondition.wakeOne();
+    }
+    sleepMutex.unlock();
+}
+
+
+/**
+ * Queue a job built from its parts.
+ */
+void MgJobSystem::submit(MgJobFunction function, MgJobCounter *counter, const char *name, int affinity)
+{
+    MgJob job;
+    job.function =  function;
+    job.counter =   counter;
+    job.name =      name;
+    job.affinity =  affinity;
+
+    submit(job);
+}
+
+
+/**
+ * Wait until every job attached to the counter has finished.
+ *
+ * The calling thread runs queued jobs while it waits. Threads other than the
+ * workers only run jobs attached to the counter, so a frame waiting on its
+ * own work never picks up a long job like a pipeline compile.
+ */
+void MgJobSystem::wait(MgJobCounter *counter)
+{
+    int workerIdx = currentWorkerIdx;
+
+    while (counter->value.loadAcquire() > 0)
+    {
+        MgJob job;
+
+        if (workerIdx >= 0)
+        {
+            if (takeJob(workerIdx, job) || stealJob(workerIdx, job))
+            {
+                execute(job, workers[workerIdx]->stats, workers[workerIdx]->statsMutex);
+                continue;
+            }
+        }
+        else if (stealJob(-1, job, counter))
+        {
+            execute(job, externalStats, externalStatsMutex);
+            continue;
+        }
+
+        QThread::yieldCurrentThread();
+    }
+}
+
+
+/**
+ * Split the range [0, count) in chunks of grainSize and run them in parallel.
+ */
+void MgJobSystem::parallelFor(int count, int grainSize, std::function<void(int, int)> function, const char *name)
+{
+    if (count <= 0)
+        return;
+
+    if (grainSize <= 0)
+        grainSize = qMax(count / (4 * (workers.size() + 1)), 1);
+
+    // Run small ranges inline.
+    if (count <= grainSize)
+    {
+        function(0, count);
+        return;
+    }
+
+    MgJobCounter counter;
+    for (int begin = 0; begin < count; begin += grainSize)
+    {
+        int end = qMin(begin + grainSize, count);
+        submit([function, begin, end]() { function(begin, end); }, &counter, name);
+    }
+
+    wait(&counter);
+}
+
+
+/**
+ * Get the timing statistics of all jobs, merged by name.
+ */
+void MgJobSystem::getStats(QVector<MgJobStats> &stats)
+{
+    QHash<QString, MgJobStats> merged;
+
+    auto merge = [&merged](const QHash<QString, MgJobStats> &source)
+    {
+        for (auto it = source.constBegin(); it != source.constEnd(); ++it)
+        {
+            MgJobStats &entry = merged[it.key()];
+            entry.name =        it.key();
+            entry.count +=      it->count;
+            entry.totalNs +=    it->totalNs;
+            entry.maxNs =       qMax(entry.maxNs, it->maxNs);
+        }
+    };
+
+    for (int i = 0; i < workers.size(); i++)
+    {
+        QMutexLocker locker(&workers[i]->statsMutex);
+        merge(workers[i]->stats);
+    }
+
+    {
+        QMutexLocker locker(&externalStatsMutex);
+        merge(externalStats);
+    }
+
+    stats = merged.values().toVector();
+}
+
+
+/**
+ * Clear the timing statistics.
+ */
+void MgJobSystem::resetStats()
+{
+    for (int i = 0; i < workers.size(); i++)
+    {
+        QMutexLocker locker(&workers[i]->statsMutex);
+        workers[i]->stats.clear();
+    }
+
+    QMutexLocker locker(&externalStatsMutex);
+    externalStats.clear();
+}
+
+
+/**
+ * Pop a job from the back of the worker's own queues.
+ */
+bool MgJobSystem::takeJob(int workerIdx, MgJob &job)
+{
+    MgJobWorker *worker = workers[workerIdx];
+    QMutexLocker locker(&worker->mutex);
+
+    if (worker->pinned.size() > 0)
+    {
+        job = worker->pinned.takeFirst();
+        return true;
+    }
+
+    if (worker->deque.size() > 0)
+    {
+        job = worker->deque.takeLast();
+        pendingJobs.deref();
+        return true;
+    }
+
+    return false;
+}
+
+
+/**
+ * Steal a job from the front of another worker's deque.
+ *
+ * If a counter is given, only the first job attached to it is stolen.
+ */
+bool MgJobSystem::stealJob(int thiefIdx, MgJob &job, const MgJobCounter *counter)
+{
+    int workerCount = workers.size();
+    int start = thiefIdx >= 0 ? thiefIdx + 1 : 0;
+
+    for (int i = 0; i < workerCount; i++)
+    {
+        int victimIdx = (start + i) % workerCount;
+        if (victimIdx == thiefIdx)
+            continue;
+
+        MgJobWorker *victim = workers[victimIdx];
+        if (!victim->mutex.tryLock())
+            continue;
+
+        int jobIdx = 0;
+        if (counter != nullptr)
+            while (jobIdx < victim->deque.size() && victim->deque[jobIdx].counter != counter)
+                jobIdx++;
+
+        bool stolen = jobIdx < victim->deque.size();
+        if (stolen)
+            job = victim->deque.takeAt(jobIdx);
+
+        victim->mutex.unlock();
+
+        if (stolen)
+        {
+            pendingJobs.deref();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/**
+ * Run a job, record its timing and signal its counter.
+ */
+void MgJobSystem::execute(MgJob &job, QHash<QString, MgJobStats> &stats, QMutex &statsMutex)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    job.function();
+
+    qint64 elapsed = timer.nsecsElapsed();
+
+    statsMutex.lock();
+    MgJobStats &entry = stats[QLatin1String(job.name)];
+    entry.count++;
+    entry.totalNs += elapsed;
+    entry.maxNs = qMax(entry.maxNs, elapsed);
+    statsMutex.unlock();
+
+    if (job.counter != nullptr)
+        job.counter->value.deref();
+}
+
+
+/**
+ * Block the calling worker until a job it can run is submitted.
+ */
+void MgJobSystem::sleep(int workerIdx)
+{
+    MgJobWorker *worker = workers[workerIdx];
+
+    auto hasPinned = [worker]()
+    {
+        QMutexLocker locker(&worker->mutex);
+        return worker->pinned.size() > 0;
+    };
+
+    // Submitting counts the job and signals under the same mutex, so no
+    // wake-up is lost between the check and the wait. A job left in a busy
+    // worker's deque keeps the count positive and the caller keeps stealing.
+    sleepMutex.lock();
+    while (running.load() && pendingJobs.load() <= 0 && !hasPinned())
+        wakeCondition.wait(&sleepMutex);
+    sleepMutex.unlock();
+
+    if (pendingJobs.load() > 0)
+        QThread::yieldCurrentThread();
+}
@@ -0,0 +1,161 @@
+#ifndef MGJOBSYSTEM_H
+#define MGJOBSYSTEM_H
+
+#include "stable.h"
+
+#include <functional>
+
+#define MG_JOB_AFFINITY_ANY -1
+
+
+/**
+ * Function executed by a job.
+ */
+typedef std::function<void()> MgJobFunction;
+
+/**
+ * Counter used for job dependencies.
+ *
+ * It holds the number of unfinished jobs attached to it; waiting on it
+ * returns once it reaches zero.
+ */
+struct MgJobCounter
+{
+    QAtomicInt                  value;
+};
+
+/**
+ * Struct used for a single unit of work.
+ */
+struct MgJob
+{
+    MgJobFunction               function =      nullptr;
+    MgJobCounter                *counter =      nullptr;
+
+    const char                  *name =         "job";
+    int                         affinity =      MG_JOB_AFFINITY_ANY;
+};
+
+/**
+ * Struct used for per-job timing statistics.
+ */
+struct MgJobStats
+{
+    QString                     name =          "";
+    quint64                     count =         0;
+    qint64                      totalNs =       0;
+    qint64                      maxNs =         0;
+};
+
+class MgJobSystem;
+
+
+/**
+ * Class used for the job system worker threads.
+ *
+ * Every worker owns a deque: it pushes and pops at the back, while idle
+ * workers steal from the front. Jobs with an affinity hint go to the pinned
+ * queue of their worker and are never stolen.
+ */
+class MgJobWorker : public QThread
+{
+    // Objects:
+public:
+    QMutex                      mutex;
+    QList<MgJob>                deque;
+    QList<MgJob>                pinned;
+
+    QHash<QString, MgJobStats>  stats;
+    QMutex                      statsMutex;
+
+private:
+    MgJobSystem                 *jobSystem;
+    int                         index;
+
+    // Functions:
+public:
+    MgJobWorker(
+            MgJobSystem         *jobSystem,
+            int                 index
+            );
+
+protected:
+    void run() override;
+};
+
+
+/**
+ * Class used for scheduling work on a pool of work-stealing threads.
+ */
+class MgJobSystem
+{
+    friend class MgJobWorker;
+
+    // Objects:
+private:
+    QVector<MgJobWorker*>       workers;
+
+    QMutex                      sleepMutex;
+    QWaitCondition              wakeCondition;
+    QAtomicInt                  pendingJobs;
+    QAtomicInt                  running;
+    QAtomicInt                  nextWorker;
+
+    QHash<QString, MgJobStats>  externalStats;
+    QMutex                      externalStatsMutex;
+
+    // Functions:
+public:
+    MgJobSystem(
+            int                 workerCount = 0
+            );
+    ~MgJobSystem();
+
+    int workerCount() const;
+    static int currentWorker();
+
+    void submit(
+            const MgJob         &job
+            );
+    void submit(
+            MgJobFunction       function,
+            MgJobCounter        *counter,
+            const char          *name = "job",
+            int                 affinity = MG_JOB_AFFINITY_ANY
+            );
+    void wait(
+            MgJobCounter        *counter
+            );
+    void parallelFor(
+            int                 count,
+            int                 grainSize,
+            std::function<void(int, int)> function,
+            const char          *name = "parallelFor"
+            );
+
+    void getStats(
+            QVector<MgJobStats> &stats
+            );
+    void resetStats();
+
+private:
+    bool takeJob(
+            int                 workerIdx,
+            MgJob               &job
+            );
+    bool stealJob(
+            int                 thiefIdx,
+            MgJob               &job,
+            const MgJobCounter  *counter = nullptr
+            );
+    void execute(
+            MgJob               &job,
+            QHash<QString, MgJobStats> &stats,
+            QMutex              &statsMutex
+            );
+    void sleep(
+            int                 workerIdx
+            );
+};
+
+#endif // MGJOBSYSTEM_H
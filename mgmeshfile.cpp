@@ -0,0 +1,477 @@
+#include "mgmeshfile.h"
+#include "mgmeshoptimizer.h"
+#include "mgmeshsimplifier.h"
+#include "mgmeshlet.h"
+#include "mggltfimporter.h"
+#include "vkc_pipeline.h"
+
+
+/**
+ * Initialize with no file open.
+ */
+MgMeshFile::MgMeshFile()
+{
+    header =    nullptr;
+    data =      nullptr;
+    size =      0;
+}
+
+
+/**
+ * Unmap and close the file.
+ */
+MgMeshFile::~MgMeshFile()
+{
+    close();
+}
+
+
+/**
+ * Map a mesh file and check its header.
+ *
+ * Returns false if the file is missing, or not a mesh file of this version.
+ */
+bool MgMeshFile::open(const QString &fileName)
+{
+    close();
+
+    file.setFileName(fileName);
+
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Mesh \"" << fileName << "\" not found.";
+        return false;
+    }
+
+    size = file.size();
+    data = file.map(0, size);
+
+    if (data == nullptr || !validate())
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Mesh \"" << fileName << "\" is not a valid mesh file.";
+        close();
+        return false;
+    }
+
+    header = (const MgMeshHeader*)data;
+
+    return true;
+}
+
+
+/**
+ * Unmap and close the file, the stream pointers become invalid.
+ */
+void MgMeshFile::close()
+{
+    if (data != nullptr)
+        file.unmap((uchar*)data);
+
+    file.close();
+
+    header =    nullptr;
+    data =      nullptr;
+    size =      0;
+}
+
+
+/**
+ * Get the encoded vertices.
+ */
+const uint8_t* MgMeshFile::getVertexData() const
+{
+    return data + header->vertexDataOffset;
+}
+
+
+/**
+ * Get the indices, of header->indexSize bytes each.
+ */
+const uint8_t* MgMeshFile::getIndexData() const
+{
+    return data + header->indexDataOffset;
+}
+
+
+/**
+ * Get the level of detail table, the full mesh first.
+ */
+const MgMeshLod* MgMeshFile::getLods() const
+{
+    return (const MgMeshLod*)(data + header->lodDataOffset);
+}
+
+
+/**
+ * Get the meshlets of every level of detail.
+ */
+const MgMeshlet* MgMeshFile::getMeshlets() const
+{
+    return (const MgMeshlet*)(data + header->meshletDataOffset);
+}
+
+
+/**
+ * Get what is needed to decode the vertices.
+ */
+void MgMeshFile::getQuantization(MgVertexQuantization &quantization) const
+{
+    quantization.positionOffset =   QVector3D(header->positionOffset[0], header->positionOffset[1], header->positionOffset[2]);
+    quantization.positionScale =    QVector3D(header->positionScale[0], header->positionScale[1], header->positionScale[2]);
+    quantization.texCoordOffset =   QVector2D(header->texCoordOffset[0], header->texCoordOffset[1]);
+    quantization.texCoordScale =    QVector2D(header->texCoordScale[0], header->texCoordScale[1]);
+}
+
+
+/**
+ * Copy the vertices, every level of detail and the meshlets into the geometry pool.
+ *
+ * The pool must store vertices in the format of the file.
+ */
+VkResult MgMeshFile::upload(MgGeometryPool *geometryPool, MgMeshRange &range) const
+{
+    if (header->vertexFormat != (uint32_t)geometryPool->vertexFormat)
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Mesh vertex format does not match the geometry pool.";
+        return VK_ERROR_FORMAT_NOT_SUPPORTED;
+    }
+
+    VkIndexType indexType = header->indexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    mgAssert(geometryPool->allocate(header->vertexCount, header->indexCount, indexType, range, header->meshletCount));
+
+    // The streams are stored as the pool keeps them.
+    memcpy(geometryPool->getVertexData(range), getVertexData(), (size_t)header->vertexCount * header->vertexStride);
+    memcpy(geometryPool->getIndexData(range), getIndexData(), (size_t)header->indexCount * header->indexSize);
+    memcpy(geometryPool->getMeshletData(range), getMeshlets(), (size_t)header->meshletCount * sizeof(MgMeshlet));
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Write a mesh file, encoding the vertices to the given format.
+ *
+ * The indices hold every level of detail one after the other; without a
+ * level of detail table they are all one level. Meshes without meshlets
+ * are always drawn whole.
+ */
+bool MgMeshFile::write(const QString &fileName, MgVertexFormatType format, const QVector<VkVertex> &vertices,
+                       const QVector<uint32_t> &indices, QVector<MgMeshLod> lods, const QVector<MgMeshlet> &meshlets)
+{
+    if (lods.isEmpty())
+        lods.append({0, (uint32_t)indices.size(), 0.0f, 0});
+
+    // Encode the vertices, with tangents from the full mesh.
+    QByteArray vertexData;
+    MgVertexQuantization quantization;
+    MgVertexFormat::encode(format, vertices, indices.mid(lods[0].firstIndex, lods[0].indexCount), vertexData, quantization);
+
+    // Store the indices in 16 bits if they fit.
+    QByteArray indexData;
+
+    if (vertices.size() <= MG_SHORT_INDEX_VERTICES)
+    {
+        indexData.resize(indices.size() * sizeof(uint16_t));
+        uint16_t *shortIndices = (uint16_t*)indexData.data();
+
+        for (int i = 0; i < indices.size(); i++)
+            shortIndices[i] = (uint16_t)indices[i];
+    }
+    else
+    {
+        indexData = QByteArray((const char*)indices.constData(), indices.size() * sizeof(uint32_t));
+    }
+
+    // Get the bounding sphere of the full mesh.
+    QVector3D minimum(0.0f, 0.0f, 0.0f);
+    QVector3D maximum(0.0f, 0.0f, 0.0f);
+
+    for (int i = 0; i < vertices.size(); i++)
+    {
+        QVector3D point(vertices[i].x, vertices[i].y, vertices[i].z);
+
+        minimum = i == 0 ? point : QVector3D(qMin(minimum.x(), point.x()), qMin(minimum.y(), point.y()), qMin(minimum.z(), point.z()));
+        maximum = i == 0 ? point : QVector3D(qMax(maximum.x(), point.x()), qMax(maximum.y(), point.y()), qMax(maximum.z(), point.z()));
+    }
+
+    QVector3D center = (minimum + maximum) * 0.5f;
+
+    // Lay out the streams, each aligned.
+    auto align = [](uint64_t offset) { return (offset + MG_MESH_ALIGNMENT - 1) / MG_MESH_ALIGNMENT * MG_MESH_ALIGNMENT; };
+
+    MgMeshHeader header = {};
+    header.magic =              MG_MESH_MAGIC;
+    header.version =            MG_MESH_VERSION;
+
+    header.vertexFormat =       format;
+    header.vertexStride =       MgVertexFormat::getStride(format);
+    header.vertexCount =        vertices.size();
+    header.indexCount =         indices.size();
+    header.indexSize =          vertices.size() <= MG_SHORT_INDEX_VERTICES ? sizeof(uint16_t) : sizeof(uint32_t);
+    header.lodCount =           lods.size();
+    header.meshletCount =       meshlets.size();
+
+    header.boundsCenter[0] =    center.x();
+    header.boundsCenter[1] =    center.y();
+    header.boundsCenter[2] =    center.z();
+    header.boundsRadius =       (maximum - minimum).length() * 0.5f;
+
+    for (int i = 0; i < 3; i++)
+    {
+        header.positionOffset[i] =  quantization.positionOffset[i];
+        header.positionScale[i] =   quantization.positionScale[i];
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        header.texCoordOffset[i] =  quantization.texCoordOffset[i];
+        header.texCoordScale[i] =   quantization.texCoordScale[i];
+    }
+
+    header.vertexDataOffset =   align(sizeof(MgMeshHeader));
+    header.indexDataOffset =    align(header.vertexDataOffset + vertexData.size());
+    header.lodDataOffset =      align(header.indexDataOffset + indexData.size());
+    header.meshletDataOffset =  align(header.lodDataOffset + lods.size() * sizeof(MgMeshLod));
+
+    QByteArray fileData(header.meshletDataOffset + meshlets.size() * sizeof(MgMeshlet), 0);
+
+    memcpy(fileData.data(), &header, sizeof(MgMeshHeader));
+    memcpy(fileData.data() + header.vertexDataOffset, vertexData.constData(), vertexData.size());
+    memcpy(fileData.data() + header.indexDataOffset, indexData.constData(), indexData.size());
+    memcpy(fileData.data() + header.lodDataOffset, lods.constData(), lods.size() * sizeof(MgMeshLod));
+    memcpy(fileData.data() + header.meshletDataOffset, meshlets.constData(), meshlets.size() * sizeof(MgMeshlet));
+
+    QFile meshFile(fileName);
+
+    if (!meshFile.open(QIODevice::WriteOnly) || meshFile.write(fileData) != fileData.size())
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Mesh \"" << fileName << "\" could not be written.";
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Turn a source mesh into an optimized mesh file with packed vertices, levels of detail and meshlets.
+ *
+ * Sources are OBJ files, or glTF scenes whose primitives are merged into one
+ * mesh. Reports the vertex cache efficiency before and after optimizing.
+ */
+bool MgMeshFile::convert(const QString &sourceName, const QString &fileName)
+{
+    QVector<VkVertex> vertices;
+    QVector<uint32_t> indices;
+
+    QString suffix = QFileInfo(sourceName).suffix().toLower();
+    bool read;
+
+    if (suffix == "obj")
+    {
+        read = readObj(sourceName, vertices, indices);
+    }
+    else if (suffix == "gltf" || suffix == "glb")
+    {
+        read = MgGltfImporter::readMesh(sourceName, vertices, indices);
+    }
+    else
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Meshes of type \"" << suffix << "\" cannot be converted.";
+        return false;
+    }
+
+    if (!read)
+        return false;
+
+    MgMeshStats before;
+    MgMeshStats after;
+    MgMeshOptimizer::optimize(vertices, indices, &before, &after);
+
+    qDebug().noquote() << QString("%1: %2 vertices, %3 triangles, ACMR %4 -> %5, ATVR %6 -> %7")
+                          .arg(sourceName).arg(vertices.size()).arg(indices.size() / 3)
+                          .arg(before.acmr, 0, 'f', 3).arg(after.acmr, 0, 'f', 3)
+                          .arg(before.atvr, 0, 'f', 3).arg(after.atvr, 0, 'f', 3);
+
+    QVector<MgMeshLod> lods;
+    MgMeshSimplifier::buildLods(vertices, indices, lods);
+
+    for (int i = 1; i < lods.size(); i++)
+        qDebug().noquote() << QString("   LOD %1: %2 triangles, error %3").arg(i).arg(lods[i].indexCount / 3).arg(lods[i].error, 0, 'f', 4);
+
+    QVector<MgMeshlet> meshlets;
+    MgMeshletBuilder::build(vertices, indices, lods, meshlets);
+
+    qDebug().noquote() << QString("   %1 meshlets, %2 in the full mesh").arg(meshlets.size()).arg(lods[0].meshletCount);
+
+    return write(fileName, MG_VERTEX_FORMAT_PACKED, vertices, indices, lods, meshlets);
+}
+
+
+/**
+ * Check that the header and the streams fit in the file, and that every index refers to a vertex.
+ */
+bool MgMeshFile::validate() const
+{
+    if (size < (qint64)sizeof(MgMeshHeader))
+        return false;
+
+    const MgMeshHeader *fileHeader = (const MgMeshHeader*)data;
+
+    if (fileHeader->magic != MG_MESH_MAGIC || fileHeader->version != MG_MESH_VERSION)
+        return false;
+
+    if (fileHeader->vertexFormat > MG_VERTEX_FORMAT_PACKED ||
+            fileHeader->vertexStride != MgVertexFormat::getStride((MgVertexFormatType)fileHeader->vertexFormat))
+        return false;
+
+    if (fileHeader->indexSize != sizeof(uint16_t) && fileHeader->indexSize != sizeof(uint32_t))
+        return false;
+
+    // Every stream must end within the file.
+    if (fileHeader->vertexDataOffset + (uint64_t)fileHeader->vertexCount * fileHeader->vertexStride > (uint64_t)size ||
+            fileHeader->indexDataOffset + (uint64_t)fileHeader->indexCount * fileHeader->indexSize > (uint64_t)size ||
+            fileHeader->lodDataOffset + (uint64_t)fileHeader->lodCount * sizeof(MgMeshLod) > (uint64_t)size ||
+            fileHeader->meshletDataOffset + (uint64_t)fileHeader->meshletCount * sizeof(MgMeshlet) > (uint64_t)size)
+        return false;
+
+    // Every index must be within the vertices, the GPU reads them unchecked.
+    const uint8_t *indexData = data + fileHeader->indexDataOffset;
+
+    for (uint32_t i = 0; i < fileHeader->indexCount; i++)
+    {
+        uint32_t index = fileHeader->indexSize == sizeof(uint16_t) ? ((const uint16_t*)indexData)[i] : ((const uint32_t*)indexData)[i];
+
+        if (index >= fileHeader->vertexCount)
+            return false;
+    }
+
+    // Every level must be within the indices, and its meshlets within the meshlets.
+    const MgMeshLod *lods = (const MgMeshLod*)(data + fileHeader->lodDataOffset);
+    uint64_t meshletCount = 0;
+
+    for (uint32_t i = 0; i < fileHeader->lodCount; i++)
+    {
+        if ((uint64_t)lods[i].firstIndex + lods[i].indexCount > fileHeader->indexCount)
+            return false;
+
+        meshletCount += lods[i].meshletCount;
+    }
+
+    if (meshletCount > fileHeader->meshletCount)
+        return false;
+
+    // Every meshlet must be within the indices.
+    const MgMeshlet *meshlets = (const MgMeshlet*)(data + fileHeader->meshletDataOffset);
+
+    for (uint32_t i = 0; i < fileHeader->meshletCount; i++)
+        if ((uint64_t)meshlets[i].firstIndex + (uint64_t)meshlets[i].triangleCount * 3 > fileHeader->indexCount)
+            return false;
+
+    return fileHeader->lodCount > 0;
+}
+
+
+/**
+ * Read the triangles of a Wavefront OBJ file.
+ *
+ * Polygons are split into fans, and corners sharing position, texture
+ * coordinates and normal share a vertex. Missing normals are computed from
+ * the faces.
+ */
+bool MgMeshFile::readObj(const QString &fileName, QVector<VkVertex> &vertices, QVector<uint32_t> &indices)
+{
+    QFile objFile(fileName);
+
+    if (!objFile.open(QIODevice::ReadOnly))
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Mesh \"" << fileName << "\" not found.";
+        return false;
+    }
+
+    QVector<QVector3D> positions;
+    QVector<QVector2D> texCoords;
+    QVector<QVector3D> normals;
+    QHash<QByteArray, uint32_t> corners;
+    bool hasNormals = true;
+
+    // Get a list index, negative ones count back from the end.
+    auto getIndex = [](const QByteArray &token, int count)
+    {
+        int index = token.toInt();
+        return index < 0 ? count + index : index - 1;
+    };
+
+    while (!objFile.atEnd())
+    {
+        QList<QByteArray> tokens = objFile.readLine().simplified().split(' ');
+
+        if (tokens[0] == "v" && tokens.size() >= 4)
+        {
+            positions.append(QVector3D(tokens[1].toFloat(), tokens[2].toFloat(), tokens[3].toFloat()));
+        }
+        else if (tokens[0] == "vt" && tokens.size() >= 3)
+        {
+            // Textures are mirrored when decoded, so rows already go up as in OBJ.
+            texCoords.append(QVector2D(tokens[1].toFloat(), tokens[2].toFloat()));
+        }
+        else if (tokens[0] == "vn" && tokens.size() >= 4)
+        {
+            normals.append(QVector3D(tokens[1].toFloat(), tokens[2].toFloat(), tokens[3].toFloat()));
+        }
+        else if (tokens[0] == "f" && tokens.size() >= 4)
+        {
+            QVector<uint32_t> polygon;
+
+            for (int i = 1; i < tokens.size(); i++)
+            {
+                // Corners are "v", "v/vt", "v//vn" or "v/vt/vn".
+                QList<QByteArray> parts = tokens[i].split('/');
+
+                int position =  getIndex(parts[0], positions.size());
+                int texCoord =  parts.size() > 1 && !parts[1].isEmpty() ? getIndex(parts[1], texCoords.size()) : -1;
+                int normal =    parts.size() > 2 && !parts[2].isEmpty() ? getIndex(parts[2], normals.size()) : -1;
+
+                if (position < 0 || position >= positions.size() || texCoord >= texCoords.size() || normal >= normals.size())
+                {
+                    qDebug() << "ERROR:   [@qDebug]              - Mesh \"" << fileName << "\" has an invalid face.";
+                    return false;
+                }
+
+                hasNormals &= normal >= 0;
+
+                QByteArray key;
+                key.append((const char*)&position, sizeof(position));
+                key.append((const char*)&texCoord, sizeof(texCoord));
+                key.append((const char*)&normal, sizeof(normal));
+
+                auto it = corners.find(key);
+
+                if (it == corners.end())
+                {
+                    QVector3D p = positions[position];
+                    QVector2D t = texCoord >= 0 ? texCoords[texCoord] : QVector2D(0.0f, 0.0f);
+                    QVector3D n = normal >= 0 ? normals[normal] : QVector3D(0.0f, 0.0f, 0.0f);
+
+                    it = corners.insert(key, vertices.size());
+                    vertices.append({p.x(), p.y(), p.z(), t.x(), t.y(), n.x(), n.y(), n.z()});
+                }
+
+                polygon.append(it.value());
+            }
+
+            for (int i = 2; i < polygon.size(); i++)
+            {
+                indices.append(polygon[0]);
+                indices.append(polygon[i - 1]);
+                indices.append(polygon[i]);
+            }
+        }
+    }
+
+    // Without normals in the file, smooth the ones of the faces.
+    if (!hasNormals)
+        MgVertexFormat::computeNormals(vertices, indices);
+
+    return true;
+}
@@ -0,0 +1,131 @@
+#ifndef MGMESHFILE_H
+#define MGMESHFILE_H
+
+#include "stable.h"
+#include "mggeometrypool.h"
+#include "mgvertexformat.h"
+
+struct VkVertex;
+
+#define MG_MESH_MAGIC 0x314d474d
+#define MG_MESH_VERSION 2
+#define MG_MESH_ALIGNMENT 16
+
+
+/**
+ * Struct used for the header at the start of a mesh file.
+ *
+ * Offsets are in bytes from the start of the file.
+ */
+struct MgMeshHeader
+{
+    uint32_t                    magic;
+    uint32_t                    version;
+
+    uint32_t                    vertexFormat;
+    uint32_t                    vertexStride;
+    uint32_t                    vertexCount;
+    uint32_t                    indexCount;
+    uint32_t                    indexSize;
+    uint32_t                    lodCount;
+    uint32_t                    meshletCount;
+    uint32_t                    reserved;
+
+    float                       boundsCenter[3];
+    float                       boundsRadius;
+
+    float                       positionOffset[3];
+    float                       positionScale[3];
+    float                       texCoordOffset[2];
+    float                       texCoordScale[2];
+
+    uint64_t                    vertexDataOffset;
+    uint64_t                    indexDataOffset;
+    uint64_t                    lodDataOffset;
+    uint64_t                    meshletDataOffset;
+};
+
+/**
+ * Struct used for one level of detail of a mesh file.
+ *
+ * Every level is a range of the index stream over the shared vertices. The
+ * error is how far it strays from the full mesh, relative to its bounding
+ * radius. The meshlets of every level follow those of the previous one.
+ */
+struct MgMeshLod
+{
+    uint32_t                    firstIndex;
+    uint32_t                    indexCount;
+    float                       error;
+    uint32_t                    meshletCount;
+};
+
+
+/**
+ * Class used to read and write mesh files.
+ *
+ * A mesh file holds the header, the vertices already encoded in their
+ * format, the indices in 16 or 32 bits, the level of detail table and the
+ * meshlets, each aligned. Files are memory-mapped and their streams copied straight into
+ * the geometry pool, nothing is parsed.
+ *
+ * Files are made offline from OBJ and glTF sources by convert().
+ */
+class MgMeshFile
+{
+    // Objects:
+public:
+    const MgMeshHeader          *header;
+
+private:
+    QFile                       file;
+    const uint8_t               *data;
+    qint64                      size;
+
+    // Functions:
+public:
+    MgMeshFile();
+    ~MgMeshFile();
+
+    bool open(
+            const QString       &fileName
+            );
+    void close();
+
+    const uint8_t* getVertexData() const;
+    const uint8_t* getIndexData() const;
+    const MgMeshLod* getLods() const;
+    const MgMeshlet* getMeshlets() const;
+    void getQuantization(
+            MgVertexQuantization &quantization
+            ) const;
+
+    VkResult upload(
+            MgGeometryPool      *geometryPool,
+            MgMeshRange         &range
+            ) const;
+
+    static bool write(
+            const QString       &fileName,
+            MgVertexFormatType  format,
+            const QVector<VkVertex> &vertices,
+            const QVector<uint32_t> &indices,
+            QVector<MgMeshLod>  lods = {},
+            const QVector<MgMeshlet> &meshlets = {}
+            );
+    static bool convert(
+            const QString       &sourceName,
+            const QString       &fileName
+            );
+
+private:
+    bool validate() const;
+
+    static bool readObj(
+            const QString       &fileName,
+            QVector<VkVertex>   &vertices,
+            QVector<uint32_t>   &indices
+            );
+};
+
+#endif // MGMESHFILE_H
@@ -0,0 +1,259 @@
+#include "mgmeshlet.h"
+#include "vkc_pipeline.h"
+
+#include <cfloat>
+
+
+/**
+ * Split every level of detail of a mesh into meshlets.
+ *
+ * The meshlets of each level follow those of the previous one, and the
+ * level of detail table says how many each has.
+ */
+void MgMeshletBuilder::build(const QVector<VkVertex> &vertices, QVector<uint32_t> &indices, QVector<MgMeshLod> &lods,
+                             QVector<MgMeshlet> &meshlets)
+{
+    meshlets.clear();
+
+    // Without levels of detail, the whole mesh is the only one.
+    if (lods.isEmpty())
+        lods.append({0, (uint32_t)indices.size(), 0.0f, 0});
+
+    uint32_t *indexData = indices.data();
+
+    for (int i = 0; i < lods.size(); i++)
+    {
+        int firstMeshlet = meshlets.size();
+        buildRange(vertices, indexData + lods[i].firstIndex, lods[i].indexCount, lods[i].firstIndex, meshlets);
+
+        lods[i].meshletCount = meshlets.size() - firstMeshlet;
+    }
+}
+
+
+/**
+ * Reorder a range of triangles into meshlets and append them.
+ *
+ * The first index is where the range starts in the index stream of the
+ * mesh, the meshlets point there.
+ */
+void MgMeshletBuilder::buildRange(const QVector<VkVertex> &vertices, uint32_t *indices, uint32_t indexCount, uint32_t firstIndex,
+                                  QVector<MgMeshlet> &meshlets)
+{
+    uint32_t vertexCount = vertices.size();
+    uint32_t triangleCount = indexCount / 3;
+
+    if (triangleCount == 0)
+        return;
+
+    // Gather the triangles of every vertex.
+    QVector<uint32_t> valence(vertexCount, 0);
+    QVector<uint32_t> firstTriangle(vertexCount + 1);
+    QVector<uint32_t> adjacency(triangleCount * 3);
+
+    for (uint32_t i = 0; i < triangleCount * 3; i++)
+        valence[indices[i]]++;
+
+    firstTriangle[0] = 0;
+
+    for (uint32_t i = 0; i < vertexCount; i++)
+        firstTriangle[i + 1] = firstTriangle[i] + valence[i];
+
+    QVector<uint32_t> fill = firstTriangle;
+
+    for (uint32_t i = 0; i < triangleCount * 3; i++)
+        adjacency[fill[indices[i]]++] = i / 3;
+
+    QVector<uint32_t> result;
+    result.reserve(triangleCount * 3);
+
+    QVector<bool> emitted(triangleCount, false);
+    QVector<bool> used(vertexCount, false);
+    QVector<uint32_t> meshletVertices;
+
+    // Every triangle before the seed has been taken.
+    uint32_t seed = 0;
+
+    while ((uint32_t)result.size() < triangleCount * 3)
+    {
+        uint32_t meshletStart = result.size();
+        uint32_t meshletTriangles = 0;
+        QVector3D centerSum(0.0f, 0.0f, 0.0f);
+
+        while (emitted[seed])
+            seed++;
+
+        int candidate = seed;
+
+        while (candidate >= 0)
+        {
+            // Take the triangle and its vertices.
+            emitted[candidate] = true;
+            meshletTriangles++;
+
+            for (int i = 0; i < 3; i++)
+            {
+                uint32_t vertex = indices[candidate * 3 + i];
+                result.append(vertex);
+
+                if (!used[vertex])
+                {
+                    used[vertex] = true;
+                    meshletVertices.append(vertex);
+                    centerSum += QVector3D(vertices[vertex].x, vertices[vertex].y, vertices[vertex].z);
+                }
+            }
+
+            if (meshletTriangles == MG_MESHLET_MAX_TRIANGLES)
+                break;
+
+            // Grow over the neighbours, those adding the fewest vertices first, then the closest ones.
+            QVector3D center = centerSum / meshletVertices.size();
+            int bestNewCount = 3;
+            float bestDistance = FLT_MAX;
+
+            candidate = -1;
+
+            for (int i = 0; i < meshletVertices.size(); i++)
+            {
+                uint32_t vertex = meshletVertices[i];
+
+                for (uint32_t j = firstTriangle[vertex]; j < firstTriangle[vertex + 1]; j++)
+                {
+                    uint32_t triangle = adjacency[j];
+
+                    if (emitted[triangle])
+                        continue;
+
+                    const uint32_t *corners = indices + triangle * 3;
+                    int newCount = !used[corners[0]] + !used[corners[1]] + !used[corners[2]];
+
+                    if (meshletVertices.size() + newCount > MG_MESHLET_MAX_VERTICES || newCount > bestNewCount)
+                        continue;
+
+                    QVector3D centroid(0.0f, 0.0f, 0.0f);
+
+                    for (int k = 0; k < 3; k++)
+                        centroid += QVector3D(vertices[corners[k]].x, vertices[corners[k]].y, vertices[corners[k]].z);
+
+                    float distance = (centroid / 3.0f - center).lengthSquared();
+
+                    if (newCount < bestNewCount || distance < bestDistance)
+                    {
+                        candidate = triangle;
+                        bestNewCount = newCount;
+                        bestDistance = distance;
+                    }
+                }
+            }
+
+            // Without neighbours left, go on with the next triangle in order if it fits.
+            if (candidate < 0 && meshletVertices.size() + 3 <= MG_MESHLET_MAX_VERTICES)
+            {
+                while (seed < triangleCount && emitted[seed])
+                    seed++;
+
+                if (seed < triangleCount)
+                    candidate = seed;
+            }
+        }
+
+        MgMeshlet meshlet = {};
+        meshlet.firstIndex =    firstIndex + meshletStart;
+        meshlet.triangleCount = meshletTriangles;
+        meshlet.vertexCount =   meshletVertices.size();
+
+        computeBounds(vertices, result.constData() + meshletStart, meshlet);
+        meshlets.append(meshlet);
+
+        for (int i = 0; i < meshletVertices.size(); i++)
+            used[meshletVertices[i]] = false;
+
+        meshletVertices.clear();
+    }
+
+    memcpy(indices, result.constData(), result.size() * sizeof(uint32_t));
+}
+
+
+/**
+ * Compute the bounding sphere and normal cone of a meshlet from its triangles.
+ *
+ * The cone axis is the mean of the triangle normals and its cutoff the sine
+ * of the widest angle to one of them. Meshlets whose normals spread over
+ * about half a sphere or more get no cone.
+ */
+void MgMeshletBuilder::computeBounds(const QVector<VkVertex> &vertices, const uint32_t *indices, MgMeshlet &meshlet)
+{
+    uint32_t indexCount = meshlet.triangleCount * 3;
+
+    // Bounding sphere around the box of the vertices.
+    QVector3D minimum(vertices[indices[0]].x, vertices[indices[0]].y, vertices[indices[0]].z);
+    QVector3D maximum = minimum;
+
+    for (uint32_t i = 1; i < indexCount; i++)
+    {
+        QVector3D point(vertices[indices[i]].x, vertices[indices[i]].y, vertices[indices[i]].z);
+
+        minimum = QVector3D(qMin(minimum.x(), point.x()), qMin(minimum.y(), point.y()), qMin(minimum.z(), point.z()));
+        maximum = QVector3D(qMax(maximum.x(), point.x()), qMax(maximum.y(), point.y()), qMax(maximum.z(), point.z()));
+    }
+
+    QVector3D center = (minimum + maximum) * 0.5f;
+    float radius = 0.0f;
+
+    for (uint32_t i = 0; i < indexCount; i++)
+        radius = qMax(radius, (QVector3D(vertices[indices[i]].x, vertices[indices[i]].y, vertices[indices[i]].z) - center).length());
+
+    // Normal cone around the mean normal, degenerate triangles face nowhere.
+    QVector<QVector3D> normals;
+    QVector3D axis(0.0f, 0.0f, 0.0f);
+
+    for (uint32_t i = 0; i < indexCount; i += 3)
+    {
+        QVector3D p0(vertices[indices[i]].x, vertices[indices[i]].y, vertices[indices[i]].z);
+        QVector3D p1(vertices[indices[i + 1]].x, vertices[indices[i + 1]].y, vertices[indices[i + 1]].z);
+        QVector3D p2(vertices[indices[i + 2]].x, vertices[indices[i + 2]].y, vertices[indices[i + 2]].z);
+
+        QVector3D normal = QVector3D::crossProduct(p1 - p0, p2 - p0);
+
+        if (normal.lengthSquared() <= 0.0f)
+            continue;
+
+        normals.append(normal.normalized());
+        axis += normals.last();
+    }
+
+    float minimumDot = 1.0f;
+
+    if (axis.lengthSquared() > 0.0f)
+    {
+        axis.normalize();
+
+        for (int i = 0; i < normals.size(); i++)
+            minimumDot = qMin(minimumDot, QVector3D::dotProduct(axis, normals[i]));
+    }
+    else
+    {
+        minimumDot = -1.0f;
+    }
+
+    meshlet.center[0] = center.x();
+    meshlet.center[1] = center.y();
+    meshlet.center[2] = center.z();
+    meshlet.radius = radius;
+
+    if (minimumDot < MG_MESHLET_MIN_CONE_DOT)
+    {
+        meshlet.coneAxis[0] = 0.0f;
+        meshlet.coneAxis[1] = 0.0f;
+        meshlet.coneAxis[2] = 0.0f;
+        meshlet.coneCutoff = 1.0f;
+        return;
+    }
+
+    meshlet.coneAxis[0] = axis.x();
+    meshlet.coneAxis[1] = axis.y();
+    meshlet.coneAxis[2] = axis.z();
+    meshlet.coneCutoff = qSqrt(1.0f - minimumDot * minimumDot);
+}
@@ -0,0 +1,50 @@
+#ifndef MGMESHLET_H
+#define MGMESHLET_H
+
+#include "stable.h"
+#include "mgmeshfile.h"
+
+struct VkVertex;
+
+#define MG_MESHLET_MAX_VERTICES 64
+#define MG_MESHLET_MAX_TRIANGLES 124
+#define MG_MESHLET_MIN_CONE_DOT 0.1f
+
+
+/**
+ * Class used to split meshes into meshlets.
+ *
+ * Meshlets grow from a seed triangle over its neighbours, preferring the
+ * triangles that add the fewest vertices and then the closest ones, until
+ * they reach MG_MESHLET_MAX_VERTICES vertices or MG_MESHLET_MAX_TRIANGLES
+ * triangles. Only the order of the triangles changes, so the vertices and
+ * the level of detail ranges stay valid. Meant to run once, when meshes are
+ * imported.
+ */
+class MgMeshletBuilder
+{
+    // Functions:
+public:
+    static void build(
+            const QVector<VkVertex> &vertices,
+            QVector<uint32_t>   &indices,
+            QVector<MgMeshLod>  &lods,
+            QVector<MgMeshlet>  &meshlets
+            );
+    static void buildRange(
+            const QVector<VkVertex> &vertices,
+            uint32_t            *indices,
+            uint32_t            indexCount,
+            uint32_t            firstIndex,
+            QVector<MgMeshlet>  &meshlets
+            );
+
+private:
+    static void computeBounds(
+            const QVector<VkVertex> &vertices,
+            const uint32_t      *indices,
+            MgMeshlet           &meshlet
+            );
+};
+
+#endif // MGMESHLET_H
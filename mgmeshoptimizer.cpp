@@ -0,0 +1,356 @@
+#include "mgmeshoptimizer.h"
+#include "vkc_pipeline.h"
+
+#include <algorithm>
+
+
+/**
+ * Run every optimization on a mesh.
+ *
+ * The cache efficiency before and after is written to the given stats.
+ */
+void MgMeshOptimizer::optimize(QVector<VkVertex> &vertices, QVector<uint32_t> &indices, MgMeshStats *before, MgMeshStats *after)
+{
+    if (before != nullptr)
+        *before = analyze(indices, vertices.size());
+
+    optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices);
+    optimizeVertexFetch(vertices, indices);
+
+    if (after != nullptr)
+        *after = analyze(indices, vertices.size());
+}
+
+
+/**
+ * Order the triangles so their vertices are reused from the post-transform cache.
+ *
+ * Greedy, after Forsyth's linear-speed optimization: vertices are scored by
+ * their place in a simulated cache and by the triangles they have left, and
+ * the triangle with the highest score among those touching the cache is
+ * drawn next.
+ */
+void MgMeshOptimizer::optimizeVertexCache(QVector<uint32_t> &indices, uint32_t vertexCount)
+{
+    int triangleCount = indices.size() / 3;
+
+    if (triangleCount == 0)
+        return;
+
+    // Gather the triangles of every vertex, the lists shrink as triangles are drawn.
+    QVector<uint32_t> valence(vertexCount, 0);
+
+    for (int i = 0; i < triangleCount * 3; i++)
+        valence[indices[i]]++;
+
+    QVector<uint32_t> firstTriangle(vertexCount + 1, 0);
+
+    for (uint32_t i = 0; i < vertexCount; i++)
+        firstTriangle[i + 1] = firstTriangle[i] + valence[i];
+
+    QVector<uint32_t> adjacency(triangleCount * 3);
+    QVector<uint32_t> fill = firstTriangle;
+
+    for (int i = 0; i < triangleCount * 3; i++)
+        adjacency[fill[indices[i]]++] = i / 3;
+
+    // Score the vertices and triangles.
+    QVector<int> cachePositions(vertexCount, -1);
+    QVector<float> vertexScores(vertexCount);
+    QVector<float> triangleScores(triangleCount);
+    QVector<bool> drawn(triangleCount, false);
+
+    for (uint32_t i = 0; i < vertexCount; i++)
+        vertexScores[i] = getVertexScore(-1, valence[i]);
+
+    int bestTriangle = 0;
+
+    for (int i = 0; i < triangleCount; i++)
+    {
+        triangleScores[i] = vertexScores[indices[i * 3]] + vertexScores[indices[i * 3 + 1]] + vertexScores[indices[i * 3 + 2]];
+
+        if (triangleScores[i] > triangleScores[bestTriangle])
+            bestTriangle = i;
+    }
+
+    QVector<uint32_t> cache;
+    QVector<uint32_t> newCache;
+    QVector<uint32_t> ordered;
+    ordered.reserve(triangleCount * 3);
+
+    int nextTriangle = 0;
+
+    while (ordered.size() < triangleCount * 3)
+    {
+        // At a dead end, go on with the first triangle not drawn yet.
+        if (bestTriangle < 0)
+        {
+            while (drawn[nextTriangle])
+                nextTriangle++;
+
+            bestTriangle = nextTriangle;
+        }
+
+        const uint32_t *triangle = indices.constData() + bestTriangle * 3;
+        drawn[bestTriangle] = true;
+
+        // Draw the triangle and take it off the lists of its vertices.
+        for (int i = 0; i < 3; i++)
+        {
+            uint32_t vertex = triangle[i];
+            uint32_t *triangles = adjacency.data() + firstTriangle[vertex];
+
+            ordered.append(vertex);
+
+            for (uint32_t j = 0; j < valence[vertex]; j++)
+            {
+                if (triangles[j] == (uint32_t)bestTriangle)
+                {
+                    triangles[j] = triangles[valence[vertex] - 1];
+                    valence[vertex]--;
+                    break;
+                }
+            }
+        }
+
+        // Put the vertices of the triangle in front of the cache.
+        newCache.clear();
+
+        for (int i = 0; i < 3; i++)
+            if (!newCache.contains(triangle[i]))
+                newCache.append(triangle[i]);
+
+        for (int i = 0; i < cache.size(); i++)
+            if (!newCache.contains(cache[i]))
+                newCache.append(cache[i]);
+
+        // Update the scores of the vertices in the cache and the ones pushed out.
+        for (int i = 0; i < newCache.size(); i++)
+        {
+            uint32_t vertex = newCache[i];
+
+            cachePositions[vertex] = i < MG_OPTIMIZER_CACHE_SIZE ? i : -1;
+            vertexScores[vertex] = getVertexScore(cachePositions[vertex], valence[vertex]);
+        }
+
+        // Rescore their triangles and pick the best one.
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+
+        for (int i = 0; i < newCache.size(); i++)
+        {
+            uint32_t vertex = newCache[i];
+            const uint32_t *triangles = adjacency.constData() + firstTriangle[vertex];
+
+            for (uint32_t j = 0; j < valence[vertex]; j++)
+            {
+                uint32_t t = triangles[j];
+
+                triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+
+                if (triangleScores[t] > bestScore)
+                {
+                    bestScore = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        if (newCache.size() > MG_OPTIMIZER_CACHE_SIZE)
+            newCache.resize(MG_OPTIMIZER_CACHE_SIZE);
+
+        cache.swap(newCache);
+    }
+
+    memcpy(indices.data(), ordered.constData(), ordered.size() * sizeof(uint32_t));
+}
+
+
+/**
+ * Order clusters of triangles so the ones facing outwards are drawn first.
+ *
+ * Clusters start where the cache starts over, so moving them around keeps
+ * most of the cache efficiency; the new order is only kept if the ACMR
+ * grows by less than the threshold. Triangles facing the camera are then
+ * more likely drawn before the ones they hide, whatever the view.
+ */
+void MgMeshOptimizer::optimizeOverdraw(QVector<uint32_t> &indices, const QVector<VkVertex> &vertices, float threshold)
+{
+    int triangleCount = indices.size() / 3;
+    uint32_t vertexCount = vertices.size();
+
+    if (triangleCount == 0)
+        return;
+
+    // Start a cluster at every triangle whose vertices all miss the cache.
+    QVector<int> clusterStarts;
+    QVector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = MG_VERTEX_CACHE_SIZE + 1;
+
+    for (int i = 0; i < triangleCount; i++)
+    {
+        int misses = 0;
+
+        for (int j = 0; j < 3; j++)
+        {
+            uint32_t vertex = indices[i * 3 + j];
+
+            if (time - timestamps[vertex] > MG_VERTEX_CACHE_SIZE)
+            {
+                timestamps[vertex] = time++;
+                misses++;
+            }
+        }
+
+        if (i == 0 || misses == 3)
+            clusterStarts.append(i);
+    }
+
+    if (clusterStarts.size() < 2)
+        return;
+
+    clusterStarts.append(triangleCount);
+
+    auto getPosition = [&vertices](uint32_t index)
+    {
+        return QVector3D(vertices[index].x, vertices[index].y, vertices[index].z);
+    };
+
+    // Get the centroid of the mesh.
+    QVector3D meshCentroid(0.0f, 0.0f, 0.0f);
+
+    for (uint32_t i = 0; i < vertexCount; i++)
+        meshCentroid += getPosition(i);
+
+    meshCentroid /= (float)qMax(vertexCount, 1u);
+
+    // Sort the clusters by how far out they face.
+    QVector<QPair<float, int>> clusterKeys;
+
+    for (int i = 0; i + 1 < clusterStarts.size(); i++)
+    {
+        QVector3D centroid(0.0f, 0.0f, 0.0f);
+        QVector3D normal(0.0f, 0.0f, 0.0f);
+
+        for (int t = clusterStarts[i]; t < clusterStarts[i + 1]; t++)
+        {
+            QVector3D p0 = getPosition(indices[t * 3]);
+            QVector3D p1 = getPosition(indices[t * 3 + 1]);
+            QVector3D p2 = getPosition(indices[t * 3 + 2]);
+
+            // The cross product is area weighted.
+            centroid += (p0 + p1 + p2) / 3.0f;
+            normal += QVector3D::crossProduct(p1 - p0, p2 - p0);
+        }
+
+        centroid /= (float)(clusterStarts[i + 1] - clusterStarts[i]);
+
+        clusterKeys.append(qMakePair(QVector3D::dotProduct(centroid - meshCentroid, normal.normalized()), i));
+    }
+
+    std::stable_sort(clusterKeys.begin(), clusterKeys.end(),
+                     [](const QPair<float, int> &a, const QPair<float, int> &b) { return a.first > b.first; });
+
+    QVector<uint32_t> ordered;
+    ordered.reserve(triangleCount * 3);
+
+    for (int i = 0; i < clusterKeys.size(); i++)
+    {
+        int cluster = clusterKeys[i].second;
+
+        for (int t = clusterStarts[cluster]; t < clusterStarts[cluster + 1]; t++)
+            for (int j = 0; j < 3; j++)
+                ordered.append(indices[t * 3 + j]);
+    }
+
+    // Keep the new order only if the cache barely suffers.
+    if (analyze(ordered, vertexCount).acmr <= analyze(indices, vertexCount).acmr * threshold)
+        memcpy(indices.data(), ordered.constData(), ordered.size() * sizeof(uint32_t));
+}
+
+
+/**
+ * Order the vertices by first use, dropping the unused ones.
+ */
+void MgMeshOptimizer::optimizeVertexFetch(QVector<VkVertex> &vertices, QVector<uint32_t> &indices)
+{
+    QVector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    QVector<VkVertex> ordered;
+    ordered.reserve(vertices.size());
+
+    for (int i = 0; i < indices.size(); i++)
+    {
+        uint32_t &index = indices[i];
+
+        if (remap[index] == UINT32_MAX)
+        {
+            remap[index] = ordered.size();
+            ordered.append(vertices[index]);
+        }
+
+        index = remap[index];
+    }
+
+    vertices.swap(ordered);
+}
+
+
+/**
+ * Simulate a FIFO post-transform cache to measure how often vertices are shaded.
+ */
+MgMeshStats MgMeshOptimizer::analyze(const QVector<uint32_t> &indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+    MgMeshStats stats;
+    int triangleCount = indices.size() / 3;
+
+    if (triangleCount == 0 || vertexCount == 0)
+        return stats;
+
+    QVector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    uint32_t invocations = 0;
+
+    for (int i = 0; i < triangleCount * 3; i++)
+    {
+        uint32_t vertex = indices[i];
+
+        if (time - timestamps[vertex] > cacheSize)
+        {
+            timestamps[vertex] = time++;
+            invocations++;
+        }
+    }
+
+    stats.acmr = (float)invocations / triangleCount;
+    stats.atvr = (float)invocations / vertexCount;
+
+    return stats;
+}
+
+
+/**
+ * Score a vertex, higher for recently used vertices and ones with few triangles left.
+ */
+float MgMeshOptimizer::getVertexScore(int cachePosition, uint32_t valence)
+{
+    // Vertices without triangles left are never picked.
+    if (valence == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+
+    // The vertices of the last triangle get a fixed score, so it is not simply reused.
+    if (cachePosition >= 0)
+    {
+        if (cachePosition < 3)
+            score = 0.75f;
+        else
+            score = qPow(1.0f - (float)(cachePosition - 3) / (MG_OPTIMIZER_CACHE_SIZE - 3), 1.5f);
+    }
+
+    // Finish vertices with few triangles left, so they leave the cache for good.
+    score += 2.0f * qPow((float)valence, -0.5f);
+
+    return score;
+}
@@ -0,0 +1,72 @@
+#ifndef MGMESHOPTIMIZER_H
+#define MGMESHOPTIMIZER_H
+
+#include "stable.h"
+
+struct VkVertex;
+
+#define MG_VERTEX_CACHE_SIZE 16
+#define MG_OPTIMIZER_CACHE_SIZE 32
+#define MG_OVERDRAW_THRESHOLD 1.05f
+
+
+/**
+ * Struct used for the post-transform vertex cache efficiency of a mesh.
+ *
+ * ACMR is the number of vertex shader invocations per triangle, ATVR the
+ * number per vertex; 0.5 and 1.0 are the best possible.
+ */
+struct MgMeshStats
+{
+    float                       acmr =          0.0f;
+    float                       atvr =          0.0f;
+};
+
+
+/**
+ * Class used to reorder meshes so they draw with less vertex work.
+ *
+ * Triangles are ordered for the post-transform vertex cache, then clusters
+ * of them for overdraw, as long as the cache efficiency barely suffers.
+ * Vertices are then ordered by first use, so they are fetched in sequence.
+ * Meant to run once, when meshes are imported.
+ */
+class MgMeshOptimizer
+{
+    // Functions:
+public:
+    static void optimize(
+            QVector<VkVertex>   &vertices,
+            QVector<uint32_t>   &indices,
+            MgMeshStats         *before = nullptr,
+            MgMeshStats         *after = nullptr
+            );
+
+    static void optimizeVertexCache(
+            QVector<uint32_t>   &indices,
+            uint32_t            vertexCount
+            );
+    static void optimizeOverdraw(
+            QVector<uint32_t>   &indices,
+            const QVector<VkVertex> &vertices,
+            float               threshold = MG_OVERDRAW_THRESHOLD
+            );
+    static void optimizeVertexFetch(
+            QVector<VkVertex>   &vertices,
+            QVector<uint32_t>   &indices
+            );
+
+    static MgMeshStats analyze(
+            const QVector<uint32_t> &indices,
+            uint32_t            vertexCount,
+            uint32_t            cacheSize = MG_VERTEX_CACHE_SIZE
+            );
+
+private:
+    static float getVertexScore(
+            int                 cachePosition,
+            uint32_t            valence
+            );
+};
+
+#endif // MGMESHOPTIMIZER_H
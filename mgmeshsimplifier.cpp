@@ -0,0 +1,370 @@
+#include "mgmeshsimplifier.h"
+#include "mgmeshoptimizer.h"
+#include "vkc_pipeline.h"
+
+#include <algorithm>
+
+
+/**
+ * Build a chain of levels of detail, each about half the triangles of the last.
+ *
+ * The indices of every level are appended to the full mesh ones, and the
+ * level of detail table says where each starts. The chain ends once a
+ * level barely simplifies or gets small enough.
+ */
+void MgMeshSimplifier::buildLods(const QVector<VkVertex> &vertices, QVector<uint32_t> &indices, QVector<MgMeshLod> &lods)
+{
+    lods.clear();
+    lods.append({0, (uint32_t)indices.size(), 0.0f, 0});
+
+    QVector<uint32_t> level = indices;
+    float error = 0.0f;
+
+    while (lods.size() < MG_LOD_MAX_LEVELS && level.size() / 3 > MG_LOD_MIN_TRIANGLES)
+    {
+        QVector<uint32_t> simplified;
+        uint32_t targetIndexCount = (uint32_t)(level.size() / 3 * MG_LOD_REDUCTION) * 3;
+        float levelError = simplify(vertices, level, targetIndexCount, MG_LOD_MAX_ERROR, simplified);
+
+        if (simplified.size() > level.size() * MG_LOD_MIN_REDUCTION)
+            break;
+
+        MgMeshOptimizer::optimizeVertexCache(simplified, vertices.size());
+
+        // Every level is simplified from the last one, so their errors add up.
+        error += levelError;
+        lods.append({(uint32_t)indices.size(), (uint32_t)simplified.size(), error, 0});
+
+        indices += simplified;
+        level = simplified;
+    }
+}
+
+
+/**
+ * Collapse edges until the target index count or error is reached.
+ *
+ * Every pass ranks the collapses of all edges and applies the cheapest ones
+ * that do not touch each other. Returns the largest error of a collapse.
+ */
+float MgMeshSimplifier::simplify(const QVector<VkVertex> &vertices, const QVector<uint32_t> &indices, uint32_t targetIndexCount,
+                                 float targetError, QVector<uint32_t> &result)
+{
+    result = indices;
+    uint32_t vertexCount = vertices.size();
+
+    if (vertexCount == 0 || (uint32_t)result.size() <= targetIndexCount)
+        return 0.0f;
+
+    // Scale the positions to the bounding sphere, so errors do not depend on the mesh size.
+    QVector3D minimum(vertices[0].x, vertices[0].y, vertices[0].z);
+    QVector3D maximum = minimum;
+
+    for (uint32_t i = 1; i < vertexCount; i++)
+    {
+        QVector3D point(vertices[i].x, vertices[i].y, vertices[i].z);
+
+        minimum = QVector3D(qMin(minimum.x(), point.x()), qMin(minimum.y(), point.y()), qMin(minimum.z(), point.z()));
+        maximum = QVector3D(qMax(maximum.x(), point.x()), qMax(maximum.y(), point.y()), qMax(maximum.z(), point.z()));
+    }
+
+    QVector3D center = (minimum + maximum) * 0.5f;
+    float radius = (maximum - minimum).length() * 0.5f;
+
+    if (radius <= 0.0f)
+        return 0.0f;
+
+    QVector<QVector3D> positions(vertexCount);
+
+    for (uint32_t i = 0; i < vertexCount; i++)
+        positions[i] = (QVector3D(vertices[i].x, vertices[i].y, vertices[i].z) - center) / radius;
+
+    // Weld vertices sharing a position, they only differ in their attributes.
+    QVector<uint32_t> welded(vertexCount);
+    QHash<QByteArray, uint32_t> positionIds;
+
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        QByteArray key((const char*)&vertices[i].x, 3 * sizeof(float));
+        auto it = positionIds.find(key);
+
+        if (it == positionIds.end())
+            it = positionIds.insert(key, i);
+
+        welded[i] = it.value();
+    }
+
+    // Lock the positions used by several vertices, they are on a seam.
+    QVector<uint32_t> wedges(vertexCount, UINT32_MAX);
+    QVector<bool> locked(vertexCount, false);
+
+    for (int i = 0; i < result.size(); i++)
+    {
+        uint32_t position = welded[result[i]];
+
+        if (wedges[position] == UINT32_MAX)
+            wedges[position] = result[i];
+        else if (wedges[position] != result[i])
+            locked[position] = true;
+    }
+
+    // Lock the positions on borders, where an edge has no opposite.
+    QSet<quint64> edges;
+
+    for (int i = 0; i < result.size(); i++)
+    {
+        uint32_t a = welded[result[i]];
+        uint32_t b = welded[result[i - i % 3 + (i % 3 + 1) % 3]];
+
+        edges.insert((quint64)a << 32 | b);
+    }
+
+    for (auto it = edges.begin(); it != edges.end(); ++it)
+    {
+        uint32_t a = (uint32_t)(*it >> 32);
+        uint32_t b = (uint32_t)*it;
+
+        if (!edges.contains((quint64)b << 32 | a))
+        {
+            locked[a] = true;
+            locked[b] = true;
+        }
+    }
+
+    // Sum the planes of the triangles around every position.
+    QVector<MgQuadric> quadrics(vertexCount);
+
+    for (int i = 0; i + 2 < result.size(); i += 3)
+        for (int j = 0; j < 3; j++)
+            addPlane(quadrics[welded[result[i + j]]], positions[result[i]], positions[result[i + 1]], positions[result[i + 2]]);
+
+    struct Collapse
+    {
+        double                  error;
+        uint32_t                source;
+        uint32_t                target;
+    };
+
+    QVector<Collapse> collapses;
+    QVector<uint32_t> remap(vertexCount);
+    QVector<bool> touched(vertexCount);
+
+    QVector<uint32_t> valence(vertexCount);
+    QVector<uint32_t> firstTriangle(vertexCount + 1);
+    QVector<uint32_t> adjacency;
+
+    double maxError = (double)targetError * targetError;
+    double resultError = 0.0;
+
+    while ((uint32_t)result.size() > targetIndexCount)
+    {
+        int triangleCount = result.size() / 3;
+
+        // Gather the triangles of every vertex.
+        valence.fill(0);
+
+        for (int i = 0; i < triangleCount * 3; i++)
+            valence[result[i]]++;
+
+        firstTriangle[0] = 0;
+
+        for (uint32_t i = 0; i < vertexCount; i++)
+            firstTriangle[i + 1] = firstTriangle[i] + valence[i];
+
+        QVector<uint32_t> fill = firstTriangle;
+        adjacency.resize(triangleCount * 3);
+
+        for (int i = 0; i < triangleCount * 3; i++)
+            adjacency[fill[result[i]]++] = i / 3;
+
+        // Rank the collapses of every edge, both ways, onto the position of the other vertex.
+        collapses.clear();
+
+        for (int i = 0; i < triangleCount * 3; i++)
+        {
+            uint32_t a = result[i];
+            uint32_t b = result[i - i % 3 + (i % 3 + 1) % 3];
+
+            if (welded[a] == welded[b])
+                continue;
+
+            MgQuadric quadric = quadrics[welded[a]];
+            addQuadric(quadric, quadrics[welded[b]]);
+
+            if (!locked[welded[a]])
+                collapses.append({getError(quadric, positions[b]), a, b});
+
+            if (!locked[welded[b]])
+                collapses.append({getError(quadric, positions[a]), b, a});
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+        // Apply the cheapest collapses that do not touch each other.
+        for (uint32_t i = 0; i < vertexCount; i++)
+            remap[i] = i;
+
+        touched.fill(false);
+
+        int removedCount = 0;
+        int targetRemovedCount = triangleCount - (int)targetIndexCount / 3;
+        int collapseCount = 0;
+
+        for (int i = 0; i < collapses.size() && removedCount < targetRemovedCount; i++)
+        {
+            const Collapse &collapse = collapses[i];
+            uint32_t source = welded[collapse.source];
+            uint32_t target = welded[collapse.target];
+
+            if (collapse.error > maxError)
+                break;
+
+            if (touched[source] || touched[target])
+                continue;
+
+            // Unlocked positions have a single vertex, so these are all the triangles around the source.
+            const uint32_t *triangles = adjacency.constData() + firstTriangle[collapse.source];
+            int sharedCount = 0;
+            bool flips = false;
+
+            for (uint32_t j = 0; j < valence[collapse.source] && !flips; j++)
+            {
+                const uint32_t *triangle = result.constData() + triangles[j] * 3;
+
+                // Triangles along the edge disappear.
+                if (welded[triangle[0]] == target || welded[triangle[1]] == target || welded[triangle[2]] == target)
+                {
+                    sharedCount++;
+                    continue;
+                }
+
+                QVector3D p[3];
+                QVector3D moved[3];
+
+                for (int k = 0; k < 3; k++)
+                {
+                    p[k] = positions[triangle[k]];
+                    moved[k] = triangle[k] == collapse.source ? positions[collapse.target] : p[k];
+                }
+
+                // The others must keep facing about the same way, or they fold over.
+                flips = QVector3D::dotProduct(QVector3D::crossProduct(p[1] - p[0], p[2] - p[0]).normalized(),
+                                              QVector3D::crossProduct(moved[1] - moved[0], moved[2] - moved[0]).normalized()) <
+                        MG_SIMPLIFY_MIN_NORMAL_DOT;
+            }
+
+            if (flips)
+                continue;
+
+            remap[collapse.source] = collapse.target;
+            addQuadric(quadrics[target], quadrics[source]);
+
+            // Keep the triangles around the source out of the rest of the pass.
+            touched[source] = true;
+            touched[target] = true;
+
+            for (uint32_t j = 0; j < valence[collapse.source]; j++)
+                for (int k = 0; k < 3; k++)
+                    touched[welded[result[triangles[j] * 3 + k]]] = true;
+
+            resultError = qMax(resultError, collapse.error);
+            removedCount += sharedCount;
+            collapseCount++;
+        }
+
+        if (collapseCount == 0)
+            break;
+
+        // Remap the indices and drop the triangles that collapsed.
+        int indexCount = 0;
+
+        for (int i = 0; i < triangleCount * 3; i += 3)
+        {
+            uint32_t a = remap[result[i]];
+            uint32_t b = remap[result[i + 1]];
+            uint32_t c = remap[result[i + 2]];
+
+            if (welded[a] == welded[b] || welded[b] == welded[c] || welded[c] == welded[a])
+                continue;
+
+            result[indexCount++] = a;
+            result[indexCount++] = b;
+            result[indexCount++] = c;
+        }
+
+        result.resize(indexCount);
+    }
+
+    return (float)qSqrt(resultError);
+}
+
+
+/**
+ * Add the plane of a triangle, weighted by its area.
+ */
+void MgMeshSimplifier::addPlane(MgQuadric &quadric, const QVector3D &p0, const QVector3D &p1, const QVector3D &p2)
+{
+    QVector3D normal = QVector3D::crossProduct(p1 - p0, p2 - p0);
+    double length = normal.length();
+
+    if (length <= 0.0)
+        return;
+
+    double a = normal.x() / length;
+    double b = normal.y() / length;
+    double c = normal.z() / length;
+    double d = -(a * p0.x() + b * p0.y() + c * p0.z());
+    double weight = length * 0.5;
+
+    quadric.a2 +=       weight * a * a;
+    quadric.b2 +=       weight * b * b;
+    quadric.c2 +=       weight * c * c;
+    quadric.d2 +=       weight * d * d;
+    quadric.ab +=       weight * a * b;
+    quadric.ac +=       weight * a * c;
+    quadric.ad +=       weight * a * d;
+    quadric.bc +=       weight * b * c;
+    quadric.bd +=       weight * b * d;
+    quadric.cd +=       weight * c * d;
+    quadric.weight +=   weight;
+}
+
+
+/**
+ * Add the planes of another quadric.
+ */
+void MgMeshSimplifier::addQuadric(MgQuadric &quadric, const MgQuadric &other)
+{
+    quadric.a2 +=       other.a2;
+    quadric.b2 +=       other.b2;
+    quadric.c2 +=       other.c2;
+    quadric.d2 +=       other.d2;
+    quadric.ab +=       other.ab;
+    quadric.ac +=       other.ac;
+    quadric.ad +=       other.ad;
+    quadric.bc +=       other.bc;
+    quadric.bd +=       other.bd;
+    quadric.cd +=       other.cd;
+    quadric.weight +=   other.weight;
+}
+
+
+/**
+ * Get the mean squared distance of a position to the planes of a quadric.
+ */
+double MgMeshSimplifier::getError(const MgQuadric &quadric, const QVector3D &position)
+{
+    if (quadric.weight <= 0.0)
+        return 0.0;
+
+    double x = position.x();
+    double y = position.y();
+    double z = position.z();
+
+    double error = quadric.a2 * x * x + quadric.b2 * y * y + quadric.c2 * z * z + quadric.d2 +
+            2.0 * (quadric.ab * x * y + quadric.ac * x * z + quadric.bc * y * z +
+                   quadric.ad * x + quadric.bd * y + quadric.cd * z);
+
+    // Rounding can take it just below zero.
+    return qMax(error, 0.0) / quadric.weight;
+}
@@ -0,0 +1,85 @@
+#ifndef MGMESHSIMPLIFIER_H
+#define MGMESHSIMPLIFIER_H
+
+#include "stable.h"
+#include "mgmeshfile.h"
+
+struct VkVertex;
+
+#define MG_LOD_MAX_LEVELS 6
+#define MG_LOD_MIN_TRIANGLES 64
+#define MG_LOD_REDUCTION 0.5f
+#define MG_LOD_MIN_REDUCTION 0.85f
+#define MG_LOD_MAX_ERROR 0.25f
+#define MG_SIMPLIFY_MIN_NORMAL_DOT 0.5f
+
+
+/**
+ * Struct used for the quadric error of a vertex.
+ *
+ * The symmetric matrix of the squared distances to the planes of its
+ * triangles, kept as its ten distinct elements. Planes are weighted by the
+ * area of their triangle, and the error is the weighted mean.
+ */
+struct MgQuadric
+{
+    double                      a2 =            0.0;
+    double                      b2 =            0.0;
+    double                      c2 =            0.0;
+    double                      d2 =            0.0;
+    double                      ab =            0.0;
+    double                      ac =            0.0;
+    double                      ad =            0.0;
+    double                      bc =            0.0;
+    double                      bd =            0.0;
+    double                      cd =            0.0;
+    double                      weight =        0.0;
+};
+
+
+/**
+ * Class used to build levels of detail of meshes.
+ *
+ * Edges are collapsed in order of their quadric error, after Garland and
+ * Heckbert, always onto one of their vertices so every level keeps using
+ * the vertices of the full mesh and only the indices change. Vertices on
+ * borders or on texture and normal seams are kept, so outlines and charts
+ * do not tear, and collapses that would flip a triangle are skipped.
+ * Errors are relative to the bounding radius of the mesh. Meant to run
+ * once, when meshes are imported.
+ */
+class MgMeshSimplifier
+{
+    // Functions:
+public:
+    static void buildLods(
+            const QVector<VkVertex> &vertices,
+            QVector<uint32_t>   &indices,
+            QVector<MgMeshLod>  &lods
+            );
+    static float simplify(
+            const QVector<VkVertex> &vertices,
+            const QVector<uint32_t> &indices,
+            uint32_t            targetIndexCount,
+            float               targetError,
+            QVector<uint32_t>   &result
+            );
+
+private:
+    static void addPlane(
+            MgQuadric           &quadric,
+            const QVector3D     &p0,
+            const QVector3D     &p1,
+            const QVector3D     &p2
+            );
+    static void addQuadric(
+            MgQuadric           &quadric,
+            const MgQuadric     &other
+            );
+    static double getError(
+            const MgQuadric     &quadric,
+            const QVector3D     &position
+            );
+};
+
+#endif // MGMESHSIMPLIFIER_H
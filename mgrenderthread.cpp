@@ -0,0 +1,208 @@
+#include "mgrenderthread.h"
+
+
+/**
+ * Create the render thread.
+ */
+MgRenderThread::MgRenderThread(VkcInstance *vkcInstance)
+{
+    this->vkcInstance = vkcInstance;
+    frameCount.store(0);
+    frameLimit.store(0);
+
+    renderMode.store(MG_RENDER_CONTINUOUS);
+    paused.store(0);
+    throttled.store(0);
+
+    wakeRequested = false;
+    idleTime.store(0);
+}
+
+
+/**
+ * Stop and destroy the render thread.
+ */
+MgRenderThread::~MgRenderThread()
+{
+    stop();
+}
+
+
+/**
+ * Ask the render loop to finish and wait for it.
+ */
+void MgRenderThread::stop()
+{
+    requestInterruption();
+    requestFrame();
+    wait();
+}
+
+
+/**
+ * Get the number of frames rendered since the last call.
+ */
+int MgRenderThread::takeFrameCount()
+{
+    return frameCount.fetchAndStoreRelaxed(0);
+}
+
+
+/**
+ * Get the time in nanoseconds spent sleeping without work since the last call.
+ */
+qint64 MgRenderThread::takeIdleTime()
+{
+    return idleTime.fetchAndStoreRelaxed(0);
+}
+
+
+/**
+ * Limit the frame rate, 0 renders as fast as presentation allows.
+ */
+void MgRenderThread::setFrameLimit(int fps)
+{
+    frameLimit.store(qMax(fps, 0));
+}
+
+
+/**
+ * Get the frame rate limit.
+ */
+int MgRenderThread::getFrameLimit() const
+{
+    return frameLimit.load();
+}
+
+
+/**
+ * Choose between rendering continuously or only when something changed.
+ */
+void MgRenderThread::setRenderMode(MgRenderMode mode)
+{
+    renderMode.store(mode);
+    requestFrame();
+}
+
+
+/**
+ * Get the render mode.
+ */
+MgRenderMode MgRenderThread::getRenderMode() const
+{
+    return (MgRenderMode)renderMode.load();
+}
+
+
+/**
+ * Stop rendering while the window cannot be seen.
+ */
+void MgRenderThread::setPaused(bool paused)
+{
+    // Redraw once visible again, the window contents may have been lost.
+    if (this->paused.fetchAndStoreOrdered(paused ? 1 : 0) != 0 && !paused)
+        requestFrame();
+}
+
+
+/**
+ * Cap the frame rate while the window is in the background.
+ */
+void MgRenderThread::setThrottled(bool throttled)
+{
+    this->throttled.store(throttled ? 1 : 0);
+}
+
+
+/**
+ * Ask for a frame to be rendered, waking the thread if it sleeps.
+ */
+void MgRenderThread::requestFrame()
+{
+    QMutexLocker locker(&wakeMutex);
+
+    wakeRequested = true;
+    wakeCondition.wakeAll();
+}
+
+
+/**
+ * Sleep until a frame is requested.
+ *
+ * The wait times out now and then, so state changes that were not signaled
+ * are still noticed.
+ */
+void MgRenderThread::idle()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    wakeMutex.lock();
+    if (!wakeRequested)
+        wakeCondition.wait(&wakeMutex, MG_IDLE_TIMEOUT_MS);
+    wakeMutex.unlock();
+
+    idleTime.fetchAndAddRelaxed(timer.nsecsElapsed());
+}
+
+
+/**
+ * Render frames until interrupted.
+ *
+ * With a frame limit the thread waits before rendering rather than after, so
+ * the scene is sampled as late as possible. It sleeps for most of the wait and
+ * spins for the last stretch, since sleeping is too coarse for exact pacing.
+ */
+void MgRenderThread::run()
+{
+    QElapsedTimer clock;
+    clock.start();
+
+    qint64 deadline = 0;
+
+    while (!isInterruptionRequested())
+    {
+        // Consume the pending request, if any.
+        wakeMutex.lock();
+        bool requested = wakeRequested;
+        wakeRequested = false;
+        wakeMutex.unlock();
+
+        // Skip the frame if it would not show anything new.
+        if (paused.load() != 0 ||
+                (renderMode.load() == MG_RENDER_ON_DEMAND && !requested && !vkcInstance->needsRender()))
+        {
+            idle();
+            continue;
+        }
+
+        int limit = frameLimit.load();
+
+        if (throttled.load() != 0)
+            limit = limit > 0 ? qMin(limit, MG_BACKGROUND_FRAME_LIMIT) : MG_BACKGROUND_FRAME_LIMIT;
+
+        if (limit > 0)
+        {
+            qint64 interval = 1000000000LL / limit;
+            qint64 remaining = deadline - clock.nsecsElapsed();
+
+            if (remaining > MG_SPIN_THRESHOLD_NS)
+                usleep((remaining - MG_SPIN_THRESHOLD_NS) / 1000);
+
+            while (clock.nsecsElapsed() < deadline)
+                yieldCurrentThread();
+
+            // Do not try to catch up after falling behind.
+            qint64 now = clock.nsecsElapsed();
+            deadline = now - deadline > interval ? now + interval : deadline + interval;
+        }
+
+        if (vkcInstance->render())
+            frameCount.ref();
+        else
+            msleep(1);
+    }
+
+    // Let the GPU finish before the instance is destroyed.
+    vkcInstance->waitIdle();
+}
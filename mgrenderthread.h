@@ -0,0 +1,82 @@
+#ifndef MGRENDERTHREAD_H
+#define MGRENDERTHREAD_H
+
+#include "stable.h"
+#include "vkc_instance.h"
+
+#define MG_SPIN_THRESHOLD_NS        2000000
+#define MG_IDLE_TIMEOUT_MS          250
+#define MG_BACKGROUND_FRAME_LIMIT   30
+
+
+/**
+ * Ways the render thread schedules its frames.
+ */
+enum MgRenderMode
+{
+    MG_RENDER_CONTINUOUS,
+    MG_RENDER_ON_DEMAND
+};
+
+
+/**
+ * Class used to render frames outside of the Qt event loop.
+ *
+ * In continuous mode a frame is rendered as often as presentation and the
+ * frame limit allow. On demand, the thread sleeps until a frame is requested
+ * or the scene changed. While paused nothing is rendered at all, and while
+ * throttled the frame rate is capped to a background limit.
+ */
+class MgRenderThread : public QThread
+{
+    // Objects:
+private:
+    VkcInstance                 *vkcInstance;
+    QAtomicInt                  frameCount;
+    QAtomicInt                  frameLimit;
+
+    QAtomicInt                  renderMode;
+    QAtomicInt                  paused;
+    QAtomicInt                  throttled;
+
+    QMutex                      wakeMutex;
+    QWaitCondition              wakeCondition;
+    bool                        wakeRequested;
+
+    QAtomicInteger<qint64>      idleTime;
+
+    // Functions:
+public:
+    MgRenderThread(
+            VkcInstance         *vkcInstance
+            );
+    ~MgRenderThread();
+
+    void stop();
+    int takeFrameCount();
+    qint64 takeIdleTime();
+    void setFrameLimit(
+            int                 fps
+            );
+    int getFrameLimit() const;
+
+    void setRenderMode(
+            MgRenderMode        mode
+            );
+    MgRenderMode getRenderMode() const;
+    void setPaused(
+            bool                paused
+            );
+    void setThrottled(
+            bool                throttled
+            );
+    void requestFrame();
+
+protected:
+    void run() override;
+
+private:
+    void idle();
+};
+
+#endif // MGRENDERTHREAD_H
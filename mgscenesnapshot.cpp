@@ -0,0 +1,49 @@
+#include "mgscenesnapshot.h"
+
+#define MG_SNAPSHOT_INDEX_MASK  0x3
+#define MG_SNAPSHOT_NEW_BIT     0x4
+
+
+/**
+ * Initialize the slots.
+ */
+MgSnapshotBuffer::MgSnapshotBuffer()
+{
+    backIdx =   0;
+    frontIdx =  2;
+    middle.store(1);
+}
+
+
+/**
+ * Get the snapshot being written by the producer.
+ */
+MgSceneSnapshot* MgSnapshotBuffer::back()
+{
+    return &slots[backIdx];
+}
+
+
+/**
+ * Hand the back snapshot over to the consumer.
+ */
+void MgSnapshotBuffer::publish()
+{
+    int old = middle.fetchAndStoreOrdered(backIdx | MG_SNAPSHOT_NEW_BIT);
+    backIdx = old & MG_SNAPSHOT_INDEX_MASK;
+}
+
+
+/**
+ * Get the most recent snapshot published by the producer.
+ */
+const MgSceneSnapshot* MgSnapshotBuffer::acquire()
+{
+    if (middle.load() & MG_SNAPSHOT_NEW_BIT)
+    {
+        int old = middle.fetchAndStoreOrdered(frontIdx);
+        frontIdx = old & MG_SNAPSHOT_INDEX_MASK;
+    }
+
+    return &slots[frontIdx];
+}
@@ -0,0 +1,51 @@
+#ifndef MGSCENESNAPSHOT_H
+#define MGSCENESNAPSHOT_H
+
+#include "stable.h"
+
+
+/**
+ * Struct used to hand the scene state from the main thread to the render thread.
+ */
+struct MgSceneSnapshot
+{
+    uint32_t                    width =     0;
+    uint32_t                    height =    0;
+    qint64                      timestamp = 0;
+    uint64_t                    version =   0;
+
+    QMatrix4x4                  vpMatrix;
+    QVector3D                   cameraPosition;
+    float                       pixelScale = 0.0f;
+    QVector<QMatrix4x4>         modelMatrices;
+};
+
+
+/**
+ * Class used for the lock-free snapshot handoff.
+ *
+ * The producer fills the back snapshot while the consumer reads the front
+ * one; publishing and acquiring swap them through a third, shared slot with
+ * a single atomic exchange, so neither side ever waits for the other.
+ */
+class MgSnapshotBuffer
+{
+    // Objects:
+private:
+    MgSceneSnapshot             slots[3];
+
+    int                         backIdx;
+    int                         frontIdx;
+    QAtomicInt                  middle;
+
+    // Functions:
+public:
+    MgSnapshotBuffer();
+
+    MgSceneSnapshot* back();
+    void publish();
+
+    const MgSceneSnapshot* acquire();
+};
+
+#endif // MGSCENESNAPSHOT_H
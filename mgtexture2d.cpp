@@ -1,9 +1,11 @@
 #include "mgtexture2d.h"
 
 /**
- * Create the texture.
+ * Decode the image file into host memory.
+ *
+ * This touches no Vulkan objects, so it may run on a worker thread.
  */
-VkResult MgTexture2D::create(const VkcDevice* pDevice, const QString filePath)
+VkResult MgTexture2D::decode(const QString filePath)
 {
     QImage imageData;
 
@@ -12,6 +14,31 @@ VkResult MgTexture2D::create(const VkcDevice* pDevice, const QString filePath)
         return VK_ERROR_INITIALIZATION_FAILED;
     }
 
+    return decodeImage(imageData);
+}
+
+/**
+ * Decode an image held in memory, such as one embedded in a scene file.
+ *
+ * This touches no Vulkan objects, so it may run on a worker thread.
+ */
+VkResult MgTexture2D::decodeData(const QByteArray &data)
+{
+    QImage imageData;
+
+    if (!imageData.loadFromData(data))
+    {
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    return decodeImage(imageData);
+}
+
+/**
+ * Prepare a loaded image for upload, with room for its mip levels.
+ */
+VkResult MgTexture2D::decodeImage(QImage imageData)
+{
     // Prepare the QImage.
     imageData = imageData.mirrored().rgbSwapped();
     imageData.convertToFormat(QImage::Format_RGBA8888);
@@ -30,8 +57,37 @@ VkResult MgTexture2D::create(const VkcDevice* pDevice, const QString filePath)
         ++mipLevelCount;
     }
 
+    decodedImage = imageData;
+    decodedMipLevels = mipLevelCount;
+
+    return VK_SUCCESS;
+}
+
+/**
+ * Create the texture from a file.
+ */
+VkResult MgTexture2D::create(const VkcDevice* pDevice, const QString filePath)
+{
+    mgAssert(decode(filePath));
+    mgAssert(create(pDevice));
+
+    return VK_SUCCESS;
+}
+
+/**
+ * Create the texture from the decoded image.
+ */
+VkResult MgTexture2D::create(const VkcDevice* pDevice)
+{
+    if (decodedImage.isNull())
+    {
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    const QImage &imageData = decodedImage;
+
     // Load the QImage into the buffer.
-    mgAssert(loadImageData(pDevice, &imageData, mipLevelCount));
+    mgAssert(loadImageData(pDevice, &imageData, decodedMipLevels));
 
     MgImageInfo imageInfo =
     {
@@ -61,6 +117,9 @@ VkResult MgTexture2D::create(const VkcDevice* pDevice, const QString filePath)
 
     mgAssert(MgImage::create(pDevice, &imageInfo));
 
+    // The pixels now live in the image buffer.
+    decodedImage = QImage();
+
     return VK_SUCCESS;
 }
 
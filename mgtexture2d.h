@@ -9,7 +9,20 @@
  */
 class MgTexture2D : public MgImage
 {
+protected:
+    QImage                      decodedImage;
+    uint32_t                    decodedMipLevels =  0;
+
 public:
+    VkResult decode(
+            const QString       filePath
+            );
+    VkResult decodeData(
+            const QByteArray    &data
+            );
+    VkResult create(
+            const VkcDevice*    pDevice
+            );
     VkResult create(
             const VkcDevice*    pDevice,
             const QString       filePath
@@ -20,6 +33,11 @@ public:
             const QImage*       pImageData,
             int                 mipLevelCount
             );
+
+protected:
+    VkResult decodeImage(
+            QImage              imageData
+            );
 };
 
 #endif // MGTEXTURE2D_H
@@ -0,0 +1,84 @@
+#include "mgtexturecache.h"
+
+
+/**
+ * Initialize an empty cache.
+ */
+MgTextureCache::MgTextureCache()
+{
+
+}
+
+
+/**
+ * Delete the textures, they must be destroyed already.
+ */
+MgTextureCache::~MgTextureCache()
+{
+    qDeleteAll(textures);
+}
+
+
+/**
+ * Get the texture of a key, adding it if it is not in the cache yet.
+ *
+ * When added is set, the caller must decode the texture before create().
+ */
+MgTexture2D* MgTextureCache::acquire(const QString &key, bool &added)
+{
+    QMutexLocker locker(&mutex);
+
+    auto it = textures.find(key);
+    added = it == textures.end();
+
+    if (added)
+    {
+        it = textures.insert(key, new MgTexture2D());
+        pending.append(it.value());
+    }
+
+    return it.value();
+}
+
+
+/**
+ * Upload the textures added since the last call.
+ *
+ * Textures that failed to decode are left without an image.
+ */
+void MgTextureCache::create(const VkcDevice *device)
+{
+    QMutexLocker locker(&mutex);
+
+    for (int i = 0; i < pending.size(); i++)
+        if (pending[i]->create(device) != VK_SUCCESS)
+            qDebug() << "WARNING: [@qDebug]              - Texture" << textures.key(pending[i]) << "could not be created.";
+
+    pending.clear();
+}
+
+
+/**
+ * Destroy the images of every texture.
+ */
+void MgTextureCache::destroy(const VkcDevice *device)
+{
+    QMutexLocker locker(&mutex);
+
+    for (auto it = textures.begin(); it != textures.end(); ++it)
+        if (it.value()->handle != VK_NULL_HANDLE)
+            it.value()->destroy(device);
+}
+
+
+/**
+ * Get every texture with an image.
+ */
+void MgTextureCache::getTextures(QVector<MgTexture2D*> &textures)
+{
+    QMutexLocker locker(&mutex);
+
+    for (auto it = this->textures.begin(); it != this->textures.end(); ++it)
+        if (it.value()->handle != VK_NULL_HANDLE)
+            textures.append(it.value());
+}
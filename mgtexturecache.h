@@ -0,0 +1,45 @@
+#ifndef MGTEXTURECACHE_H
+#define MGTEXTURECACHE_H
+
+#include "stable.h"
+#include "mgtexture2d.h"
+
+
+/**
+ * Class used to share textures between the assets using them.
+ *
+ * Textures are keyed by their file path, or by asset and image for
+ * embedded ones, so an image used by several assets is decoded and uploaded
+ * once. Lookups may come from worker threads; whoever adds a texture
+ * decodes it, and create() uploads every decoded one on the calling thread.
+ */
+class MgTextureCache
+{
+    // Objects:
+private:
+    QHash<QString, MgTexture2D*> textures;
+    QVector<MgTexture2D*>       pending;
+    QMutex                      mutex;
+
+    // Functions:
+public:
+    MgTextureCache();
+    ~MgTextureCache();
+
+    MgTexture2D* acquire(
+            const QString       &key,
+            bool                &added
+            );
+    void create(
+            const VkcDevice     *device
+            );
+    void destroy(
+            const VkcDevice     *device
+            );
+
+    void getTextures(
+            QVector<MgTexture2D*> &textures
+            );
+};
+
+#endif // MGTEXTURECACHE_H
@@ -0,0 +1,241 @@
+#include "mgvertexformat.h"
+#include "vkc_pipeline.h"
+
+
+/**
+ * Get the size of a vertex.
+ */
+uint32_t MgVertexFormat::getStride(MgVertexFormatType format)
+{
+    return format == MG_VERTEX_FORMAT_PACKED ? sizeof(MgPackedVertex) : sizeof(VkVertex);
+}
+
+
+/**
+ * Get the vertex input attributes of a format, at the locations the shaders use.
+ *
+ * Packed normals also hold the tangent, shaders reading them as a vec3 only
+ * decode the first two components.
+ */
+void MgVertexFormat::getAttributes(MgVertexFormatType format, QVector<VkVertexInputAttributeDescription> &attributes)
+{
+    if (format == MG_VERTEX_FORMAT_PACKED)
+    {
+        attributes =
+        {
+            {0, 0, VK_FORMAT_R16G16B16A16_SNORM,    offsetof(MgPackedVertex, position)},
+            {1, 0, VK_FORMAT_R16G16_UNORM,          offsetof(MgPackedVertex, texCoord)},
+            {2, 0, VK_FORMAT_R8G8B8A8_SNORM,        offsetof(MgPackedVertex, normal)}
+        };
+    }
+    else
+    {
+        attributes =
+        {
+            {0, 0, VK_FORMAT_R32G32B32_SFLOAT,      offsetof(VkVertex, x)},
+            {1, 0, VK_FORMAT_R32G32_SFLOAT,         offsetof(VkVertex, u)},
+            {2, 0, VK_FORMAT_R32G32B32_SFLOAT,      offsetof(VkVertex, nx)}
+        };
+    }
+}
+
+
+/**
+ * Encode vertices to a format, along with what is needed to decode them.
+ *
+ * Positions are quantized within the bounds of the mesh, and texture
+ * coordinates within their range, so the precision follows the mesh size.
+ */
+void MgVertexFormat::encode(MgVertexFormatType format, const QVector<VkVertex> &vertices, const QVector<uint32_t> &indices,
+                            QByteArray &data, MgVertexQuantization &quantization)
+{
+    quantization = MgVertexQuantization();
+
+    if (format != MG_VERTEX_FORMAT_PACKED)
+    {
+        data = QByteArray((const char*)vertices.constData(), vertices.size() * sizeof(VkVertex));
+        return;
+    }
+
+    data.resize(vertices.size() * sizeof(MgPackedVertex));
+
+    if (vertices.isEmpty())
+        return;
+
+    // Get the bounds of the positions and texture coordinates.
+    QVector3D minPosition(vertices[0].x, vertices[0].y, vertices[0].z);
+    QVector3D maxPosition = minPosition;
+    QVector2D minTexCoord(vertices[0].u, vertices[0].v);
+    QVector2D maxTexCoord = minTexCoord;
+
+    for (int i = 1; i < vertices.size(); i++)
+    {
+        const VkVertex &vertex = vertices[i];
+
+        minPosition = QVector3D(qMin(minPosition.x(), vertex.x), qMin(minPosition.y(), vertex.y), qMin(minPosition.z(), vertex.z));
+        maxPosition = QVector3D(qMax(maxPosition.x(), vertex.x), qMax(maxPosition.y(), vertex.y), qMax(maxPosition.z(), vertex.z));
+        minTexCoord = QVector2D(qMin(minTexCoord.x(), vertex.u), qMin(minTexCoord.y(), vertex.v));
+        maxTexCoord = QVector2D(qMax(maxTexCoord.x(), vertex.u), qMax(maxTexCoord.y(), vertex.v));
+    }
+
+    // Map the bounds to [-1, 1] and the texture coordinates to [0, 1], flat axes keep a unit scale.
+    QVector3D halfExtent = (maxPosition - minPosition) * 0.5f;
+    QVector2D texCoordRange = maxTexCoord - minTexCoord;
+
+    quantization.positionOffset =   (minPosition + maxPosition) * 0.5f;
+    quantization.positionScale =    QVector3D(halfExtent.x() > 0.0f ? halfExtent.x() : 1.0f,
+                                              halfExtent.y() > 0.0f ? halfExtent.y() : 1.0f,
+                                              halfExtent.z() > 0.0f ? halfExtent.z() : 1.0f);
+    quantization.texCoordOffset =   minTexCoord;
+    quantization.texCoordScale =    QVector2D(texCoordRange.x() > 0.0f ? texCoordRange.x() : 1.0f,
+                                              texCoordRange.y() > 0.0f ? texCoordRange.y() : 1.0f);
+
+    QVector<QVector3D> tangents;
+    getTangents(vertices, indices, tangents);
+
+    MgPackedVertex *packed = (MgPackedVertex*)data.data();
+
+    for (int i = 0; i < vertices.size(); i++)
+    {
+        const VkVertex &vertex = vertices[i];
+
+        QVector3D position = (QVector3D(vertex.x, vertex.y, vertex.z) - quantization.positionOffset) / quantization.positionScale;
+        QVector2D texCoord = (QVector2D(vertex.u, vertex.v) - quantization.texCoordOffset) / quantization.texCoordScale;
+
+        packed[i].position[0] = (int16_t)qRound(qBound(-1.0f, position.x(), 1.0f) * 32767.0f);
+        packed[i].position[1] = (int16_t)qRound(qBound(-1.0f, position.y(), 1.0f) * 32767.0f);
+        packed[i].position[2] = (int16_t)qRound(qBound(-1.0f, position.z(), 1.0f) * 32767.0f);
+        packed[i].position[3] = 32767;
+
+        packed[i].texCoord[0] = (uint16_t)qRound(qBound(0.0f, texCoord.x(), 1.0f) * 65535.0f);
+        packed[i].texCoord[1] = (uint16_t)qRound(qBound(0.0f, texCoord.y(), 1.0f) * 65535.0f);
+
+        encodeOctahedral(QVector3D(vertex.nx, vertex.ny, vertex.nz), packed[i].normal);
+        encodeOctahedral(tangents[i], packed[i].tangent);
+    }
+}
+
+
+/**
+ * Get the matrix turning quantized positions back into mesh positions.
+ */
+QMatrix4x4 MgVertexFormat::getPositionMatrix(const MgVertexQuantization &quantization)
+{
+    QMatrix4x4 matrix;
+    matrix.translate(quantization.positionOffset);
+    matrix.scale(quantization.positionScale);
+
+    return matrix;
+}
+
+
+/**
+ * Compute smooth vertex normals from the faces around them.
+ *
+ * Face normals are weighted by their area.
+ */
+void MgVertexFormat::computeNormals(QVector<VkVertex> &vertices, const QVector<uint32_t> &indices)
+{
+    QVector<QVector3D> normals(vertices.size(), QVector3D(0.0f, 0.0f, 0.0f));
+
+    for (int i = 0; i + 2 < indices.size(); i += 3)
+    {
+        const VkVertex &v0 = vertices[indices[i]];
+        const VkVertex &v1 = vertices[indices[i + 1]];
+        const VkVertex &v2 = vertices[indices[i + 2]];
+
+        QVector3D normal = QVector3D::crossProduct(QVector3D(v1.x - v0.x, v1.y - v0.y, v1.z - v0.z),
+                                                   QVector3D(v2.x - v0.x, v2.y - v0.y, v2.z - v0.z));
+
+        for (int j = 0; j < 3; j++)
+            normals[indices[i + j]] += normal;
+    }
+
+    for (int i = 0; i < vertices.size(); i++)
+    {
+        QVector3D normal = normals[i].normalized();
+
+        vertices[i].nx = normal.x();
+        vertices[i].ny = normal.y();
+        vertices[i].nz = normal.z();
+    }
+}
+
+
+/**
+ * Compute a tangent per vertex, following the texture coordinates.
+ *
+ * Triangle tangents are summed per vertex and made perpendicular to the
+ * normal. Vertices without a usable texture mapping get any perpendicular.
+ */
+void MgVertexFormat::getTangents(const QVector<VkVertex> &vertices, const QVector<uint32_t> &indices, QVector<QVector3D> &tangents)
+{
+    tangents.fill(QVector3D(0.0f, 0.0f, 0.0f), vertices.size());
+
+    for (int i = 0; i + 2 < indices.size(); i += 3)
+    {
+        const VkVertex &v0 = vertices[indices[i]];
+        const VkVertex &v1 = vertices[indices[i + 1]];
+        const VkVertex &v2 = vertices[indices[i + 2]];
+
+        QVector3D edge1(v1.x - v0.x, v1.y - v0.y, v1.z - v0.z);
+        QVector3D edge2(v2.x - v0.x, v2.y - v0.y, v2.z - v0.z);
+
+        float du1 = v1.u - v0.u, dv1 = v1.v - v0.v;
+        float du2 = v2.u - v0.u, dv2 = v2.v - v0.v;
+
+        float determinant = du1 * dv2 - du2 * dv1;
+        if (qAbs(determinant) < 1e-12f)
+            continue;
+
+        QVector3D tangent = (edge1 * dv2 - edge2 * dv1) / determinant;
+
+        for (int j = 0; j < 3; j++)
+            tangents[indices[i + j]] += tangent;
+    }
+
+    for (int i = 0; i < vertices.size(); i++)
+    {
+        QVector3D normal(vertices[i].nx, vertices[i].ny, vertices[i].nz);
+        QVector3D tangent = tangents[i] - normal * QVector3D::dotProduct(normal, tangents[i]);
+
+        if (tangent.lengthSquared() < 1e-12f)
+        {
+            QVector3D axis = qAbs(normal.x()) < 0.9f ? QVector3D(1.0f, 0.0f, 0.0f) : QVector3D(0.0f, 1.0f, 0.0f);
+            tangent = QVector3D::crossProduct(normal, axis);
+        }
+
+        tangents[i] = tangent.normalized();
+    }
+}
+
+
+/**
+ * Encode a direction as two snorm8, by folding the octahedron onto a square.
+ */
+void MgVertexFormat::encodeOctahedral(QVector3D direction, int8_t encoded[2])
+{
+    float length = qAbs(direction.x()) + qAbs(direction.y()) + qAbs(direction.z());
+
+    if (length <= 0.0f)
+    {
+        encoded[0] = 0;
+        encoded[1] = 0;
+        return;
+    }
+
+    direction /= length;
+
+    float x = direction.x();
+    float y = direction.y();
+
+    // Fold the lower half over the diagonals.
+    if (direction.z() < 0.0f)
+    {
+        x = (1.0f - qAbs(direction.y())) * (direction.x() >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - qAbs(direction.x())) * (direction.y() >= 0.0f ? 1.0f : -1.0f);
+    }
+
+    encoded[0] = (int8_t)qRound(qBound(-1.0f, x, 1.0f) * 127.0f);
+    encoded[1] = (int8_t)qRound(qBound(-1.0f, y, 1.0f) * 127.0f);
+}
@@ -0,0 +1,94 @@
+#ifndef MGVERTEXFORMAT_H
+#define MGVERTEXFORMAT_H
+
+#include "stable.h"
+
+struct VkVertex;
+
+
+/**
+ * Layouts vertices are stored in.
+ */
+enum MgVertexFormatType
+{
+    MG_VERTEX_FORMAT_FLOAT,
+    MG_VERTEX_FORMAT_PACKED
+};
+
+/**
+ * Struct used for a vertex in the packed format, 16 bytes.
+ *
+ * Positions are snorm16 within the mesh's bounds, texture coordinates are
+ * unorm16 within the mesh's texture coordinate range, and the normal and
+ * tangent are octahedral-encoded as two snorm8 each.
+ */
+struct MgPackedVertex
+{
+    int16_t                     position[4];
+    uint16_t                    texCoord[2];
+    int8_t                      normal[2];
+    int8_t                      tangent[2];
+};
+
+/**
+ * Struct used to turn quantized positions and texture coordinates back into mesh values.
+ *
+ * The position transform is folded into the model matrix, the texture
+ * coordinate transform is part of the per-draw data.
+ */
+struct MgVertexQuantization
+{
+    QVector3D                   positionOffset =    QVector3D(0.0f, 0.0f, 0.0f);
+    QVector3D                   positionScale =     QVector3D(1.0f, 1.0f, 1.0f);
+    QVector2D                   texCoordOffset =    QVector2D(0.0f, 0.0f);
+    QVector2D                   texCoordScale =     QVector2D(1.0f, 1.0f);
+};
+
+
+/**
+ * Class used to describe and encode vertex formats.
+ *
+ * Meshes are loaded as VkVertex and encoded to the format of the geometry
+ * they are stored in; pipelines describe their vertex input from the same
+ * format.
+ */
+class MgVertexFormat
+{
+    // Functions:
+public:
+    static uint32_t getStride(
+            MgVertexFormatType  format
+            );
+    static void getAttributes(
+            MgVertexFormatType  format,
+            QVector<VkVertexInputAttributeDescription> &attributes
+            );
+
+    static void encode(
+            MgVertexFormatType  format,
+            const QVector<VkVertex> &vertices,
+            const QVector<uint32_t> &indices,
+            QByteArray          &data,
+            MgVertexQuantization &quantization
+            );
+    static QMatrix4x4 getPositionMatrix(
+            const MgVertexQuantization &quantization
+            );
+    static void computeNormals(
+            QVector<VkVertex>   &vertices,
+            const QVector<uint32_t> &indices
+            );
+
+private:
+    static void getTangents(
+            const QVector<VkVertex> &vertices,
+            const QVector<uint32_t> &indices,
+            QVector<QVector3D>  &tangents
+            );
+    static void encodeOctahedral(
+            QVector3D           direction,
+            int8_t              encoded[2]
+            );
+};
+
+#endif // MGVERTEXFORMAT_H
@@ -8,8 +8,7 @@ MgWindow::MgWindow(QWidget *parent) :
     QMainWindow(parent) ,
     ui(new Ui::MgWindow)
 {
-    // Install event filter.
-    installEventFilter(this);
+    renderThread = nullptr;
 
     // Setup main window.
     ui->setupUi(this);
@@ -28,13 +27,22 @@ MgWindow::MgWindow(QWidget *parent) :
     fpsTimer = new QTimer(this);
     connect(fpsTimer, SIGNAL(timeout()), this, SLOT(showFps()));
     fpsTimer->start(1000);
-    frameCount = 0;
 
     // Store original title.
     title = this->windowTitle();
 
-    // Include loop() in eventLoop() with lower priority().
-    QCoreApplication::postEvent(this, new QEvent(QEvent::User), -2);
+    hidden =        false;
+    skippedCount =  0;
+
+    // Initialize scene update timer.
+    updateTimer = new QTimer(this);
+    updateTimer->setTimerType(Qt::PreciseTimer);
+    connect(updateTimer, SIGNAL(timeout()), this, SLOT(tick()));
+    updateTimer->start(MG_UPDATE_INTERVAL);
+
+    // Render on a dedicated thread.
+    renderThread = new MgRenderThread(vkcInstance);
+    renderThread->start(QThread::HighPriority);
 }
 
 /**
@@ -42,55 +50,170 @@ MgWindow::MgWindow(QWidget *parent) :
  */
 MgWindow::~MgWindow()
 { 
-    removeEventFilter(this);
+    // Stop rendering before the instance goes away.
+    delete renderThread;
+    renderThread = nullptr;
 
+    delete updateTimer;
     delete fpsTimer;
 
+#ifdef QT_DEBUG
+    vkcInstance->printJobStats(new QFile("jobs.txt"));
+    vkcInstance->printGraphStats(new QFile("graph.txt"));
+    vkcInstance->printAssetStats(new QFile("assets.txt"));
+#endif
+
     delete vkcInstance;
     delete ui;
 }
 
 /**
- * Filters the events.
+ * Advance the scene and hand it to the render thread.
  */
-bool MgWindow::eventFilter(QObject *obj, QEvent *event)
+void MgWindow::tick()
 {
-    switch (event->type())
+    updateVisibility();
+
+    // Leave the scene as it is while nobody can see it.
+    if (hidden)
     {
-        /**
-         * Handle other events.
-         */
-    default:
-        return QObject::eventFilter(obj, event);
-
-        /**
-         * Handle loop reentry event.
-         */
-    case QEvent::User:
-        loop();
-        return true;
+        skippedCount++;
+        return;
     }
+
+    // Only animate when rendering continuously, otherwise frames follow changes.
+    bool continuous = renderThread->getRenderMode() == MG_RENDER_CONTINUOUS;
+
+    if (vkcInstance->update(ui->vulkanWidget->width(), ui->vulkanWidget->height(), continuous))
+        renderThread->requestFrame();
+    else
+        skippedCount++;
 }
 
+
 /**
- * Begin the render loop.
+ * Pause rendering while the window is minimized or not exposed, and throttle
+ * it while the window is in the background.
  */
-void MgWindow::loop()
+void MgWindow::updateVisibility()
 {
-    // Main render.
-    vkcInstance->render();
-    frameCount++;
+    if (renderThread == nullptr)
+        return;
+
+    QWindow *window = windowHandle();
+
+    hidden = isMinimized() || !isVisible() || (window != nullptr && !window->isExposed());
 
-    // Reenter loop() after processing all other events.
-    QCoreApplication::postEvent(this, new QEvent(QEvent::User), -2);
+    renderThread->setPaused(hidden);
+    renderThread->setThrottled(!isActiveWindow());
 }
 
+
 /**
- * Display the number of frames rendered the last second.
+ * React to the window being minimized, restored or (de)activated right away.
+ */
+void MgWindow::changeEvent(QEvent *event)
+{
+    if (event->type() == QEvent::WindowStateChange || event->type() == QEvent::ActivationChange)
+        updateVisibility();
+
+    QMainWindow::changeEvent(event);
+}
+
+/**
+ * Display the number of frames rendered the last second along with the presentation settings.
  */
 void MgWindow::showFps()
 {
-    this->setWindowTitle(title + QString("     (FPS:%1)").arg(frameCount));
+    VkcFrameStats stats;
+    vkcInstance->takeFrameStats(stats);
+
+    // Share of the last second the render thread spent sleeping.
+    double idle = renderThread->takeIdleTime() / 1e7;
+
+    this->setWindowTitle(title + QString("     (FPS:%1  %2  skipped:%3  idle:%4%  %5 x%6%7  limit:%8  latency:%9/%10 ms  triangles:%11/%12  occluded:%13)")
+                         .arg(renderThread->takeFrameCount())
+                         .arg(renderThread->getRenderMode() == MG_RENDER_CONTINUOUS ? "continuous" : "on demand")
+                         .arg(skippedCount)
+                         .arg(qMin(idle, 100.0), 0, 'f', 0)
+                         .arg(VkcSwapchain::getPresentModeName(stats.presentMode))
+                         .arg(stats.imageCount)
+                         .arg(stats.latencyMode ? "  low-latency" : "")
+                         .arg(renderThread->getFrameLimit())
+                         .arg(stats.averageLatencyMs, 0, 'f', 1)
+                         .arg(stats.maxLatencyMs, 0, 'f', 1)
+                         .arg(stats.drawnTriangles)
+                         .arg(stats.sceneTriangles)
+                         .arg(stats.occludedEntities));
+
+    skippedCount = 0;
+}
+
+/**
+ * Switch presentation settings.
+ *
+ * F1 cycles the present mode, F2 the swapchain image count, F3 toggles the
+ * latency mode, F4 cycles the frame limit and F5 switches between rendering
+ * continuously and on demand.
+ */
+void MgWindow::keyPressEvent(QKeyEvent *event)
+{
+    static const VkPresentModeKHR modes[] =
+    {
+        VK_PRESENT_MODE_FIFO_KHR,
+        VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+        VK_PRESENT_MODE_MAILBOX_KHR,
+        VK_PRESENT_MODE_IMMEDIATE_KHR
+    };
+    static const uint32_t imageCounts[] = { 0, 2, 3, 4 };
+    static const int frameLimits[] = { 0, 30, 60, 120, 144 };
+
+    VkcPresentPolicy policy = vkcInstance->getPresentPolicy();
+
+    switch (event->key())
+    {
+    case Qt::Key_F1:
+        for (int i = 0; i < 4; i++)
+            if (modes[i] == policy.mode)
+            {
+                policy.mode = modes[(i + 1) % 4];
+                break;
+            }
+        vkcInstance->setPresentPolicy(policy);
+        break;
+
+    case Qt::Key_F2:
+        for (int i = 0; i < 4; i++)
+            if (imageCounts[i] == policy.imageCount)
+            {
+                policy.imageCount = imageCounts[(i + 1) % 4];
+                break;
+            }
+        vkcInstance->setPresentPolicy(policy);
+        break;
+
+    case Qt::Key_F3:
+        vkcInstance->setLatencyMode(!vkcInstance->getLatencyMode());
+        break;
+
+    case Qt::Key_F4:
+        for (int i = 0; i < 5; i++)
+            if (frameLimits[i] == renderThread->getFrameLimit())
+            {
+                renderThread->setFrameLimit(frameLimits[(i + 1) % 5]);
+                break;
+            }
+        break;
+
+    case Qt::Key_F5:
+        renderThread->setRenderMode(renderThread->getRenderMode() == MG_RENDER_CONTINUOUS ? MG_RENDER_ON_DEMAND : MG_RENDER_CONTINUOUS);
+        break;
+
+    default:
+        QMainWindow::keyPressEvent(event);
+        return;
+    }
 
-    frameCount = 0;
+    // Show the new settings even if the scene is still.
+    renderThread->requestFrame();
 }
@@ -4,6 +4,9 @@
 #include "stable.h"
 #include "ui_mgwindow.h"
 #include "vkc_instance.h"
+#include "mgrenderthread.h"
+
+#define MG_UPDATE_INTERVAL 8
 
 
 /**
@@ -28,19 +31,31 @@ public:
     ~MgWindow();
 
 public slots:
-    void loop();
+    void tick();
     void showFps();
 
+protected:
+    void keyPressEvent(
+            QKeyEvent       *event
+            ) override;
+    void changeEvent(
+            QEvent          *event
+            ) override;
+
+private:
+    void updateVisibility();
+
 private:
     Ui::MgWindow    *ui;
     VkcInstance     *vkcInstance;
+    MgRenderThread  *renderThread;
 
+    QTimer          *updateTimer;
     QTimer          *fpsTimer;
-    int             frameCount;
     QString         title;
 
-protected:
-    bool eventFilter(QObject *obj, QEvent *event);
+    bool            hidden;
+    int             skippedCount;
 };
 
 #endif // MGWINDOW_H
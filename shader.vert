@@ -4,15 +4,33 @@ layout(location = 0) in vec3 in_Position;
 layout(location = 1) in vec2 in_TexCoord;
 layout(location = 2) in vec3 in_Normals;
 
-layout(binding = 0) uniform Uniforms
+layout(push_constant) uniform DrawConstants
 {
     mat4 mvpMatrix;
-} u;
+    vec4 color;
+    vec4 texCoordTransform;
+} pc;
+
+layout(constant_id = 3) const bool PACKED_VERTEX = false;
 
 layout(location = 0) out vec2 out_TexCoord;
+layout(location = 1) out vec4 out_Color;
+layout(location = 2) out vec3 out_Normal;
+
+// Unfold a direction encoded on the octahedron.
+vec3 decodeOctahedral(vec2 encoded)
+{
+    vec3 direction = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-direction.z, 0.0f);
+    direction.xy += vec2(direction.x >= 0.0f ? -fold : fold, direction.y >= 0.0f ? -fold : fold);
+
+    return normalize(direction);
+}
 
 void main()
 {
-    gl_Position = u.mvpMatrix * vec4(in_Position, 1.0f);
-    out_TexCoord = in_TexCoord;
+    gl_Position = pc.mvpMatrix * vec4(in_Position, 1.0f);
+    out_TexCoord = in_TexCoord * pc.texCoordTransform.xy + pc.texCoordTransform.zw;
+    out_Color = pc.color;
+    out_Normal = PACKED_VERTEX ? decodeOctahedral(in_Normals.xy) : in_Normals;
 }
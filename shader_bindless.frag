@@ -0,0 +1,37 @@
+#version 450
+
+layout(location = 0) in vec2 in_TexCoord;
+layout(location = 1) in vec4 in_Color;
+layout(location = 2) in vec3 in_Normal;
+
+layout(constant_id = 0) const bool TEXTURED = true;
+layout(constant_id = 1) const bool LIT = false;
+layout(constant_id = 2) const bool ALPHA_TEST = false;
+
+const vec3 LIGHT_DIRECTION = vec3(0.0f, 0.6f, 0.8f);
+const float ALPHA_CUTOFF = 0.5f;
+
+layout(set = 1, binding = 0) uniform sampler2D u_Textures[];
+
+layout(push_constant) uniform DrawConstants
+{
+    layout(offset = 96) uint textureIndex;
+} pc;
+
+layout(location = 0) out vec4 out_FragColor;
+
+void main()
+{
+    vec4 color = in_Color;
+
+    if (TEXTURED)
+        color *= texture(u_Textures[pc.textureIndex], in_TexCoord);
+
+    if (ALPHA_TEST && color.a < ALPHA_CUTOFF)
+        discard;
+
+    if (LIT)
+        color.rgb *= max(dot(normalize(in_Normal), LIGHT_DIRECTION), 0.0f) * 0.8f + 0.2f;
+
+    out_FragColor = color;
+}
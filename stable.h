@@ -4,17 +4,40 @@
 #include <QMainWindow>
 #include <QApplication>
 #include <QWidget>
+#include <QWindow>
 
 #include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QFileSystemWatcher>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QCryptographicHash>
 #include <QTimer>
 #include <QVector>
 #include <QImage>
 #include <QPainter>
 
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QUrl>
+
 #include <QMouseEvent>
 
 #include <QtMath>
 #include <QMatrix4x4>
+#include <QVector2D>
 #include <QVector3D>
 #include <QQuaternion>
 
@@ -0,0 +1,195 @@
+#include "vkc_bindlesstable.h"
+#include "vkc_layoutcache.h"
+
+
+/**
+ * Create the table's pool and allocate its set.
+ */
+VkcBindlessTable::VkcBindlessTable(const VkcDevice *device)
+{
+    this->device =  device;
+
+    setLayout =     VK_NULL_HANDLE;
+    set =           VK_NULL_HANDLE;
+    pool =          VK_NULL_HANDLE;
+    capacity =      device->bindlessCapacity;
+    textureCount =  0;
+    nextSlot =      0;
+
+    if (getSetLayout(device, setLayout) != VK_SUCCESS)
+        return;
+
+    VkDescriptorPoolSize poolSize =
+    {
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,      // VkDescriptorType    type;
+        capacity                                        // uint32_t            descriptorCount;
+    };
+
+    // Fill descriptor pool info, the set is written while bound.
+    VkDescriptorPoolCreateInfo descriptorPoolInfo =
+    {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,          // VkStructureType                sType;
+        nullptr,                                                // const void*                    pNext;
+        VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT,    // VkDescriptorPoolCreateFlags    flags;
+
+        1,                                                      // uint32_t                       maxSets;
+        1,                                                      // uint32_t                       poolSizeCount;
+        &poolSize                                               // const VkDescriptorPoolSize*    pPoolSizes;
+    };
+
+    // Create descriptor pool.
+    if (vkCreateDescriptorPool(device->logical, &descriptorPoolInfo, nullptr, &pool) != VK_SUCCESS)
+    {
+        pool = VK_NULL_HANDLE;
+        return;
+    }
+
+    // Fill descriptor set allocate info.
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo =
+    {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,     // VkStructureType                 sType;
+        nullptr,                                            // const void*                     pNext;
+
+        pool,                                               // VkDescriptorPool                descriptorPool;
+        1,                                                  // uint32_t                        descriptorSetCount;
+        &setLayout                                          // const VkDescriptorSetLayout*    pSetLayouts;
+    };
+
+    // Allocate descriptor set.
+    if (vkAllocateDescriptorSets(device->logical, &descriptorSetAllocateInfo, &set) != VK_SUCCESS)
+        set = VK_NULL_HANDLE;
+}
+
+
+/**
+ * Destroy the table, destroying the pool frees its set.
+ *
+ * The device must be idle.
+ */
+VkcBindlessTable::~VkcBindlessTable()
+{
+    // Run the pending slot releases while the table still exists.
+    device->deletionQueue->flush();
+
+    if (pool != VK_NULL_HANDLE)
+        vkDestroyDescriptorPool(device->logical, pool, nullptr);
+}
+
+
+/**
+ * Put a texture in a free slot and return its index.
+ *
+ * Returns UINT32_MAX if the table is full.
+ */
+uint32_t VkcBindlessTable::add(VkImageView view, VkSampler sampler, VkImageLayout layout)
+{
+    uint32_t index;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        if (!freeSlots.isEmpty())
+            index = freeSlots.takeLast();
+        else if (nextSlot < capacity)
+            index = nextSlot++;
+        else
+        {
+            qDebug() << "ERROR:   [@qDebug]              - Bindless table is full.";
+            return UINT32_MAX;
+        }
+
+        textureCount++;
+    }
+
+    // The slot is unused by pending frames, so it may be written while the set is bound.
+    write(index, view, sampler, layout);
+
+    return index;
+}
+
+
+/**
+ * Free the slot of a texture.
+ *
+ * Frames in flight may still sample it, so the slot is reused only once they
+ * have completed.
+ */
+void VkcBindlessTable::remove(uint32_t index)
+{
+    if (index >= capacity)
+        return;
+
+    device->deletionQueue->retire([this, index]()
+    {
+        QMutexLocker locker(&mutex);
+
+        freeSlots.append(index);
+        textureCount--;
+    });
+}
+
+
+/**
+ * Get the layout of the table's set, shared with the pipelines reading it.
+ */
+VkResult VkcBindlessTable::getSetLayout(const VkcDevice *device, VkDescriptorSetLayout &setLayout)
+{
+    if (!device->descriptorIndexing)
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+
+    QVector<VkDescriptorSetLayoutBinding> bindings =
+    {
+        {
+            VKC_BINDLESS_BINDING,                       // uint32_t              binding;
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,  // VkDescriptorType      descriptorType;
+            device->bindlessCapacity,                   // uint32_t              descriptorCount;
+            VK_SHADER_STAGE_ALL,                        // VkShaderStageFlags    stageFlags;
+            nullptr                                     // const VkSampler*      pImmutableSamplers;
+        }
+    };
+
+    // Unwritten slots are never read, and slots are written while the set is in use.
+    QVector<VkDescriptorBindingFlagsEXT> bindingFlags =
+    {
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+        VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT
+    };
+
+    return device->layoutCache->getSetLayout(bindings, VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT, bindingFlags, setLayout);
+}
+
+
+/**
+ * Write the descriptor of a slot.
+ */
+void VkcBindlessTable::write(uint32_t index, VkImageView view, VkSampler sampler, VkImageLayout layout)
+{
+    // Fill texture info.
+    VkDescriptorImageInfo textureInfo =
+    {
+        sampler,                // VkSampler        sampler;
+        view,                   // VkImageView      imageView;
+        layout                  // VkImageLayout    imageLayout;
+    };
+
+    // Fill write descriptor set info.
+    VkWriteDescriptorSet writeSet =
+    {
+        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,     // VkStructureType                  sType;
+        nullptr,                                    // const void*                      pNext;
+
+        set,                                        // VkDescriptorSet                  dstSet;
+        VKC_BINDLESS_BINDING,                       // uint32_t                         dstBinding;
+        index,                                      // uint32_t                         dstArrayElement;
+        1,                                          // uint32_t                         descriptorCount;
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,  // VkDescriptorType                 descriptorType;
+
+        &textureInfo,                               // const VkDescriptorImageInfo*     pImageInfo;
+        nullptr,                                    // const VkDescriptorBufferInfo*    pBufferInfo;
+        nullptr                                     // const VkBufferView*              pTexelBufferView;
+    };
+
+    // Update descriptor set.
+    vkUpdateDescriptorSets(device->logical, 1, &writeSet, 0, nullptr);
+}
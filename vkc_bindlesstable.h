@@ -0,0 +1,72 @@
+#ifndef VKC_BINDLESSTABLE_H
+#define VKC_BINDLESSTABLE_H
+
+#include "stable.h"
+#include "vkc_device.h"
+
+#define VKC_BINDLESS_BINDING 0
+#define VKC_BINDLESS_FRAG_SHADER "shader_bindless.frag.spv"
+
+
+/**
+ * Class used for a bindless texture table.
+ *
+ * All textures live in one large, partially bound array of combined image
+ * samplers, in a set that is bound once per command buffer. Materials refer
+ * to their textures by index, so draws with different textures need no
+ * descriptor binds. Slots are written after the set is bound, and freed
+ * slots are only reused once the frames in flight are done with them.
+ *
+ * Needs descriptor indexing, see VkcDevice::descriptorIndexing.
+ *
+ * Classes named "Vkc[class]" stand for "Vulkan custom class".
+ */
+class VkcBindlessTable
+{
+    // Objects:
+public:
+    VkDescriptorSetLayout           setLayout;
+    VkDescriptorSet                 set;
+    uint32_t                        capacity;
+    uint32_t                        textureCount;
+
+private:
+    VkDescriptorPool                pool;
+
+    QMutex                          mutex;
+    QVector<uint32_t>               freeSlots;
+    uint32_t                        nextSlot;
+
+    const VkcDevice                 *device;
+
+    // Functions:
+public:
+    VkcBindlessTable(
+            const VkcDevice         *device
+            );
+    ~VkcBindlessTable();
+
+    uint32_t add(
+            VkImageView             view,
+            VkSampler               sampler,
+            VkImageLayout           layout
+            );
+    void remove(
+            uint32_t                index
+            );
+
+    static VkResult getSetLayout(
+            const VkcDevice         *device,
+            VkDescriptorSetLayout   &setLayout
+            );
+
+private:
+    void write(
+            uint32_t                index,
+            VkImageView             view,
+            VkSampler               sampler,
+            VkImageLayout           layout
+            );
+};
+
+#endif // VKC_BINDLESSTABLE_H
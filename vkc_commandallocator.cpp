@@ -0,0 +1,115 @@
+#include "vkc_commandallocator.h"
+#include "mgjobsystem.h"
+
+
+/**
+ * Create the command pools.
+ */
+VkcCommandAllocator::VkcCommandAllocator(const VkcDevice *device, uint32_t familyIndex, uint32_t frameCount, uint32_t threadCount)
+{
+    this->device =      device;
+    this->threadCount = threadCount;
+
+    // Fill command pool info.
+    VkCommandPoolCreateInfo commandPoolInfo =
+    {
+        VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,         // VkStructureType             sType;
+        nullptr,                                            // const void*                 pNext;
+        VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,               // VkCommandPoolCreateFlags    flags;
+
+        familyIndex                                         // uint32_t                    queueFamilyIndex;
+    };
+
+    // Create a pool for each thread of each frame.
+    pools.resize(frameCount * threadCount);
+    for (int i = 0; i < pools.size(); i++)
+        vkCreateCommandPool(device->logical, &commandPoolInfo, nullptr, &pools[i].handle);
+}
+
+
+/**
+ * Destroy the command pools.
+ */
+VkcCommandAllocator::~VkcCommandAllocator()
+{
+    // Destroying a pool frees its command buffers.
+    while (pools.size() > 0)
+    {
+        if (pools[0].handle != VK_NULL_HANDLE)
+            vkDestroyCommandPool(device->logical, pools[0].handle, nullptr);
+
+        pools.removeFirst();
+    }
+}
+
+
+/**
+ * Reset every pool of the frame.
+ *
+ * The frame's fence must have signaled.
+ */
+void VkcCommandAllocator::reset(uint32_t frameIdx)
+{
+    for (uint32_t i = 0; i < threadCount; i++)
+    {
+        VkcCommandPool &pool = pools[frameIdx * threadCount + i];
+
+        if (pool.primaryUsed == 0 && pool.secondaryUsed == 0)
+            continue;
+
+        vkResetCommandPool(device->logical, pool.handle, 0);
+
+        pool.primaryUsed =      0;
+        pool.secondaryUsed =    0;
+    }
+}
+
+
+/**
+ * Get a command buffer from the pool of the frame and thread.
+ *
+ * Buffers are reused across frames, new ones are only allocated when a
+ * frame records more than before.
+ */
+VkCommandBuffer VkcCommandAllocator::allocate(uint32_t frameIdx, uint32_t threadIdx, VkCommandBufferLevel level)
+{
+    VkcCommandPool &pool = pools[frameIdx * threadCount + threadIdx];
+
+    bool primary = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    QVector<VkCommandBuffer> &buffers = primary ? pool.primaryBuffers : pool.secondaryBuffers;
+    int &used = primary ? pool.primaryUsed : pool.secondaryUsed;
+
+    if (used == buffers.size())
+    {
+        // Fill command buffer allocation info.
+        VkCommandBufferAllocateInfo commandBufferAllocateInfo =
+        {
+            VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,     // VkStructureType         sType;
+            nullptr,                                            // const void*             pNext;
+
+            pool.handle,                                        // VkCommandPool           commandPool;
+            level,                                              // VkCommandBufferLevel    level;
+            1                                                   // uint32_t                commandBufferCount;
+        };
+
+        // Allocate command buffer.
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device->logical, &commandBufferAllocateInfo, &commandBuffer) != VK_SUCCESS)
+            return VK_NULL_HANDLE;
+
+        buffers.append(commandBuffer);
+    }
+
+    return buffers[used++];
+}
+
+
+/**
+ * Get the pool index of the calling thread.
+ *
+ * Index 0 belongs to the render thread, job system workers follow it.
+ */
+uint32_t VkcCommandAllocator::currentThread()
+{
+    return (uint32_t)(MgJobSystem::currentWorker() + 1);
+}
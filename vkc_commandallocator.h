@@ -0,0 +1,62 @@
+#ifndef VKC_COMMANDALLOCATOR_H
+#define VKC_COMMANDALLOCATOR_H
+
+#include "stable.h"
+#include "vkc_device.h"
+
+
+/**
+ * Struct used for a transient command pool and the buffers allocated from it.
+ */
+struct VkcCommandPool
+{
+    VkCommandPool               handle =            VK_NULL_HANDLE;
+
+    QVector<VkCommandBuffer>    primaryBuffers =    {};
+    QVector<VkCommandBuffer>    secondaryBuffers =  {};
+    int                         primaryUsed =       0;
+    int                         secondaryUsed =     0;
+};
+
+
+/**
+ * Class used for allocating per-frame, per-thread command buffers.
+ *
+ * Every frame in flight owns one transient pool per recording thread. Buffers
+ * are never reset one by one: the whole pool is reset once the frame's fence
+ * has signaled and its buffers are handed out again.
+ *
+ * Classes named "Vkc[class]" stand for "Vulkan custom class".
+ */
+class VkcCommandAllocator
+{
+    // Objects:
+private:
+    QVector<VkcCommandPool>     pools;
+    uint32_t                    threadCount;
+
+    const VkcDevice             *device;
+
+    // Functions:
+public:
+    VkcCommandAllocator(
+            const VkcDevice     *device,
+            uint32_t            familyIndex,
+            uint32_t            frameCount,
+            uint32_t            threadCount
+            );
+    ~VkcCommandAllocator();
+
+    void reset(
+            uint32_t            frameIdx
+            );
+    VkCommandBuffer allocate(
+            uint32_t            frameIdx,
+            uint32_t            threadIdx,
+            VkCommandBufferLevel level
+            );
+
+    static uint32_t currentThread();
+};
+
+#endif // VKC_COMMANDALLOCATOR_H
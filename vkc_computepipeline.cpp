@@ -0,0 +1,187 @@
+#include "vkc_computepipeline.h"
+#include "vkc_pipeline.h"
+#include "vkc_pipelinecache.h"
+#include "vkc_layoutcache.h"
+
+
+/**
+ * Load, reflect and create the compute pipeline.
+ *
+ * On failure the handle stays null and isReady() returns false.
+ */
+VkcComputePipeline::VkcComputePipeline(const QString &shaderName, const VkcDevice *device)
+{
+    handle =    VK_NULL_HANDLE;
+    layout =    VK_NULL_HANDLE;
+    shader =    VK_NULL_HANDLE;
+
+    this->shaderName =  shaderName;
+    this->device =      device;
+
+    if (create() != VK_SUCCESS)
+        handle = VK_NULL_HANDLE;
+}
+
+
+/**
+ * Destroy the compute pipeline, the layouts belong to the device's layout cache.
+ */
+VkcComputePipeline::~VkcComputePipeline()
+{
+    VkcDeletionQueue *deletionQueue = device->deletionQueue;
+
+    deletionQueue->retire(VKC_DELETION_PIPELINE, (uint64_t)handle);
+    deletionQueue->retire(VKC_DELETION_SHADER_MODULE, (uint64_t)shader);
+}
+
+
+/**
+ * Check if the pipeline can be bound.
+ */
+bool VkcComputePipeline::isReady() const
+{
+    return handle != VK_NULL_HANDLE;
+}
+
+
+/**
+ * Get the binding number of a resource, by variable or block name.
+ */
+uint32_t VkcComputePipeline::getBinding(const QByteArray &name) const
+{
+    const VkcShaderBinding *binding = reflection.findBinding(name);
+
+    return binding != nullptr ? binding->binding : UINT32_MAX;
+}
+
+
+/**
+ * Get the file name of the shader.
+ */
+const QString& VkcComputePipeline::getShaderName() const
+{
+    return shaderName;
+}
+
+
+/**
+ * Create the shader module, layouts and pipeline.
+ */
+VkResult VkcComputePipeline::create()
+{
+    QByteArray code;
+
+    if (!VkcPipeline::loadShader(shaderName, code))
+        return VK_ERROR_INITIALIZATION_FAILED;
+
+    if (!reflection.parse(code, VK_SHADER_STAGE_COMPUTE_BIT))
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Shader" << shaderName << "is not valid SPIR-V.";
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    mgAssert(createLayouts());
+
+    // Fill shader module info.
+    VkShaderModuleCreateInfo shaderInfo =
+    {
+        VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,    // VkStructureType              sType;
+        nullptr,                                        // const void*                  pNext;
+        0,                                              // VkShaderModuleCreateFlags    flags;
+
+        (size_t)code.size(),                            // size_t                       codeSize;
+        (const uint32_t*)code.constData()               // const uint32_t*              pCode;
+    };
+
+    // Create shader module.
+    mgAssert(vkCreateShaderModule(device->logical, &shaderInfo, nullptr, &shader));
+
+    // Fill compute pipeline info.
+    VkComputePipelineCreateInfo pipelineInfo =
+    {
+        VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,             // VkStructureType                    sType;
+        nullptr,                                                    // const void*                        pNext;
+        0,                                                          // VkPipelineCreateFlags              flags;
+
+        {
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,    // VkStructureType                    sType;
+            nullptr,                                                // const void*                        pNext;
+            0,                                                      // VkPipelineShaderStageCreateFlags   flags;
+            VK_SHADER_STAGE_COMPUTE_BIT,                            // VkShaderStageFlagBits              stage;
+            shader,                                                 // VkShaderModule                     module;
+            "main",                                                 // const char*                        pName;
+            nullptr                                                 // const VkSpecializationInfo*        pSpecializationInfo;
+        },                                                          // VkPipelineShaderStageCreateInfo    stage;
+
+        layout,                                                     // VkPipelineLayout                   layout;
+        VK_NULL_HANDLE,                                             // VkPipeline                         basePipelineHandle;
+        0                                                           // int32_t                            basePipelineIndex;
+    };
+
+    // Create compute pipeline.
+    mgAssert(vkCreateComputePipelines(device->logical, device->pipelineCache->handle, 1, &pipelineInfo, nullptr, &handle));
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Get the descriptor set and pipeline layouts matching the reflected bindings.
+ */
+VkResult VkcComputePipeline::createLayouts()
+{
+    // Gather the bindings of every set, sorted so equal sets hash equally.
+    uint32_t setCount = 1;
+    for (int i = 0; i < reflection.bindings.size(); i++)
+        setCount = qMax(setCount, reflection.bindings[i].set + 1);
+
+    QVector<QVector<VkDescriptorSetLayoutBinding>> setBindings(setCount);
+
+    for (int i = 0; i < reflection.bindings.size(); i++)
+    {
+        const VkcShaderBinding &binding = reflection.bindings[i];
+
+        VkDescriptorSetLayoutBinding setBinding =
+        {
+            binding.binding,                            // uint32_t              binding;
+            binding.type,                               // VkDescriptorType      descriptorType;
+            binding.count,                              // uint32_t              descriptorCount;
+            binding.stages,                             // VkShaderStageFlags    stageFlags;
+            nullptr                                     // const VkSampler*      pImmutableSamplers;
+        };
+
+        QVector<VkDescriptorSetLayoutBinding> &bindings = setBindings[binding.set];
+
+        int j = 0;
+        while (j < bindings.size() && bindings[j].binding < setBinding.binding)
+            j++;
+
+        bindings.insert(j, setBinding);
+    }
+
+    // Get the set layouts.
+    setLayouts.resize(setCount);
+
+    for (uint32_t i = 0; i < setCount; i++)
+        mgAssert(device->layoutCache->getSetLayout(setBindings[i], 0, {}, setLayouts[i]));
+
+    // Fill push constant range info.
+    QVector<VkPushConstantRange> pushConstantRanges;
+
+    if (reflection.pushConstantSize > 0)
+    {
+        VkPushConstantRange pushConstantRange =
+        {
+            VK_SHADER_STAGE_COMPUTE_BIT,                    // VkShaderStageFlags    stageFlags;
+            0,                                              // uint32_t              offset;
+            reflection.pushConstantSize                     // uint32_t              size;
+        };
+
+        pushConstantRanges.append(pushConstantRange);
+    }
+
+    // Get the pipeline layout.
+    mgAssert(device->layoutCache->getPipelineLayout(setLayouts, pushConstantRanges, layout));
+
+    return VK_SUCCESS;
+}
@@ -0,0 +1,54 @@
+#ifndef VKC_COMPUTEPIPELINE_H
+#define VKC_COMPUTEPIPELINE_H
+
+#include "stable.h"
+#include "vkc_device.h"
+#include "vkc_shaderreflection.h"
+
+
+/**
+ * Class used for a compute pipeline.
+ *
+ * The shader is loaded and reflected, the layouts taken from the device's
+ * layout cache and the pipeline created through the device's pipeline
+ * cache, all on the calling thread. Compute pipelines are few and have no
+ * variants, so they are not shared.
+ *
+ * Classes named "Vkc[class]" stand for "Vulkan custom class".
+ */
+class VkcComputePipeline
+{
+    // Objects:
+public:
+    VkPipeline                      handle;
+    VkPipelineLayout                layout;
+    VkShaderModule                  shader;
+
+    QVector<VkDescriptorSetLayout>  setLayouts;
+    VkcShaderReflection             reflection;
+
+private:
+    QString                         shaderName;
+
+    const VkcDevice                 *device;
+
+    // Functions:
+public:
+    VkcComputePipeline(
+            const QString           &shaderName,
+            const VkcDevice         *device
+            );
+    ~VkcComputePipeline();
+
+    bool isReady() const;
+    uint32_t getBinding(
+            const QByteArray        &name
+            ) const;
+    const QString& getShaderName() const;
+
+private:
+    VkResult create();
+    VkResult createLayouts();
+};
+
+#endif // VKC_COMPUTEPIPELINE_H
@@ -8,6 +8,12 @@ VkcContext::VkcContext()
 {
     surface =       VK_NULL_HANDLE;
     instance =      VK_NULL_HANDLE;
+
+    swapchain =     nullptr;
+    pipeline =      nullptr;
+    graph =         nullptr;
+    backbuffer =    -1;
+    depthBuffer =   -1;
 }
 
 
@@ -22,8 +28,8 @@ VkcContext::VkcContext(uint32_t id, const VkcDevice *device, const VkInstance in
     createSurface(id);
     getCommandChains();
 
-    swapchain = new VkcSwapchain(surface, device);
-    pipeline = new VkcPipeline(swapchain, device);
+    swapchain = new VkcSwapchain(surface, device, presentPolicy);
+    createGraph();
 }
 
 
@@ -32,12 +38,17 @@ VkcContext::VkcContext(uint32_t id, const VkcDevice *device, const VkInstance in
  */
 VkcContext::~VkcContext()
 {
-    if (pipeline != nullptr)
-        delete pipeline;
+    unsetupRender();
+
+    if (graph != nullptr)
+        delete graph;
 
     if (swapchain != nullptr)
         delete swapchain;
 
+    // The swapchain must be gone before its surface.
+    device->deletionQueue->flush();
+
     if (surface != VK_NULL_HANDLE)
         vkDestroySurfaceKHR(instance, surface, nullptr);
 }
@@ -84,18 +95,83 @@ void VkcContext::getCommandChains()
 
 
 /**
- * Resize the swapchain.
+ * Create the render graph and import the swapchain images into it.
+ *
+ * Passes are added by the owner of the context, before setupRender().
  */
-void VkcContext::resize()
+void VkcContext::createGraph()
 {
-    if (swapchain != nullptr)
+    graph = new VkcRenderGraph(device);
+
+    // The acquired image is swapped in every frame, its old contents never matter.
+    backbuffer = graph->importImage("backbuffer", swapchain->colorImages[0], false);
+    graph->setClearValue(backbuffer, {0.8f, 0.8f, 1.0f, 1.0f});
+    graph->setOutput(backbuffer, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+    depthBuffer = graph->importImage("depth", &swapchain->depthStencilImage, false);
+    graph->setClearValue(depthBuffer, {0.0f, 0});
+}
+
+
+/**
+ * Compile the render graph and get the pipeline for one of its passes.
+ *
+ * The pipeline compiles in the background, its layouts can be used right
+ * away.
+ */
+VkResult VkcContext::setupRender(int pass)
+{
+    mgAssert(graph->compile(swapchain->extent));
+
+    // Describe the pipeline, drawing in the render pass of the pass.
+    VkcPipelineInfo pipelineInfo;
+    graph->getRenderPass(pass, pipelineInfo.renderPass, pipelineInfo.subpass);
+
+    // Read textures from the bindless table if the device supports one.
+    if (device->descriptorIndexing)
+        pipelineInfo.fragShader = VKC_BINDLESS_FRAG_SHADER;
+
+    pipeline = device->pipelineCache->acquireAsync(pipelineInfo);
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Release the pipeline.
+ */
+void VkcContext::unsetupRender()
+{
+    if (pipeline != nullptr)
     {
-        // Destroy swapchain.
-        VkRenderPass oldRenderPass = swapchain->renderPass;
-        swapchain->renderPass = VK_NULL_HANDLE;
-        delete swapchain;
+        device->pipelineCache->release(pipeline);
+        pipeline = nullptr;
+    }
+}
+
 
-        // Recreate swapchain using old render pass.
-        swapchain = new VkcSwapchain(oldRenderPass, surface, device);
+/**
+ * Resize the swapchain, also applying the present policy.
+ *
+ * The old swapchain is handed to the new one for recycling and destroyed once
+ * the frames in flight are done with it, so the device is never stalled. The
+ * render passes of the graph keep their description, so the pipeline stays
+ * compatible with them.
+ */
+VkResult VkcContext::resize()
+{
+    if (swapchain != nullptr)
+    {
+        // Recreate swapchain, the old one retires its objects.
+        VkcSwapchain *oldSwapchain = swapchain;
+        swapchain = new VkcSwapchain(surface, device, presentPolicy, oldSwapchain->handle);
+        delete oldSwapchain;
+
+        // Rebuild the graph around the new images.
+        graph->setImage(backbuffer, swapchain->colorImages[0]);
+        graph->setImage(depthBuffer, &swapchain->depthStencilImage);
+        mgAssert(graph->compile(swapchain->extent));
     }
+
+    return VK_SUCCESS;
 }
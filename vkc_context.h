@@ -5,7 +5,8 @@
 #include "vkc_device.h"
 #include "mgimage.h"
 #include "vkc_swapchain.h"
-#include "vkc_pipeline.h"
+#include "vkc_pipelinecache.h"
+#include "vkc_rendergraph.h"
 
 
 struct VkcCommandChain
@@ -26,8 +27,13 @@ class VkcContext
 public:
     VkSurfaceKHR                surface;
     VkcSwapchain                *swapchain;
+    VkcPresentPolicy            presentPolicy;
     VkcPipeline                 *pipeline;
 
+    VkcRenderGraph              *graph;
+    int                         backbuffer;
+    int                         depthBuffer;
+
     QVector<VkcCommandChain>    commandChain;
 
     const VkcDevice             *device;
@@ -48,11 +54,14 @@ public:
 private:
     void createSurface(uint64_t id);
     void getCommandChains();
+    void createGraph();
 
 public:
-    void setupRender();
+    VkResult setupRender(
+            int                 pass
+            );
     void unsetupRender();
-    void resize();
+    VkResult resize();
 };
 
 #endif // VKC_CONTEXT_H
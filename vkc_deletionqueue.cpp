@@ -0,0 +1,178 @@
+#include "vkc_deletionqueue.h"
+
+
+/**
+ * Create an empty queue.
+ */
+VkcDeletionQueue::VkcDeletionQueue(VkDevice logical)
+{
+    this->logical =     logical;
+
+    budget =            VKC_DELETION_BUDGET;
+    destroyedCount =    0;
+    currentFrame =      0;
+}
+
+
+/**
+ * Destroy everything still queued.
+ *
+ * The device must be idle.
+ */
+VkcDeletionQueue::~VkcDeletionQueue()
+{
+    flush();
+}
+
+
+/**
+ * Queue the destruction of an object the frame being recorded may still use.
+ *
+ * Null handles are ignored. May be called from any thread.
+ */
+void VkcDeletionQueue::retire(VkcDeletionType type, uint64_t handle)
+{
+    if (handle == 0)
+        return;
+
+    VkcDeletion deletion;
+    deletion.type =     type;
+    deletion.handle =   handle;
+
+    push(deletion);
+}
+
+
+/**
+ * Queue a function destroying objects the frame being recorded may still use.
+ *
+ * May be called from any thread.
+ */
+void VkcDeletionQueue::retire(std::function<void()> destroy)
+{
+    VkcDeletion deletion;
+    deletion.type =     VKC_DELETION_FUNCTION;
+    deletion.destroy =  destroy;
+
+    push(deletion);
+}
+
+
+/**
+ * Destroy the objects of completed frames, within the budget, and start a new frame.
+ *
+ * Called at the beginning of a frame, once the fence of the oldest frame in
+ * flight has signaled.
+ */
+void VkcDeletionQueue::collect(uint64_t frame, uint64_t completedFrames)
+{
+    QList<VkcDeletion> ready;
+
+    mutex.lock();
+    currentFrame = frame;
+
+    // Deletions are queued in frame order, whatever is left waits for the next frame.
+    while (deletions.size() > 0 && deletions.first().frame < completedFrames && (uint32_t)ready.size() < budget)
+        ready.append(deletions.takeFirst());
+
+    mutex.unlock();
+
+    for (int i = 0; i < ready.size(); i++)
+        destroy(ready[i]);
+}
+
+
+/**
+ * Destroy every queued object, ignoring the budget.
+ *
+ * The device must be idle.
+ */
+void VkcDeletionQueue::flush()
+{
+    QList<VkcDeletion> ready;
+
+    mutex.lock();
+    ready.swap(deletions);
+    mutex.unlock();
+
+    for (int i = 0; i < ready.size(); i++)
+        destroy(ready[i]);
+}
+
+
+/**
+ * Get the number of objects waiting to be destroyed.
+ */
+int VkcDeletionQueue::pendingCount()
+{
+    QMutexLocker locker(&mutex);
+
+    return deletions.size();
+}
+
+
+/**
+ * Tag a deletion with the current frame and queue it.
+ */
+void VkcDeletionQueue::push(VkcDeletion &deletion)
+{
+    QMutexLocker locker(&mutex);
+
+    deletion.frame = currentFrame;
+    deletions.append(deletion);
+}
+
+
+/**
+ * Destroy a single object.
+ */
+void VkcDeletionQueue::destroy(const VkcDeletion &deletion)
+{
+    switch (deletion.type)
+    {
+    case VKC_DELETION_BUFFER:
+        vkDestroyBuffer(logical, (VkBuffer)deletion.handle, nullptr);
+        break;
+    case VKC_DELETION_IMAGE:
+        vkDestroyImage(logical, (VkImage)deletion.handle, nullptr);
+        break;
+    case VKC_DELETION_IMAGE_VIEW:
+        vkDestroyImageView(logical, (VkImageView)deletion.handle, nullptr);
+        break;
+    case VKC_DELETION_SAMPLER:
+        vkDestroySampler(logical, (VkSampler)deletion.handle, nullptr);
+        break;
+    case VKC_DELETION_MEMORY:
+        vkFreeMemory(logical, (VkDeviceMemory)deletion.handle, nullptr);
+        break;
+    case VKC_DELETION_FRAMEBUFFER:
+        vkDestroyFramebuffer(logical, (VkFramebuffer)deletion.handle, nullptr);
+        break;
+    case VKC_DELETION_RENDER_PASS:
+        vkDestroyRenderPass(logical, (VkRenderPass)deletion.handle, nullptr);
+        break;
+    case VKC_DELETION_PIPELINE:
+        vkDestroyPipeline(logical, (VkPipeline)deletion.handle, nullptr);
+        break;
+    case VKC_DELETION_PIPELINE_LAYOUT:
+        vkDestroyPipelineLayout(logical, (VkPipelineLayout)deletion.handle, nullptr);
+        break;
+    case VKC_DELETION_DESCRIPTOR_SET_LAYOUT:
+        vkDestroyDescriptorSetLayout(logical, (VkDescriptorSetLayout)deletion.handle, nullptr);
+        break;
+    case VKC_DELETION_DESCRIPTOR_POOL:
+        vkDestroyDescriptorPool(logical, (VkDescriptorPool)deletion.handle, nullptr);
+        break;
+    case VKC_DELETION_SHADER_MODULE:
+        vkDestroyShaderModule(logical, (VkShaderModule)deletion.handle, nullptr);
+        break;
+    case VKC_DELETION_SWAPCHAIN:
+        vkDestroySwapchainKHR(logical, (VkSwapchainKHR)deletion.handle, nullptr);
+        break;
+    case VKC_DELETION_FUNCTION:
+        deletion.destroy();
+        break;
+    }
+
+    destroyedCount++;
+}
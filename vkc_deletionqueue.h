@@ -0,0 +1,101 @@
+#ifndef VKC_DELETIONQUEUE_H
+#define VKC_DELETIONQUEUE_H
+
+#include "stable.h"
+
+#include <functional>
+
+#define VKC_DELETION_BUDGET 64
+
+
+/**
+ * Kinds of objects the deletion queue can destroy.
+ */
+enum VkcDeletionType
+{
+    VKC_DELETION_BUFFER,
+    VKC_DELETION_IMAGE,
+    VKC_DELETION_IMAGE_VIEW,
+    VKC_DELETION_SAMPLER,
+    VKC_DELETION_MEMORY,
+    VKC_DELETION_FRAMEBUFFER,
+    VKC_DELETION_RENDER_PASS,
+    VKC_DELETION_PIPELINE,
+    VKC_DELETION_PIPELINE_LAYOUT,
+    VKC_DELETION_DESCRIPTOR_SET_LAYOUT,
+    VKC_DELETION_DESCRIPTOR_POOL,
+    VKC_DELETION_SHADER_MODULE,
+    VKC_DELETION_SWAPCHAIN,
+    VKC_DELETION_FUNCTION
+};
+
+/**
+ * Struct used for an object waiting to be destroyed.
+ */
+struct VkcDeletion
+{
+    VkcDeletionType                 type =          VKC_DELETION_FUNCTION;
+    uint64_t                        handle =        0;
+    std::function<void()>           destroy =       nullptr;
+
+    uint64_t                        frame =         0;
+};
+
+
+/**
+ * Class used to destroy objects once the GPU no longer uses them.
+ *
+ * Objects retired while frame N is recorded are destroyed once N + 1 frames
+ * have completed, i.e. once the fence of frame N has signaled. At most a
+ * budget of objects is destroyed per frame, so releasing a large scene does
+ * not cause a hitch.
+ *
+ * Classes named "Vkc[class]" stand for "Vulkan custom class".
+ */
+class VkcDeletionQueue
+{
+    // Objects:
+public:
+    uint32_t                        budget;
+    quint64                         destroyedCount;
+
+private:
+    QList<VkcDeletion>              deletions;
+    QMutex                          mutex;
+
+    uint64_t                        currentFrame;
+
+    VkDevice                        logical;
+
+    // Functions:
+public:
+    VkcDeletionQueue(
+            VkDevice                logical
+            );
+    ~VkcDeletionQueue();
+
+    void retire(
+            VkcDeletionType         type,
+            uint64_t                handle
+            );
+    void retire(
+            std::function<void()>   destroy
+            );
+    void collect(
+            uint64_t                frame,
+            uint64_t                completedFrames
+            );
+    void flush();
+
+    int pendingCount();
+
+private:
+    void push(
+            VkcDeletion             &deletion
+            );
+    void destroy(
+            const VkcDeletion       &deletion
+            );
+};
+
+#endif // VKC_DELETIONQUEUE_H
@@ -0,0 +1,528 @@
+#include "vkc_descriptorallocator.h"
+#include "vkc_layoutcache.h"
+
+
+/**
+ * Create the allocator and load the update template functions, if enabled.
+ */
+VkcDescriptorAllocator::VkcDescriptorAllocator(const VkcDevice *device, uint32_t frameCount)
+{
+    this->device =      device;
+    poolCount =         0;
+    cachedSetCount =    0;
+
+    pfnCreateUpdateTemplate =   nullptr;
+    pfnDestroyUpdateTemplate =  nullptr;
+    pfnUpdateWithTemplate =     nullptr;
+
+    if (device->hasExtension(VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME))
+    {
+        pfnCreateUpdateTemplate =   (PFN_vkCreateDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(device->logical, "vkCreateDescriptorUpdateTemplateKHR");
+        pfnDestroyUpdateTemplate =  (PFN_vkDestroyDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(device->logical, "vkDestroyDescriptorUpdateTemplateKHR");
+        pfnUpdateWithTemplate =     (PFN_vkUpdateDescriptorSetWithTemplateKHR)vkGetDeviceProcAddr(device->logical, "vkUpdateDescriptorSetWithTemplateKHR");
+    }
+
+    // Without every function fall back to plain writes.
+    if (pfnCreateUpdateTemplate == nullptr || pfnDestroyUpdateTemplate == nullptr || pfnUpdateWithTemplate == nullptr)
+        pfnCreateUpdateTemplate = nullptr;
+
+    frames.resize(frameCount);
+}
+
+
+/**
+ * Destroy all pools and update templates.
+ *
+ * Called once the device no longer uses any of the sets.
+ */
+VkcDescriptorAllocator::~VkcDescriptorAllocator()
+{
+    for (auto it = layouts.begin(); it != layouts.end(); ++it)
+    {
+        VkcDescriptorLayout &layout = it.value();
+
+        if (layout.updateTemplate != VK_NULL_HANDLE)
+            pfnDestroyUpdateTemplate(device->logical, layout.updateTemplate, nullptr);
+
+        for (int i = 0; i < layout.pools.size(); i++)
+            vkDestroyDescriptorPool(device->logical, layout.pools[i], nullptr);
+    }
+
+    for (int i = 0; i < frames.size(); i++)
+        for (int j = 0; j < frames[i].pools.size(); j++)
+            vkDestroyDescriptorPool(device->logical, frames[i].pools[j], nullptr);
+}
+
+
+/**
+ * Reset the transient pools of the frame, freeing all of its sets at once.
+ *
+ * The frame's fence must have signaled.
+ */
+void VkcDescriptorAllocator::reset(uint32_t frameIdx)
+{
+    QMutexLocker locker(&mutex);
+
+    VkcDescriptorFrame &frame = frames[frameIdx];
+
+    for (int i = 0; i <= frame.current && i < frame.pools.size(); i++)
+        vkResetDescriptorPool(device->logical, frame.pools[i], 0);
+
+    frame.current = 0;
+}
+
+
+/**
+ * Allocate a set that lives as long as the allocator.
+ */
+VkResult VkcDescriptorAllocator::allocate(VkDescriptorSetLayout setLayout, VkDescriptorSet &set)
+{
+    QMutexLocker locker(&mutex);
+
+    VkcDescriptorLayout *layout = getLayout(setLayout);
+
+    if (layout == nullptr)
+        return VK_ERROR_INITIALIZATION_FAILED;
+
+    return allocatePersistent(*layout, setLayout, set);
+}
+
+
+/**
+ * Allocate a set that is freed when the frame is reset.
+ */
+VkResult VkcDescriptorAllocator::allocateTransient(uint32_t frameIdx, VkDescriptorSetLayout setLayout, VkDescriptorSet &set)
+{
+    QMutexLocker locker(&mutex);
+
+    VkcDescriptorFrame &frame = frames[frameIdx];
+
+    // Try the current pool, then move on to the next one.
+    while (true)
+    {
+        if (frame.current == frame.pools.size())
+        {
+            // Size the pool for the descriptors a typical set uses.
+            QVector<VkDescriptorPoolSize> poolSizes =
+            {
+                {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,           VKC_TRANSIENT_POOL_SETS},
+                {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,   VKC_TRANSIENT_POOL_SETS},
+                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,           VKC_TRANSIENT_POOL_SETS},
+                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,   VKC_TRANSIENT_POOL_SETS},
+                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,   VKC_TRANSIENT_POOL_SETS * 4},
+                {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,            VKC_TRANSIENT_POOL_SETS * 2},
+                {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,            VKC_TRANSIENT_POOL_SETS},
+                {VK_DESCRIPTOR_TYPE_SAMPLER,                  VKC_TRANSIENT_POOL_SETS}
+            };
+
+            VkDescriptorPool pool;
+            mgAssert(createPool(VKC_TRANSIENT_POOL_SETS, poolSizes, pool));
+
+            frame.pools.append(pool);
+
+            // A fresh pool that cannot hold the set never will.
+            VkResult result = allocateSet(pool, setLayout, set);
+
+            if (result != VK_SUCCESS)
+                qDebug() << "ERROR:   [@qDebug]              - Descriptor set does not fit in a transient pool.";
+
+            return result;
+        }
+
+        if (allocateSet(frame.pools[frame.current], setLayout, set) == VK_SUCCESS)
+            return VK_SUCCESS;
+
+        frame.current++;
+    }
+}
+
+
+/**
+ * Get a set holding the given descriptors, which must never be updated.
+ *
+ * Equal descriptors for the same layout give the same set, so materials
+ * sharing textures and buffers share their set.
+ */
+VkResult VkcDescriptorAllocator::getSet(VkDescriptorSetLayout setLayout, const QVector<VkcDescriptorData> &data, VkDescriptorSet &set)
+{
+    QMutexLocker locker(&mutex);
+
+    VkcDescriptorLayout *layout = getLayout(setLayout);
+
+    if (layout == nullptr || (uint32_t)data.size() < layout->dataSize)
+        return VK_ERROR_INITIALIZATION_FAILED;
+
+    QByteArray key = getKey(*layout, setLayout, data);
+
+    auto it = cachedSets.constFind(key);
+    if (it != cachedSets.constEnd())
+    {
+        set = it.value();
+        return VK_SUCCESS;
+    }
+
+    // Create and write the set once.
+    mgAssert(allocatePersistent(*layout, setLayout, set));
+    write(*layout, set, data);
+
+    cachedSets.insert(key, set);
+    cachedSetCount++;
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Write all descriptors of a set.
+ *
+ * The set must not be in use by a pending command buffer.
+ */
+void VkcDescriptorAllocator::update(VkDescriptorSet set, VkDescriptorSetLayout setLayout, const QVector<VkcDescriptorData> &data)
+{
+    mutex.lock();
+
+    VkcDescriptorLayout *layoutPtr = getLayout(setLayout);
+
+    if (layoutPtr == nullptr || (uint32_t)data.size() < layoutPtr->dataSize)
+    {
+        mutex.unlock();
+        qDebug() << "ERROR:   [@qDebug]              - Descriptor data does not match the set layout.";
+        return;
+    }
+
+    // Copy the layout, so the set is written without holding the lock.
+    VkcDescriptorLayout layout = *layoutPtr;
+
+    mutex.unlock();
+
+    write(layout, set, data);
+}
+
+
+/**
+ * Create the descriptor array for a layout, with every descriptor empty.
+ */
+void VkcDescriptorAllocator::createData(VkDescriptorSetLayout setLayout, QVector<VkcDescriptorData> &data)
+{
+    QMutexLocker locker(&mutex);
+
+    VkcDescriptorLayout *layout = getLayout(setLayout);
+
+    data.resize(layout != nullptr ? layout->dataSize : 0);
+    memset(data.data(), 0, data.size() * sizeof(VkcDescriptorData));
+}
+
+
+/**
+ * Get where the descriptors of a binding start in the descriptor array.
+ *
+ * Returns -1 if the layout has no such binding.
+ */
+int VkcDescriptorAllocator::getDataIndex(VkDescriptorSetLayout setLayout, uint32_t binding)
+{
+    QMutexLocker locker(&mutex);
+
+    VkcDescriptorLayout *layout = getLayout(setLayout);
+
+    if (layout == nullptr)
+        return -1;
+
+    for (int i = 0; i < layout->bindings.size(); i++)
+        if (layout->bindings[i].binding == binding)
+            return layout->dataOffsets[i];
+
+    return -1;
+}
+
+
+/**
+ * Get the pools and update template of a layout, creating them the first time.
+ *
+ * The mutex must be held.
+ */
+VkcDescriptorLayout* VkcDescriptorAllocator::getLayout(VkDescriptorSetLayout setLayout)
+{
+    auto it = layouts.find((uint64_t)setLayout);
+    if (it != layouts.end())
+        return &it.value();
+
+    VkcDescriptorLayout layout;
+
+    // Only layouts made by the layout cache are known.
+    if (!device->layoutCache->getBindings(setLayout, layout.bindings))
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Descriptor set layout is not from the layout cache.";
+        return nullptr;
+    }
+
+    // Place the descriptors of each binding one after the other.
+    for (int i = 0; i < layout.bindings.size(); i++)
+    {
+        const VkDescriptorSetLayoutBinding &binding = layout.bindings[i];
+
+        layout.dataOffsets.append(layout.dataSize);
+
+        if (binding.descriptorCount == 0)
+            continue;
+
+        // Fill update template entry.
+        VkDescriptorUpdateTemplateEntryKHR entry =
+        {
+            binding.binding,                                        // uint32_t            dstBinding;
+            0,                                                      // uint32_t            dstArrayElement;
+            binding.descriptorCount,                                // uint32_t            descriptorCount;
+            binding.descriptorType,                                 // VkDescriptorType    descriptorType;
+            layout.dataSize * sizeof(VkcDescriptorData),            // size_t              offset;
+            sizeof(VkcDescriptorData)                               // size_t              stride;
+        };
+
+        layout.entries.append(entry);
+        layout.dataSize += binding.descriptorCount;
+    }
+
+    if (pfnCreateUpdateTemplate != nullptr && !layout.entries.isEmpty())
+    {
+        // Fill descriptor update template info.
+        VkDescriptorUpdateTemplateCreateInfoKHR templateInfo =
+        {
+            VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR,   // VkStructureType                           sType;
+            nullptr,                                                        // const void*                               pNext;
+            0,                                                              // VkDescriptorUpdateTemplateCreateFlags     flags;
+
+            (uint32_t)layout.entries.size(),                                // uint32_t                                  descriptorUpdateEntryCount;
+            layout.entries.constData(),                                     // const VkDescriptorUpdateTemplateEntry*    pDescriptorUpdateEntries;
+
+            VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR,          // VkDescriptorUpdateTemplateType            templateType;
+            setLayout,                                                      // VkDescriptorSetLayout                     descriptorSetLayout;
+
+            VK_PIPELINE_BIND_POINT_GRAPHICS,                                // VkPipelineBindPoint                       pipelineBindPoint;
+            VK_NULL_HANDLE,                                                 // VkPipelineLayout                          pipelineLayout;
+            0                                                               // uint32_t                                  set;
+        };
+
+        // Create update template, sets are still written one binding at a time if it fails.
+        if (pfnCreateUpdateTemplate(device->logical, &templateInfo, nullptr, &layout.updateTemplate) != VK_SUCCESS)
+            layout.updateTemplate = VK_NULL_HANDLE;
+    }
+
+    return &layouts.insert((uint64_t)setLayout, layout).value();
+}
+
+
+/**
+ * Create a descriptor pool.
+ */
+VkResult VkcDescriptorAllocator::createPool(uint32_t maxSets, const QVector<VkDescriptorPoolSize> &poolSizes, VkDescriptorPool &pool)
+{
+    // Fill descriptor pool info.
+    VkDescriptorPoolCreateInfo descriptorPoolInfo =
+    {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,          // VkStructureType                sType;
+        nullptr,                                                // const void*                    pNext;
+        0,                                                      // VkDescriptorPoolCreateFlags    flags;
+
+        maxSets,                                                // uint32_t                       maxSets;
+        (uint32_t)poolSizes.size(),                             // uint32_t                       poolSizeCount;
+        poolSizes.constData()                                   // const VkDescriptorPoolSize*    pPoolSizes;
+    };
+
+    // Create descriptor pool.
+    mgAssert(vkCreateDescriptorPool(device->logical, &descriptorPoolInfo, nullptr, &pool));
+
+    poolCount++;
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Allocate a set from a pool.
+ */
+VkResult VkcDescriptorAllocator::allocateSet(VkDescriptorPool pool, VkDescriptorSetLayout setLayout, VkDescriptorSet &set)
+{
+    // Fill descriptor set allocate info.
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo =
+    {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,     // VkStructureType                 sType;
+        nullptr,                                            // const void*                     pNext;
+
+        pool,                                               // VkDescriptorPool                descriptorPool;
+        1,                                                  // uint32_t                        descriptorSetCount;
+        &setLayout                                          // const VkDescriptorSetLayout*    pSetLayouts;
+    };
+
+    // Allocate descriptor set.
+    return vkAllocateDescriptorSets(device->logical, &descriptorSetAllocateInfo, &set);
+}
+
+
+/**
+ * Allocate a set from the pools of its layout, adding a larger pool when they are full.
+ *
+ * The mutex must be held.
+ */
+VkResult VkcDescriptorAllocator::allocatePersistent(VkcDescriptorLayout &layout, VkDescriptorSetLayout setLayout, VkDescriptorSet &set)
+{
+    if (layout.freeSets == 0)
+    {
+        // Grow geometrically, so many sets take few pools.
+        layout.poolSets = layout.poolSets == 0 ? VKC_DESCRIPTOR_POOL_MIN_SETS : qMin(layout.poolSets * 2, (uint32_t)VKC_DESCRIPTOR_POOL_MAX_SETS);
+
+        // Pools are sized exactly for their layout.
+        QVector<VkDescriptorPoolSize> poolSizes;
+
+        for (int i = 0; i < layout.bindings.size(); i++)
+        {
+            const VkDescriptorSetLayoutBinding &binding = layout.bindings[i];
+
+            if (binding.descriptorCount == 0)
+                continue;
+
+            int j = 0;
+            while (j < poolSizes.size() && poolSizes[j].type != binding.descriptorType)
+                j++;
+
+            if (j == poolSizes.size())
+                poolSizes.append({binding.descriptorType, 0});
+
+            poolSizes[j].descriptorCount += binding.descriptorCount * layout.poolSets;
+        }
+
+        // Pools must have at least one size, even for empty sets.
+        if (poolSizes.isEmpty())
+            poolSizes.append({VK_DESCRIPTOR_TYPE_SAMPLER, 1});
+
+        VkDescriptorPool pool;
+        mgAssert(createPool(layout.poolSets, poolSizes, pool));
+
+        layout.pools.append(pool);
+        layout.freeSets = layout.poolSets;
+    }
+
+    mgAssert(allocateSet(layout.pools.last(), setLayout, set));
+    layout.freeSets--;
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Write the descriptors of a set, with its update template if there is one.
+ */
+void VkcDescriptorAllocator::write(const VkcDescriptorLayout &layout, VkDescriptorSet set, const QVector<VkcDescriptorData> &data)
+{
+    if (layout.updateTemplate != VK_NULL_HANDLE)
+    {
+        pfnUpdateWithTemplate(device->logical, set, layout.updateTemplate, data.constData());
+        return;
+    }
+
+    // Texel buffer views are not spaced like the array, gather them first.
+    QVector<VkBufferView> texelBuffers(layout.dataSize);
+    for (uint32_t i = 0; i < layout.dataSize; i++)
+        texelBuffers[i] = data[i].texelBuffer;
+
+    QVector<VkWriteDescriptorSet> writeSets;
+
+    for (int i = 0; i < layout.entries.size(); i++)
+    {
+        const VkDescriptorUpdateTemplateEntryKHR &entry = layout.entries[i];
+        uint32_t index = entry.offset / sizeof(VkcDescriptorData);
+
+        bool image = isImage(entry.descriptorType);
+        bool texelBuffer = isTexelBuffer(entry.descriptorType);
+
+        // Fill write descriptor set info.
+        VkWriteDescriptorSet writeSet =
+        {
+            VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,                         // VkStructureType                  sType;
+            nullptr,                                                        // const void*                      pNext;
+
+            set,                                                            // VkDescriptorSet                  dstSet;
+            entry.dstBinding,                                               // uint32_t                         dstBinding;
+            entry.dstArrayElement,                                          // uint32_t                         dstArrayElement;
+            entry.descriptorCount,                                          // uint32_t                         descriptorCount;
+            entry.descriptorType,                                           // VkDescriptorType                 descriptorType;
+
+            image ? &data[index].image : nullptr,                           // const VkDescriptorImageInfo*     pImageInfo;
+            !image && !texelBuffer ? &data[index].buffer : nullptr,         // const VkDescriptorBufferInfo*    pBufferInfo;
+            texelBuffer ? &texelBuffers[index] : nullptr                    // const VkBufferView*              pTexelBufferView;
+        };
+
+        writeSets.append(writeSet);
+    }
+
+    // Update descriptor set.
+    vkUpdateDescriptorSets(device->logical, writeSets.size(), writeSets.constData(), 0, nullptr);
+}
+
+
+/**
+ * Check if a descriptor type is written from image info.
+ */
+bool VkcDescriptorAllocator::isImage(VkDescriptorType type)
+{
+    return type == VK_DESCRIPTOR_TYPE_SAMPLER ||
+           type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+           type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
+           type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ||
+           type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+}
+
+
+/**
+ * Check if a descriptor type is written from a buffer view.
+ */
+bool VkcDescriptorAllocator::isTexelBuffer(VkDescriptorType type)
+{
+    return type == VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER ||
+           type == VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+}
+
+
+/**
+ * Get the key identifying the contents of a set.
+ *
+ * Only the fields used by each descriptor type are read, so padding and
+ * unused union bytes do not split equal sets.
+ */
+QByteArray VkcDescriptorAllocator::getKey(const VkcDescriptorLayout &layout, VkDescriptorSetLayout setLayout, const QVector<VkcDescriptorData> &data)
+{
+    uint64_t layoutHandle = (uint64_t)setLayout;
+    QByteArray key((const char*)&layoutHandle, sizeof(layoutHandle));
+
+    for (int i = 0; i < layout.entries.size(); i++)
+    {
+        const VkDescriptorUpdateTemplateEntryKHR &entry = layout.entries[i];
+        uint32_t index = entry.offset / sizeof(VkcDescriptorData);
+
+        for (uint32_t j = index; j < index + entry.descriptorCount; j++)
+        {
+            if (isImage(entry.descriptorType))
+            {
+                const VkDescriptorImageInfo &image = data[j].image;
+                uint64_t handles[2] = {(uint64_t)image.sampler, (uint64_t)image.imageView};
+
+                key.append((const char*)handles, sizeof(handles));
+                key.append((const char*)&image.imageLayout, sizeof(image.imageLayout));
+            }
+            else if (isTexelBuffer(entry.descriptorType))
+            {
+                uint64_t handle = (uint64_t)data[j].texelBuffer;
+
+                key.append((const char*)&handle, sizeof(handle));
+            }
+            else
+            {
+                const VkDescriptorBufferInfo &buffer = data[j].buffer;
+                uint64_t handle = (uint64_t)buffer.buffer;
+
+                key.append((const char*)&handle, sizeof(handle));
+                key.append((const char*)&buffer.offset, sizeof(buffer.offset));
+                key.append((const char*)&buffer.range, sizeof(buffer.range));
+            }
+        }
+    }
+
+    return key;
+}
@@ -0,0 +1,163 @@
+#ifndef VKC_DESCRIPTORALLOCATOR_H
+#define VKC_DESCRIPTORALLOCATOR_H
+
+#include "stable.h"
+#include "vkc_device.h"
+
+#define VKC_DESCRIPTOR_POOL_MIN_SETS 16
+#define VKC_DESCRIPTOR_POOL_MAX_SETS 1024
+#define VKC_TRANSIENT_POOL_SETS 256
+
+
+/**
+ * Union used for one descriptor written to a set.
+ *
+ * A set is written from an array holding its descriptors in binding order,
+ * array elements of a binding next to each other.
+ */
+union VkcDescriptorData
+{
+    VkDescriptorImageInfo       image;
+    VkDescriptorBufferInfo      buffer;
+    VkBufferView                texelBuffer;
+};
+
+/**
+ * Struct used for the pools and update template of a descriptor set layout.
+ */
+struct VkcDescriptorLayout
+{
+    QVector<VkDescriptorSetLayoutBinding> bindings = {};
+    QVector<uint32_t>           dataOffsets =       {};
+    uint32_t                    dataSize =          0;
+
+    QVector<VkDescriptorUpdateTemplateEntryKHR> entries = {};
+    VkDescriptorUpdateTemplateKHR updateTemplate =  VK_NULL_HANDLE;
+
+    QVector<VkDescriptorPool>   pools =             {};
+    uint32_t                    poolSets =          0;
+    uint32_t                    freeSets =          0;
+};
+
+/**
+ * Struct used for the transient pools of a frame in flight.
+ */
+struct VkcDescriptorFrame
+{
+    QVector<VkDescriptorPool>   pools =             {};
+    int                         current =           0;
+};
+
+
+/**
+ * Class used for allocating and writing descriptor sets.
+ *
+ * Persistent sets come from pools made for their layout, which grow
+ * geometrically as more sets are needed. Sets whose descriptors never change
+ * are cached by their contents, so equal materials share one set. Transient
+ * sets come from per-frame pools that are reset all at once when the frame's
+ * fence has signaled.
+ *
+ * Sets are written with a descriptor update template if the device supports
+ * them, otherwise with one write per binding.
+ *
+ * Classes named "Vkc[class]" stand for "Vulkan custom class".
+ */
+class VkcDescriptorAllocator
+{
+    // Objects:
+public:
+    uint32_t                        poolCount;
+    uint32_t                        cachedSetCount;
+
+private:
+    QMutex                          mutex;
+    QHash<uint64_t, VkcDescriptorLayout> layouts;
+    QHash<QByteArray, VkDescriptorSet> cachedSets;
+    QVector<VkcDescriptorFrame>     frames;
+
+    PFN_vkCreateDescriptorUpdateTemplateKHR     pfnCreateUpdateTemplate;
+    PFN_vkDestroyDescriptorUpdateTemplateKHR    pfnDestroyUpdateTemplate;
+    PFN_vkUpdateDescriptorSetWithTemplateKHR    pfnUpdateWithTemplate;
+
+    const VkcDevice                 *device;
+
+    // Functions:
+public:
+    VkcDescriptorAllocator(
+            const VkcDevice         *device,
+            uint32_t                frameCount
+            );
+    ~VkcDescriptorAllocator();
+
+    void reset(
+            uint32_t                frameIdx
+            );
+    VkResult allocate(
+            VkDescriptorSetLayout   setLayout,
+            VkDescriptorSet         &set
+            );
+    VkResult allocateTransient(
+            uint32_t                frameIdx,
+            VkDescriptorSetLayout   setLayout,
+            VkDescriptorSet         &set
+            );
+    VkResult getSet(
+            VkDescriptorSetLayout   setLayout,
+            const QVector<VkcDescriptorData> &data,
+            VkDescriptorSet         &set
+            );
+
+    void update(
+            VkDescriptorSet         set,
+            VkDescriptorSetLayout   setLayout,
+            const QVector<VkcDescriptorData> &data
+            );
+    void createData(
+            VkDescriptorSetLayout   setLayout,
+            QVector<VkcDescriptorData> &data
+            );
+    int getDataIndex(
+            VkDescriptorSetLayout   setLayout,
+            uint32_t                binding
+            );
+
+private:
+    VkcDescriptorLayout* getLayout(
+            VkDescriptorSetLayout   setLayout
+            );
+    VkResult createPool(
+            uint32_t                maxSets,
+            const QVector<VkDescriptorPoolSize> &poolSizes,
+            VkDescriptorPool        &pool
+            );
+    VkResult allocateSet(
+            VkDescriptorPool        pool,
+            VkDescriptorSetLayout   setLayout,
+            VkDescriptorSet         &set
+            );
+    VkResult allocatePersistent(
+            VkcDescriptorLayout     &layout,
+            VkDescriptorSetLayout   setLayout,
+            VkDescriptorSet         &set
+            );
+    void write(
+            const VkcDescriptorLayout &layout,
+            VkDescriptorSet         set,
+            const QVector<VkcDescriptorData> &data
+            );
+
+    static bool isImage(
+            VkDescriptorType        type
+            );
+    static bool isTexelBuffer(
+            VkDescriptorType        type
+            );
+    static QByteArray getKey(
+            const VkcDescriptorLayout &layout,
+            VkDescriptorSetLayout   setLayout,
+            const QVector<VkcDescriptorData> &data
+            );
+};
+
+#endif // VKC_DESCRIPTORALLOCATOR_H
@@ -1,4 +1,7 @@
 #include "vkc_device.h"
+#include "vkc_pipelinecache.h"
+#include "vkc_layoutcache.h"
+#include "vkc_renderpasscache.h"
 
 
 /**
@@ -8,13 +11,21 @@ VkcDevice::VkcDevice()
 {
     physical =          VK_NULL_HANDLE;
     logical =           VK_NULL_HANDLE;
+
+    deletionQueue =     nullptr;
+    pipelineCache =     nullptr;
+    layoutCache =       nullptr;
+    renderPassCache =   nullptr;
+
+    descriptorIndexing = false;
+    bindlessCapacity =  0;
 }
 
 
 /**
  * Create the device.
  */
-VkcDevice::VkcDevice(VkPhysicalDevice physicalDevice) : VkcDevice()
+VkcDevice::VkcDevice(VkPhysicalDevice physicalDevice, VkInstance instance) : VkcDevice()
 {
     // Get the number of queue properties.
     uint32_t familyCount;
@@ -82,11 +93,54 @@ VkcDevice::VkcDevice(VkPhysicalDevice physicalDevice) : VkcDevice()
         VK_KHR_SWAPCHAIN_EXTENSION_NAME
     };
 
+    // Enable the optional extensions the device supports.
+    QVector<const char*> optionalExtentions =
+    {
+        VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME,
+        VK_KHR_MAINTENANCE3_EXTENSION_NAME,
+        VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME
+    };
+
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+
+    QVector<VkExtensionProperties> extensionProperties(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensionProperties.data());
+
+    for (int i = 0; i < optionalExtentions.size(); i++)
+        for (uint32_t j = 0; j < extensionCount; j++)
+            if (strcmp(optionalExtentions[i], extensionProperties[j].extensionName) == 0)
+            {
+                deviceExtentions.append(optionalExtentions[i]);
+                break;
+            }
+
+    // Bindless textures need descriptor indexing, with the features used by the bindless table.
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+    for (int i = 0; i < deviceExtentions.size(); i++)
+        extensions.append(deviceExtentions[i]);
+
+    if (hasExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) && hasExtension(VK_KHR_MAINTENANCE3_EXTENSION_NAME))
+        getIndexingSupport(physicalDevice, instance, indexingFeatures);
+
+    // Leave the extensions disabled if the features are missing.
+    for (int i = deviceExtentions.size() - 1; i >= 0 && !descriptorIndexing; i--)
+        if (strcmp(deviceExtentions[i], VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0 ||
+            strcmp(deviceExtentions[i], VK_KHR_MAINTENANCE3_EXTENSION_NAME) == 0)
+        {
+            deviceExtentions.remove(i);
+            extensions.remove(i);
+        }
+
+    void *pIndexingFeatures = descriptorIndexing ? &indexingFeatures : nullptr;
+
     // Fill device info.
     VkDeviceCreateInfo deviceInfo =
     {
         VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,       // VkStructureType                    sType;
-        nullptr,                                    // const void*                        pNext;
+        pIndexingFeatures,                          // const void*                        pNext;
         0,                                          // VkDeviceCreateFlags                flags;
 
         (uint32_t)queueInfos.size(),                // uint32_t                           queueCreateInfoCount;
@@ -104,6 +158,18 @@ VkcDevice::VkcDevice(VkPhysicalDevice physicalDevice) : VkcDevice()
     // Create device.
     vkCreateDevice(physicalDevice, &deviceInfo, nullptr, &logical);
 
+    // Create the queue of objects waiting for the GPU to release them.
+    deletionQueue = new VkcDeletionQueue(logical);
+
+    // Create the cache sharing descriptor set and pipeline layouts between pipelines.
+    layoutCache = new VkcLayoutCache(logical);
+
+    // Create the cache sharing render passes between contexts.
+    renderPassCache = new VkcRenderPassCache(logical);
+
+    // Create the cache sharing pipelines between contexts.
+    pipelineCache = new VkcPipelineCache(this);
+
 
     // For each queue family...
     for (int i = 0; i < queueFamilies.size(); i++)
@@ -158,6 +224,22 @@ VkcDevice::VkcDevice(VkPhysicalDevice physicalDevice) : VkcDevice()
  */
 VkcDevice::~VkcDevice()
 {
+    // Pipelines still cached retire their objects too.
+    if (pipelineCache != nullptr)
+        delete pipelineCache;
+
+    // Destroy the retired objects while the device still exists.
+    if (deletionQueue != nullptr)
+        delete deletionQueue;
+
+    // Layouts outlive every pipeline using them.
+    if (layoutCache != nullptr)
+        delete layoutCache;
+
+    // Render passes outlive every framebuffer using them.
+    if (renderPassCache != nullptr)
+        delete renderPassCache;
+
     if (logical != VK_NULL_HANDLE)
     {
         while (queueFamilies.size() > 0)
@@ -191,6 +273,71 @@ void VkcDevice::getQueueFamilies(QVector<uint32_t> &queueFamilies) const
 }
 
 
+/**
+ * Check if descriptor indexing supports a bindless texture table.
+ *
+ * Keeps only the features the table needs in the feature struct, ready to be
+ * chained to the device info, and sizes the table from the device limits.
+ */
+void VkcDevice::getIndexingSupport(VkPhysicalDevice physicalDevice, VkInstance instance, VkPhysicalDeviceDescriptorIndexingFeaturesEXT &indexingFeatures)
+{
+    PFN_vkGetPhysicalDeviceFeatures2KHR pfnGetFeatures2 =
+            (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+    PFN_vkGetPhysicalDeviceProperties2KHR pfnGetProperties2 =
+            (PFN_vkGetPhysicalDeviceProperties2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR");
+
+    if (pfnGetFeatures2 == nullptr || pfnGetProperties2 == nullptr)
+        return;
+
+    // Get the descriptor indexing features.
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT supported = {};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+    VkPhysicalDeviceFeatures2KHR features2 = {};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+    features2.pNext = &supported;
+
+    pfnGetFeatures2(physicalDevice, &features2);
+
+    if (!supported.runtimeDescriptorArray ||
+        !supported.descriptorBindingPartiallyBound ||
+        !supported.descriptorBindingSampledImageUpdateAfterBind ||
+        !supported.descriptorBindingUpdateUnusedWhilePending)
+        return;
+
+    // Get the descriptor indexing limits.
+    VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties = {};
+    indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+
+    VkPhysicalDeviceProperties2KHR properties2 = {};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+    properties2.pNext = &indexingProperties;
+
+    pfnGetProperties2(physicalDevice, &properties2);
+
+    bindlessCapacity = qMin((uint32_t)VKC_BINDLESS_MAX_TEXTURES,
+                            qMin(indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                 indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages));
+
+    // Enable only what the bindless table uses.
+    indexingFeatures.runtimeDescriptorArray =                       VK_TRUE;
+    indexingFeatures.descriptorBindingPartiallyBound =              VK_TRUE;
+    indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    indexingFeatures.descriptorBindingUpdateUnusedWhilePending =    VK_TRUE;
+
+    descriptorIndexing = bindlessCapacity > 0;
+}
+
+
+/**
+ * Check if an extension was enabled on the device.
+ */
+bool VkcDevice::hasExtension(const char *name) const
+{
+    return extensions.contains(name);
+}
+
+
 /**
  * Get memory type index.
  */
@@ -2,8 +2,15 @@
 #define VKC_DEVICE_H
 
 #include "stable.h"
+#include "vkc_deletionqueue.h"
 
 #define ACTIVE_FAMILY 0
+#define VKC_FRAMES_IN_FLIGHT 2
+#define VKC_BINDLESS_MAX_TEXTURES 16384
+
+class VkcPipelineCache;
+class VkcLayoutCache;
+class VkcRenderPassCache;
 
 
 /**
@@ -40,15 +47,28 @@ public:
     VkPhysicalDeviceProperties          properties;
     VkPhysicalDeviceFeatures            features;
     VkPhysicalDeviceMemoryProperties    memoryProperties;
+    QVector<QByteArray>                 extensions;
+
+    bool                                descriptorIndexing;
+    uint32_t                            bindlessCapacity;
+
+    VkcDeletionQueue                    *deletionQueue;
+    VkcPipelineCache                    *pipelineCache;
+    VkcLayoutCache                      *layoutCache;
+    VkcRenderPassCache                  *renderPassCache;
 
     // Functions
 public:
     VkcDevice();
     VkcDevice(
-            VkPhysicalDevice            physicalDevice
+            VkPhysicalDevice            physicalDevice,
+            VkInstance                  instance
             );
     ~VkcDevice();
 
+    bool hasExtension(
+            const char                  *name
+            ) const;
     void getQueueFamilies(
             QVector<uint32_t>           &queueFamilies
             ) const;
@@ -57,6 +77,13 @@ public:
             VkMemoryRequirements        requirements,
             uint32_t*                   pTypeIdx
             ) const;
+
+private:
+    void getIndexingSupport(
+            VkPhysicalDevice            physicalDevice,
+            VkInstance                  instance,
+            VkPhysicalDeviceDescriptorIndexingFeaturesEXT &indexingFeatures
+            );
 };
 
 #endif // VKC_DEVICE_H
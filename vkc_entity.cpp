@@ -10,15 +10,30 @@ VkcEntity::VkcEntity()
     scale =     QVector3D(1.0f, 1.0f, 1.0f);
     rotation =  QQuaternion(1.0f, 0.0f, 0.0f, 0.0f);
 
+    boundsCenter =  QVector3D(0.0f, 0.0f, 0.0f);
+    boundsRadius =  0.0f;
+    worldCenter =   QVector3D(0.0f, 0.0f, 0.0f);
+    worldRadius =   0.0f;
+
+    geometryPool = nullptr;
+    sharedMesh = nullptr;
+    lod = 0;
+
     dir = 0.1f / 15.0f;
+    color = QVector4D(1.0f, 1.0f, 1.0f, 1.0f);
+    texture = nullptr;
+    textureIndex = 0;
+    visible = true;
 }
 
 
 /**
  * Create the entity.
  */
-VkcEntity::VkcEntity(const VkcDevice *device) : VkcEntity()
+VkcEntity::VkcEntity(MgGeometryPool *geometryPool) : VkcEntity()
 {
+    this->geometryPool = geometryPool;
+
     // Load the model.
     vertices.append({-1.0f,  0.0f,  1.0f,    0.0f,  1.0f,    0.0f, -1.0f,  0.0f});
     vertices.append({-1.0f,  0.0f, -1.0f,    0.0f,  0.0f,    0.0f, -1.0f,  0.0f});
@@ -27,42 +42,111 @@ VkcEntity::VkcEntity(const VkcDevice *device) : VkcEntity()
 
     indices = {0, 1, 2, 2, 1, 3};
 
+    // Reorder the mesh for the vertex cache.
+    MgMeshOptimizer::optimize(vertices, indices);
+
     // Load position, scale and rotation data.
     // /@todo
 
-    // Create buffer.
-    buffer.create(vertices.size() * sizeof(VkVertex) + indices.size() * sizeof(uint32_t),
-                  VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, device);
+    upload();
+}
+
+
+/**
+ * Create the entity from a mesh file.
+ *
+ * The file holds the vertices already encoded, so they are copied straight
+ * into the pool; the bounds come from its header.
+ */
+VkcEntity::VkcEntity(MgGeometryPool *geometryPool, const MgMeshFile &meshFile) : VkcEntity()
+{
+    this->geometryPool = geometryPool;
+
+    const MgMeshHeader *header = meshFile.header;
 
-    // Map buffer memory to host.
-    uint8_t *data;
-    vkMapMemory(device->logical, buffer.memory, 0, VK_WHOLE_SIZE, 0,(void**) &data);
+    boundsCenter = QVector3D(header->boundsCenter[0], header->boundsCenter[1], header->boundsCenter[2]);
+    boundsRadius = header->boundsRadius;
 
-    // Copy data to the buffer.
-    uint32_t offset = 0;
-    memcpy(data + offset, vertices.data(), vertices.size() * sizeof(VkVertex));
+    meshFile.getQuantization(quantization);
+    positionMatrix = MgVertexFormat::getPositionMatrix(quantization);
 
-    offset += vertices.size() * sizeof(VkVertex);
-    memcpy(data + offset, indices.data(), indices.size() * sizeof(uint32_t));
+    for (uint32_t i = 0; i < header->lodCount; i++)
+        lods.append(meshFile.getLods()[i]);
 
-    // Unmap memory.
-    vkUnmapMemory(device->logical, buffer.memory);
+    meshFile.upload(geometryPool, mesh);
+    shareMesh();
 }
 
 
 /**
- * Destroy the entity.
+ * Create the entity from decoded geometry, placed by the node holding it.
+ *
+ * The mesh is expected to be optimized already, with the indices of its
+ * levels of detail following the full ones and split into meshlets.
+ * Entities of imported scenes stay where the scene puts them.
+ */
+VkcEntity::VkcEntity(MgGeometryPool *geometryPool, const QVector<VkVertex> &vertices, const QVector<uint32_t> &indices,
+                     const QVector<MgMeshLod> &lods, const QVector<MgMeshlet> &meshlets, const QMatrix4x4 &nodeMatrix) : VkcEntity()
+{
+    this->geometryPool = geometryPool;
+    this->vertices = vertices;
+    this->indices = indices;
+    this->lods = lods;
+    this->meshlets = meshlets;
+    this->nodeMatrix = nodeMatrix;
+
+    dir = 0.0f;
+
+    upload();
+}
+
+
+/**
+ * Create another instance of an entity's mesh, placed by the node holding it.
+ *
+ * The instance draws the same range of the pool, nothing is uploaded again.
+ */
+VkcEntity::VkcEntity(const VkcEntity &source, const QMatrix4x4 &nodeMatrix) : VkcEntity()
+{
+    geometryPool =      source.geometryPool;
+    mesh =              source.mesh;
+    sharedMesh =        source.sharedMesh;
+    lods =              source.lods;
+    quantization =      source.quantization;
+    positionMatrix =    source.positionMatrix;
+    boundsCenter =      source.boundsCenter;
+    boundsRadius =      source.boundsRadius;
+
+    color =             source.color;
+    texture =           source.texture;
+
+    this->nodeMatrix =  nodeMatrix;
+    dir = 0.0f;
+
+    if (sharedMesh != nullptr)
+        sharedMesh->references.ref();
+}
+
+
+/**
+ * Destroy the entity, the last instance of its mesh frees it from the pool.
  */
 VkcEntity::~VkcEntity()
 {
-    buffer.destroy();
+    if (sharedMesh != nullptr && !sharedMesh->references.deref())
+    {
+        geometryPool->free(sharedMesh->range);
+        delete sharedMesh;
+    }
 }
 
 
 /**
- * Register the commands that render the entity.
+ * Advance the entity animation.
+ *
+ * Called on the main thread; the render thread only sees the resulting model matrix.
  */
-void VkcEntity::render(VkCommandBuffer commandBuffer, MgBuffer uniformBuffer, QMatrix4x4 vpMatrix, const VkcDevice *device)
+void VkcEntity::animate()
 {
     // Wiggle, wiggle, wiggle.
     position += QVector3D(dir, 0.0f, 0.0f);
@@ -70,36 +154,229 @@ void VkcEntity::render(VkCommandBuffer commandBuffer, MgBuffer uniformBuffer, QM
 
     if(pos > 0.1f || pos < -0.1f)
         dir *= -1.0f;
+}
+
 
-    // Calculate model matrix.
+/**
+ * Get the model matrix of the entity.
+ */
+QMatrix4x4 VkcEntity::getModelMatrix() const
+{
     QMatrix4x4 modelMatrix;
     modelMatrix.translate(position);
     modelMatrix.rotate(rotation);
     modelMatrix.scale(scale);
 
-    // Calculate MVP matrix.
-    QMatrix4x4 mvpMatrix = vpMatrix * modelMatrix;
+    return modelMatrix * nodeMatrix;
+}
+
+
+/**
+ * Compute the MVP matrix of the entity and test it against the view frustum.
+ *
+ * Entities are independent, so this may be called from any worker thread.
+ */
+void VkcEntity::update(const QMatrix4x4 &vpMatrix, const QMatrix4x4 &modelMatrix, const QVector4D frustumPlanes[6],
+                       float pixelScale)
+{
+    // Calculate MVP matrix, quantized positions are scaled back to the mesh bounds first.
+    mvpMatrix = vpMatrix * modelMatrix * positionMatrix;
+
+    // Test the bounding sphere against the frustum planes, it is kept for the occlusion test.
+    worldCenter = modelMatrix.map(boundsCenter);
+    worldRadius = boundsRadius * qMax(modelMatrix.column(0).toVector3D().length(),
+                                      qMax(modelMatrix.column(1).toVector3D().length(),
+                                           modelMatrix.column(2).toVector3D().length()));
 
-    // Map uniform buffer memory to host.
-    void *data = nullptr;
-    vkMapMemory(device->logical, uniformBuffer.memory, 0, VK_WHOLE_SIZE, 0, &data);
+    visible = true;
+    for (int i = 0; i < 6 && visible; i++)
+        visible = QVector3D::dotProduct(frustumPlanes[i].toVector3D(), worldCenter) + frustumPlanes[i].w() >= -worldRadius;
+
+    // Clip space w is the distance along the view direction.
+    if (visible)
+        selectLod(qAbs((vpMatrix * QVector4D(worldCenter, 1.0f)).w()), worldRadius, pixelScale);
+}
 
-    // Copy data to the buffer.
-    memcpy(data, mvpMatrix.data(), 16 * sizeof(float));
 
-    // Unmap memory.
-    vkUnmapMemory(device->logical, uniformBuffer.memory);
+/**
+ * Get the per-draw data of the entity.
+ */
+void VkcEntity::getDrawConstants(VkcDrawConstants &constants) const
+{
+    memcpy(constants.mvpMatrix, mvpMatrix.constData(), sizeof(constants.mvpMatrix));
 
-    // Bind vertex and index bufffer.
-    VkDeviceSize vboOffsets[] = {0};
-    uint32_t iboOffset = vertices.size() * sizeof(VkVertex);
+    constants.color[0] = color.x();
+    constants.color[1] = color.y();
+    constants.color[2] = color.z();
+    constants.color[3] = color.w();
 
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer.handle, vboOffsets);
-    vkCmdBindIndexBuffer(commandBuffer, buffer.handle, iboOffset, VK_INDEX_TYPE_UINT32);
+    constants.texCoordTransform[0] = quantization.texCoordScale.x();
+    constants.texCoordTransform[1] = quantization.texCoordScale.y();
+    constants.texCoordTransform[2] = quantization.texCoordOffset.x();
+    constants.texCoordTransform[3] = quantization.texCoordOffset.y();
 
-    // Draw entity.
-    vkCmdDrawIndexed(commandBuffer, indices.size(), 1, 0, 0, 0);
+    constants.textureIndex = textureIndex;
 }
 
 
+/**
+ * Register the commands that render the entity.
+ *
+ * The pipeline, geometry pool with the index buffer of the mesh's type,
+ * descriptor set and per-draw data are bound by the caller.
+ */
+void VkcEntity::render(VkCommandBuffer commandBuffer)
+{
+    geometryPool->draw(commandBuffer, getDrawRange());
+}
+
+
+/**
+ * Get where the geometry of the entity is in the pool.
+ */
+const MgMeshRange& VkcEntity::getMesh() const
+{
+    return mesh;
+}
+
+
+/**
+ * Get the range of the pool drawn for the selected level of detail.
+ */
+MgMeshRange VkcEntity::getDrawRange() const
+{
+    // Draw the indices of the selected level, the vertices are shared.
+    MgMeshRange range = mesh;
+    range.firstIndex += lods[lod].firstIndex;
+    range.indexCount = lods[lod].indexCount;
 
+    return range;
+}
+
+
+/**
+ * Get the world space bounding sphere from the last update.
+ */
+void VkcEntity::getWorldBounds(QVector3D &center, float &radius) const
+{
+    center = worldCenter;
+    radius = worldRadius;
+}
+
+
+/**
+ * Get the selected level of detail.
+ */
+int VkcEntity::getLod() const
+{
+    return lod;
+}
+
+
+/**
+ * Get the range of the pool's meshlet buffer covering the selected level of detail.
+ *
+ * The count is 0 if the mesh was not split into meshlets.
+ */
+void VkcEntity::getMeshlets(uint32_t &firstMeshlet, uint32_t &meshletCount) const
+{
+    firstMeshlet = mesh.firstMeshlet;
+
+    for (int i = 0; i < lod; i++)
+        firstMeshlet += lods[i].meshletCount;
+
+    meshletCount = lods[lod].meshletCount;
+}
+
+
+/**
+ * Get the triangle count of a level of detail, level 0 is the full mesh.
+ */
+uint32_t VkcEntity::getTriangleCount(int lod) const
+{
+    return lods.size() > lod ? lods[lod].indexCount / 3 : 0;
+}
+
+
+/**
+ * Compute the model space bounding sphere of the vertices.
+ */
+void VkcEntity::computeBounds()
+{
+    if (vertices.size() == 0)
+        return;
+
+    QVector3D minimum(vertices[0].x, vertices[0].y, vertices[0].z);
+    QVector3D maximum = minimum;
+
+    for (int i = 1; i < vertices.size(); i++)
+    {
+        QVector3D point(vertices[i].x, vertices[i].y, vertices[i].z);
+
+        minimum = QVector3D(qMin(minimum.x(), point.x()), qMin(minimum.y(), point.y()), qMin(minimum.z(), point.z()));
+        maximum = QVector3D(qMax(maximum.x(), point.x()), qMax(maximum.y(), point.y()), qMax(maximum.z(), point.z()));
+    }
+
+    boundsCenter = (minimum + maximum) * 0.5f;
+    boundsRadius = (maximum - minimum).length() * 0.5f;
+}
+
+
+/**
+ * Encode the vertices to the pool's format and copy them in.
+ */
+void VkcEntity::upload()
+{
+    computeBounds();
+
+    // Without levels of detail, the whole mesh is the only one.
+    if (lods.isEmpty())
+        lods.append({0, (uint32_t)indices.size(), 0.0f, 0});
+
+    // Tangents follow the full mesh.
+    QByteArray vertexData;
+    MgVertexFormat::encode(geometryPool->vertexFormat, vertices, indices.mid(lods[0].firstIndex, lods[0].indexCount),
+                           vertexData, quantization);
+    positionMatrix = MgVertexFormat::getPositionMatrix(quantization);
+
+    geometryPool->upload(vertexData.constData(), vertices.size(), indices, mesh, meshlets);
+    shareMesh();
+}
+
+
+/**
+ * Hold the uploaded range, so instances made from the entity can share it.
+ */
+void VkcEntity::shareMesh()
+{
+    sharedMesh = new VkcSharedMesh();
+    sharedMesh->range = mesh;
+    sharedMesh->references.store(1);
+}
+
+
+/**
+ * Pick the coarsest level of detail whose error stays below a pixel on screen.
+ *
+ * Errors are relative to the bounding radius, so they scale with the entity.
+ * A coarser level is only taken once its error is well below the limit,
+ * so entities near the switching distance do not pop back and forth.
+ */
+void VkcEntity::selectLod(float distance, float radius, float pixelScale)
+{
+    // Inside the bounding sphere, only the full mesh will do.
+    if (distance <= radius)
+    {
+        lod = 0;
+        return;
+    }
+
+    float scale = radius * pixelScale / distance;
+    lod = qMin(lod, lods.size() - 1);
+
+    while (lod > 0 && lods[lod].error * scale > VKC_LOD_PIXEL_ERROR)
+        lod--;
+
+    while (lod + 1 < lods.size() && lods[lod + 1].error * scale <= VKC_LOD_PIXEL_ERROR * (1.0f - VKC_LOD_HYSTERESIS))
+        lod++;
+}
@@ -3,10 +3,28 @@
 
 #include "stable.h"
 #include "vkc_device.h"
-#include "mgbuffer.h"
+#include "mggeometrypool.h"
+#include "mgmeshoptimizer.h"
+#include "mgmeshfile.h"
+#include "mgtexture2d.h"
+
+#define VKC_LOD_PIXEL_ERROR 1.0f
+#define VKC_LOD_HYSTERESIS 0.25f
 #include "vkc_pipeline.h"
 
 
+/**
+ * Struct used for a range of the geometry pool shared by the instances of a mesh.
+ *
+ * The last entity using it frees the range.
+ */
+struct VkcSharedMesh
+{
+    MgMeshRange                 range;
+    QAtomicInt                  references;
+};
+
+
 /**
  * Class used for entities.
  *
@@ -19,27 +37,96 @@ protected:
     QVector<VkVertex>           vertices;
     QVector<uint32_t>           indices;
 
-    MgBuffer                    buffer;
+    MgGeometryPool              *geometryPool;
+    MgMeshRange                 mesh;
+    VkcSharedMesh               *sharedMesh;
+    QVector<MgMeshLod>          lods;
+    QVector<MgMeshlet>          meshlets;
+    int                         lod;
+    MgVertexQuantization        quantization;
+    QMatrix4x4                  positionMatrix;
 
     QVector3D                   position;
     QVector3D                   scale;
     QQuaternion                 rotation;
+    QMatrix4x4                  nodeMatrix;
+
+    QVector3D                   boundsCenter;
+    float                       boundsRadius;
+    QVector3D                   worldCenter;
+    float                       worldRadius;
 
     float                       dir;
 
+public:
+    QMatrix4x4                  mvpMatrix;
+    QVector4D                   color;
+    MgTexture2D                 *texture;
+    uint32_t                    textureIndex;
+    bool                        visible;
+
     // Functions:
 public:
     VkcEntity();
     VkcEntity(
-            const VkcDevice     *device
+            MgGeometryPool      *geometryPool
+            );
+    VkcEntity(
+            MgGeometryPool      *geometryPool,
+            const MgMeshFile    &meshFile
+            );
+    VkcEntity(
+            MgGeometryPool      *geometryPool,
+            const QVector<VkVertex> &vertices,
+            const QVector<uint32_t> &indices,
+            const QVector<MgMeshLod> &lods,
+            const QVector<MgMeshlet> &meshlets,
+            const QMatrix4x4    &nodeMatrix
+            );
+    VkcEntity(
+            const VkcEntity     &source,
+            const QMatrix4x4    &nodeMatrix
             );
     ~VkcEntity();
 
+    void animate();
+    QMatrix4x4 getModelMatrix() const;
+
+    void update(
+            const QMatrix4x4    &vpMatrix,
+            const QMatrix4x4    &modelMatrix,
+            const QVector4D     frustumPlanes[6],
+            float               pixelScale
+            );
+    void getDrawConstants(
+            VkcDrawConstants    &constants
+            ) const;
     void render(
-            VkCommandBuffer     commandBuffer,
-            MgBuffer           uniformBuffer,
-            QMatrix4x4          vpMatrix,
-            const VkcDevice     *device
+            VkCommandBuffer     commandBuffer
+            );
+    const MgMeshRange& getMesh() const;
+    MgMeshRange getDrawRange() const;
+    void getWorldBounds(
+            QVector3D           &center,
+            float               &radius
+            ) const;
+    int getLod() const;
+    void getMeshlets(
+            uint32_t            &firstMeshlet,
+            uint32_t            &meshletCount
+            ) const;
+    uint32_t getTriangleCount(
+            int                 lod
+            ) const;
+
+protected:
+    void computeBounds();
+    void upload();
+    void shareMesh();
+    void selectLod(
+            float               distance,
+            float               radius,
+            float               pixelScale
             );
 };
 
@@ -16,19 +16,63 @@ VkcInstance::VkcInstance(QWidget *parent) : QObject(parent)
     createInstance();
     getDevices();
 
+    // Shared clock for latency measurements.
+    clock.start();
+
+    policyChanged = false;
+    latencyMode.store(0);
+
+    // Leave a core each for the main and render threads.
+    jobSystem = new MgJobSystem(QThread::idealThreadCount() - 2);
+
+    // Compile pipelines on the workers.
+    devices[0]->pipelineCache->setJobSystem(jobSystem);
+
+    // Recompile shaders on the workers when their sources change.
+    shaderWatcher = new VkcShaderWatcher(jobSystem);
+
+    // Decode textures on the workers while the context is created.
+    MgJobCounter decodeCounter;
+    jobSystem->submit([this]() { tux.decode("data/textures/tux.png"); }, &decodeCounter, "decodeTexture");
+
+    // Keep the geometry of every entity in shared buffers, packed like the pipelines expect.
+    geometryPool = new MgGeometryPool(devices[0], VkcPipelineInfo().vertexFormat);
+
+    // Import the scenes on the workers too, sharing their textures.
+    textureCache = new MgTextureCache();
+    MgGltfImporter importer(jobSystem, geometryPool, textureCache);
+
+    QFileInfoList sceneFiles = QDir(VKC_SCENE_DIRECTORY).entryInfoList({"*.gltf", "*.glb"}, QDir::Files);
+    QStringList sceneFileNames;
+
+    for (int i = 0; i < sceneFiles.size(); i++)
+        sceneFileNames.append(sceneFiles[i].filePath());
+
+    importer.load(sceneFileNames);
+
     context = new VkcContext((uint32_t)parent->winId(), devices[0], instance);
 
-    square = new VkcEntity(devices[0]);
+    entities.append(new VkcEntity(geometryPool));
+    importer.finish(entities, assetStats);
 
-    tux.create(devices[0], "data/textures/tux.png");
+    // Upload the decoded textures.
+    jobSystem->wait(&decodeCounter);
+    tux.create(devices[0]);
+    textureCache->create(devices[0]);
 
     width =     parent->width();
     height =    parent->height();
 
     camera = new MgCamera();
-    camera->setProjectionMatrix(3.14159f / 2, (float)width / (float)height, 1, 100);
+    sceneWidth =    0;
+    sceneHeight =   0;
+    sceneVersion =  0;
+    renderedVersion = 0;
 
     setupRender(devices[0]);
+
+    // Publish the initial scene.
+    update(width, height);
 }
 
 
@@ -37,11 +81,23 @@ VkcInstance::VkcInstance(QWidget *parent) : QObject(parent)
  */
 VkcInstance::~VkcInstance()
 {
-    if (square != nullptr)
-        delete square;
+    while (entities.size() > 0)
+    {
+        delete entities[0];
+        entities.removeFirst();
+    }
+
+    if (geometryPool != nullptr)
+        delete geometryPool;
 
     tux.destroy(devices[0]);
 
+    if (textureCache != nullptr)
+    {
+        textureCache->destroy(devices[0]);
+        delete textureCache;
+    }
+
     if (camera != nullptr)
         delete camera;
 
@@ -60,6 +116,12 @@ VkcInstance::~VkcInstance()
 
     if (instance != nullptr)
         vkDestroyInstance(instance, nullptr);
+
+    if (shaderWatcher != nullptr)
+        delete shaderWatcher;
+
+    if (jobSystem != nullptr)
+        delete jobSystem;
 }
 
 
@@ -137,6 +199,7 @@ void VkcInstance::createInstance()
     {
         VK_KHR_SURFACE_EXTENSION_NAME,
         VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
 
 #ifdef QT_DEBUG
         VK_EXT_DEBUG_REPORT_EXTENSION_NAME
@@ -228,30 +291,239 @@ void VkcInstance::getDevices()
 
     for (int i = 0; i < physicalDevices.size(); i++)
     {
-        VkcDevice *device = new VkcDevice(physicalDevices[i]);
+        VkcDevice *device = new VkcDevice(physicalDevices[i], instance);
         devices.append(device);
     }
 }
 
 
+/**
+ * Advance the scene and publish a snapshot of it for the render thread.
+ *
+ * Called on the main thread. Returns false if nothing changed and no snapshot
+ * was published.
+ */
+bool VkcInstance::update(uint32_t width, uint32_t height, bool animate)
+{
+    bool dirty = animate;
+
+    // Update projection matrix.
+    if (width != sceneWidth || height != sceneHeight)
+    {
+        sceneWidth =    width;
+        sceneHeight =   height;
+        dirty =         true;
+
+        if (width > 0 && height > 0)
+            camera->setProjectionMatrix(3.14159f / 2, (float)width / (float)height, 1, 100);
+    }
+
+    QMatrix4x4 vpMatrix;
+    camera->getViewProjectionMatrix(&vpMatrix);
+
+    if (vpMatrix != sceneVpMatrix)
+    {
+        sceneVpMatrix = vpMatrix;
+        dirty =         true;
+    }
+
+    // Nothing changed, the last published scene is still current.
+    if (!dirty)
+        return false;
+
+    MgSceneSnapshot *snapshot = snapshots.back();
+
+    snapshot->width =       width;
+    snapshot->height =      height;
+    snapshot->timestamp =   clock.nsecsElapsed();
+    snapshot->version =     ++sceneVersion;
+    snapshot->vpMatrix =    vpMatrix;
+    snapshot->cameraPosition = camera->getPosition();
+    snapshot->pixelScale =  camera->getPixelScale(height);
+
+    // Animate our entities.
+    snapshot->modelMatrices.resize(entities.size());
+    for (int i = 0; i < entities.size(); i++)
+    {
+        if (animate)
+            entities[i]->animate();
+
+        snapshot->modelMatrices[i] = entities[i]->getModelMatrix();
+    }
+
+    snapshots.publish();
+
+    return true;
+}
+
+
+/**
+ * Check if the window no longer shows the latest scene.
+ *
+ * Called on the render thread.
+ */
+bool VkcInstance::needsRender()
+{
+    return snapshots.acquire()->version != renderedVersion || swapchainDirty ||
+            (drawsSkipped && context->pipeline->isReady()) ||
+            shaderWatcher->hasCompiled() || context->device->pipelineCache->hasReloaded();
+}
+
+
 /**
  * Display objects on screen.
+ *
+ * Called on the render thread. Returns false if no frame was rendered.
  */
-void VkcInstance::render()
+bool VkcInstance::render()
 {
-    // Get the queue and command buffer.
-    // /@todo For this thread.
+    // Pick up presentation changes made on the main thread.
+    settingsMutex.lock();
+    if (policyChanged)
+    {
+        context->presentPolicy = pendingPolicy;
+        policyChanged = false;
+        swapchainDirty = true;
+    }
+    settingsMutex.unlock();
+
+    bool latencyOptimized = latencyMode.load() != 0;
+
+    // Get the latest scene published by the main thread.
+    const MgSceneSnapshot *snapshot = snapshots.acquire();
+
+    if (snapshot->width == 0 || snapshot->height == 0)
+        return false;
+
+    // Recreate the swapchain if the window changed or presentation asked for it.
+    if ((snapshot->width != width || snapshot->height != height || swapchainDirty) && !resize(snapshot->width, snapshot->height))
+        return false;
+
+    // Get the device objects.
     const VkcDevice         *device =           context->device;
-    const VkcSwapchain      *swapchain =        context->swapchain;
-    const VkcPipeline       *pipeline =         context->pipeline;
+    VkcSwapchain            *swapchain =        context->swapchain;
     VkQueue                 activeQueue =       context->commandChain[0].queue;
-    VkCommandBuffer         commandBuffer =     context->commandChain[0].buffer;
 
-    // Get the next image available.
-    uint32_t nextImageIdx;
-    VkResult result = vkAcquireNextImageKHR(device->logical, swapchain->handle, UINT64_MAX, sphAcquire, VK_NULL_HANDLE, &nextImageIdx);
+    measureLatency();
+
+    // Wait until the GPU is done with this frame's resources.
+    uint32_t frameIdx = frameNumber % VKC_FRAMES_IN_FLIGHT;
+    VkcFrame &frame = frames[frameIdx];
+
+    vkWaitForFences(device->logical, 1, &frame.fence, VK_TRUE, UINT64_MAX);
+
+    // In latency mode also wait for the previous frame, so a single frame is queued at a time.
+    if (latencyOptimized && frameNumber > 0)
+        vkWaitForFences(device->logical, 1, &frames[(frameNumber - 1) % VKC_FRAMES_IN_FLIGHT].fence, VK_TRUE, UINT64_MAX);
+
+    measureLatency();
+
+    // Every frame up to the one that last used this slot has completed.
+    uint64_t completedFrames = frameNumber >= VKC_FRAMES_IN_FLIGHT ? frameNumber - VKC_FRAMES_IN_FLIGHT + 1 : 0;
+    device->deletionQueue->collect(frameNumber, completedFrames);
+
+    // Recycle all of the frame's command buffers and transient descriptor sets at once.
+    commandAllocator->reset(frameIdx);
+    descriptorAllocator->reset(frameIdx);
+
+    // Read back what the meshlet culling of the frame let through, before the slot is reused.
+    uint64_t clusterTriangles = meshletCuller->takeDrawnTriangles(frameIdx);
+
+    // Read back the occlusion test of the frame, it picks the entities drawn first from now on.
+    uint64_t lateTriangles;
+    uint32_t occludedEntities;
+    occlusionCuller->takeResults(frameIdx, lateTriangles, occludedEntities);
+
+    // Swap in the pipelines rebuilt from changed shaders.
+    reloadShaders();
+
+    // Make room for the uniforms of every entity that may be drawn. The frame
+    // is skipped if that fails, while it can still be dropped without a trace.
+    if (reserveUniforms(frameIdx, entities.size()) != VK_SUCCESS || writeFrameSet(frameIdx) != VK_SUCCESS)
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Uniforms of the frame could not be allocated.";
+        return false;
+    }
+
+    // Get the next image available before the culling lists of the frame are
+    // rebuilt, so a dropped frame never leaves them out of step with the GPU
+    // results read back later. In latency mode this is where the frame waits
+    // for the display, and the scene is sampled again right after it.
+    uint32_t nextImageIdx = 0;
+
+    if (!acquireImage(frame, nextImageIdx))
+        return false;
+
+    if (latencyOptimized)
+        snapshot = snapshots.acquire();
+
+    // Get the view frustum.
+    const QMatrix4x4 &vpMatrix = snapshot->vpMatrix;
+
+    QVector4D frustumPlanes[6];
+    MgCamera::getFrustumPlanes(vpMatrix, frustumPlanes);
+
+    // Update entity transforms and cull them in parallel.
+    int entityCount = qMin(entities.size(), snapshot->modelMatrices.size());
+    jobSystem->parallelFor(entityCount, 64, [this, snapshot, &vpMatrix, &frustumPlanes](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+            entities[i]->update(vpMatrix, snapshot->modelMatrices[i], frustumPlanes, snapshot->pixelScale);
+    }, "updateEntities");
+
+    // Gather the visible entities. Those hidden the last time they were tested
+    // are drawn after the occlusion test, dense ones drawn before it are culled
+    // per meshlet on the GPU. Drawn triangles count the selected levels of
+    // detail of the others, and the read back survivors of the GPU culling.
+    uint64_t sceneTriangles = 0;
+    uint64_t drawnTriangles = clusterTriangles + lateTriangles;
+    QVector<int> lateEntities;
+
+    visibleEntities.clear();
+    cullSlots.clear();
+    meshletCuller->begin(frameIdx);
+    occlusionCuller->begin(frameIdx, vpMatrix);
+
+    for (int i = 0; i < entityCount; i++)
+    {
+        sceneTriangles += entities[i]->getTriangleCount(0);
+
+        if (!entities[i]->visible)
+            continue;
+
+        // The slots of the entities drawn after the test follow their order.
+        if (occlusionCuller->add(frameIdx, i, entities[i]) >= 0)
+        {
+            lateEntities.append(i);
+            continue;
+        }
+
+        int cullSlot = meshletCuller->add(frameIdx, entities[i], snapshot->modelMatrices[i], snapshot->cameraPosition, frustumPlanes);
+
+        visibleEntities.append(i);
+        cullSlots.append(cullSlot);
+
+        if (cullSlot < 0)
+            drawnTriangles += entities[i]->getTriangleCount(entities[i]->getLod());
+    }
+
+    // The entities drawn after the test come last, whole.
+    firstLateEntity = visibleEntities.size();
+    visibleEntities += lateEntities;
+    cullSlots.insert(cullSlots.size(), lateEntities.size(), -1);
+
+    statsMutex.lock();
+    frameStats.sceneTriangles =     sceneTriangles;
+    frameStats.drawnTriangles =     drawnTriangles;
+    frameStats.occludedEntities =   occludedEntities;
+    statsMutex.unlock();
+
+
     MgImage *nextImage = swapchain->colorImages[nextImageIdx];
 
+    // Get a command buffer for this frame.
+    VkCommandBuffer commandBuffer = commandAllocator->allocate(frameIdx, VkcCommandAllocator::currentThread(), VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
 
     // Fill commmand buffer begin info.
     VkCommandBufferBeginInfo commandBeginInfo =
@@ -266,25 +538,224 @@ void VkcInstance::render()
     // Begin command recording.
     vkBeginCommandBuffer(commandBuffer, &commandBeginInfo);
 
-    // Change image layout to color attachment optimal.
-    nextImage->changeLayout(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, commandBuffer);
+    // Cull the meshlets before the graph, whose passes draw the survivors.
+    meshletCuller->record(commandBuffer, frameIdx);
+
+    // The acquired image is handed over by the semaphore wait.
+    nextImage->reset(VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0);
+    context->graph->setImage(context->backbuffer, nextImage);
 
+    // Record large scenes on the workers.
+    bool parallel = firstLateEntity >= VKC_PARALLEL_RECORD_THRESHOLD;
+    bool lateParallel = visibleEntities.size() - firstLateEntity >= VKC_PARALLEL_RECORD_THRESHOLD;
+    context->graph->setPassContents(forwardPass, parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+    context->graph->setPassContents(latePass, lateParallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
 
-    // Fill render pass begin info.
-    VkRenderPassBeginInfo renderPassBeginInfo =
+    // Record the passes of the frame along with their barriers, every forward
+    // pass reports whether it had to skip its draws.
+    currentFrameIdx = frameIdx;
+    drawsSkipped = false;
+    context->graph->execute(commandBuffer);
+
+    // Stop command recording.
+    vkEndCommandBuffer(commandBuffer);
+
+
+    // Fill queue submit info.
+    VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    VkSubmitInfo submitInfo =
     {
-        VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,       // VkStructureType        sType;
-        nullptr,                                        // const void*            pNext;
+        VK_STRUCTURE_TYPE_SUBMIT_INFO,      // VkStructureType                sType;
+        nullptr,                               // const void*                    pNext;
 
-        swapchain->renderPass,                          // VkRenderPass           renderPass;
-        swapchain->framebuffers[nextImageIdx],          // VkFramebuffer          framebuffer;
-        {0, 0, width, height},                          // VkRect2D               renderArea;
-        2,                                              // uint32_t               clearValueCount;
-        swapchain->clearValues                          // const VkClearValue*    pClearValues;
+        1,                                  // uint32_t                       waitSemaphoreCount;
+        &frame.sphAcquire,                  // const VkSemaphore*             pWaitSemaphores;
+
+        &stageMask,                         // const VkPipelineStageFlags*    pWaitDstStageMask;
+
+        1,                                  // uint32_t                       commandBufferCount;
+        &commandBuffer,                     // const VkCommandBuffer*         pCommandBuffers;
+
+        1,                                  // uint32_t                       signalSemaphoreCount;
+        &frame.sphRender                    // const VkSemaphore*             pSignalSemaphores;
     };
 
-    // Begin render pass.
-    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    // Remember when the scene of this frame was sampled, redraws of an old scene are not measured.
+    frame.sampleTime =      snapshot->timestamp;
+    frame.latencyPending =  snapshot->version != renderedVersion;
+    renderedVersion =       snapshot->version;
+
+    // Submit queue, the fence signals once the frame's resources are free again.
+    vkResetFences(device->logical, 1, &frame.fence);
+    vkQueueSubmit(activeQueue, 1, &submitInfo, frame.fence);
+
+
+    // Fill queue present info.
+    VkPresentInfoKHR presentInfo =
+    {
+        VK_STRUCTURE_TYPE_PRESENT_INFO_KHR, // VkStructureType          sType;
+        nullptr,                               // const void*              pNext;
+
+        1,                                  // uint32_t                 waitSemaphoreCount;
+        &frame.sphRender,                   // const VkSemaphore*       pWaitSemaphores;
+
+        1,                                  // uint32_t                 swapchainCount;
+        &swapchain->handle,                 // const VkSwapchainKHR*    pSwapchains;
+
+        &nextImageIdx,                      // const uint32_t*          pImageIndices;
+        nullptr                             // VkResult*                pResults;
+    };
+
+    // Now present.
+    VkResult result = vkQueuePresentKHR(activeQueue, &presentInfo);
+
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+        swapchainDirty = true;
+
+    frameNumber++;
+
+    return true;
+}
+
+
+/**
+ * Acquire the next swapchain image.
+ *
+ * Returns false if the frame has to be skipped.
+ */
+bool VkcInstance::acquireImage(VkcFrame &frame, uint32_t &imageIdx)
+{
+    VkResult result = vkAcquireNextImageKHR(context->device->logical, context->swapchain->handle, UINT64_MAX,
+                                            frame.sphAcquire, VK_NULL_HANDLE, &imageIdx);
+
+    // The swapchain no longer matches the surface, skip the frame and recreate it.
+    if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+        swapchainDirty = true;
+        return false;
+    }
+
+    // A suboptimal swapchain can still present, recreate it afterwards.
+    if (result == VK_SUBOPTIMAL_KHR)
+        swapchainDirty = true;
+    else if (result != VK_SUCCESS)
+        return false;
+
+    return true;
+}
+
+
+/**
+ * Record the latency of the frames the GPU finished since the last check.
+ *
+ * Latency is measured from the moment the main thread sampled the scene to
+ * the moment the frame's fence is seen signaled.
+ */
+void VkcInstance::measureLatency()
+{
+    qint64 now = clock.nsecsElapsed();
+
+    for (uint32_t i = 0; i < VKC_FRAMES_IN_FLIGHT; i++)
+    {
+        VkcFrame &frame = frames[i];
+
+        if (!frame.latencyPending || vkGetFenceStatus(context->device->logical, frame.fence) != VK_SUCCESS)
+            continue;
+
+        frame.latencyPending = false;
+        qint64 latency = now - frame.sampleTime;
+
+        QMutexLocker locker(&statsMutex);
+        latencySum += latency;
+        latencyMax = qMax(latencyMax, latency);
+        latencyCount++;
+    }
+}
+
+
+/**
+ * Record a forward pass drawing a range of visible entities, on the workers for large scenes.
+ */
+void VkcInstance::recordForward(VkCommandBuffer commandBuffer, const VkcGraphPassContext &passContext, int begin, int end)
+{
+    uint32_t frameIdx = currentFrameIdx;
+
+    // Skip the draws until the pipeline has compiled, rather than stalling the frame.
+    if (!context->pipeline->isReady())
+    {
+        drawsSkipped = true;
+        return;
+    }
+
+    int entityCount = end - begin;
+
+    if (entityCount < VKC_PARALLEL_RECORD_THRESHOLD)
+    {
+        recordEntities(commandBuffer, frameIdx, begin, end);
+        return;
+    }
+
+    // Split the draws in one chunk per thread.
+    int chunkCount = jobSystem->workerCount() + 1;
+    int chunkSize = (entityCount + chunkCount - 1) / chunkCount;
+
+    QVector<VkCommandBuffer> secondaryBuffers(chunkCount, VK_NULL_HANDLE);
+    VkCommandBuffer *pSecondaryBuffers = secondaryBuffers.data();
+
+    jobSystem->parallelFor(entityCount, chunkSize,
+                           [this, frameIdx, &passContext, begin, chunkSize, pSecondaryBuffers](int chunkBegin, int chunkEnd)
+    {
+        // Each thread records from its own pool.
+        VkCommandBuffer secondaryBuffer = commandAllocator->allocate(frameIdx, VkcCommandAllocator::currentThread(), VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+        // Fill command buffer inheritance info.
+        VkCommandBufferInheritanceInfo inheritanceInfo =
+        {
+            VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,  // VkStructureType                  sType;
+            nullptr,                                            // const void*                      pNext;
+
+            passContext.renderPass,                             // VkRenderPass                     renderPass;
+            passContext.subpass,                                // uint32_t                         subpass;
+            passContext.framebuffer,                            // VkFramebuffer                    framebuffer;
+
+            VK_FALSE,                                           // VkBool32                         occlusionQueryEnable;
+            0,                                                  // VkQueryControlFlags              queryFlags;
+            0                                                   // VkQueryPipelineStatisticFlags    pipelineStatistics;
+        };
+
+        // Fill commmand buffer begin info.
+        VkCommandBufferBeginInfo secondaryBeginInfo =
+        {
+            VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,        // VkStructureType                          sType;
+            nullptr,                                            // const void*                              pNext;
+            VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |       // VkCommandBufferUsageFlags                flags;
+            VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+
+            &inheritanceInfo                                    // const VkCommandBufferInheritanceInfo*    pInheritanceInfo;
+        };
+
+        vkBeginCommandBuffer(secondaryBuffer, &secondaryBeginInfo);
+        recordEntities(secondaryBuffer, frameIdx, begin + chunkBegin, begin + chunkEnd);
+        vkEndCommandBuffer(secondaryBuffer);
+
+        pSecondaryBuffers[chunkBegin / chunkSize] = secondaryBuffer;
+    }, "recordCommands");
+
+    // Execute the secondary command buffers in order.
+    secondaryBuffers.removeAll(VK_NULL_HANDLE);
+    vkCmdExecuteCommands(commandBuffer, secondaryBuffers.size(), secondaryBuffers.data());
+}
+
+
+/**
+ * Record the draw commands of a range of visible entities.
+ *
+ * Ranges are disjoint, so this may be called from any worker thread.
+ */
+void VkcInstance::recordEntities(VkCommandBuffer commandBuffer, uint32_t frameIdx, int begin, int end)
+{
+    const VkcPipeline       *pipeline =         context->pipeline;
+    VkcFrame                &frame =            frames[frameIdx];
 
     // Bind the graphics pipeline.
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->handle);
@@ -310,96 +781,180 @@ void VkcInstance::render()
 
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    // Bind descriptor sets.
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->layout, 0,
-                            1, &pipeline->descriptorSet, 0, nullptr);
+    // Every entity draws from the shared vertex buffer, bind it once.
+    geometryPool->bind(commandBuffer);
 
+    // The material set is shared by all entities, bind it once.
+    if (materialSet != VK_NULL_HANDLE)
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->layout, materialSetIndex,
+                                1, &materialSet, 0, nullptr);
 
-    // Get the view-projection matrix.
-    QMatrix4x4 vpMatrix;
-    camera->getViewProjectionMatrix(&vpMatrix);
+    // With bindless textures entities only push their texture index.
+    const VkcShaderBinding *textureTable = pipeline->reflection.findBinding("u_Textures");
 
-    // Render our entities.
-    square->render(commandBuffer, uniformBuffer, vpMatrix, device);
+    if (bindlessTable != nullptr && textureTable != nullptr)
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->layout, textureTable->set,
+                                1, &bindlessTable->set, 0, nullptr);
 
-    // End render pass.
-    vkCmdEndRenderPass(commandBuffer);
+    // Push what the shaders declare, the plain fragment shader reads no texture
+    // index and the fallback vertex shader reads no push constants.
+    uint32_t pushSize = qMin((uint32_t)sizeof(VkcDrawConstants), pipeline->reflection.pushConstantSize);
 
+    // Render the entities, with their data pushed or in their own uniform slot.
+    VkIndexType indexType = VK_INDEX_TYPE_MAX_ENUM;
+    bool culledIndices = false;
 
-    // Change image layout to present.
-    nextImage->changeLayout(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, commandBuffer);
+    for (int i = begin; i < end; i++)
+    {
+        VkcEntity *entity = entities[visibleEntities[i]];
+        int cullSlot = cullSlots[i];
 
-    // Stop command recording.
-    vkEndCommandBuffer(commandBuffer);
+        // Meshes with 16 and 32-bit indices use different index buffers,
+        // entities culled per meshlet the culled indices of the frame.
+        if (cullSlot >= 0 && !culledIndices)
+        {
+            meshletCuller->bindIndices(commandBuffer, frameIdx);
+            culledIndices = true;
+            indexType = VK_INDEX_TYPE_MAX_ENUM;
+        }
+        else if (cullSlot < 0 && entity->getMesh().indexType != indexType)
+        {
+            indexType = entity->getMesh().indexType;
+            geometryPool->bindIndices(commandBuffer, indexType);
+            culledIndices = false;
+        }
 
+        VkcDrawConstants constants;
+        entity->getDrawConstants(constants);
 
-    // Fill queue submit info.
-    VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    VkSubmitInfo submitInfo =
+        if (pushSize > 0)
+        {
+            vkCmdPushConstants(commandBuffer, pipeline->layout, pipeline->reflection.pushConstantStages,
+                               0, pushSize, &constants);
+        }
+
+        // The fallback vertex shader reads the rest from the entity's uniform slot.
+        if (!pipeline->pushConstants)
+        {
+            uint32_t uniformOffset = i * uniformStride;
+            memcpy(frame.uniformData + uniformOffset, &constants, sizeof(VkcDrawConstants));
+
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->layout, uniformSetIndex,
+                                    1, &frame.descriptorSet, 1, &uniformOffset);
+        }
+
+        if (i >= firstLateEntity)
+            occlusionCuller->draw(commandBuffer, frameIdx, i - firstLateEntity);
+        else if (cullSlot >= 0)
+            meshletCuller->draw(commandBuffer, frameIdx, cullSlot);
+        else
+            entity->render(commandBuffer);
+    }
+}
+
+
+/**
+ * Recreate the swapchain and pipeline to fit window.
+ *
+ * Returns false if the render graph could not be rebuilt, the frame is then
+ * skipped and the resize tried again with the next one.
+ */
+bool VkcInstance::resize(uint32_t width, uint32_t height)
+{
+    // Update resolution fields.
+    this->width =   width;
+    this->height =  height;
+
+    // Resize context, frames in flight keep using the old swapchain.
+    VkResult result = context->resize();
+
+    // The depth pyramid follows the new depth buffer.
+    occlusionCuller->resize(&context->swapchain->depthStencilImage);
+
+    if (result != VK_SUCCESS)
     {
-        VK_STRUCTURE_TYPE_SUBMIT_INFO,      // VkStructureType                sType;
-        nullptr,                               // const void*                    pNext;
+        qDebug() << "ERROR:   [@qDebug]              - Render graph could not be rebuilt for the new swapchain.";
+        swapchainDirty = true;
+        return false;
+    }
 
-        1,                                  // uint32_t                       waitSemaphoreCount;
-        &sphAcquire,                        // const VkSemaphore*             pWaitSemaphores;
+    swapchainDirty = false;
 
-        &stageMask,                         // const VkPipelineStageFlags*    pWaitDstStageMask;
+    // Report the presentation actually in use.
+    QMutexLocker locker(&statsMutex);
+    frameStats.presentMode =    context->swapchain->presentMode;
+    frameStats.imageCount =     context->swapchain->imageCount;
 
-        1,                                  // uint32_t                       commandBufferCount;
-        &commandBuffer,                     // const VkCommandBuffer*         pCommandBuffers;
+    return true;
+}
 
-        1,                                  // uint32_t                       signalSemaphoreCount;
-        &sphRender                          // const VkSemaphore*             pSignalSemaphores;
-    };
 
-    // Submit queue.
-    vkQueueSubmit(activeQueue, 1, &submitInfo, fence);
+/**
+ * Wait until the device has finished all submitted work.
+ */
+void VkcInstance::waitIdle()
+{
+    vkDeviceWaitIdle(context->device->logical);
+}
 
-    vkWaitForFences(device->logical, 1, &fence, VK_TRUE, UINT64_MAX);
-    vkResetFences(device->logical, 1, &fence);
 
-    vkResetCommandBuffer(commandBuffer, 0);
+/**
+ * Request a new present policy, applied by the render thread before its next frame.
+ */
+void VkcInstance::setPresentPolicy(const VkcPresentPolicy &policy)
+{
+    QMutexLocker locker(&settingsMutex);
 
+    pendingPolicy = policy;
+    policyChanged = true;
+}
 
-    // Fill queue present info.
-    VkPresentInfoKHR presentInfo =
-    {
-        VK_STRUCTURE_TYPE_PRESENT_INFO_KHR, // VkStructureType          sType;
-        nullptr,                               // const void*              pNext;
 
-        1,                                  // uint32_t                 waitSemaphoreCount;
-        &sphRender,                         // const VkSemaphore*       pWaitSemaphores;
+/**
+ * Get the present policy last requested.
+ */
+VkcPresentPolicy VkcInstance::getPresentPolicy()
+{
+    QMutexLocker locker(&settingsMutex);
 
-        1,                                  // uint32_t                 swapchainCount;
-        &swapchain->handle,                 // const VkSwapchainKHR*    pSwapchains;
+    return policyChanged ? pendingPolicy : context->presentPolicy;
+}
 
-        &nextImageIdx,                      // const uint32_t*          pImageIndices;
-        &result                             // VkResult*                pResults;
-    };
 
-    // Now present.
-    vkQueuePresentKHR(activeQueue, &presentInfo);
+/**
+ * Enable or disable the latency-optimized frame pacing.
+ */
+void VkcInstance::setLatencyMode(bool enabled)
+{
+    latencyMode.store(enabled ? 1 : 0);
 }
 
 
 /**
- * Recreate the swapchain and pipeline to fit window.
+ * Check if the latency-optimized frame pacing is enabled.
  */
-void VkcInstance::resize()
+bool VkcInstance::getLatencyMode() const
 {
-    QWidget *parent = (QWidget*)this->parent();
-    if (width != (uint32_t)parent->width() || height != (uint32_t)parent->height())
-    {
-        // Update resolution fields.
-        width = parent->width();
-        height = parent->height();
+    return latencyMode.load() != 0;
+}
 
-        // Resize context.
-        context->resize();
 
-        // Update projection matrix.
-        camera->setProjectionMatrix(3.14159f / 2, (float)width / (float)height, 1, 100);
-    }
+/**
+ * Get the presentation settings and latency measured since the last call.
+ */
+void VkcInstance::takeFrameStats(VkcFrameStats &stats)
+{
+    QMutexLocker locker(&statsMutex);
+
+    stats =                 frameStats;
+    stats.latencyMode =     latencyMode.load() != 0;
+    stats.frameCount =      latencyCount;
+    stats.averageLatencyMs = latencyCount > 0 ? latencySum / 1e6 / latencyCount : 0.0;
+    stats.maxLatencyMs =    latencyMax / 1e6;
+
+    latencySum =    0;
+    latencyMax =    0;
+    latencyCount =  0;
 }
 
 
@@ -468,13 +1023,182 @@ void VkcInstance::printDevices(QFile *file)
 }
 
 
+/**
+ * Print the timing statistics of the jobs run so far.
+ */
+void VkcInstance::printJobStats(QFile *file)
+{
+    file->open(QIODevice::WriteOnly);
+
+    QVector<MgJobStats> stats;
+    jobSystem->getStats(stats);
+
+    file->write(QString("Workers:               %1\r\n\r\n").arg(jobSystem->workerCount()).toStdString().data());
+
+    for (int i = 0; i < stats.size(); i++)
+    {
+        double average = stats[i].count > 0 ? stats[i].totalNs / 1000.0 / stats[i].count : 0.0;
+
+        file->write(QString("Job:                   %1\r\n").arg(stats[i].name).toStdString().data());
+        file->write(QString("   Count:              %1\r\n").arg(stats[i].count).toStdString().data());
+        file->write(QString("   Average:            %1 us\r\n").arg(average, 0, 'f', 2).toStdString().data());
+        file->write(QString("   Maximum:            %1 us\r\n\r\n").arg(stats[i].maxNs / 1000.0, 0, 'f', 2).toStdString().data());
+    }
+
+    file->close();
+}
+
+
+/**
+ * Print how the render graph was last compiled.
+ */
+void VkcInstance::printGraphStats(QFile *file)
+{
+    file->open(QIODevice::WriteOnly);
+
+    VkcGraphStats stats;
+    context->graph->getStats(stats);
+
+    file->write(QString("Passes:                %1
+").arg(stats.passCount).toStdString().data());
+    file->write(QString("   Culled:             %1
+").arg(stats.culledPassCount).toStdString().data());
+    file->write(QString("Render passes:         %1
+").arg(stats.renderPassCount).toStdString().data());
+    file->write(QString("Transient memory:      %1 KiB
+").arg(stats.transientMemorySize / 1024).toStdString().data());
+    file->write(QString("   Allocated:          %1 KiB
+").arg(stats.allocatedMemorySize / 1024).toStdString().data());
+
+    file->close();
+}
+
+
+/**
+ * Print the load timing of every imported asset.
+ */
+void VkcInstance::printAssetStats(QFile *file)
+{
+    file->open(QIODevice::WriteOnly);
+
+    for (int i = 0; i < assetStats.size(); i++)
+    {
+        const MgAssetStats &stats = assetStats[i];
+
+        file->write(QString("Asset:                 %1\r\n").arg(stats.name).toStdString().data());
+        file->write(QString("   Loaded:             %1\r\n").arg(stats.loaded ? "yes" : "no").toStdString().data());
+        file->write(QString("   Meshes:             %1\r\n").arg(stats.meshCount).toStdString().data());
+        file->write(QString("   Primitives:         %1\r\n").arg(stats.primitiveCount).toStdString().data());
+        file->write(QString("   Textures:           %1\r\n").arg(stats.textureCount).toStdString().data());
+        file->write(QString("   Entities:           %1\r\n").arg(stats.entityCount).toStdString().data());
+        file->write(QString("   Parse:              %1 ms\r\n").arg(stats.parseNs / 1000000.0, 0, 'f', 2).toStdString().data());
+        file->write(QString("   Geometry:           %1 ms\r\n").arg(stats.geometryNs / 1000000.0, 0, 'f', 2).toStdString().data());
+        file->write(QString("   Image decode:       %1 ms\r\n").arg(stats.textureNs / 1000000.0, 0, 'f', 2).toStdString().data());
+        file->write(QString("   Total:              %1 ms\r\n\r\n").arg(stats.totalNs / 1000000.0, 0, 'f', 2).toStdString().data());
+    }
+
+    file->close();
+}
+
+
 /**
  * Create render utility objects.
  */
 void VkcInstance::setupRender(const VkcDevice *device)
 {
-    // Create uniform buffer.
-    uniformBuffer.create(16 * sizeof(float), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, device);
+    frameNumber = 0;
+    currentFrameIdx = 0;
+    swapchainDirty = false;
+
+    latencySum =    0;
+    latencyMax =    0;
+    latencyCount =  0;
+
+    frameStats.presentMode =    context->swapchain->presentMode;
+    frameStats.imageCount =     context->swapchain->imageCount;
+
+    // Create the descriptor allocator, with transient pools per frame.
+    descriptorAllocator = new VkcDescriptorAllocator(device, VKC_FRAMES_IN_FLIGHT);
+
+    // Create the meshlet and occlusion cullers, their sets are transient too.
+    meshletCuller = new VkcMeshletCuller(device, geometryPool, descriptorAllocator);
+    occlusionCuller = new VkcOcclusionCuller(device, descriptorAllocator, &context->swapchain->depthStencilImage);
+    firstLateEntity = 0;
+
+    // Draw the entities visible last time straight into the swapchain image.
+    VkcRenderGraph *graph = context->graph;
+
+    forwardPass = graph->addPass("forward", VKC_GRAPH_PASS_GRAPHICS,
+                                 [this](VkCommandBuffer commandBuffer, const VkcGraphPassContext &passContext)
+    {
+        recordForward(commandBuffer, passContext, 0, firstLateEntity);
+    });
+    graph->addAccess(forwardPass, context->backbuffer, VKC_GRAPH_USAGE_COLOR_ATTACHMENT);
+    graph->addAccess(forwardPass, context->depthBuffer, VKC_GRAPH_USAGE_DEPTH_ATTACHMENT);
+
+    // Reduce their depth into the pyramid and test every entity against it.
+    // The results leave the graph through buffers it does not track, so the
+    // pyramid counts as an output.
+    depthPyramid = graph->importImage("depthPyramid", occlusionCuller->getPyramid(), false);
+    graph->setOutput(depthPyramid, VK_IMAGE_LAYOUT_GENERAL);
+
+    occlusionPass = graph->addPass("occlusion", VKC_GRAPH_PASS_COMPUTE,
+                                   [this](VkCommandBuffer commandBuffer, const VkcGraphPassContext&)
+    {
+        occlusionCuller->record(commandBuffer, currentFrameIdx);
+    });
+    graph->addAccess(occlusionPass, context->depthBuffer, VKC_GRAPH_USAGE_DEPTH_READ);
+    graph->addAccess(occlusionPass, depthPyramid, VKC_GRAPH_USAGE_STORAGE_WRITE);
+
+    // Then draw the entities it found visible over them.
+    latePass = graph->addPass("forwardLate", VKC_GRAPH_PASS_GRAPHICS,
+                              [this](VkCommandBuffer commandBuffer, const VkcGraphPassContext &passContext)
+    {
+        recordForward(commandBuffer, passContext, firstLateEntity, visibleEntities.size());
+    });
+    graph->addAccess(latePass, context->backbuffer, VKC_GRAPH_USAGE_COLOR_ATTACHMENT);
+    graph->addAccess(latePass, context->depthBuffer, VKC_GRAPH_USAGE_DEPTH_ATTACHMENT);
+
+    // Compile the graph and start compiling the pipeline.
+    context->setupRender(forwardPass);
+    drawsSkipped = false;
+
+    // Start compiling the pipelines the scene will need in the same pass.
+    VkcPipelineInfo baseInfo;
+    graph->getRenderPass(forwardPass, baseInfo.renderPass, baseInfo.subpass);
+
+    if (device->descriptorIndexing)
+        baseInfo.fragShader = VKC_BINDLESS_FRAG_SHADER;
+    device->pipelineCache->prewarm(VKC_PIPELINE_MANIFEST_FILE, baseInfo);
+
+    // Give every entity uniform its own aligned slot.
+    VkDeviceSize alignment = device->properties.limits.minUniformBufferOffsetAlignment;
+    uniformStride = (uint32_t)((sizeof(VkcDrawConstants) + alignment - 1) / alignment * alignment);
+
+    // Create the command allocator, one pool per frame and recording thread.
+    commandAllocator = new VkcCommandAllocator(device, device->queueFamilies[ACTIVE_FAMILY].index,
+                                               VKC_FRAMES_IN_FLIGHT, jobSystem->workerCount() + 1);
+
+    // Put the textures in the bindless table, if the device has one.
+    bindlessTable = nullptr;
+
+    if (device->descriptorIndexing)
+    {
+        bindlessTable = new VkcBindlessTable(device);
+
+        uint32_t tuxIndex = bindlessTable->add(tux.view, tux.sampler, tux.info.layout);
+
+        QVector<MgTexture2D*> textures;
+        QHash<MgTexture2D*, uint32_t> textureIndices;
+        textureCache->getTextures(textures);
+
+        for (int i = 0; i < textures.size(); i++)
+            textureIndices.insert(textures[i], bindlessTable->add(textures[i]->view, textures[i]->sampler, textures[i]->info.layout));
+
+        // Entities without a texture of their own get the default one.
+        for (int i = 0; i < entities.size(); i++)
+            entities[i]->textureIndex = textureIndices.value(entities[i]->texture, tuxIndex);
+    }
 
     // Create present buffer.
     presentBuffer.create(width * height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT, device);
@@ -487,94 +1211,202 @@ void VkcInstance::setupRender(const VkcDevice *device)
         0                                           // VkSemaphoreCreateFlags    flags;
     };
 
-    // Create semaphores.
-    vkCreateSemaphore(device->logical, &semaphoreInfo, nullptr, &sphAcquire);
-    vkCreateSemaphore(device->logical, &semaphoreInfo, nullptr, &sphRender);
-
-
     // Fill fence create info.
     VkFenceCreateInfo fenceInfo =
     {
         VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,    // VkStructureType           sType;
         nullptr,                                   // const void*               pNext;
-        0                                       // VkFenceCreateFlags        flags;
+        VK_FENCE_CREATE_SIGNALED_BIT            // VkFenceCreateFlags        flags;
     };
 
-    // Create fence.
-    vkCreateFence(device->logical, &fenceInfo, nullptr, &fence);
+    for (uint32_t i = 0; i < VKC_FRAMES_IN_FLIGHT; i++)
+    {
+        // Create semaphores.
+        vkCreateSemaphore(device->logical, &semaphoreInfo, nullptr, &frames[i].sphAcquire);
+        vkCreateSemaphore(device->logical, &semaphoreInfo, nullptr, &frames[i].sphRender);
+
+        // Create fence, signaled so the first wait returns immediately.
+        vkCreateFence(device->logical, &fenceInfo, nullptr, &frames[i].fence);
+
+        // Create uniform buffer, if the pipeline needs one.
+        reserveUniforms(i, 1);
+    }
+
+    createMaterialSet();
+}
+
 
+/**
+ * Destroy render utility objects.
+ */
+void VkcInstance::unsetupRender(const VkcDevice *device)
+{
+    // Destroy present buffer.
+    presentBuffer.destroy();
 
-    // Fill uniform buffer info.
-    VkDescriptorBufferInfo uniformBufferInfo =
+    for (uint32_t i = 0; i < VKC_FRAMES_IN_FLIGHT; i++)
     {
-        uniformBuffer.handle,   // VkBuffer        buffer;
-        0,                      // VkDeviceSize    offset;
-        VK_WHOLE_SIZE           // VkDeviceSize    range;
-    };
+        // Destroy uniform buffer.
+        frames[i].uniformBuffer.destroy();
+
+        // Destroy semaphores.
+        vkDestroySemaphore(device->logical, frames[i].sphAcquire, nullptr);
+        vkDestroySemaphore(device->logical, frames[i].sphRender, nullptr);
+
+        // Destroy fence.
+        vkDestroyFence(device->logical, frames[i].fence, nullptr);
+    }
+
+    // Destroy command allocator.
+    if (commandAllocator != nullptr)
+        delete commandAllocator;
+
+    // Destroy meshlet and occlusion cullers.
+    if (meshletCuller != nullptr)
+        delete meshletCuller;
+
+    if (occlusionCuller != nullptr)
+        delete occlusionCuller;
+
+    // Destroy descriptor allocator, this frees every set.
+    if (descriptorAllocator != nullptr)
+        delete descriptorAllocator;
+
+    // Destroy bindless table.
+    if (bindlessTable != nullptr)
+        delete bindlessTable;
+}
+
+
+/**
+ * Make sure the frame's uniform buffer holds at least count slots.
+ *
+ * The buffer stays mapped for its whole lifetime. It is only recreated after
+ * the frame's fence has signaled, so the GPU no longer reads it. Pipelines
+ * using push constants need no uniform buffer at all.
+ */
+VkResult VkcInstance::reserveUniforms(uint32_t frameIdx, uint32_t count)
+{
+    const VkcDevice *device = context->device;
+    VkcFrame &frame = frames[frameIdx];
+
+    if (context->pipeline->pushConstants || count <= frame.uniformCapacity)
+        return VK_SUCCESS;
+
+    // Grow geometrically.
+    uint32_t capacity = qMax(qNextPowerOfTwo(count), 64u);
+
+    // Destroy the old buffer, this also unmaps it.
+    frame.uniformBuffer.destroy();
+    frame.uniformData = nullptr;
+    frame.uniformCapacity = 0;
+
+    // Create and map the new buffer.
+    mgAssert(frame.uniformBuffer.create(capacity * uniformStride, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, device));
+    mgAssert(vkMapMemory(device->logical, frame.uniformBuffer.memory, 0, VK_WHOLE_SIZE, 0, (void**)&frame.uniformData));
+
+    frame.uniformCapacity = capacity;
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Get the material set for the pipeline's set layouts.
+ *
+ * The texture never changes, so the set comes from the cache of immutable sets.
+ * It is bound at the set index the shaders declare for the texture.
+ */
+void VkcInstance::createMaterialSet()
+{
+    materialSet = VK_NULL_HANDLE;
+    const VkcShaderBinding *textureBinding = context->pipeline->reflection.findBinding("u_ColorTexture");
+
+    if (textureBinding == nullptr)
+        return;
+
+    materialSetIndex = textureBinding->set;
+
+    VkDescriptorSetLayout setLayout = context->pipeline->setLayouts[textureBinding->set];
+
+    QVector<VkcDescriptorData> data;
+    descriptorAllocator->createData(setLayout, data);
 
     // Fill texture info.
-    VkDescriptorImageInfo textureInfo =
+    data[descriptorAllocator->getDataIndex(setLayout, textureBinding->binding)].image =
     {
         tux.sampler,            // VkSampler        sampler;
         tux.view,               // VkImageView      imageView;
         tux.info.layout         // VkImageLayout    imageLayout;
     };
 
-    // Fill write descriptor set info.
-    VkWriteDescriptorSet writeSets[2] =
-    {
-        {
-            VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,     // VkStructureType                  sType;
-            nullptr,                                    // const void*                      pNext;
+    descriptorAllocator->getSet(setLayout, data, materialSet);
+}
+
 
-            context->pipeline->descriptorSet,           // VkDescriptorSet                  dstSet;
-            0,                                          // uint32_t                         dstBinding;
-            0,                                          // uint32_t                         dstArrayElement;
-            1,                                          // uint32_t                         descriptorCount;
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,          // VkDescriptorType                 descriptorType;
+/**
+ * Rebuild the pipelines using recompiled shaders, and swap in the finished rebuilds.
+ *
+ * Called on the render thread at the start of a frame. Rebuilds compile in
+ * the background, so the frame never waits for them; until they are done
+ * the old pipelines keep drawing.
+ */
+void VkcInstance::reloadShaders()
+{
+    VkcPipelineCache *pipelineCache = context->device->pipelineCache;
 
-            nullptr,                                    // const VkDescriptorImageInfo*     pImageInfo;
-            &uniformBufferInfo,                         // const VkDescriptorBufferInfo*    pBufferInfo;
-            nullptr                                     // const VkBufferView*              pTexelBufferView;
-        },
+    QStringList shaders = shaderWatcher->takeCompiled();
+    if (!shaders.isEmpty())
+        pipelineCache->reload(shaders);
 
-        {
-            VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,     // VkStructureType                  sType;
-            nullptr,                                    // const void*                      pNext;
-
-            context->pipeline->descriptorSet,           // VkDescriptorSet                  dstSet;
-            10,                                         // uint32_t                         dstBinding;
-            0,                                          // uint32_t                         dstArrayElement;
-            1,                                          // uint32_t                         descriptorCount;
-            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,  // VkDescriptorType                 descriptorType;
-
-            &textureInfo,                               // const VkDescriptorImageInfo*     pImageInfo;
-            nullptr,                                    // const VkDescriptorBufferInfo*    pBufferInfo;
-            nullptr                                     // const VkBufferView*              pTexelBufferView;
-        }
+    if (shaders.contains(meshletCuller->getShaderName()))
+        meshletCuller->reload();
 
-    };
+    occlusionCuller->reload(shaders);
 
-    // Update descriptor set.
-    vkUpdateDescriptorSets(device->logical, 2, writeSets, 0, nullptr);
+    // The set layouts may have changed along with the shaders.
+    if (pipelineCache->swapReloaded() > 0)
+        createMaterialSet();
 }
 
 
 /**
- * Destroy render utility objects.
+ * Allocate the frame's descriptor set and write it with the frame's buffers.
+ *
+ * The set comes from the frame's transient pools and is freed when the
+ * frame's slot is reused, so it always points at the current uniform buffer.
+ * It is bound at the set index the fallback shader declares for it.
  */
-void VkcInstance::unsetupRender(const VkcDevice *device)
+VkResult VkcInstance::writeFrameSet(uint32_t frameIdx)
 {
-    // Destroy uniform buffer.
-    uniformBuffer.destroy();
+    const VkcPipeline *pipeline = context->pipeline;
+    VkcFrame &frame = frames[frameIdx];
 
-    // Destroy present buffer.
-    presentBuffer.destroy();
+    frame.descriptorSet = VK_NULL_HANDLE;
+
+    // Look up where the fallback shader reads the per-draw data.
+    const VkcShaderBinding *uniformBinding = pipeline->reflection.findBinding("Uniforms");
+
+    if (pipeline->pushConstants || uniformBinding == nullptr)
+        return VK_SUCCESS;
+
+    uniformSetIndex = uniformBinding->set;
+
+    VkDescriptorSetLayout setLayout = pipeline->setLayouts[uniformBinding->set];
+    mgAssert(descriptorAllocator->allocateTransient(frameIdx, setLayout, frame.descriptorSet));
+
+    QVector<VkcDescriptorData> data;
+    descriptorAllocator->createData(setLayout, data);
+
+    // Fill uniform buffer info, a single slot is visible per dynamic offset.
+    data[descriptorAllocator->getDataIndex(setLayout, uniformBinding->binding)].buffer =
+    {
+        frame.uniformBuffer.handle,     // VkBuffer        buffer;
+        0,                              // VkDeviceSize    offset;
+        sizeof(VkcDrawConstants)        // VkDeviceSize    range;
+    };
 
-    // Destroy semaphores.
-    vkDestroySemaphore(device->logical, sphAcquire, nullptr);
-    vkDestroySemaphore(device->logical, sphRender, nullptr);
+    descriptorAllocator->update(frame.descriptorSet, setLayout, data);
 
-    // Destroy fence.
-    vkDestroyFence(device->logical, fence, nullptr);
+    return VK_SUCCESS;
 }
@@ -3,16 +3,67 @@
 
 #include "stable.h"
 #include "vkc_context.h"
+#include "vkc_pipelinecache.h"
 #include "vkc_device.h"
 #include "mgcamera.h"
 #include "mgbuffer.h"
 #include "vkc_entity.h"
 #include "mgtexture2d.h"
+#include "mgjobsystem.h"
+#include "mgscenesnapshot.h"
+#include "vkc_commandallocator.h"
+#include "vkc_descriptorallocator.h"
+#include "vkc_shaderwatcher.h"
+#include "mgtexturecache.h"
+#include "mggltfimporter.h"
+#include "vkc_meshletculler.h"
+#include "vkc_occlusionculler.h"
 
 #define PROC(NAME) PFN_vk##NAME pf##NAME = nullptr
 #define GET_IPROC(INSTANCE, NAME) pf##NAME = (PFN_vk##NAME)vkGetInstanceProcAddr(INSTANCE, "vk" #NAME)
 #define GET_DPROC(INSTANCE, NAME) pf##NAME = (PFN_vk##NAME)vkGetDeviceProcAddr(INSTANCE, "vk" #NAME)
 
+#define VKC_PARALLEL_RECORD_THRESHOLD 256
+#define VKC_PIPELINE_MANIFEST_FILE "data/pipelines.json"
+#define VKC_SCENE_DIRECTORY "data/scenes"
+
+
+/**
+ * Struct used for the resources of a frame in flight.
+ */
+struct VkcFrame
+{
+    VkFence                     fence =             VK_NULL_HANDLE;
+    VkSemaphore                 sphAcquire =        VK_NULL_HANDLE;
+    VkSemaphore                 sphRender =         VK_NULL_HANDLE;
+
+    MgBuffer                    uniformBuffer;
+    uint8_t                     *uniformData =      nullptr;
+    uint32_t                    uniformCapacity =   0;
+    VkDescriptorSet             descriptorSet =     VK_NULL_HANDLE;
+
+    qint64                      sampleTime =        0;
+    bool                        latencyPending =    false;
+};
+
+/**
+ * Struct used to report the presentation settings and measured latency.
+ */
+struct VkcFrameStats
+{
+    VkPresentModeKHR            presentMode =       VK_PRESENT_MODE_FIFO_KHR;
+    uint32_t                    imageCount =        0;
+    bool                        latencyMode =       false;
+
+    uint32_t                    frameCount =        0;
+    double                      averageLatencyMs =  0.0;
+    double                      maxLatencyMs =      0.0;
+
+    uint64_t                    sceneTriangles =    0;
+    uint64_t                    drawnTriangles =    0;
+    uint32_t                    occludedEntities =  0;
+};
+
 
 /**
  * Class used as the Vulkan instance.
@@ -29,20 +80,63 @@ private:
     QVector<VkcDevice*>         devices;
     VkcContext                  *context;
 
-    MgBuffer                    uniformBuffer;
     MgBuffer                    presentBuffer;
     void                        *pPresentBuffer;
     MgCamera                    *camera;
+    MgSnapshotBuffer            snapshots;
 
     uint32_t                    width;
     uint32_t                    height;
-
-    VkSemaphore                 sphAcquire;
-    VkSemaphore                 sphRender;
-    VkFence                     fence;
-
-    VkcEntity*                  square;
+    uint32_t                    sceneWidth;
+    uint32_t                    sceneHeight;
+    QMatrix4x4                  sceneVpMatrix;
+    uint64_t                    sceneVersion;
+    uint64_t                    renderedVersion;
+
+    VkcFrame                    frames[VKC_FRAMES_IN_FLIGHT];
+    uint64_t                    frameNumber;
+    uint32_t                    uniformStride;
+
+    VkcCommandAllocator         *commandAllocator;
+    VkcDescriptorAllocator      *descriptorAllocator;
+    VkcBindlessTable            *bindlessTable;
+    VkDescriptorSet             materialSet;
+    uint32_t                    materialSetIndex;
+    uint32_t                    uniformSetIndex;
+    VkcMeshletCuller            *meshletCuller;
+    VkcOcclusionCuller          *occlusionCuller;
+    QVector<int>                visibleEntities;
+    QVector<int>                cullSlots;
+    int                         firstLateEntity;
+
+    int                         forwardPass;
+    int                         occlusionPass;
+    int                         latePass;
+    int                         depthPyramid;
+    uint32_t                    currentFrameIdx;
+    bool                        swapchainDirty;
+    bool                        drawsSkipped;
+
+    QMutex                      settingsMutex;
+    VkcPresentPolicy            pendingPolicy;
+    bool                        policyChanged;
+    QAtomicInt                  latencyMode;
+
+    QElapsedTimer               clock;
+    QMutex                      statsMutex;
+    VkcFrameStats               frameStats;
+    qint64                      latencySum;
+    qint64                      latencyMax;
+    uint32_t                    latencyCount;
+
+    MgGeometryPool              *geometryPool;
+    QVector<VkcEntity*>         entities;
     MgTexture2D                 tux;
+    MgTextureCache              *textureCache;
+    QVector<MgAssetStats>       assetStats;
+
+    MgJobSystem                 *jobSystem;
+    VkcShaderWatcher            *shaderWatcher;
 
     VkDebugReportCallbackEXT    debugReport;
 
@@ -62,11 +156,42 @@ private:
     void getDevices();
 
 public:
-    void render();
-    void resize();
+    bool update(
+            uint32_t            width,
+            uint32_t            height,
+            bool                animate = true
+            );
+    bool needsRender();
+    bool render();
+    bool resize(
+            uint32_t            width,
+            uint32_t            height
+            );
+    void waitIdle();
+
+    void setPresentPolicy(
+            const VkcPresentPolicy &policy
+            );
+    VkcPresentPolicy getPresentPolicy();
+    void setLatencyMode(
+            bool                enabled
+            );
+    bool getLatencyMode() const;
+    void takeFrameStats(
+            VkcFrameStats       &stats
+            );
     void printDevices(
             QFile               *file
             );
+    void printJobStats(
+            QFile               *file
+            );
+    void printGraphStats(
+            QFile               *file
+            );
+    void printAssetStats(
+            QFile               *file
+            );
 
     void setupRender(
             const VkcDevice     *device
@@ -74,6 +199,34 @@ public:
     void unsetupRender(
             const VkcDevice     *device
             );
+
+private:
+    bool acquireImage(
+            VkcFrame            &frame,
+            uint32_t            &imageIdx
+            );
+    void measureLatency();
+    VkResult reserveUniforms(
+            uint32_t            frameIdx,
+            uint32_t            count
+            );
+    VkResult writeFrameSet(
+            uint32_t            frameIdx
+            );
+    void createMaterialSet();
+    void reloadShaders();
+    void recordForward(
+            VkCommandBuffer     commandBuffer,
+            const VkcGraphPassContext &passContext,
+            int                 begin,
+            int                 end
+            );
+    void recordEntities(
+            VkCommandBuffer     commandBuffer,
+            uint32_t            frameIdx,
+            int                 begin,
+            int                 end
+            );
 };
 
 #endif // VKC_INSTANCE_H
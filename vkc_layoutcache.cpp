@@ -0,0 +1,140 @@
+#include "vkc_layoutcache.h"
+
+
+/**
+ * Create an empty layout cache.
+ */
+VkcLayoutCache::VkcLayoutCache(VkDevice device)
+{
+    this->device = device;
+}
+
+
+/**
+ * Destroy all layouts.
+ *
+ * Called once no pipeline or descriptor set uses them anymore.
+ */
+VkcLayoutCache::~VkcLayoutCache()
+{
+    for (auto it = pipelineLayouts.constBegin(); it != pipelineLayouts.constEnd(); ++it)
+        vkDestroyPipelineLayout(device, it.value(), nullptr);
+
+    for (auto it = setLayouts.constBegin(); it != setLayouts.constEnd(); ++it)
+        vkDestroyDescriptorSetLayout(device, it.value(), nullptr);
+}
+
+
+/**
+ * Get the descriptor set layout for a list of bindings, sorted by binding.
+ *
+ * Binding flags are either empty or given for every binding.
+ */
+VkResult VkcLayoutCache::getSetLayout(const QVector<VkDescriptorSetLayoutBinding> &bindings, VkDescriptorSetLayoutCreateFlags flags,
+                                      const QVector<VkDescriptorBindingFlagsEXT> &bindingFlags, VkDescriptorSetLayout &setLayout)
+{
+    QByteArray key((const char*)&flags, sizeof(flags));
+    key.append((const char*)bindings.constData(), bindings.size() * sizeof(VkDescriptorSetLayoutBinding));
+    key.append((const char*)bindingFlags.constData(), bindingFlags.size() * sizeof(VkDescriptorBindingFlagsEXT));
+
+    QMutexLocker locker(&mutex);
+
+    auto it = setLayouts.constFind(key);
+    if (it != setLayouts.constEnd())
+    {
+        setLayout = it.value();
+        return VK_SUCCESS;
+    }
+
+    // Fill binding flags info.
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo =
+    {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT,  // VkStructureType                    sType;
+        nullptr,                                                                // const void*                        pNext;
+
+        (uint32_t)bindingFlags.size(),                                          // uint32_t                           bindingCount;
+        bindingFlags.constData()                                                // const VkDescriptorBindingFlags*    pBindingFlags;
+    };
+
+    void *pBindingFlagsInfo = bindingFlags.isEmpty() ? nullptr : &bindingFlagsInfo;
+
+    // Fill descriptor set layout info.
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo =
+    {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,    // VkStructureType                        sType;
+        pBindingFlagsInfo,                                      // const void*                            pNext;
+        flags,                                                  // VkDescriptorSetLayoutCreateFlags       flags;
+
+        (uint32_t)bindings.size(),                              // uint32_t                               bindingCount;
+        bindings.constData()                                    // const VkDescriptorSetLayoutBinding*    pBindings;
+    };
+
+    // Create descriptor set layout.
+    mgAssert(vkCreateDescriptorSetLayout(device, &setLayoutInfo, nullptr, &setLayout));
+
+    setLayouts.insert(key, setLayout);
+    setBindings.insert((uint64_t)setLayout, bindings);
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Get the bindings a descriptor set layout was created from.
+ */
+bool VkcLayoutCache::getBindings(VkDescriptorSetLayout setLayout, QVector<VkDescriptorSetLayoutBinding> &bindings)
+{
+    QMutexLocker locker(&mutex);
+
+    auto it = setBindings.constFind((uint64_t)setLayout);
+    if (it == setBindings.constEnd())
+        return false;
+
+    bindings = it.value();
+
+    return true;
+}
+
+
+/**
+ * Get the pipeline layout for a list of set layouts and push constant ranges.
+ */
+VkResult VkcLayoutCache::getPipelineLayout(const QVector<VkDescriptorSetLayout> &setLayouts, const QVector<VkPushConstantRange> &pushConstantRanges,
+                                           VkPipelineLayout &layout)
+{
+    uint32_t setCount = setLayouts.size();
+
+    QByteArray key((const char*)&setCount, sizeof(setCount));
+    key.append((const char*)setLayouts.constData(), setLayouts.size() * sizeof(VkDescriptorSetLayout));
+    key.append((const char*)pushConstantRanges.constData(), pushConstantRanges.size() * sizeof(VkPushConstantRange));
+
+    QMutexLocker locker(&mutex);
+
+    auto it = pipelineLayouts.constFind(key);
+    if (it != pipelineLayouts.constEnd())
+    {
+        layout = it.value();
+        return VK_SUCCESS;
+    }
+
+    // Fill pipeline layout info.
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo =
+    {
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,      // VkStructureType                 sType;
+        nullptr,                                            // const void*                     pNext;
+        0,                                                  // VkPipelineLayoutCreateFlags     flags;
+
+        (uint32_t)setLayouts.size(),                        // uint32_t                        setLayoutCount;
+        setLayouts.constData(),                             // const VkDescriptorSetLayout*    pSetLayouts;
+
+        (uint32_t)pushConstantRanges.size(),                // uint32_t                        pushConstantRangeCount;
+        pushConstantRanges.constData()                      // const VkPushConstantRange*      pPushConstantRanges;
+    };
+
+    // Create pipeline layout.
+    mgAssert(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &layout));
+
+    pipelineLayouts.insert(key, layout);
+
+    return VK_SUCCESS;
+}
@@ -0,0 +1,52 @@
+#ifndef VKC_LAYOUTCACHE_H
+#define VKC_LAYOUTCACHE_H
+
+#include "stable.h"
+
+
+/**
+ * Class used to share descriptor set and pipeline layouts.
+ *
+ * Layouts are hashed by their definition, so equal definitions get the same
+ * handle. Pipelines with the same layout can then switch without rebinding
+ * their descriptor sets. Layouts are small and few, so they live as long as
+ * the device.
+ *
+ * Classes named "Vkc[class]" stand for "Vulkan custom class".
+ */
+class VkcLayoutCache
+{
+    // Objects:
+private:
+    QMutex                                      mutex;
+    QHash<QByteArray, VkDescriptorSetLayout>    setLayouts;
+    QHash<QByteArray, VkPipelineLayout>         pipelineLayouts;
+    QHash<uint64_t, QVector<VkDescriptorSetLayoutBinding>> setBindings;
+
+    VkDevice                                    device;
+
+    // Functions:
+public:
+    VkcLayoutCache(
+            VkDevice                            device
+            );
+    ~VkcLayoutCache();
+
+    VkResult getSetLayout(
+            const QVector<VkDescriptorSetLayoutBinding> &bindings,
+            VkDescriptorSetLayoutCreateFlags    flags,
+            const QVector<VkDescriptorBindingFlagsEXT> &bindingFlags,
+            VkDescriptorSetLayout               &setLayout
+            );
+    bool getBindings(
+            VkDescriptorSetLayout               setLayout,
+            QVector<VkDescriptorSetLayoutBinding> &bindings
+            );
+    VkResult getPipelineLayout(
+            const QVector<VkDescriptorSetLayout> &setLayouts,
+            const QVector<VkPushConstantRange>  &pushConstantRanges,
+            VkPipelineLayout                    &layout
+            );
+};
+
+#endif // VKC_LAYOUTCACHE_H
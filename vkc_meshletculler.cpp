@@ -0,0 +1,271 @@
+#include "vkc_meshletculler.h"
+#include "mgbarrierbatch.h"
+
+
+/**
+ * Create the culling pipeline and the buffers of every frame in flight.
+ */
+VkcMeshletCuller::VkcMeshletCuller(const VkcDevice *device, MgGeometryPool *geometryPool, VkcDescriptorAllocator *descriptorAllocator)
+{
+    this->device =              device;
+    this->geometryPool =        geometryPool;
+    this->descriptorAllocator = descriptorAllocator;
+
+    pipeline = new VkcComputePipeline(VKC_MESHLET_CULL_SHADER, device);
+
+    for (uint32_t i = 0; i < VKC_FRAMES_IN_FLIGHT; i++)
+        createFrame(frames[i]);
+}
+
+
+/**
+ * Destroy the pipeline and the buffers, this also unmaps them.
+ */
+VkcMeshletCuller::~VkcMeshletCuller()
+{
+    for (uint32_t i = 0; i < VKC_FRAMES_IN_FLIGHT; i++)
+    {
+        frames[i].drawBuffer.destroy();
+        frames[i].commandBuffer.destroy();
+        frames[i].indexBuffer.destroy();
+    }
+
+    delete pipeline;
+}
+
+
+/**
+ * Create the culling pipeline again, after its shader changed.
+ *
+ * Called on the render thread between frames; the old pipeline is retired
+ * once the frames in flight are done with it.
+ */
+void VkcMeshletCuller::reload()
+{
+    VkcComputePipeline *reloaded = new VkcComputePipeline(VKC_MESHLET_CULL_SHADER, device);
+
+    // Keep the old pipeline if the new shader does not work.
+    if (!reloaded->isReady())
+    {
+        delete reloaded;
+        return;
+    }
+
+    delete pipeline;
+    pipeline = reloaded;
+}
+
+
+/**
+ * Get the file name of the culling shader.
+ */
+const QString& VkcMeshletCuller::getShaderName() const
+{
+    return pipeline->getShaderName();
+}
+
+
+/**
+ * Get how many triangles survived the culling of the last frame using this slot.
+ *
+ * The frame's fence must have signaled.
+ */
+uint64_t VkcMeshletCuller::takeDrawnTriangles(uint32_t frameIdx)
+{
+    const VkcCullFrame &frame = frames[frameIdx];
+    uint64_t triangleCount = 0;
+
+    for (uint32_t i = 0; i < frame.drawCount; i++)
+        triangleCount += frame.commands[i].indexCount / 3;
+
+    return triangleCount;
+}
+
+
+/**
+ * Start gathering the entities of a frame.
+ */
+void VkcMeshletCuller::begin(uint32_t frameIdx)
+{
+    VkcCullFrame &frame = frames[frameIdx];
+
+    frame.drawCount =   0;
+    frame.taskCount =   0;
+    frame.indexCount =  0;
+}
+
+
+/**
+ * Add a visible entity to be culled per meshlet.
+ *
+ * Returns the slot of its indirect draw, or -1 if the entity has too few
+ * meshlets or the frame is full, and it has to be drawn whole.
+ */
+int VkcMeshletCuller::add(uint32_t frameIdx, const VkcEntity *entity, const QMatrix4x4 &modelMatrix, const QVector3D &cameraPosition,
+                          const QVector4D frustumPlanes[6])
+{
+    VkcCullFrame &frame = frames[frameIdx];
+
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    entity->getMeshlets(firstMeshlet, meshletCount);
+
+    uint32_t indexCount = entity->getTriangleCount(entity->getLod()) * 3;
+
+    if (!pipeline->isReady() || frame.draws == nullptr || frame.commands == nullptr || meshletCount < VKC_MESHLET_CULL_MIN_MESHLETS ||
+            frame.drawCount == VKC_MESHLET_CULL_MAX_DRAWS || frame.indexCount + indexCount > VKC_MESHLET_CULL_MAX_INDICES)
+        return -1;
+
+    int slot = frame.drawCount++;
+    VkcCullDraw &draw = frame.draws[slot];
+    const MgMeshRange &mesh = entity->getMesh();
+
+    // A world space plane p is transpose(M) p in model space, with distances still in world units.
+    QMatrix4x4 transposed = modelMatrix.transposed();
+
+    for (int i = 0; i < 6; i++)
+    {
+        QVector4D plane = transposed * frustumPlanes[i];
+
+        for (int j = 0; j < 4; j++)
+            draw.frustumPlanes[i][j] = plane[j];
+    }
+
+    QVector3D camera = modelMatrix.inverted().map(cameraPosition);
+
+    draw.cameraPosition[0] = camera.x();
+    draw.cameraPosition[1] = camera.y();
+    draw.cameraPosition[2] = camera.z();
+
+    // Normal cones only hold under rotations and uniform scales.
+    float scaleX = modelMatrix.column(0).toVector3D().length();
+    float scaleY = modelMatrix.column(1).toVector3D().length();
+    float scaleZ = modelMatrix.column(2).toVector3D().length();
+    float maxScale = qMax(scaleX, qMax(scaleY, scaleZ));
+    float minScale = qMin(scaleX, qMin(scaleY, scaleZ));
+
+    draw.radiusScale =      maxScale;
+    draw.coneCulling =      maxScale - minScale <= maxScale * 0.001f && modelMatrix.determinant() > 0.0;
+
+    draw.firstMeshlet =     firstMeshlet;
+    draw.meshletCount =     meshletCount;
+    draw.firstTask =        frame.taskCount;
+    draw.firstIndex =       mesh.firstIndex;
+    draw.shortIndices =     mesh.indexType == VK_INDEX_TYPE_UINT16;
+    draw.culledFirstIndex = frame.indexCount;
+    draw.reserved =         0;
+
+    // The shader counts the indices of the surviving meshlets.
+    frame.commands[slot] =
+    {
+        0,                          // uint32_t    indexCount;
+        1,                          // uint32_t    instanceCount;
+        frame.indexCount,           // uint32_t    firstIndex;
+        mesh.vertexOffset,          // int32_t     vertexOffset;
+        0                           // uint32_t    firstInstance;
+    };
+
+    frame.taskCount +=  meshletCount;
+    frame.indexCount += indexCount;
+
+    return slot;
+}
+
+
+/**
+ * Register the commands culling the meshlets of the frame's entities.
+ *
+ * Must be recorded outside of a render pass, before the draws reading the results.
+ */
+void VkcMeshletCuller::record(VkCommandBuffer commandBuffer, uint32_t frameIdx)
+{
+    const VkcCullFrame &frame = frames[frameIdx];
+
+    if (frame.drawCount == 0)
+        return;
+
+    // Point a transient set at the pool and the frame's buffers.
+    VkDescriptorSetLayout setLayout = pipeline->setLayouts[0];
+    VkDescriptorSet set;
+
+    if (descriptorAllocator->allocateTransient(frameIdx, setLayout, set) != VK_SUCCESS)
+        return;
+
+    QVector<VkcDescriptorData> data;
+    descriptorAllocator->createData(setLayout, data);
+
+    QVector<QPair<QByteArray, VkBuffer>> buffers =
+    {
+        {"Meshlets",        geometryPool->meshletBuffer.handle},
+        {"Draws",           frame.drawBuffer.handle},
+        {"Indices",         geometryPool->indexBuffer.handle},
+        {"ShortIndices",    geometryPool->shortIndexBuffer.handle},
+        {"DrawCommands",    frame.commandBuffer.handle},
+        {"CulledIndices",   frame.indexBuffer.handle}
+    };
+
+    for (int i = 0; i < buffers.size(); i++)
+    {
+        int dataIndex = descriptorAllocator->getDataIndex(setLayout, pipeline->getBinding(buffers[i].first));
+
+        if (dataIndex >= 0)
+            data[dataIndex].buffer = {buffers[i].second, 0, VK_WHOLE_SIZE};
+    }
+
+    descriptorAllocator->update(set, setLayout, data);
+
+    // One workgroup per meshlet, in rows as wide as every device allows.
+    VkcCullConstants constants = {frame.drawCount, frame.taskCount};
+
+    uint32_t groupCountX = qMin(frame.taskCount, (uint32_t)VKC_MESHLET_CULL_GROUPS_X);
+    uint32_t groupCountY = (frame.taskCount + groupCountX - 1) / groupCountX;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->handle);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->layout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, pipeline->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(VkcCullConstants), &constants);
+    vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+
+    // The draws read the counts and indices the shader wrote, the host reads the counts back later.
+    MgBarrierBatch barriers;
+    barriers.addMemoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                              VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                              VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_HOST_READ_BIT);
+    barriers.flush(commandBuffer);
+}
+
+
+/**
+ * Bind the frame's culled indices, shared by every entity culled per meshlet.
+ */
+void VkcMeshletCuller::bindIndices(VkCommandBuffer commandBuffer, uint32_t frameIdx) const
+{
+    vkCmdBindIndexBuffer(commandBuffer, frames[frameIdx].indexBuffer.handle, 0, VK_INDEX_TYPE_UINT32);
+}
+
+
+/**
+ * Draw the surviving meshlets of an entity, the culled indices must be bound.
+ */
+void VkcMeshletCuller::draw(VkCommandBuffer commandBuffer, uint32_t frameIdx, int slot) const
+{
+    vkCmdDrawIndexedIndirect(commandBuffer, frames[frameIdx].commandBuffer.handle, slot * sizeof(VkDrawIndexedIndirectCommand),
+                             1, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+
+/**
+ * Create and map the buffers of a frame.
+ */
+VkResult VkcMeshletCuller::createFrame(VkcCullFrame &frame)
+{
+    mgAssert(frame.drawBuffer.create(VKC_MESHLET_CULL_MAX_DRAWS * sizeof(VkcCullDraw), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, device));
+    mgAssert(frame.commandBuffer.create(VKC_MESHLET_CULL_MAX_DRAWS * sizeof(VkDrawIndexedIndirectCommand),
+                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, device));
+    mgAssert(frame.indexBuffer.create((VkDeviceSize)VKC_MESHLET_CULL_MAX_INDICES * sizeof(uint32_t),
+                                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, device));
+
+    mgAssert(vkMapMemory(device->logical, frame.drawBuffer.memory, 0, VK_WHOLE_SIZE, 0, (void**)&frame.draws));
+    mgAssert(vkMapMemory(device->logical, frame.commandBuffer.memory, 0, VK_WHOLE_SIZE, 0, (void**)&frame.commands));
+
+    return VK_SUCCESS;
+}
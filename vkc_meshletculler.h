@@ -0,0 +1,137 @@
+#ifndef VKC_MESHLETCULLER_H
+#define VKC_MESHLETCULLER_H
+
+#include "stable.h"
+#include "vkc_device.h"
+#include "vkc_computepipeline.h"
+#include "vkc_descriptorallocator.h"
+#include "vkc_entity.h"
+#include "mggeometrypool.h"
+#include "mgbuffer.h"
+
+#define VKC_MESHLET_CULL_SHADER "meshlet_cull.comp.spv"
+#define VKC_MESHLET_CULL_MIN_MESHLETS 8
+#define VKC_MESHLET_CULL_MAX_DRAWS 1024
+#define VKC_MESHLET_CULL_MAX_INDICES 4194304
+#define VKC_MESHLET_CULL_GROUPS_X 65535
+
+
+/**
+ * Struct used for an entity culled per meshlet, matching the Draw struct of the culling shader.
+ *
+ * The frustum planes and camera position are in the model space of the
+ * entity; the radius scale brings meshlet radii to world space. The cone
+ * test is left out for entities whose transform does not keep angles.
+ */
+struct VkcCullDraw
+{
+    float                       frustumPlanes[6][4];
+    float                       cameraPosition[3];
+    float                       radiusScale;
+
+    uint32_t                    firstMeshlet;
+    uint32_t                    meshletCount;
+    uint32_t                    firstTask;
+    uint32_t                    firstIndex;
+    uint32_t                    shortIndices;
+    uint32_t                    coneCulling;
+    uint32_t                    culledFirstIndex;
+    uint32_t                    reserved;
+};
+
+/**
+ * Struct used for the push constants of the culling shader.
+ */
+struct VkcCullConstants
+{
+    uint32_t                    drawCount;
+    uint32_t                    taskCount;
+};
+
+/**
+ * Struct used for the buffers of a frame in flight.
+ */
+struct VkcCullFrame
+{
+    MgBuffer                    drawBuffer;
+    VkcCullDraw                 *draws =        nullptr;
+    MgBuffer                    commandBuffer;
+    VkDrawIndexedIndirectCommand *commands =    nullptr;
+    MgBuffer                    indexBuffer;
+
+    uint32_t                    drawCount =     0;
+    uint32_t                    taskCount =     0;
+    uint32_t                    indexCount =    0;
+};
+
+
+/**
+ * Class used to cull the meshlets of dense entities on the GPU.
+ *
+ * Entities with enough meshlets in their selected level of detail are added
+ * to the frame instead of being drawn whole. A compute shader then tests
+ * every meshlet against the view frustum and its normal cone against the
+ * camera, and copies the indices of the survivors into a buffer of the
+ * frame, counting them in an indexed indirect draw per entity. So the
+ * triangles drawn follow what is visible rather than the size of the mesh.
+ *
+ * Classes named "Vkc[class]" stand for "Vulkan custom class".
+ */
+class VkcMeshletCuller
+{
+    // Objects:
+private:
+    VkcComputePipeline          *pipeline;
+    VkcCullFrame                frames[VKC_FRAMES_IN_FLIGHT];
+
+    MgGeometryPool              *geometryPool;
+    VkcDescriptorAllocator      *descriptorAllocator;
+    const VkcDevice             *device;
+
+    // Functions:
+public:
+    VkcMeshletCuller(
+            const VkcDevice     *device,
+            MgGeometryPool      *geometryPool,
+            VkcDescriptorAllocator *descriptorAllocator
+            );
+    ~VkcMeshletCuller();
+
+    void reload();
+    const QString& getShaderName() const;
+
+    uint64_t takeDrawnTriangles(
+            uint32_t            frameIdx
+            );
+    void begin(
+            uint32_t            frameIdx
+            );
+    int add(
+            uint32_t            frameIdx,
+            const VkcEntity     *entity,
+            const QMatrix4x4    &modelMatrix,
+            const QVector3D     &cameraPosition,
+            const QVector4D     frustumPlanes[6]
+            );
+
+    void record(
+            VkCommandBuffer     commandBuffer,
+            uint32_t            frameIdx
+            );
+    void bindIndices(
+            VkCommandBuffer     commandBuffer,
+            uint32_t            frameIdx
+            ) const;
+    void draw(
+            VkCommandBuffer     commandBuffer,
+            uint32_t            frameIdx,
+            int                 slot
+            ) const;
+
+private:
+    VkResult createFrame(
+            VkcCullFrame        &frame
+            );
+};
+
+#endif // VKC_MESHLETCULLER_H
@@ -0,0 +1,529 @@
+#include "vkc_occlusionculler.h"
+#include "mgbarrierbatch.h"
+
+
+/**
+ * Create the pipelines, the depth pyramid and the buffers of every frame in flight.
+ */
+VkcOcclusionCuller::VkcOcclusionCuller(const VkcDevice *device, VkcDescriptorAllocator *descriptorAllocator, const MgImage *depthImage)
+{
+    this->device =              device;
+    this->descriptorAllocator = descriptorAllocator;
+    this->depthImage =          depthImage;
+
+    depthView = VK_NULL_HANDLE;
+    sampler =   VK_NULL_HANDLE;
+
+    pyramidPipeline =   new VkcComputePipeline(VKC_DEPTH_PYRAMID_SHADER, device);
+    cullPipeline =      new VkcComputePipeline(VKC_OCCLUSION_CULL_SHADER, device);
+
+    // The depth buffer is only reduced if its format can be sampled.
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(device->physical, depthImage->info.format, &formatProperties);
+
+    depthSampled = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+
+    if (!depthSampled)
+        qDebug() << "ERROR:   [@qDebug]              - The depth format cannot be sampled, occlusion culling is off.";
+
+    // Fill sampler info, texels are fetched so only nearest filtering fits.
+    VkSamplerCreateInfo samplerInfo =
+    {
+        VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,      // VkStructureType         sType;
+        nullptr,                                    // const void*             pNext;
+        0,                                          // VkSamplerCreateFlags    flags;
+
+        VK_FILTER_NEAREST,                          // VkFilter                magFilter;
+        VK_FILTER_NEAREST,                          // VkFilter                minFilter;
+        VK_SAMPLER_MIPMAP_MODE_NEAREST,             // VkSamplerMipmapMode     mipmapMode;
+
+        VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,      // VkSamplerAddressMode    addressModeU;
+        VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,      // VkSamplerAddressMode    addressModeV;
+        VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,      // VkSamplerAddressMode    addressModeW;
+        0.0f,                                       // float                   mipLodBias;
+
+        VK_FALSE,                                   // VkBool32                anisotropyEnable;
+        1.0f,                                       // float                   maxAnisotropy;
+
+        VK_FALSE,                                   // VkBool32                compareEnable;
+        VK_COMPARE_OP_NEVER,                        // VkCompareOp             compareOp;
+
+        0.0f,                                       // float                   minLod;
+        VK_LOD_CLAMP_NONE,                          // float                   maxLod;
+
+        VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,    // VkBorderColor           borderColor;
+        VK_FALSE,                                   // VkBool32                unnormalizedCoordinates;
+    };
+
+    // Create sampler.
+    vkCreateSampler(device->logical, &samplerInfo, nullptr, &sampler);
+
+    createPyramid();
+
+    for (uint32_t i = 0; i < VKC_FRAMES_IN_FLIGHT; i++)
+        createFrame(frames[i]);
+}
+
+
+/**
+ * Destroy the pipelines, the pyramid and the buffers, this also unmaps them.
+ */
+VkcOcclusionCuller::~VkcOcclusionCuller()
+{
+    for (uint32_t i = 0; i < VKC_FRAMES_IN_FLIGHT; i++)
+    {
+        frames[i].objectBuffer.destroy();
+        frames[i].commandBuffer.destroy();
+        frames[i].visibilityBuffer.destroy();
+    }
+
+    destroyPyramid();
+    device->deletionQueue->retire(VKC_DELETION_SAMPLER, (uint64_t)sampler);
+
+    delete pyramidPipeline;
+    delete cullPipeline;
+}
+
+
+/**
+ * Create the pyramid again for a new depth buffer, after the swapchain was resized.
+ *
+ * The old pyramid is retired once the frames in flight are done with it.
+ */
+void VkcOcclusionCuller::resize(const MgImage *depthImage)
+{
+    this->depthImage = depthImage;
+
+    destroyPyramid();
+    createPyramid();
+}
+
+
+/**
+ * Create the pipelines whose shaders changed again.
+ *
+ * Called on the render thread between frames; a pipeline is only replaced
+ * if its new shader works.
+ */
+void VkcOcclusionCuller::reload(const QStringList &shaders)
+{
+    const QString shaderNames[] = {VKC_DEPTH_PYRAMID_SHADER, VKC_OCCLUSION_CULL_SHADER};
+    VkcComputePipeline **pipelines[] = {&pyramidPipeline, &cullPipeline};
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (!shaders.contains(shaderNames[i]))
+            continue;
+
+        VkcComputePipeline *reloaded = new VkcComputePipeline(shaderNames[i], device);
+
+        if (!reloaded->isReady())
+        {
+            delete reloaded;
+            continue;
+        }
+
+        delete *pipelines[i];
+        *pipelines[i] = reloaded;
+    }
+}
+
+
+/**
+ * Check if entities can be tested.
+ */
+bool VkcOcclusionCuller::isReady() const
+{
+    return pyramidPipeline->isReady() && cullPipeline->isReady() && depthView != VK_NULL_HANDLE;
+}
+
+
+/**
+ * Get the depth pyramid, to be imported into the render graph.
+ */
+MgImage* VkcOcclusionCuller::getPyramid()
+{
+    return &pyramid;
+}
+
+
+/**
+ * Read back the test of the last frame using this slot, choosing the entities drawn first from now on.
+ *
+ * The frame's fence must have signaled. Also gets how many triangles the
+ * entities drawn after the test added, and how many entities were hidden.
+ */
+void VkcOcclusionCuller::takeResults(uint32_t frameIdx, uint64_t &drawnTriangles, uint32_t &occludedCount)
+{
+    VkcOcclusionFrame &frame = frames[frameIdx];
+
+    drawnTriangles =    0;
+    occludedCount =     0;
+
+    for (int i = 0; i < frame.entities.size(); i++)
+    {
+        bool visible = frame.visibility[i] != 0;
+
+        if (frame.entities[i] < history.size())
+            history[frame.entities[i]] = visible;
+
+        if (!visible)
+            occludedCount++;
+    }
+
+    for (uint32_t i = 0; i < frame.commandCount; i++)
+        drawnTriangles += frame.commands[i].instanceCount * frame.commands[i].indexCount / 3;
+
+    // The results are only taken once.
+    frame.entities.clear();
+    frame.commandCount = 0;
+}
+
+
+/**
+ * Start gathering the entities of a frame, seen through a view-projection matrix.
+ */
+void VkcOcclusionCuller::begin(uint32_t frameIdx, const QMatrix4x4 &vpMatrix)
+{
+    VkcOcclusionFrame &frame = frames[frameIdx];
+
+    frame.entities.clear();
+    frame.commandCount =    0;
+    frame.vpMatrix =        vpMatrix;
+}
+
+
+/**
+ * Add an entity in the view frustum to be tested.
+ *
+ * Returns the slot of its indirect draw if it was hidden the last time it
+ * was tested, so it has to be drawn after the test. Returns -1 if it is
+ * drawn before the test, or cannot be tested at all.
+ */
+int VkcOcclusionCuller::add(uint32_t frameIdx, int entityIdx, const VkcEntity *entity)
+{
+    VkcOcclusionFrame &frame = frames[frameIdx];
+
+    if (!isReady() || frame.objects == nullptr || frame.commands == nullptr || frame.visibility == nullptr ||
+            frame.entities.size() == VKC_OCCLUSION_MAX_OBJECTS)
+        return -1;
+
+    // Entities never tested count as visible.
+    while (history.size() <= entityIdx)
+        history.append(true);
+
+    int objectIdx = frame.entities.size();
+    frame.entities.append(entityIdx);
+
+    QVector3D center;
+    float radius;
+    entity->getWorldBounds(center, radius);
+
+    VkcOcclusionObject &object = frame.objects[objectIdx];
+    object.center[0] =  center.x();
+    object.center[1] =  center.y();
+    object.center[2] =  center.z();
+    object.radius =     radius;
+    object.command =    VKC_OCCLUSION_NO_COMMAND;
+
+    if (history[entityIdx])
+        return -1;
+
+    // The shader sets the instance count.
+    int slot = frame.commandCount++;
+    MgMeshRange range = entity->getDrawRange();
+
+    frame.commands[slot] =
+    {
+        range.indexCount,           // uint32_t    indexCount;
+        0,                          // uint32_t    instanceCount;
+        range.firstIndex,           // uint32_t    firstIndex;
+        range.vertexOffset,         // int32_t     vertexOffset;
+        0                           // uint32_t    firstInstance;
+    };
+
+    object.command = slot;
+
+    return slot;
+}
+
+
+/**
+ * Register the commands building the depth pyramid and testing the frame's entities.
+ *
+ * Must be recorded outside of a render pass, after the entities drawn before
+ * the test and before the ones drawn after it. The depth buffer must be
+ * readable by compute shaders and the pyramid in the general layout.
+ */
+void VkcOcclusionCuller::record(VkCommandBuffer commandBuffer, uint32_t frameIdx)
+{
+    VkcOcclusionFrame &frame = frames[frameIdx];
+
+    if (frame.entities.isEmpty())
+        return;
+
+    VkDescriptorSetLayout setLayout = cullPipeline->setLayouts[0];
+    VkDescriptorSet set;
+
+    // Without a pyramid the entities drawn after the test are drawn anyway, and tested again next time.
+    if (recordPyramid(commandBuffer, frameIdx) != VK_SUCCESS ||
+            descriptorAllocator->allocateTransient(frameIdx, setLayout, set) != VK_SUCCESS)
+    {
+        for (uint32_t i = 0; i < frame.commandCount; i++)
+            frame.commands[i].instanceCount = 1;
+
+        frame.entities.clear();
+        frame.commandCount = 0;
+        return;
+    }
+
+    // Point the set at the frame's buffers and the whole pyramid.
+    QVector<VkcDescriptorData> data;
+    descriptorAllocator->createData(setLayout, data);
+
+    QVector<QPair<QByteArray, VkBuffer>> buffers =
+    {
+        {"Objects",         frame.objectBuffer.handle},
+        {"DrawCommands",    frame.commandBuffer.handle},
+        {"Visibility",      frame.visibilityBuffer.handle}
+    };
+
+    for (int i = 0; i < buffers.size(); i++)
+    {
+        int dataIndex = descriptorAllocator->getDataIndex(setLayout, cullPipeline->getBinding(buffers[i].first));
+
+        if (dataIndex >= 0)
+            data[dataIndex].buffer = {buffers[i].second, 0, VK_WHOLE_SIZE};
+    }
+
+    int pyramidIndex = descriptorAllocator->getDataIndex(setLayout, cullPipeline->getBinding("u_Pyramid"));
+
+    if (pyramidIndex >= 0)
+        data[pyramidIndex].image = {sampler, pyramid.view, VK_IMAGE_LAYOUT_GENERAL};
+
+    descriptorAllocator->update(set, setLayout, data);
+
+    // One thread per entity.
+    VkcOcclusionConstants constants;
+    memcpy(constants.vpMatrix, frame.vpMatrix.constData(), sizeof(constants.vpMatrix));
+    constants.objectCount =     frame.entities.size();
+    constants.levelCount =      pyramid.info.resourceRange.levelCount;
+    constants.pyramidSize[0] =  pyramid.info.extent.width;
+    constants.pyramidSize[1] =  pyramid.info.extent.height;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline->handle);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline->layout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, cullPipeline->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(VkcOcclusionConstants), &constants);
+    vkCmdDispatch(commandBuffer, (frame.entities.size() + 63) / 64, 1, 1);
+
+    // The draws read the instance counts the shader wrote, the host reads the results back later.
+    MgBarrierBatch barriers;
+    barriers.addMemoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                              VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                              VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT);
+    barriers.flush(commandBuffer);
+}
+
+
+/**
+ * Draw an entity added after the test, the index buffer of its mesh's type must be bound.
+ */
+void VkcOcclusionCuller::draw(VkCommandBuffer commandBuffer, uint32_t frameIdx, int slot) const
+{
+    vkCmdDrawIndexedIndirect(commandBuffer, frames[frameIdx].commandBuffer.handle, slot * sizeof(VkDrawIndexedIndirectCommand),
+                             1, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+
+/**
+ * Create and map the buffers of a frame.
+ */
+VkResult VkcOcclusionCuller::createFrame(VkcOcclusionFrame &frame)
+{
+    mgAssert(frame.objectBuffer.create(VKC_OCCLUSION_MAX_OBJECTS * sizeof(VkcOcclusionObject), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, device));
+    mgAssert(frame.commandBuffer.create(VKC_OCCLUSION_MAX_OBJECTS * sizeof(VkDrawIndexedIndirectCommand),
+                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, device));
+    mgAssert(frame.visibilityBuffer.create(VKC_OCCLUSION_MAX_OBJECTS * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, device));
+
+    mgAssert(vkMapMemory(device->logical, frame.objectBuffer.memory, 0, VK_WHOLE_SIZE, 0, (void**)&frame.objects));
+    mgAssert(vkMapMemory(device->logical, frame.commandBuffer.memory, 0, VK_WHOLE_SIZE, 0, (void**)&frame.commands));
+    mgAssert(vkMapMemory(device->logical, frame.visibilityBuffer.memory, 0, VK_WHOLE_SIZE, 0, (void**)&frame.visibility));
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Create the pyramid for the depth buffer, with a view per level and a depth view of the depth buffer.
+ *
+ * The pyramid is the largest power of two size fitting in the depth buffer,
+ * so every level halves the one before exactly.
+ */
+VkResult VkcOcclusionCuller::createPyramid()
+{
+    const VkExtent3D &depthExtent = depthImage->info.extent;
+
+    uint32_t width = 1;
+    while (width * 2 <= depthExtent.width)
+        width *= 2;
+
+    uint32_t height = 1;
+    while (height * 2 <= depthExtent.height)
+        height *= 2;
+
+    uint32_t levelCount = 1;
+    while ((qMax(width, height) >> levelCount) > 0)
+        levelCount++;
+
+    MgImageInfo pyramidInfo =
+    {
+        VK_IMAGE_TYPE_2D,                                   // VkImageType               type;
+        {                                                   // VkExtent3D                extent;
+            width,                                              // uint32_t              width;
+            height,                                             // uint32_t              height;
+            1                                                   // uint32_t              depth;
+        },
+        VK_FORMAT_R32_SFLOAT,                               // VkFormat                  format;
+        VK_IMAGE_LAYOUT_GENERAL,                            // VkImageLayout             layout;
+        VK_IMAGE_USAGE_STORAGE_BIT |                        // VkImageUsageFlags         usage;
+        VK_IMAGE_USAGE_SAMPLED_BIT,
+        {                                                   // VkImageSubresourceRange   resourceRange;
+            VK_IMAGE_ASPECT_COLOR_BIT,                          // VkImageAspectFlags    aspectMask;
+            0,                                                  // uint32_t              baseMipLevel;
+            levelCount,                                         // uint32_t              levelCount;
+            0,                                                  // uint32_t              baseArrayLayer;
+            1,                                                  // uint32_t              layerCount;
+        },
+
+        VK_NULL_HANDLE,                                     // const VkImage             image;
+        true,                                               // bool                      createView;
+        false                                               // bool                      createSampler;
+    };
+
+    // Create pyramid image.
+    mgAssert(pyramid.create(device, &pyramidInfo));
+
+    // Each level is written through its own view.
+    levelViews.fill(VK_NULL_HANDLE, levelCount);
+
+    for (uint32_t i = 0; i < levelCount; i++)
+        mgAssert(createView(pyramid.handle, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, i, 1, levelViews[i]));
+
+    // Only the depth aspect of the depth buffer can be sampled.
+    if (depthSampled)
+        mgAssert(createView(depthImage->handle, depthImage->info.format, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, depthView));
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Retire the pyramid and the views.
+ */
+void VkcOcclusionCuller::destroyPyramid()
+{
+    VkcDeletionQueue *deletionQueue = device->deletionQueue;
+
+    for (int i = 0; i < levelViews.size(); i++)
+        deletionQueue->retire(VKC_DELETION_IMAGE_VIEW, (uint64_t)levelViews[i]);
+
+    levelViews.clear();
+
+    deletionQueue->retire(VKC_DELETION_IMAGE_VIEW, (uint64_t)depthView);
+    depthView = VK_NULL_HANDLE;
+
+    pyramid.destroy(device);
+}
+
+
+/**
+ * Register the commands reducing the depth buffer into every level of the pyramid.
+ */
+VkResult VkcOcclusionCuller::recordPyramid(VkCommandBuffer commandBuffer, uint32_t frameIdx)
+{
+    VkDescriptorSetLayout setLayout = pyramidPipeline->setLayouts[0];
+
+    int sourceIndex = descriptorAllocator->getDataIndex(setLayout, pyramidPipeline->getBinding("u_Source"));
+    int targetIndex = descriptorAllocator->getDataIndex(setLayout, pyramidPipeline->getBinding("u_Target"));
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipeline->handle);
+
+    // Level 0 reads the depth buffer, every other level the one before.
+    VkcPyramidConstants constants;
+    constants.sourceSize[0] =   depthImage->info.extent.width;
+    constants.sourceSize[1] =   depthImage->info.extent.height;
+
+    for (int i = 0; i < levelViews.size(); i++)
+    {
+        constants.targetSize[0] =   qMax(pyramid.info.extent.width >> i, 1u);
+        constants.targetSize[1] =   qMax(pyramid.info.extent.height >> i, 1u);
+
+        // Point a transient set at the source and the target.
+        VkDescriptorSet set;
+        mgAssert(descriptorAllocator->allocateTransient(frameIdx, setLayout, set));
+
+        QVector<VkcDescriptorData> data;
+        descriptorAllocator->createData(setLayout, data);
+
+        if (sourceIndex >= 0)
+        {
+            if (i == 0)
+                data[sourceIndex].image = {sampler, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+            else
+                data[sourceIndex].image = {sampler, levelViews[i - 1], VK_IMAGE_LAYOUT_GENERAL};
+        }
+
+        if (targetIndex >= 0)
+            data[targetIndex].image = {VK_NULL_HANDLE, levelViews[i], VK_IMAGE_LAYOUT_GENERAL};
+
+        descriptorAllocator->update(set, setLayout, data);
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipeline->layout, 0, 1, &set, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, pyramidPipeline->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(VkcPyramidConstants), &constants);
+        vkCmdDispatch(commandBuffer, (constants.targetSize[0] + 7) / 8, (constants.targetSize[1] + 7) / 8, 1);
+
+        // The next level, or the test, reads what this one wrote.
+        MgBarrierBatch barriers;
+        barriers.addMemoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        barriers.flush(commandBuffer);
+
+        constants.sourceSize[0] =   constants.targetSize[0];
+        constants.sourceSize[1] =   constants.targetSize[1];
+    }
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Create a 2D view of a range of levels of an image.
+ */
+VkResult VkcOcclusionCuller::createView(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t level,
+                                        uint32_t levelCount, VkImageView &view)
+{
+    // Fill image view info.
+    VkImageViewCreateInfo viewInfo =
+    {
+        VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,   // VkStructureType            sType;
+        nullptr,                                    // const void*                pNext;
+        0,                                          // VkImageViewCreateFlags     flags;
+
+        image,                                      // VkImage                    image;
+        VK_IMAGE_VIEW_TYPE_2D,                      // VkImageViewType            viewType;
+        format,                                     // VkFormat                   format;
+        {  },                                       // VkComponentMapping         components;
+        {                                           // VkImageSubresourceRange    subresourceRange;
+            aspect,                                     // VkImageAspectFlags    aspectMask;
+            level,                                      // uint32_t              baseMipLevel;
+            levelCount,                                 // uint32_t              levelCount;
+            0,                                          // uint32_t              baseArrayLayer;
+            1                                           // uint32_t              layerCount;
+        }
+    };
+
+    // Create image view.
+    mgAssert(vkCreateImageView(device->logical, &viewInfo, nullptr, &view));
+
+    return VK_SUCCESS;
+}
@@ -0,0 +1,170 @@
+#ifndef VKC_OCCLUSIONCULLER_H
+#define VKC_OCCLUSIONCULLER_H
+
+#include "stable.h"
+#include "vkc_device.h"
+#include "vkc_computepipeline.h"
+#include "vkc_descriptorallocator.h"
+#include "vkc_entity.h"
+#include "mgimage.h"
+#include "mgbuffer.h"
+
+#define VKC_DEPTH_PYRAMID_SHADER "depth_pyramid.comp.spv"
+#define VKC_OCCLUSION_CULL_SHADER "occlusion_cull.comp.spv"
+#define VKC_OCCLUSION_MAX_OBJECTS 65536
+#define VKC_OCCLUSION_NO_COMMAND UINT32_MAX
+
+
+/**
+ * Struct used for an entity tested against the depth pyramid, matching the Object struct of the culling shader.
+ *
+ * Entities drawn after the test have an indirect draw, whose instance
+ * count the shader sets.
+ */
+struct VkcOcclusionObject
+{
+    float                       center[3];
+    float                       radius;
+
+    uint32_t                    command;
+    uint32_t                    reserved[3];
+};
+
+/**
+ * Struct used for the push constants of the culling shader.
+ */
+struct VkcOcclusionConstants
+{
+    float                       vpMatrix[16];
+    uint32_t                    objectCount;
+    uint32_t                    levelCount;
+    float                       pyramidSize[2];
+};
+
+/**
+ * Struct used for the push constants of the depth pyramid shader.
+ */
+struct VkcPyramidConstants
+{
+    uint32_t                    sourceSize[2];
+    uint32_t                    targetSize[2];
+};
+
+/**
+ * Struct used for the buffers of a frame in flight.
+ */
+struct VkcOcclusionFrame
+{
+    MgBuffer                    objectBuffer;
+    VkcOcclusionObject          *objects =      nullptr;
+    MgBuffer                    commandBuffer;
+    VkDrawIndexedIndirectCommand *commands =    nullptr;
+    MgBuffer                    visibilityBuffer;
+    uint32_t                    *visibility =   nullptr;
+
+    QVector<int>                entities =      {};
+    uint32_t                    commandCount =  0;
+    QMatrix4x4                  vpMatrix;
+};
+
+
+/**
+ * Class used to cull entities hidden behind others, with a hierarchical depth buffer.
+ *
+ * The frame is drawn in two phases. Entities visible the last time they
+ * were tested are drawn first. Their depth is then reduced into a pyramid
+ * keeping the farthest depth of every texel, and every entity in the view
+ * frustum is tested against the level where its bounds cover at most two
+ * texels. The entities not drawn yet are drawn after the test through
+ * indirect draws, with no instance if they are hidden.
+ *
+ * The results of the test are read back once the frame's fence has
+ * signaled, they choose which entities are drawn first in later frames.
+ * Entities only change phase late, but none is ever hidden wrongly.
+ *
+ * Classes named "Vkc[class]" stand for "Vulkan custom class".
+ */
+class VkcOcclusionCuller
+{
+    // Objects:
+private:
+    VkcComputePipeline          *pyramidPipeline;
+    VkcComputePipeline          *cullPipeline;
+    VkcOcclusionFrame           frames[VKC_FRAMES_IN_FLIGHT];
+
+    MgImage                     pyramid;
+    QVector<VkImageView>        levelViews;
+    VkImageView                 depthView;
+    VkSampler                   sampler;
+    const MgImage               *depthImage;
+
+    QVector<bool>               history;
+    bool                        depthSampled;
+
+    VkcDescriptorAllocator      *descriptorAllocator;
+    const VkcDevice             *device;
+
+    // Functions:
+public:
+    VkcOcclusionCuller(
+            const VkcDevice     *device,
+            VkcDescriptorAllocator *descriptorAllocator,
+            const MgImage       *depthImage
+            );
+    ~VkcOcclusionCuller();
+
+    void resize(
+            const MgImage       *depthImage
+            );
+    void reload(
+            const QStringList   &shaders
+            );
+    bool isReady() const;
+    MgImage* getPyramid();
+
+    void takeResults(
+            uint32_t            frameIdx,
+            uint64_t            &drawnTriangles,
+            uint32_t            &occludedCount
+            );
+    void begin(
+            uint32_t            frameIdx,
+            const QMatrix4x4    &vpMatrix
+            );
+    int add(
+            uint32_t            frameIdx,
+            int                 entityIdx,
+            const VkcEntity     *entity
+            );
+
+    void record(
+            VkCommandBuffer     commandBuffer,
+            uint32_t            frameIdx
+            );
+    void draw(
+            VkCommandBuffer     commandBuffer,
+            uint32_t            frameIdx,
+            int                 slot
+            ) const;
+
+private:
+    VkResult createFrame(
+            VkcOcclusionFrame   &frame
+            );
+    VkResult createPyramid();
+    void destroyPyramid();
+    VkResult recordPyramid(
+            VkCommandBuffer     commandBuffer,
+            uint32_t            frameIdx
+            );
+    VkResult createView(
+            VkImage             image,
+            VkFormat            format,
+            VkImageAspectFlags  aspect,
+            uint32_t            level,
+            uint32_t            levelCount,
+            VkImageView         &view
+            );
+};
+
+#endif // VKC_OCCLUSIONCULLER_H
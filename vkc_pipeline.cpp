@@ -1,112 +1,274 @@
 #include "vkc_pipeline.h"
 
+#include <algorithm>
+
+
+/**
+ * Load and reflect the shaders of the graphics pipeline and get its layouts.
+ */
+VkcPipeline::VkcPipeline(const VkcPipelineInfo &info, const VkcDevice *device)
+{
+    handle =        VK_NULL_HANDLE;
+    layout =        VK_NULL_HANDLE;
+    vertShader =    VK_NULL_HANDLE;
+    fragShader =    VK_NULL_HANDLE;
+    pushConstants = false;
+    vertexStride =  0;
+
+    this->info =    info;
+    this->device =  device;
+    status.store(VKC_PIPELINE_PENDING);
+
+    // Shaders decode packed vertices behind a feature of their own.
+    if (info.vertexFormat == MG_VERTEX_FORMAT_PACKED)
+        this->info.features |= VKC_FEATURE_PACKED_VERTEX;
+
+    // Per-draw data goes in push constants if the device has room for it,
+    // otherwise the fallback vertex shader reads it from a uniform buffer.
+    bool fits = info.drawDataSize <= device->properties.limits.maxPushConstantsSize;
+
+    if (!loadShader(fits ? info.vertShader : info.vertShaderFallback, vertCode) || !loadShader(info.fragShader, fragCode))
+    {
+        status.store(VKC_PIPELINE_FAILED);
+        return;
+    }
+
+    // Read the interface of both stages.
+    VkcShaderReflection fragReflection;
+
+    if (!reflection.parse(vertCode, VK_SHADER_STAGE_VERTEX_BIT) || !fragReflection.parse(fragCode, VK_SHADER_STAGE_FRAGMENT_BIT))
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Shaders" << info.vertShader << info.fragShader << "are not valid SPIR-V.";
+        status.store(VKC_PIPELINE_FAILED);
+        return;
+    }
+
+    // Per-draw data is pushed if the vertex stage reads it from push constants,
+    // the fragment stage may push its texture index with either vertex shader.
+    pushConstants = reflection.pushConstantSize > 0;
+    reflection.merge(fragReflection);
+
+    if (createLayouts() != VK_SUCCESS)
+    {
+        status.store(VKC_PIPELINE_FAILED);
+        return;
+    }
+
+    createVertexLayout();
+}
+
 
 /**
- * Create the graphics pipeline.
+ * Get the descriptor set and pipeline layouts matching the reflected bindings.
  */
-VkcPipeline::VkcPipeline(const VkcSwapchain *swapchain, const VkcDevice *device)
+VkResult VkcPipeline::createLayouts()
 {
-    // Fill descriptor set binding info.
-    QVector<VkDescriptorSetLayoutBinding> setBindings =
+    // Gather the bindings of every set.
+    uint32_t setCount = 1;
+    for (int i = 0; i < reflection.bindings.size(); i++)
+        setCount = qMax(setCount, reflection.bindings[i].set + 1);
+
+    QVector<QVector<VkDescriptorSetLayoutBinding>> setBindings(setCount);
+    QVector<bool> bindlessSets(setCount, false);
+
+    for (int i = 0; i < reflection.bindings.size(); i++)
     {
+        const VkcShaderBinding &binding = reflection.bindings[i];
+        VkDescriptorType type = binding.type;
 
+        // An unsized texture array is the bindless table.
+        if (binding.count == 0)
         {
-            0,                                          // uint32_t              binding;
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,          // VkDescriptorType      descriptorType;
-            1,                                          // uint32_t              descriptorCount;
-            VK_SHADER_STAGE_VERTEX_BIT,                 // VkShaderStageFlags    stageFlags;
-            nullptr                                     // const VkSampler*      pImmutableSamplers;
-        },
+            if (!device->descriptorIndexing || type != VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER || binding.binding != VKC_BINDLESS_BINDING)
+            {
+                qDebug() << "ERROR:   [@qDebug]              - Unsized array" << binding.name << "is not a supported bindless table.";
+                return VK_ERROR_FEATURE_NOT_PRESENT;
+            }
 
+            bindlessSets[binding.set] = true;
+        }
+
+        // Buffer blocks named in the description take dynamic offsets.
+        if (info.dynamicBuffers.contains(binding.typeName))
         {
-            10,                                         // uint32_t              binding;
-            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,  // VkDescriptorType      descriptorType;
-            1,                                          // uint32_t              descriptorCount;
-            VK_SHADER_STAGE_FRAGMENT_BIT,               // VkShaderStageFlags    stageFlags;
-            nullptr                                     // const VkSampler*      pImmutableSamplers;
+            if (type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+                type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+            else if (type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+                type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
         }
 
-    };
+        VkDescriptorSetLayoutBinding setBinding =
+        {
+            binding.binding,                            // uint32_t              binding;
+            type,                                       // VkDescriptorType      descriptorType;
+            binding.count,                              // uint32_t              descriptorCount;
+            binding.stages,                             // VkShaderStageFlags    stageFlags;
+            nullptr                                     // const VkSampler*      pImmutableSamplers;
+        };
+
+        // Keep the bindings sorted, so equal sets hash equally.
+        QVector<VkDescriptorSetLayoutBinding> &bindings = setBindings[binding.set];
+
+        int j = 0;
+        while (j < bindings.size() && bindings[j].binding < setBinding.binding)
+            j++;
 
-    // Fill desctriptor set size info.
-    QVector<VkDescriptorPoolSize> poolSizes =
+        bindings.insert(j, setBinding);
+    }
+
+    // Get the set layouts.
+    setLayouts.resize(setCount);
+
+    for (uint32_t i = 0; i < setCount; i++)
     {
+        if (!bindlessSets[i])
         {
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,          // VkDescriptorType    type;
-            1                                           // uint32_t            descriptorCount;
-        },
+            mgAssert(device->layoutCache->getSetLayout(setBindings[i], 0, {}, setLayouts[i]));
+            continue;
+        }
 
+        // The bindless table is a set of its own.
+        if (setBindings[i].size() > 1)
         {
-            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,  // VkDescriptorType    type;
-            1                                           // uint32_t            descriptorCount;
+            qDebug() << "ERROR:   [@qDebug]              - Bindless table shares set" << i << "with other bindings.";
+            return VK_ERROR_FEATURE_NOT_PRESENT;
         }
-    };
 
-    // Fill descriptor set layout info.
-    VkDescriptorSetLayoutCreateInfo setLayoutInfo =
+        mgAssert(VkcBindlessTable::getSetLayout(device, setLayouts[i]));
+    }
+
+    // Fill push constant range info.
+    QVector<VkPushConstantRange> pushConstantRanges;
+
+    if (reflection.pushConstantSize > 0)
     {
-        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,    // VkStructureType                        sType;
-        nullptr,                                                // const void*                            pNext;
-        0,                                                      // VkDescriptorSetLayoutCreateFlags       flags;
+        VkPushConstantRange pushConstantRange =
+        {
+            reflection.pushConstantStages,                  // VkShaderStageFlags    stageFlags;
+            0,                                              // uint32_t              offset;
+            reflection.pushConstantSize                     // uint32_t              size;
+        };
 
-        (uint32_t)setBindings.size(),                           // uint32_t                               bindingCount;
-        setBindings.data()                                      // const VkDescriptorSetLayoutBinding*    pBindings;
-    };
+        pushConstantRanges.append(pushConstantRange);
+    }
+
+    // Get the pipeline layout.
+    mgAssert(device->layoutCache->getPipelineLayout(setLayouts, pushConstantRanges, layout));
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Match the vertex layout of the description with the shader inputs.
+ *
+ * Without a described layout packed vertices use the layout of their format,
+ * and float inputs are packed tightly in location order.
+ */
+void VkcPipeline::createVertexLayout()
+{
+    // Sort the inputs by location.
+    QVector<VkcShaderInput> inputs = reflection.inputs;
+    std::sort(inputs.begin(), inputs.end(), [](const VkcShaderInput &a, const VkcShaderInput &b) { return a.location < b.location; });
 
-    // Create descriptor set layout.
-    vkCreateDescriptorSetLayout(device->logical, &setLayoutInfo, nullptr, &setLayout);
+    QVector<VkVertexInputAttributeDescription> attributes = info.vertexAttributes;
+    vertexStride = info.vertexStride;
 
-    // Fill descriptor pool info.
-    VkDescriptorPoolCreateInfo descriptorPoolInfo =
+    if (attributes.isEmpty() && info.vertexFormat != MG_VERTEX_FORMAT_FLOAT)
     {
-        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,          // VkStructureType                sType;
-        nullptr,                                                // const void*                    pNext;
-        VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,      // VkDescriptorPoolCreateFlags    flags;
+        MgVertexFormat::getAttributes(info.vertexFormat, attributes);
+        vertexStride = MgVertexFormat::getStride(info.vertexFormat);
+    }
 
-        1,                                                      // uint32_t                       maxSets;
-        (uint32_t)poolSizes.size(),                             // uint32_t                       poolSizeCount;
-        poolSizes.data()                                        // const VkDescriptorPoolSize*    pPoolSizes;
-    };
+    if (attributes.isEmpty())
+    {
+        vertexStride = 0;
+
+        for (int i = 0; i < inputs.size(); i++)
+        {
+            vertexAttributes.append({inputs[i].location, 0, inputs[i].format, vertexStride});
+            vertexStride += inputs[i].size;
+        }
 
-    // Create descriptor pool.
-    vkCreateDescriptorPool(device->logical, &descriptorPoolInfo, nullptr, &descriptorPool);
+        if (info.vertexStride > 0)
+            vertexStride = info.vertexStride;
 
-    // Fill descriptor set allocate info.
-    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo =
+        return;
+    }
+
+    // Only pass the attributes the shader reads.
+    for (int i = 0; i < inputs.size(); i++)
     {
+        int j = 0;
+        while (j < attributes.size() && attributes[j].location != inputs[i].location)
+            j++;
+
+        if (j < attributes.size())
+            vertexAttributes.append(attributes[j]);
+        else
+            qDebug() << "ERROR:   [@qDebug]              - Vertex input" << inputs[i].location << "of" << info.vertShader << "is not described.";
+    }
+}
+
 
-        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,     // VkStructureType                 sType;
-        nullptr,                                            // const void*                     pNext;
+/**
+ * Create the shaders and the graphics pipeline.
+ *
+ * Only touches objects of this pipeline and the internally synchronized
+ * cache, so different pipelines may compile in parallel.
+ */
+VkResult VkcPipeline::compile(VkPipelineCache cache)
+{
+    // Loading or reflecting the shaders may have failed already.
+    if (status.loadAcquire() == VKC_PIPELINE_FAILED)
+        return VK_ERROR_INITIALIZATION_FAILED;
 
-        descriptorPool,                                     // VkDescriptorPool                descriptorPool;
-        1,                                                  // uint32_t                        descriptorSetCount;
-        &setLayout                                          // const VkDescriptorSetLayout*    pSetLayouts;
+    // Create shaders from the code read when the pipeline was described.
+    VkResult result = createShader(vertShader, vertCode);
 
-    };
+    if (result == VK_SUCCESS)
+        result = createShader(fragShader, fragCode);
 
-    // Allocate space for descriptor set.
-    vkAllocateDescriptorSets(device->logical, &descriptorSetAllocateInfo, &descriptorSet);
+    // The code is no longer needed.
+    vertCode.clear();
+    fragCode.clear();
 
-    // Fill pipeline layout info.
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo =
+    if (result != VK_SUCCESS)
     {
-        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,      // VkStructureType                 sType;
-        nullptr,                                            // const void*                     pNext;
-        0,                                                  // VkPipelineLayoutCreateFlags     flags;
+        status.storeRelease(VKC_PIPELINE_FAILED);
+        return result;
+    }
 
-        1,                                                  // uint32_t                        setLayoutCount;
-        &setLayout,                                         // const VkDescriptorSetLayout*    pSetLayouts;
+    // Fill the value of every feature the shaders declare, a stage ignores the ones it lacks.
+    QVector<VkSpecializationMapEntry> featureEntries;
+    QVector<VkBool32> featureValues;
 
-        0,                                                  // uint32_t                        pushConstantRangeCount;
-        nullptr                                             // const VkPushConstantRange*      pPushConstantRanges;
-    };
+    for (uint32_t bit = 0; bit < 32; bit++)
+    {
+        if ((reflection.featureMask & (1u << bit)) == 0)
+            continue;
 
-    // Create pipeline layout.
-    vkCreatePipelineLayout(device->logical, &pipelineLayoutInfo, nullptr, &layout);
+        uint32_t offset = (uint32_t)(featureValues.size() * sizeof(VkBool32));
 
-    // Create shaders.
-    createShader(vertShader, "shader.vert.spv", device);
-    createShader(fragShader, "shader.frag.spv", device);
+        featureEntries.append(
+        {
+            bit,                    // uint32_t    constantID;
+            offset,                 // uint32_t    offset;
+            sizeof(VkBool32)        // size_t      size;
+        });
+        featureValues.append((info.features & (1u << bit)) != 0 ? VK_TRUE : VK_FALSE);
+    }
+
+    // Fill specialization info.
+    VkSpecializationInfo specializationInfo =
+    {
+        (uint32_t)featureEntries.size(),                    // uint32_t                           mapEntryCount;
+        featureEntries.constData(),                         // const VkSpecializationMapEntry*    pMapEntries;
+        featureValues.size() * sizeof(VkBool32),            // size_t                             dataSize;
+        featureValues.constData()                           // const void*                        pData;
+    };
+
+    const VkSpecializationInfo *pSpecializationInfo = featureEntries.isEmpty() ? nullptr : &specializationInfo;
 
     // Fill shader stage info.
     QVector<VkPipelineShaderStageCreateInfo> shaderStages =
@@ -120,7 +282,7 @@ VkcPipeline::VkcPipeline(const VkcSwapchain *swapchain, const VkcDevice *device)
 
             vertShader,                                             // VkShaderModule                      module;
             "main",                                                 // const char*                         pName;
-            nullptr                                                 // const VkSpecializationInfo*         pSpecializationInfo;
+            pSpecializationInfo                                     // const VkSpecializationInfo*         pSpecializationInfo;
         },
 
         {
@@ -132,7 +294,7 @@ VkcPipeline::VkcPipeline(const VkcSwapchain *swapchain, const VkcDevice *device)
 
             fragShader,                                             // VkShaderModule                      module;
             "main",                                                 // const char*                         pName;
-            nullptr                                                 // const VkSpecializationInfo*         pSpecializationInfo;
+            pSpecializationInfo                                     // const VkSpecializationInfo*         pSpecializationInfo;
         }
     };
 
@@ -140,35 +302,10 @@ VkcPipeline::VkcPipeline(const VkcSwapchain *swapchain, const VkcDevice *device)
     VkVertexInputBindingDescription vertexBinding =
     {
         0,                                      // uint32_t             binding;
-        sizeof(VkVertex),                       // uint32_t             stride;
+        vertexStride,                           // uint32_t             stride;
         VK_VERTEX_INPUT_RATE_VERTEX,            // VkVertexInputRate    inputRate;
     };
 
-    // Fill vertex input attribute description.
-    QVector<VkVertexInputAttributeDescription> vertexAttributes =
-    {
-        {
-            0,                                  // uint32_t    location;
-            0,                                  // uint32_t    binding;
-            VK_FORMAT_R32G32B32_SFLOAT,         // VkFormat    format;
-            offsetof(VkVertex, x)               // uint32_t    offset;
-        },
-
-        {
-            1,                                  // uint32_t    location;
-            0,                                  // uint32_t    binding;
-            VK_FORMAT_R32G32_SFLOAT,            // VkFormat    format;
-            offsetof(VkVertex, u)               // uint32_t    offset;
-        },
-
-        {
-            2,                                  // uint32_t    location;
-            0,                                  // uint32_t    binding;
-            VK_FORMAT_R32G32B32_SFLOAT,         // VkFormat    format;
-            offsetof(VkVertex, nx)              // uint32_t    offset;
-        }
-    };
-
     // Fill vertex input state info.
     VkPipelineVertexInputStateCreateInfo vertexInfo =
     {
@@ -176,11 +313,11 @@ VkcPipeline::VkcPipeline(const VkcSwapchain *swapchain, const VkcDevice *device)
         nullptr,                                                        // const void*                                 pNext;
         0,                                                              // VkPipelineVertexInputStateCreateFlags       flags;
 
-        1,                                                              // uint32_t                                    vertexBindingDescriptionCount;
+        vertexAttributes.isEmpty() ? 0u : 1u,                           // uint32_t                                    vertexBindingDescriptionCount;
         &vertexBinding,                                                 // const VkVertexInputBindingDescription*      pVertexBindingDescriptions;
 
         (uint32_t)vertexAttributes.size(),                              // uint32_t                                    vertexAttributeDescriptionCount;
-        vertexAttributes.data()                                         // const VkVertexInputAttributeDescription*    pVertexAttributeDescriptions;
+        vertexAttributes.constData()                                    // const VkVertexInputAttributeDescription*    pVertexAttributeDescriptions;
     };
 
 
@@ -190,7 +327,7 @@ VkcPipeline::VkcPipeline(const VkcSwapchain *swapchain, const VkcDevice *device)
         nullptr,                                                        // const void*                                pNext;
         0,                                                              // VkPipelineInputAssemblyStateCreateFlags    flags;
 
-        VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,                            // VkPrimitiveTopology                        topology;
+        info.topology,                                                  // VkPrimitiveTopology                        topology;
         VK_FALSE,                                                       // VkBool32                                   primitiveRestartEnable;
     };
 
@@ -200,25 +337,7 @@ VkcPipeline::VkcPipeline(const VkcSwapchain *swapchain, const VkcDevice *device)
      */
 
 
-    // Fill viewport info.
-    VkViewport viewport =
-    {
-        0.0f,                               // float    x;
-        0.0f,                               // float    y;
-        (float)swapchain->extent.width,     // float    width;
-        (float)swapchain->extent.height,    // float    height;
-        0.0f,                               // float    minDepth;
-        1.0f,                               // float    maxDepth;
-    };
-
-    // Fill scissors info.
-    VkRect2D scissors =
-    {
-        {0, 0},                 // VkOffset2D    offset;
-        swapchain->extent       // VkExtent2D    extent;
-    };
-
-    // Fill viewport state info.
+    // Fill viewport state info, viewport and scissors are set dynamically.
     VkPipelineViewportStateCreateInfo viewportInfo =
     {
         VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,      // VkStructureType                       sType;
@@ -226,10 +345,10 @@ VkcPipeline::VkcPipeline(const VkcSwapchain *swapchain, const VkcDevice *device)
         0,                                                          // VkPipelineViewportStateCreateFlags    flags;
 
         1,                                                          // uint32_t                              viewportCount;
-        &viewport,                                                  // const VkViewport*                     pViewports;
+        nullptr,                                                    // const VkViewport*                     pViewports;
 
         1,                                                          // uint32_t                              scissorCount;
-        &scissors                                                   // const VkRect2D*                       pScissors;
+        nullptr                                                     // const VkRect2D*                       pScissors;
     };
 
 
@@ -242,9 +361,9 @@ VkcPipeline::VkcPipeline(const VkcSwapchain *swapchain, const VkcDevice *device)
 
         VK_FALSE,                                                   // VkBool32                                   depthClampEnable;
         VK_FALSE,                                                   // VkBool32                                   rasterizerDiscardEnable;
-        VK_POLYGON_MODE_FILL,                                       // VkPolygonMode                              polygonMode;
-        VK_CULL_MODE_BACK_BIT,                                      // VkCullModeFlags                            cullMode;
-        VK_FRONT_FACE_COUNTER_CLOCKWISE,                            // VkFrontFace                                frontFace;
+        info.polygonMode,                                           // VkPolygonMode                              polygonMode;
+        info.cullMode,                                              // VkCullModeFlags                            cullMode;
+        info.frontFace,                                             // VkFrontFace                                frontFace;
 
         VK_FALSE,                                                   // VkBool32                                   depthBiasEnable;
         0,                                                          // float                                      depthBiasConstantFactor;
@@ -292,12 +411,12 @@ VkcPipeline::VkcPipeline(const VkcSwapchain *swapchain, const VkcDevice *device)
         nullptr,                                                        // const void*                               pNext;
         0,                                                              // VkPipelineDepthStencilStateCreateFlags    flags;
 
-        VK_TRUE,                                                        // VkBool32                                  depthTestEnable;
-        VK_TRUE,                                                        // VkBool32                                  depthWriteEnable;
-        VK_COMPARE_OP_GREATER_OR_EQUAL,                                 // VkCompareOp                               depthCompareOp;
+        info.depthTest,                                                 // VkBool32                                  depthTestEnable;
+        info.depthWrite,                                                // VkBool32                                  depthWriteEnable;
+        info.depthCompareOp,                                            // VkCompareOp                               depthCompareOp;
 
         VK_FALSE,                                                       // VkBool32                                  depthBoundsTestEnable;
-        VK_TRUE,                                                        // VkBool32                                  stencilTestEnable;
+        info.stencilTest,                                               // VkBool32                                  stencilTestEnable;
         stencilInfo,                                                    // VkStencilOpState                          front;
         stencilInfo,                                                    // VkStencilOpState                          back;
         0.0f,                                                           // float                                     minDepthBounds;
@@ -307,19 +426,17 @@ VkcPipeline::VkcPipeline(const VkcSwapchain *swapchain, const VkcDevice *device)
     // Fill color blend attachment state info.
     VkPipelineColorBlendAttachmentState colorBlendState =
     {
-        VK_TRUE,                                // VkBool32                 blendEnable;
+        info.blendEnable,                       // VkBool32                 blendEnable;
 
-        VK_BLEND_FACTOR_SRC_ALPHA,              // VkBlendFactor            srcColorBlendFactor;
-        VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,    // VkBlendFactor            dstColorBlendFactor;
-        VK_BLEND_OP_ADD,                        // VkBlendOp                colorBlendOp;
+        info.srcBlendFactor,                    // VkBlendFactor            srcColorBlendFactor;
+        info.dstBlendFactor,                    // VkBlendFactor            dstColorBlendFactor;
+        info.blendOp,                           // VkBlendOp                colorBlendOp;
 
-        VK_BLEND_FACTOR_SRC_ALPHA,              // VkBlendFactor            srcAlphaBlendFactor;
-        VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,    // VkBlendFactor            dstAlphaBlendFactor;
-        VK_BLEND_OP_ADD,                        // VkBlendOp                alphaBlendOp;
+        info.srcBlendFactor,                    // VkBlendFactor            srcAlphaBlendFactor;
+        info.dstBlendFactor,                    // VkBlendFactor            dstAlphaBlendFactor;
+        info.blendOp,                           // VkBlendOp                alphaBlendOp;
 
-        VK_COLOR_COMPONENT_R_BIT |              // VkColorComponentFlags    colorWriteMask;
-        VK_COLOR_COMPONENT_G_BIT |
-        VK_COLOR_COMPONENT_B_BIT
+        info.colorWriteMask                     // VkColorComponentFlags    colorWriteMask;
     };
 
     // Fill color blend state info.
@@ -378,69 +495,112 @@ VkcPipeline::VkcPipeline(const VkcSwapchain *swapchain, const VkcDevice *device)
         &dynamicStateInfo,                                          // const VkPipelineDynamicStateCreateInfo*          pDynamicState;
 
         layout,                                                     // VkPipelineLayout                                 layout;
-        swapchain->renderPass,                                      // VkRenderPass                                     renderPass;
-        0,                                                          // uint32_t                                         subpass;
+        info.renderPass,                                            // VkRenderPass                                     renderPass;
+        info.subpass,                                               // uint32_t                                         subpass;
         VK_NULL_HANDLE,                                             // VkPipeline                                       basePipelineHandle;
         0                                                           // int32_t                                          basePipelineIndex;
     };
 
     // Create graphics pipeline.
-    vkCreateGraphicsPipelines(device->logical, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &handle);
+    result = vkCreateGraphicsPipelines(device->logical, cache, 1, &pipelineInfo, nullptr, &handle);
+
+    if (result != VK_SUCCESS)
+    {
+        handle = VK_NULL_HANDLE;
+        status.storeRelease(VKC_PIPELINE_FAILED);
+        return result;
+    }
+
+    // Publish the handle to the threads checking the status.
+    status.storeRelease(VKC_PIPELINE_READY);
 
-    this->logicalDevice = device->logical;
+    return VK_SUCCESS;
 }
 
 
 /**
- * Destroy the graphics pipeline.
+ * Get the compilation state.
  */
-VkcPipeline::~VkcPipeline()
+VkcPipelineStatus VkcPipeline::getStatus() const
 {
-    if (logicalDevice != VK_NULL_HANDLE)
-    {
-        if (descriptorSet != VK_NULL_HANDLE)
-            vkFreeDescriptorSets(logicalDevice, descriptorPool, 1, &descriptorSet);
+    return (VkcPipelineStatus)status.loadAcquire();
+}
 
-        if (setLayout != VK_NULL_HANDLE)
-            vkDestroyDescriptorSetLayout(logicalDevice, setLayout, nullptr);
 
-        if (descriptorPool != VK_NULL_HANDLE)
-            vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+/**
+ * Check if the pipeline can be bound.
+ */
+bool VkcPipeline::isReady() const
+{
+    return status.loadAcquire() == VKC_PIPELINE_READY;
+}
 
-        if (vertShader != VK_NULL_HANDLE)
-            vkDestroyShaderModule(logicalDevice, vertShader, nullptr);
 
-        if (fragShader != VK_NULL_HANDLE)
-            vkDestroyShaderModule(logicalDevice, fragShader, nullptr);
+/**
+ * Get the binding number of a resource, by variable or block name.
+ */
+uint32_t VkcPipeline::getBinding(const QByteArray &name) const
+{
+    const VkcShaderBinding *binding = reflection.findBinding(name);
 
-        if (layout != VK_NULL_HANDLE)
-            vkDestroyPipelineLayout(logicalDevice, layout, nullptr);
+    return binding != nullptr ? binding->binding : UINT32_MAX;
+}
 
-        if (handle != VK_NULL_HANDLE)
-            vkDestroyPipeline(logicalDevice, handle, nullptr);
-    }
+
+/**
+ * Get the description the pipeline was created from.
+ */
+const VkcPipelineInfo& VkcPipeline::getInfo() const
+{
+    return info;
 }
 
 
 /**
- * Load shader module from file.
+ * Exchange the compiled objects and layouts with a pipeline of the same description.
+ *
+ * Used to put a pipeline rebuilt from changed shaders in place of the one its
+ * users hold; deleting the other pipeline then retires the old objects.
+ * Neither pipeline may be compiling.
  */
-VkResult VkcPipeline::createShader(VkShaderModule &shader, QString fileName, const VkcDevice *device)
+void VkcPipeline::swap(VkcPipeline &other)
 {
-    // Open shader file in binary.
-    QFile shaderFile("data/shaders/" + fileName);
+    std::swap(handle, other.handle);
+    std::swap(layout, other.layout);
+    std::swap(vertShader, other.vertShader);
+    std::swap(fragShader, other.fragShader);
 
-    if(!shaderFile.exists())
-    {
-        qDebug() << "ERROR:   [@qDebug]              - Shader \"" << fileName << "\" not found.";
-        return VK_ERROR_INITIALIZATION_FAILED;
-    }
+    std::swap(setLayouts, other.setLayouts);
+    std::swap(reflection, other.reflection);
+    std::swap(pushConstants, other.pushConstants);
 
-    shaderFile.open(QIODevice::ReadOnly);
+    std::swap(vertexStride, other.vertexStride);
+    std::swap(vertexAttributes, other.vertexAttributes);
 
-    // Read shader data.
-    QByteArray shaderData = shaderFile.readAll();
+    int otherStatus = other.status.loadAcquire();
+    other.status.storeRelease(status.loadAcquire());
+    status.storeRelease(otherStatus);
+}
+
+
+/**
+ * Destroy the graphics pipeline, the layouts belong to the device's layout cache.
+ */
+VkcPipeline::~VkcPipeline()
+{
+    VkcDeletionQueue *deletionQueue = device->deletionQueue;
 
+    deletionQueue->retire(VKC_DELETION_PIPELINE, (uint64_t)handle);
+    deletionQueue->retire(VKC_DELETION_SHADER_MODULE, (uint64_t)vertShader);
+    deletionQueue->retire(VKC_DELETION_SHADER_MODULE, (uint64_t)fragShader);
+}
+
+
+/**
+ * Create shader module from SPIR-V code.
+ */
+VkResult VkcPipeline::createShader(VkShaderModule &shader, const QByteArray &code)
+{
     // Fill shader module info.
     VkShaderModuleCreateInfo shaderInfo =
     {
@@ -448,8 +608,8 @@ VkResult VkcPipeline::createShader(VkShaderModule &shader, QString fileName, con
         nullptr,                                        // const void*                  pNext;
         0,                                              // VkShaderModuleCreateFlags    flags;
 
-        (size_t)shaderData.size(),                      // size_t                       codeSize;
-        (const uint32_t*)shaderData.data()              // const uint32_t*              pCode;
+        (size_t)code.size(),                            // size_t                       codeSize;
+        (const uint32_t*)code.constData()               // const uint32_t*              pCode;
     };
 
     // Create shader module.
@@ -457,3 +617,42 @@ VkResult VkcPipeline::createShader(VkShaderModule &shader, QString fileName, con
 
     return VK_SUCCESS;
 }
+
+
+/**
+ * Read shader code from file.
+ */
+bool VkcPipeline::loadShader(const QString &fileName, QByteArray &code)
+{
+    // Open shader file in binary.
+    QFile shaderFile("data/shaders/" + fileName);
+
+    if (!shaderFile.open(QIODevice::ReadOnly))
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Shader \"" << fileName << "\" not found.";
+        return false;
+    }
+
+    // Read shader data.
+    code = shaderFile.readAll();
+
+    return true;
+}
+
+
+/**
+ * Get the features a shader declares, see VkcShaderFeature.
+ *
+ * Returns 0 if the shader cannot be read.
+ */
+uint32_t VkcPipeline::getFeatureMask(const QString &fileName)
+{
+    QByteArray code;
+    VkcShaderReflection shaderReflection;
+
+    // The stage only matters for the stage inputs.
+    if (!loadShader(fileName, code) || !shaderReflection.parse(code, VK_SHADER_STAGE_ALL_GRAPHICS))
+        return 0;
+
+    return shaderReflection.featureMask;
+}
@@ -3,7 +3,9 @@
 
 #include "stable.h"
 #include "vkc_device.h"
-#include "vkc_swapchain.h"
+#include "vkc_shaderreflection.h"
+#include "vkc_bindlesstable.h"
+#include "mgvertexformat.h"
 
 
 /**
@@ -15,10 +17,108 @@ struct VkVertex {
     float nx, ny, nz;
 };
 
+/**
+ * Struct used for the per-draw data, matching the DrawConstants block of the shaders.
+ *
+ * The texture coordinate transform holds the scale then the offset that
+ * undo their quantization. The texture index is only read by the bindless
+ * fragment shader.
+ */
+struct VkcDrawConstants {
+    float mvpMatrix[16];
+    float color[4];
+    float texCoordTransform[4];
+    uint32_t textureIndex;
+};
+
+/**
+ * Shader features toggled per pipeline variant.
+ *
+ * Each bit is the constant_id of a boolean specialization constant in the
+ * shaders, so the branches of disabled features are compiled out.
+ */
+enum VkcShaderFeature
+{
+    VKC_FEATURE_TEXTURED =      0x1,
+    VKC_FEATURE_LIT =           0x2,
+    VKC_FEATURE_ALPHA_TEST =    0x4,
+    VKC_FEATURE_PACKED_VERTEX = 0x8
+};
+
+/**
+ * Struct used to describe a graphics pipeline.
+ *
+ * Pipelines with equal descriptions are created once and shared through the
+ * device's pipeline cache. The defaults describe the textured forward pass.
+ * Viewport and scissors are dynamic, so they are not part of the description.
+ * Descriptor bindings and push constants are read from the shaders.
+ * Features the shaders do not declare are ignored, so variants differing
+ * only in those share a pipeline.
+ */
+struct VkcPipelineInfo
+{
+    // Shader file names, the fallback vertex shader reads the per-draw data from a uniform buffer.
+    QString                     vertShader =            "shader.vert.spv";
+    QString                     vertShaderFallback =    "shader_ubo.vert.spv";
+    QString                     fragShader =            "shader.frag.spv";
+
+    // Shader variant, see VkcShaderFeature.
+    uint32_t                    features =              VKC_FEATURE_TEXTURED;
+
+    // Vertex layout. Without attributes, packed vertices use the attributes of
+    // their format and float ones the shader inputs packed in location order.
+    MgVertexFormatType          vertexFormat =          MG_VERTEX_FORMAT_PACKED;
+    uint32_t                    vertexStride =          sizeof(VkVertex);
+    QVector<VkVertexInputAttributeDescription> vertexAttributes = {};
+    VkPrimitiveTopology         topology =              VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    // Rasterizer state.
+    VkPolygonMode               polygonMode =           VK_POLYGON_MODE_FILL;
+    VkCullModeFlags             cullMode =              VK_CULL_MODE_BACK_BIT;
+    VkFrontFace                 frontFace =             VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+    // Depth and stencil state, depth is reversed.
+    VkBool32                    depthTest =             VK_TRUE;
+    VkBool32                    depthWrite =            VK_TRUE;
+    VkCompareOp                 depthCompareOp =        VK_COMPARE_OP_GREATER_OR_EQUAL;
+    VkBool32                    stencilTest =           VK_TRUE;
+
+    // Blend state of the color attachment.
+    VkBool32                    blendEnable =           VK_TRUE;
+    VkBlendFactor               srcBlendFactor =        VK_BLEND_FACTOR_SRC_ALPHA;
+    VkBlendFactor               dstBlendFactor =        VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    VkBlendOp                   blendOp =               VK_BLEND_OP_ADD;
+    VkColorComponentFlags       colorWriteMask =        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT;
+
+    // Per-draw data and the buffer blocks bound with dynamic offsets.
+    uint32_t                    drawDataSize =          sizeof(VkcDrawConstants);
+    QVector<QByteArray>         dynamicBuffers =        {"Uniforms"};
+
+    // Render pass compatibility.
+    VkRenderPass                renderPass =            VK_NULL_HANDLE;
+    uint32_t                    subpass =               0;
+};
+
+
+/**
+ * Compilation states of a pipeline.
+ */
+enum VkcPipelineStatus
+{
+    VKC_PIPELINE_PENDING,
+    VKC_PIPELINE_READY,
+    VKC_PIPELINE_FAILED
+};
+
 
 /**
  * Class used for the graphics pipeline.
  *
+ * The shaders are loaded and reflected right away, and the layouts taken
+ * from the device's layout cache, so descriptor sets can be prepared and
+ * bound; the shader modules and the pipeline itself are created by
+ * compile(), which may run on any thread.
+ *
  * Classes named "Vkc[class]" stand for "Vulkan custom class".
  */
 class VkcPipeline
@@ -31,28 +131,60 @@ public:
     VkShaderModule                  vertShader;
     VkShaderModule                  fragShader;
 
-    VkDescriptorPool                descriptorPool;
-    VkDescriptorSet                 descriptorSet;
-    VkDescriptorSetLayout           setLayout;
+    QVector<VkDescriptorSetLayout>  setLayouts;
+    VkcShaderReflection             reflection;
+
+    bool                            pushConstants;
+    QByteArray                      key;
 
 private:
-    VkDevice                        logicalDevice;
+    VkcPipelineInfo                 info;
+    QAtomicInt                      status;
+
+    QByteArray                      vertCode;
+    QByteArray                      fragCode;
+    uint32_t                        vertexStride;
+    QVector<VkVertexInputAttributeDescription> vertexAttributes;
+
+    const VkcDevice                 *device;
 
     // Functions:
 public:
-    VkcPipeline();
     VkcPipeline(
-            const VkcSwapchain      *swapchain,
+            const VkcPipelineInfo   &info,
             const VkcDevice         *device
             );
     ~VkcPipeline();
 
+    VkResult compile(
+            VkPipelineCache         cache
+            );
+    VkcPipelineStatus getStatus() const;
+    bool isReady() const;
+    uint32_t getBinding(
+            const QByteArray        &name
+            ) const;
+    const VkcPipelineInfo& getInfo() const;
+    void swap(
+            VkcPipeline             &other
+            );
+
+    static bool loadShader(
+            const QString           &fileName,
+            QByteArray              &code
+            );
+    static uint32_t getFeatureMask(
+            const QString           &fileName
+            );
+
 private:
+    VkResult createLayouts();
+    void createVertexLayout();
     VkResult createShader(
             VkShaderModule          &shader,
-            QString                 fileName,
-            const VkcDevice         *device
+            const QByteArray        &code
             );
+
 };
 
 #endif // VKC_PIPELINE_H
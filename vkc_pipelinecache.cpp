@@ -0,0 +1,553 @@
+#include "vkc_pipelinecache.h"
+
+
+/**
+ * Create the pipeline cache, seeded with the data saved by the last run.
+ */
+VkcPipelineCache::VkcPipelineCache(const VkcDevice *device)
+{
+    this->device = device;
+
+    handle =        VK_NULL_HANDLE;
+    createdCount =  0;
+    sharedCount =   0;
+    jobSystem =     nullptr;
+    pendingCounter.value.store(0);
+
+    // Read the saved cache data, the driver ignores it if it does not match.
+    QByteArray cacheData;
+    QFile cacheFile(VKC_PIPELINE_CACHE_FILE);
+
+    if (cacheFile.open(QIODevice::ReadOnly))
+        cacheData = cacheFile.readAll();
+
+    // Fill pipeline cache info.
+    VkPipelineCacheCreateInfo cacheInfo =
+    {
+        VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,   // VkStructureType               sType;
+        nullptr,                                        // const void*                   pNext;
+        0,                                              // VkPipelineCacheCreateFlags    flags;
+
+        (size_t)cacheData.size(),                       // size_t                        initialDataSize;
+        cacheData.constData()                           // const void*                   pInitialData;
+    };
+
+    // Create pipeline cache, starting empty if the saved data is rejected.
+    if (vkCreatePipelineCache(device->logical, &cacheInfo, nullptr, &handle) != VK_SUCCESS)
+    {
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = nullptr;
+
+        vkCreatePipelineCache(device->logical, &cacheInfo, nullptr, &handle);
+    }
+}
+
+
+/**
+ * Save and destroy the pipeline cache along with the pipelines still in it.
+ */
+VkcPipelineCache::~VkcPipelineCache()
+{
+    waitIdle();
+    save();
+
+    // Pre-warmed pipelines are held by the cache itself.
+    for (int i = 0; i < prewarmed.size(); i++)
+        release(prewarmed[i]);
+
+    prewarmed.clear();
+
+    // Rebuilds that were never swapped in.
+    for (auto it = reloading.begin(); it != reloading.end(); ++it)
+        delete it.value();
+
+    for (int i = 0; i < discarded.size(); i++)
+        delete discarded[i];
+
+    reloading.clear();
+    discarded.clear();
+
+    for (auto it = entries.begin(); it != entries.end(); ++it)
+    {
+#ifdef QT_DEBUG
+        qDebug() << "WARNING: [@qDebug]              - Pipeline destroyed with" << it.value().references << "references left.";
+#endif
+        delete it.value().pipeline;
+    }
+
+    entries.clear();
+
+    if (handle != VK_NULL_HANDLE)
+        vkDestroyPipelineCache(device->logical, handle, nullptr);
+}
+
+
+/**
+ * Compile asynchronous pipelines on the given job system.
+ *
+ * Without one they compile on the thread acquiring them.
+ */
+void VkcPipelineCache::setJobSystem(MgJobSystem *jobSystem)
+{
+    this->jobSystem = jobSystem;
+}
+
+
+/**
+ * Get the pipeline matching a description, waiting until it is compiled.
+ *
+ * Every call must be paired with a call to release(). Returns null if the
+ * pipeline could not be created.
+ */
+VkcPipeline* VkcPipelineCache::acquire(const VkcPipelineInfo &info)
+{
+    VkcPipeline *pipeline = find(info, false);
+
+    // It may have been requested by another thread before.
+    waitFor(pipeline);
+
+    if (pipeline->getStatus() == VKC_PIPELINE_FAILED)
+    {
+        release(pipeline);
+        return nullptr;
+    }
+
+    return pipeline;
+}
+
+
+/**
+ * Get the pipeline matching a description without waiting for it.
+ *
+ * New pipelines are compiled on the job system; check isReady() before
+ * binding. Every call must be paired with a call to release().
+ */
+VkcPipeline* VkcPipelineCache::acquireAsync(const VkcPipelineInfo &info)
+{
+    return find(info, true);
+}
+
+
+/**
+ * Give up a reference to a pipeline, the last one destroys it.
+ */
+void VkcPipelineCache::release(VkcPipeline *pipeline)
+{
+    if (pipeline == nullptr)
+        return;
+
+    // A compile job may still use it.
+    waitFor(pipeline);
+
+    QMutexLocker locker(&mutex);
+
+    auto it = entries.find(pipeline->key);
+    if (it == entries.end() || --it.value().references > 0)
+        return;
+
+    // A rebuild may still be compiling, it is deleted once done.
+    VkcPipeline *replacement = reloading.take(pipeline);
+    if (replacement != nullptr)
+        discarded.append(replacement);
+
+    // The pipeline retires its objects, frames in flight may still use them.
+    delete it.value().pipeline;
+    entries.erase(it);
+}
+
+
+/**
+ * Start compiling the pipelines listed in a manifest.
+ *
+ * The manifest is a JSON object whose "pipelines" array holds the fields
+ * that differ from the base description. Returns the number of pipelines
+ * queued; a missing manifest queues none.
+ */
+int VkcPipelineCache::prewarm(const QString &fileName, const VkcPipelineInfo &baseInfo)
+{
+    QFile manifestFile(fileName);
+
+    if (!manifestFile.open(QIODevice::ReadOnly))
+        return 0;
+
+    QJsonParseError error;
+    QJsonDocument manifest = QJsonDocument::fromJson(manifestFile.readAll(), &error);
+
+    if (error.error != QJsonParseError::NoError)
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Pipeline manifest \"" << fileName << "\":" << error.errorString();
+        return 0;
+    }
+
+    static const QHash<QString, int> enums =
+    {
+        {"none",            VK_CULL_MODE_NONE},
+        {"front",           VK_CULL_MODE_FRONT_BIT},
+        {"back",            VK_CULL_MODE_BACK_BIT},
+        {"fill",            VK_POLYGON_MODE_FILL},
+        {"line",            VK_POLYGON_MODE_LINE},
+        {"point",           VK_POLYGON_MODE_POINT},
+        {"triangleList",    VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST},
+        {"triangleStrip",   VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP},
+        {"lineList",        VK_PRIMITIVE_TOPOLOGY_LINE_LIST},
+        {"pointList",       VK_PRIMITIVE_TOPOLOGY_POINT_LIST}
+    };
+
+    static const QHash<QString, uint32_t> featureBits =
+    {
+        {"textured",        VKC_FEATURE_TEXTURED},
+        {"lit",             VKC_FEATURE_LIT},
+        {"alphaTest",       VKC_FEATURE_ALPHA_TEST}
+    };
+
+    QJsonArray pipelines = manifest.object().value("pipelines").toArray();
+
+    for (int i = 0; i < pipelines.size(); i++)
+    {
+        QJsonObject object = pipelines[i].toObject();
+        VkcPipelineInfo info = baseInfo;
+
+        info.vertShader =           object.value("vertShader").toString(info.vertShader);
+        info.vertShaderFallback =   object.value("vertShaderFallback").toString(info.vertShaderFallback);
+        info.fragShader =           object.value("fragShader").toString(info.fragShader);
+
+        if (object.contains("features"))
+        {
+            QJsonArray features = object.value("features").toArray();
+            info.features = 0;
+
+            for (int j = 0; j < features.size(); j++)
+                info.features |= featureBits.value(features[j].toString(), 0);
+        }
+
+        info.cullMode =     (VkCullModeFlags)enums.value(object.value("cullMode").toString(), info.cullMode);
+        info.polygonMode =  (VkPolygonMode)enums.value(object.value("polygonMode").toString(), info.polygonMode);
+        info.topology =     (VkPrimitiveTopology)enums.value(object.value("topology").toString(), info.topology);
+
+        info.depthTest =    object.value("depthTest").toBool(info.depthTest) ? VK_TRUE : VK_FALSE;
+        info.depthWrite =   object.value("depthWrite").toBool(info.depthWrite) ? VK_TRUE : VK_FALSE;
+        info.blendEnable =  object.value("blend").toBool(info.blendEnable) ? VK_TRUE : VK_FALSE;
+
+        VkcPipeline *pipeline = acquireAsync(info);
+
+        QMutexLocker locker(&mutex);
+        prewarmed.append(pipeline);
+    }
+
+    return pipelines.size();
+}
+
+
+/**
+ * Rebuild the pipelines using any of the given shaders.
+ *
+ * The shaders are read again and the rebuilds compiled like asynchronous
+ * pipelines; swapReloaded() puts them in place. Returns the number of
+ * pipelines being rebuilt.
+ */
+int VkcPipelineCache::reload(const QStringList &shaders)
+{
+    QVector<VkcPipeline*> replacements;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        // The shaders may declare other features now.
+        for (int i = 0; i < shaders.size(); i++)
+            featureMasks.remove(shaders[i]);
+
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            VkcPipeline *pipeline = it.value().pipeline;
+            const VkcPipelineInfo &info = pipeline->getInfo();
+
+            if (!shaders.contains(info.vertShader) && !shaders.contains(info.vertShaderFallback) &&
+                    !shaders.contains(info.fragShader))
+                continue;
+
+            // A newer change supersedes a rebuild that is still compiling.
+            VkcPipeline *replacement = reloading.take(pipeline);
+            if (replacement != nullptr)
+                discarded.append(replacement);
+
+            replacement = new VkcPipeline(info, device);
+            replacement->key = pipeline->key;
+
+            reloading.insert(pipeline, replacement);
+            replacements.append(replacement);
+        }
+    }
+
+    for (int i = 0; i < replacements.size(); i++)
+        compile(replacements[i], true);
+
+    return replacements.size();
+}
+
+
+/**
+ * Put the rebuilt pipelines that finished compiling in place of the old ones.
+ *
+ * Must be called between frames, while no thread records commands with the
+ * pipelines. The old objects are retired, so frames in flight keep them. A
+ * rebuild that failed is dropped and the old pipeline kept. Returns the
+ * number of pipelines swapped.
+ */
+int VkcPipelineCache::swapReloaded()
+{
+    QMutexLocker locker(&mutex);
+
+    int swapCount = 0;
+
+    for (auto it = reloading.begin(); it != reloading.end();)
+    {
+        VkcPipeline *pipeline = it.key();
+        VkcPipeline *replacement = it.value();
+
+        // The old pipeline may not be compiled yet either.
+        if (pipeline->getStatus() == VKC_PIPELINE_PENDING || replacement->getStatus() == VKC_PIPELINE_PENDING)
+        {
+            ++it;
+            continue;
+        }
+
+        if (replacement->isReady())
+        {
+            pipeline->swap(*replacement);
+            swapCount++;
+        }
+        else
+        {
+            qDebug() << "ERROR:   [@qDebug]              - Pipeline rebuild failed, keeping the old one.";
+        }
+
+        delete replacement;
+        it = reloading.erase(it);
+    }
+
+    // Delete the superseded rebuilds that are done compiling.
+    for (int i = discarded.size() - 1; i >= 0; i--)
+    {
+        if (discarded[i]->getStatus() == VKC_PIPELINE_PENDING)
+            continue;
+
+        delete discarded[i];
+        discarded.remove(i);
+    }
+
+    return swapCount;
+}
+
+
+/**
+ * Check if any rebuilt pipeline is ready to be swapped in.
+ */
+bool VkcPipelineCache::hasReloaded()
+{
+    QMutexLocker locker(&mutex);
+
+    for (auto it = reloading.begin(); it != reloading.end(); ++it)
+        if (it.key()->getStatus() != VKC_PIPELINE_PENDING && it.value()->getStatus() != VKC_PIPELINE_PENDING)
+            return true;
+
+    return false;
+}
+
+
+/**
+ * Wait until every pipeline compile job has finished.
+ */
+void VkcPipelineCache::waitIdle()
+{
+    if (jobSystem != nullptr)
+        jobSystem->wait(&pendingCounter);
+}
+
+
+/**
+ * Wait until a pipeline is no longer compiling.
+ */
+void VkcPipelineCache::waitFor(const VkcPipeline *pipeline)
+{
+    while (pipeline->getStatus() == VKC_PIPELINE_PENDING)
+    {
+        // Help with the compile jobs, or let another thread finish its compile.
+        waitIdle();
+        QThread::yieldCurrentThread();
+    }
+}
+
+
+/**
+ * Write the contents of the Vulkan pipeline cache to disk.
+ */
+VkResult VkcPipelineCache::save()
+{
+    size_t size = 0;
+    mgAssert(vkGetPipelineCacheData(device->logical, handle, &size, nullptr));
+
+    QByteArray cacheData((int)size, 0);
+    mgAssert(vkGetPipelineCacheData(device->logical, handle, &size, cacheData.data()));
+
+    QFile cacheFile(VKC_PIPELINE_CACHE_FILE);
+
+    if (!cacheFile.open(QIODevice::WriteOnly))
+        return VK_ERROR_INITIALIZATION_FAILED;
+
+    cacheFile.write(cacheData.constData(), (qint64)size);
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Hash a pipeline description into a cache key.
+ *
+ * Fields are appended in a fixed order, arrays prefixed by their size.
+ */
+QByteArray VkcPipelineCache::getKey(const VkcPipelineInfo &info)
+{
+    QByteArray key;
+
+    // Append a string with its size.
+    auto appendString = [&key](const QString &string)
+    {
+        QByteArray data = string.toUtf8();
+        int size = data.size();
+
+        key.append((const char*)&size, sizeof(size));
+        key.append(data);
+    };
+
+    appendString(info.vertShader);
+    appendString(info.vertShaderFallback);
+    appendString(info.fragShader);
+    key.append((const char*)&info.features, sizeof(info.features));
+
+    int attributeCount = info.vertexAttributes.size();
+    key.append((const char*)&info.vertexFormat, sizeof(info.vertexFormat));
+    key.append((const char*)&info.vertexStride, sizeof(info.vertexStride));
+    key.append((const char*)&attributeCount, sizeof(attributeCount));
+    key.append((const char*)info.vertexAttributes.constData(), attributeCount * sizeof(VkVertexInputAttributeDescription));
+    key.append((const char*)&info.topology, sizeof(info.topology));
+
+    key.append((const char*)&info.polygonMode, sizeof(info.polygonMode));
+    key.append((const char*)&info.cullMode, sizeof(info.cullMode));
+    key.append((const char*)&info.frontFace, sizeof(info.frontFace));
+
+    key.append((const char*)&info.depthTest, sizeof(info.depthTest));
+    key.append((const char*)&info.depthWrite, sizeof(info.depthWrite));
+    key.append((const char*)&info.depthCompareOp, sizeof(info.depthCompareOp));
+    key.append((const char*)&info.stencilTest, sizeof(info.stencilTest));
+
+    key.append((const char*)&info.blendEnable, sizeof(info.blendEnable));
+    key.append((const char*)&info.srcBlendFactor, sizeof(info.srcBlendFactor));
+    key.append((const char*)&info.dstBlendFactor, sizeof(info.dstBlendFactor));
+    key.append((const char*)&info.blendOp, sizeof(info.blendOp));
+    key.append((const char*)&info.colorWriteMask, sizeof(info.colorWriteMask));
+
+    key.append((const char*)&info.drawDataSize, sizeof(info.drawDataSize));
+    for (int i = 0; i < info.dynamicBuffers.size(); i++)
+        key.append(info.dynamicBuffers[i]).append('\0');
+
+    // Render passes are cached by the device, so equal handles mean compatible passes.
+    uint64_t renderPass = (uint64_t)info.renderPass;
+    key.append((const char*)&renderPass, sizeof(renderPass));
+    key.append((const char*)&info.subpass, sizeof(info.subpass));
+
+    return key;
+}
+
+
+/**
+ * Find the pipeline for a description, creating it if needed, and take a reference.
+ *
+ * Synchronous requests compile on the calling thread, asynchronous ones on
+ * the job system. The lock is held while the entry is created, so concurrent
+ * requests for the same state compile it once.
+ */
+VkcPipeline* VkcPipelineCache::find(const VkcPipelineInfo &info, bool async)
+{
+    // Drop the features the shaders do not declare, they would compile to the same code.
+    VkcPipelineInfo variant = info;
+    variant.features &= getFeatureMask(info);
+
+    QByteArray key = getKey(variant);
+    VkcPipeline *pipeline;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        auto it = entries.find(key);
+        if (it != entries.end())
+        {
+            it.value().references++;
+            sharedCount++;
+
+            return it.value().pipeline;
+        }
+
+        pipeline = new VkcPipeline(variant, device);
+        pipeline->key = key;
+
+        entries.insert(key, {pipeline, 1});
+        createdCount++;
+    }
+
+    // Compile outside of the lock, other pipelines may be requested meanwhile.
+    compile(pipeline, async);
+
+    return pipeline;
+}
+
+
+/**
+ * Compile a pipeline, on the job system if asynchronous.
+ */
+void VkcPipelineCache::compile(VkcPipeline *pipeline, bool async)
+{
+    if (async && jobSystem != nullptr)
+    {
+        VkPipelineCache cache = handle;
+        jobSystem->submit([pipeline, cache]() { pipeline->compile(cache); }, &pendingCounter, "compilePipeline");
+    }
+    else
+    {
+        pipeline->compile(handle);
+    }
+}
+
+
+/**
+ * Get the features declared by the shaders of a description.
+ *
+ * Each shader is read once, later requests use the stored mask.
+ */
+uint32_t VkcPipelineCache::getFeatureMask(const VkcPipelineInfo &info)
+{
+    QStringList shaders = QStringList() << info.vertShader << info.vertShaderFallback << info.fragShader;
+    uint32_t mask = 0;
+
+    for (int i = 0; i < shaders.size(); i++)
+    {
+        {
+            QMutexLocker locker(&mutex);
+
+            auto it = featureMasks.find(shaders[i]);
+            if (it != featureMasks.end())
+            {
+                mask |= it.value();
+                continue;
+            }
+        }
+
+        // Read the shader outside of the lock.
+        uint32_t shaderMask = VkcPipeline::getFeatureMask(shaders[i]);
+        mask |= shaderMask;
+
+        QMutexLocker locker(&mutex);
+        featureMasks.insert(shaders[i], shaderMask);
+    }
+
+    return mask;
+}
@@ -0,0 +1,119 @@
+#ifndef VKC_PIPELINECACHE_H
+#define VKC_PIPELINECACHE_H
+
+#include "stable.h"
+#include "vkc_pipeline.h"
+#include "mgjobsystem.h"
+
+#define VKC_PIPELINE_CACHE_FILE "data/pipelines.cache"
+
+
+/**
+ * Struct used for a pipeline shared through the cache.
+ */
+struct VkcPipelineEntry
+{
+    VkcPipeline                 *pipeline =     nullptr;
+    uint32_t                    references =    0;
+};
+
+
+/**
+ * Class used to share pipelines with equal descriptions.
+ *
+ * Descriptions are hashed into a key; acquiring a pipeline whose key is known
+ * returns the existing one, so every distinct state is created once per
+ * device no matter how many contexts ask for it. Creation goes through a
+ * Vulkan pipeline cache, so drivers can reuse compiled shader code too; its
+ * contents are kept on disk between runs.
+ *
+ * Pipelines acquired asynchronously compile on the job system, several at a
+ * time. Until they are ready their users skip them or draw with a fallback.
+ *
+ * Variants are keyed by the features their shaders actually declare, so
+ * toggles a shader ignores never create another pipeline.
+ *
+ * When shaders change, the pipelines using them are rebuilt in the
+ * background and swapped in between frames, keeping the pointers their users
+ * hold.
+ *
+ * Classes named "Vkc[class]" stand for "Vulkan custom class".
+ */
+class VkcPipelineCache
+{
+    // Objects:
+public:
+    VkPipelineCache                     handle;
+
+    uint32_t                            createdCount;
+    uint32_t                            sharedCount;
+
+private:
+    QMutex                              mutex;
+    QHash<QByteArray, VkcPipelineEntry> entries;
+    QVector<VkcPipeline*>               prewarmed;
+    QHash<VkcPipeline*, VkcPipeline*>   reloading;
+    QVector<VkcPipeline*>               discarded;
+    QHash<QString, uint32_t>            featureMasks;
+
+    MgJobSystem                         *jobSystem;
+    MgJobCounter                        pendingCounter;
+
+    const VkcDevice                     *device;
+
+    // Functions:
+public:
+    VkcPipelineCache(
+            const VkcDevice             *device
+            );
+    ~VkcPipelineCache();
+
+    void setJobSystem(
+            MgJobSystem                 *jobSystem
+            );
+
+    VkcPipeline* acquire(
+            const VkcPipelineInfo       &info
+            );
+    VkcPipeline* acquireAsync(
+            const VkcPipelineInfo       &info
+            );
+    void release(
+            VkcPipeline                 *pipeline
+            );
+
+    int prewarm(
+            const QString               &fileName,
+            const VkcPipelineInfo       &baseInfo
+            );
+    int reload(
+            const QStringList           &shaders
+            );
+    int swapReloaded();
+    bool hasReloaded();
+
+    void waitIdle();
+    VkResult save();
+
+    static QByteArray getKey(
+            const VkcPipelineInfo       &info
+            );
+
+private:
+    VkcPipeline* find(
+            const VkcPipelineInfo       &info,
+            bool                        async
+            );
+    void waitFor(
+            const VkcPipeline           *pipeline
+            );
+    void compile(
+            VkcPipeline                 *pipeline,
+            bool                        async
+            );
+    uint32_t getFeatureMask(
+            const VkcPipelineInfo       &info
+            );
+};
+
+#endif // VKC_PIPELINECACHE_H
@@ -0,0 +1,1328 @@
+#include "vkc_rendergraph.h"
+#include "vkc_renderpasscache.h"
+
+#include <algorithm>
+
+
+/**
+ * Create an empty graph.
+ */
+VkcRenderGraph::VkcRenderGraph(const VkcDevice *device)
+{
+    this->device =          device;
+
+    culledPassCount =       0;
+    transientMemorySize =   0;
+    allocatedMemorySize =   0;
+
+    extent =                {0, 0};
+    compiled =              false;
+}
+
+
+/**
+ * Retire everything the graph created.
+ */
+VkcRenderGraph::~VkcRenderGraph()
+{
+    destroyFramebuffers();
+    destroyTransients();
+}
+
+
+/**
+ * Add an image owned outside of the graph.
+ *
+ * If preserve is set the contents of the image are loaded by its first use,
+ * otherwise they are discarded.
+ */
+int VkcRenderGraph::importImage(const QString &name, MgImage *image, bool preserve)
+{
+    VkcGraphResource resource;
+    resource.name =         name;
+    resource.image =        image;
+    resource.imported =     true;
+    resource.preserve =     preserve;
+    resource.format =       image->info.format;
+    resource.aspect =       image->info.resourceRange.aspectMask;
+
+    resources.append(resource);
+    compiled = false;
+
+    return resources.size() - 1;
+}
+
+
+/**
+ * Add an image created by the graph.
+ *
+ * An empty extent stands for the extent the graph is compiled with.
+ */
+int VkcRenderGraph::createImage(const QString &name, VkFormat format, VkImageAspectFlags aspect, VkExtent2D extent)
+{
+    VkcGraphResource resource;
+    resource.name =         name;
+    resource.format =       format;
+    resource.aspect =       aspect;
+    resource.extent =       extent;
+
+    resources.append(resource);
+    compiled = false;
+
+    return resources.size() - 1;
+}
+
+
+/**
+ * Get the index of a resource by name, or -1.
+ */
+int VkcRenderGraph::findResource(const QString &name) const
+{
+    for (int i = 0; i < resources.size(); i++)
+        if (resources[i].name == name)
+            return i;
+
+    return -1;
+}
+
+
+/**
+ * Replace the image behind an imported resource, e.g. the acquired swapchain image.
+ */
+void VkcRenderGraph::setImage(int resource, MgImage *image)
+{
+    resources[resource].image = image;
+}
+
+
+/**
+ * Clear a resource when it is first written as an attachment.
+ */
+void VkcRenderGraph::setClearValue(int resource, VkClearValue clearValue)
+{
+    resources[resource].clear =         true;
+    resources[resource].clearValue =    clearValue;
+    compiled = false;
+}
+
+
+/**
+ * Mark a resource as a graph output, left in the given layout after execution.
+ */
+void VkcRenderGraph::setOutput(int resource, VkImageLayout layout)
+{
+    resources[resource].output =        true;
+    resources[resource].outputLayout =  layout;
+    compiled = false;
+}
+
+
+/**
+ * Add a pass, recorded in declaration order.
+ */
+int VkcRenderGraph::addPass(const QString &name, VkcGraphPassType type, VkcGraphRecord record)
+{
+    VkcGraphPass pass;
+    pass.name =     name;
+    pass.type =     type;
+    pass.record =   record;
+
+    passes.append(pass);
+    compiled = false;
+
+    return passes.size() - 1;
+}
+
+
+/**
+ * Declare that a pass reads or writes a resource.
+ */
+void VkcRenderGraph::addAccess(int pass, int resource, VkcGraphUsage usage)
+{
+    VkcGraphAccess access;
+    access.resource =   resource;
+    access.usage =      usage;
+
+    passes[pass].accesses.append(access);
+    compiled = false;
+}
+
+
+/**
+ * Choose whether a graphics pass records inline or through secondary command buffers.
+ *
+ * May change every frame.
+ */
+void VkcRenderGraph::setPassContents(int pass, VkSubpassContents contents)
+{
+    passes[pass].contents = contents;
+}
+
+
+/**
+ * Build the render passes and transient images of the graph.
+ *
+ * Must be called again after the graph or the imported images change size.
+ * The previous transient images and framebuffers are retired.
+ */
+VkResult VkcRenderGraph::compile(VkExtent2D extent)
+{
+    this->extent = extent;
+    compiled = false;
+
+    destroyFramebuffers();
+    destroyTransients();
+    renderPasses.clear();
+
+    // Drop passes that do not contribute to an output.
+    cullPasses();
+
+    // Get the lifetime and usage of every resource.
+    for (int i = 0; i < resources.size(); i++)
+    {
+        resources[i].usage =        0;
+        resources[i].firstPass =    -1;
+        resources[i].lastPass =     -1;
+        resources[i].memoryBlock =  -1;
+    }
+
+    for (int i = 0; i < passes.size(); i++)
+    {
+        if (passes[i].culled)
+            continue;
+
+        for (int j = 0; j < passes[i].accesses.size(); j++)
+        {
+            const VkcGraphAccess &access = passes[i].accesses[j];
+            VkcGraphResource &resource = resources[access.resource];
+
+            if (resource.firstPass < 0)
+                resource.firstPass = i;
+
+            resource.lastPass = i;
+            resource.usage |= getImageUsage(access.usage, passes[i].type);
+        }
+    }
+
+    // Merge graphics passes into render passes.
+    mergePasses();
+
+    // Create the transient images in aliased memory.
+    VkResult result = createTransients();
+    if (result != VK_SUCCESS)
+        return result;
+
+    // Create the render passes.
+    for (int i = 0; i < renderPasses.size(); i++)
+    {
+        result = createRenderPass(renderPasses[i]);
+        if (result != VK_SUCCESS)
+            return result;
+    }
+
+    compiled = true;
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Record every pass with the barriers between them.
+ */
+void VkcRenderGraph::execute(VkCommandBuffer commandBuffer)
+{
+    if (!compiled)
+        return;
+
+    int passIdx = 0;
+    while (passIdx < passes.size())
+    {
+        VkcGraphPass &pass = passes[passIdx];
+
+        if (pass.culled)
+        {
+            passIdx++;
+            continue;
+        }
+
+        MgBarrierBatch barriers;
+
+        if (pass.renderPass >= 0)
+        {
+            VkcGraphRenderPass &renderPass = renderPasses[pass.renderPass];
+
+            // Prepare every resource of the render pass with a single barrier.
+            // Attachments only need their layout for the first subpass using them,
+            // the render pass takes care of the rest.
+            QVector<bool> prepared(resources.size(), false);
+
+            for (int i = 0; i < renderPass.passes.size(); i++)
+            {
+                int subpassIdx = renderPass.passes[i];
+                const VkcGraphPass &subpass = passes[subpassIdx];
+
+                beginLifetimes(subpassIdx);
+
+                for (int j = 0; j < subpass.accesses.size(); j++)
+                {
+                    const VkcGraphAccess &access = subpass.accesses[j];
+                    VkcGraphResource &resource = resources[access.resource];
+
+                    bool attachment = isAttachment(access.usage, subpass.type);
+                    if (attachment && prepared[access.resource])
+                        continue;
+
+                    prepared[access.resource] = attachment;
+
+                    MgImageState state;
+                    getUsageState(access.usage, subpass.type, state);
+
+                    bool discard = resource.firstPass == subpassIdx && !resource.preserve;
+                    resource.image->transition(state.layout, state.stages, state.access, barriers,
+                                               resource.image->info.resourceRange, discard);
+                }
+            }
+
+            barriers.flush(commandBuffer);
+
+            // Fill render pass begin info.
+            VkFramebuffer framebuffer = getFramebuffer(renderPass);
+
+            VkRenderPassBeginInfo renderPassBeginInfo =
+            {
+                VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,       // VkStructureType        sType;
+                nullptr,                                        // const void*            pNext;
+
+                renderPass.handle,                              // VkRenderPass           renderPass;
+                framebuffer,                                    // VkFramebuffer          framebuffer;
+                {{0, 0}, renderPass.extent},                    // VkRect2D               renderArea;
+                (uint32_t)renderPass.clearValues.size(),        // uint32_t               clearValueCount;
+                renderPass.clearValues.data()                   // const VkClearValue*    pClearValues;
+            };
+
+            // Record the subpasses.
+            for (int i = 0; i < renderPass.passes.size(); i++)
+            {
+                VkcGraphPass &subpass = passes[renderPass.passes[i]];
+
+                if (i == 0)
+                    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, subpass.contents);
+                else
+                    vkCmdNextSubpass(commandBuffer, subpass.contents);
+
+                VkcGraphPassContext passContext;
+                passContext.renderPass =    renderPass.handle;
+                passContext.subpass =       i;
+                passContext.framebuffer =   framebuffer;
+                passContext.extent =        renderPass.extent;
+
+                if (subpass.record != nullptr)
+                    subpass.record(commandBuffer, passContext);
+            }
+
+            vkCmdEndRenderPass(commandBuffer);
+
+            // The render pass left the attachments in their final layouts.
+            for (int i = 0; i < renderPass.attachments.size(); i++)
+            {
+                const MgImageState &state = renderPass.finalStates[i];
+                resources[renderPass.attachments[i]].image->reset(state.layout, state.stages, state.access);
+            }
+
+            for (int i = 0; i < renderPass.passes.size(); i++)
+                endLifetimes(renderPass.passes[i]);
+
+            passIdx = renderPass.passes.last() + 1;
+        }
+        else
+        {
+            beginLifetimes(passIdx);
+
+            // Prepare the resources of the pass with a single barrier.
+            for (int i = 0; i < pass.accesses.size(); i++)
+            {
+                const VkcGraphAccess &access = pass.accesses[i];
+                VkcGraphResource &resource = resources[access.resource];
+
+                MgImageState state;
+                getUsageState(access.usage, pass.type, state);
+
+                bool discard = resource.firstPass == passIdx && !resource.preserve;
+                resource.image->transition(state.layout, state.stages, state.access, barriers,
+                                           resource.image->info.resourceRange, discard);
+            }
+
+            barriers.flush(commandBuffer);
+
+            VkcGraphPassContext passContext;
+            passContext.extent = extent;
+
+            if (pass.record != nullptr)
+                pass.record(commandBuffer, passContext);
+
+            endLifetimes(passIdx);
+
+            passIdx++;
+        }
+    }
+
+    // Leave the outputs in their requested layouts.
+    MgBarrierBatch barriers;
+
+    for (int i = 0; i < resources.size(); i++)
+        if (resources[i].output && resources[i].image != nullptr)
+            resources[i].image->transition(resources[i].outputLayout, barriers);
+
+    barriers.flush(commandBuffer);
+}
+
+
+/**
+ * Get the render pass and subpass a graphics pass is recorded in.
+ */
+void VkcRenderGraph::getRenderPass(int pass, VkRenderPass &renderPass, uint32_t &subpass) const
+{
+    const VkcGraphPass &graphPass = passes[pass];
+
+    if (graphPass.renderPass < 0)
+    {
+        renderPass =    VK_NULL_HANDLE;
+        subpass =       0;
+        return;
+    }
+
+    renderPass =    renderPasses[graphPass.renderPass].handle;
+    subpass =       graphPass.subpass;
+}
+
+
+/**
+ * Get the pass counts and transient memory of the last compilation.
+ */
+void VkcRenderGraph::getStats(VkcGraphStats &stats) const
+{
+    stats.passCount =           passes.size() - culledPassCount;
+    stats.culledPassCount =     culledPassCount;
+    stats.renderPassCount =     renderPasses.size();
+    stats.transientMemorySize = transientMemorySize;
+    stats.allocatedMemorySize = allocatedMemorySize;
+}
+
+
+/**
+ * Cull the passes whose writes never reach an output.
+ *
+ * Walks the passes backwards; a pass is kept if it writes a resource needed
+ * later, in which case everything it touches becomes needed as well.
+ */
+void VkcRenderGraph::cullPasses()
+{
+    QVector<bool> needed(resources.size(), false);
+    for (int i = 0; i < resources.size(); i++)
+        needed[i] = resources[i].output;
+
+    culledPassCount = 0;
+
+    for (int i = passes.size() - 1; i >= 0; i--)
+    {
+        VkcGraphPass &pass = passes[i];
+        pass.culled =       true;
+        pass.renderPass =   -1;
+        pass.subpass =      0;
+
+        for (int j = 0; j < pass.accesses.size() && pass.culled; j++)
+            if (isWrite(pass.accesses[j].usage) && needed[pass.accesses[j].resource])
+                pass.culled = false;
+
+        if (pass.culled)
+        {
+            culledPassCount++;
+            continue;
+        }
+
+        // Earlier writes of any resource touched here are needed too.
+        for (int j = 0; j < pass.accesses.size(); j++)
+            needed[pass.accesses[j].resource] = true;
+    }
+}
+
+
+/**
+ * Merge consecutive graphics passes into subpasses of the same render pass.
+ *
+ * A pass joins the previous one if it renders at the same extent and only
+ * reads earlier results of the render pass as attachments.
+ */
+void VkcRenderGraph::mergePasses()
+{
+    const uint8_t usedAsAttachment =    0x1;
+    const uint8_t usedOtherwise =       0x2;
+    const uint8_t written =             0x4;
+
+    QVector<uint8_t> flags(resources.size(), 0);
+    int current = -1;
+
+    for (int i = 0; i < passes.size(); i++)
+    {
+        VkcGraphPass &pass = passes[i];
+
+        if (pass.culled)
+            continue;
+
+        if (pass.type != VKC_GRAPH_PASS_GRAPHICS)
+        {
+            current = -1;
+            continue;
+        }
+
+        // Get the render area from the attachments.
+        VkExtent2D passExtent = extent;
+        for (int j = 0; j < pass.accesses.size(); j++)
+        {
+            if (isAttachment(pass.accesses[j].usage, pass.type))
+            {
+                passExtent = getExtent(pass.accesses[j].resource);
+                break;
+            }
+        }
+
+        // Check whether the pass can become a subpass of the current render pass.
+        bool merge = current >= 0 &&
+                renderPasses[current].extent.width == passExtent.width &&
+                renderPasses[current].extent.height == passExtent.height;
+
+        for (int j = 0; j < pass.accesses.size() && merge; j++)
+        {
+            const VkcGraphAccess &access = pass.accesses[j];
+            uint8_t resourceFlags = flags[access.resource];
+
+            if (isAttachment(access.usage, pass.type))
+                merge = !(resourceFlags & usedOtherwise);
+            else
+                merge = !(resourceFlags & (usedAsAttachment | written));
+        }
+
+        if (!merge)
+        {
+            VkcGraphRenderPass renderPass;
+            renderPass.extent = passExtent;
+
+            renderPasses.append(renderPass);
+            current = renderPasses.size() - 1;
+            flags.fill(0);
+        }
+
+        VkcGraphRenderPass &renderPass = renderPasses[current];
+
+        pass.renderPass =   current;
+        pass.subpass =      renderPass.passes.size();
+        renderPass.passes.append(i);
+
+        for (int j = 0; j < pass.accesses.size(); j++)
+        {
+            const VkcGraphAccess &access = pass.accesses[j];
+
+            if (isAttachment(access.usage, pass.type))
+            {
+                flags[access.resource] |= usedAsAttachment;
+
+                if (!renderPass.attachments.contains(access.resource))
+                    renderPass.attachments.append(access.resource);
+            }
+            else
+            {
+                flags[access.resource] |= usedOtherwise;
+            }
+
+            if (isWrite(access.usage))
+                flags[access.resource] |= written;
+        }
+    }
+}
+
+
+/**
+ * Create the Vulkan render pass of merged graphics passes.
+ *
+ * Render passes with the same description are shared by the device, so
+ * pipelines created against them stay compatible across recompilations and
+ * are shared between contexts.
+ */
+VkResult VkcRenderGraph::createRenderPass(VkcGraphRenderPass &renderPass)
+{
+    int subpassCount = renderPass.passes.size();
+    int attachmentCount = renderPass.attachments.size();
+    int lastPass = renderPass.passes.last();
+
+    QVector<VkAttachmentDescription> attachmentDescriptions;
+    QVector<QVector<bool>> used(attachmentCount, QVector<bool>(subpassCount, false));
+
+    renderPass.clearValues.clear();
+    renderPass.finalStates.clear();
+
+    // Fill attachment descriptions.
+    for (int i = 0; i < attachmentCount; i++)
+    {
+        const VkcGraphResource &resource = resources[renderPass.attachments[i]];
+
+        MgImageState firstState;
+        MgImageState lastState;
+        bool found = false;
+
+        for (int j = 0; j < subpassCount; j++)
+        {
+            const VkcGraphPass &pass = passes[renderPass.passes[j]];
+
+            for (int k = 0; k < pass.accesses.size(); k++)
+            {
+                const VkcGraphAccess &access = pass.accesses[k];
+                if (access.resource != renderPass.attachments[i] || !isAttachment(access.usage, pass.type))
+                    continue;
+
+                getUsageState(access.usage, pass.type, lastState);
+                if (!found)
+                    firstState = lastState;
+
+                found = true;
+                used[i][j] = true;
+            }
+        }
+
+        // Discarded contents are cleared or left undefined, the rest is loaded.
+        bool discard = resource.firstPass >= renderPass.passes.first() && !resource.preserve;
+        VkAttachmentLoadOp loadOp = discard ?
+                    (resource.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE) :
+                    VK_ATTACHMENT_LOAD_OP_LOAD;
+
+        // Transient results nobody reads afterwards never have to reach memory.
+        bool keep = resource.imported || resource.output || resource.lastPass > lastPass;
+        VkAttachmentStoreOp storeOp = keep ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+        bool stencil = resource.aspect & VK_IMAGE_ASPECT_STENCIL_BIT;
+
+        VkAttachmentDescription attachmentDescription =
+        {
+            0,                                                  // VkAttachmentDescriptionFlags    flags;
+
+            resource.format,                                    // VkFormat                        format;
+            VK_SAMPLE_COUNT_1_BIT,                              // VkSampleCountFlagBits           samples;
+
+            loadOp,                                             // VkAttachmentLoadOp              loadOp;
+            storeOp,                                            // VkAttachmentStoreOp             storeOp;
+            stencil ? loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE, // VkAttachmentLoadOp              stencilLoadOp;
+            stencil ? storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE,   // VkAttachmentStoreOp         stencilStoreOp;
+
+            firstState.layout,                                  // VkImageLayout                   initialLayout;
+            lastState.layout                                    // VkImageLayout                   finalLayout;
+        };
+
+        attachmentDescriptions.append(attachmentDescription);
+        renderPass.clearValues.append(resource.clearValue);
+        renderPass.finalStates.append(lastState);
+    }
+
+    // Fill attachment references of every subpass.
+    QVector<QVector<VkAttachmentReference>> colorReferences(subpassCount);
+    QVector<QVector<VkAttachmentReference>> inputReferences(subpassCount);
+    VkAttachmentReference unusedReference = {VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED};
+    QVector<VkAttachmentReference> depthReferences(subpassCount, unusedReference);
+    QVector<QVector<uint32_t>> preserveReferences(subpassCount);
+
+    for (int i = 0; i < subpassCount; i++)
+    {
+        const VkcGraphPass &pass = passes[renderPass.passes[i]];
+
+        for (int j = 0; j < pass.accesses.size(); j++)
+        {
+            const VkcGraphAccess &access = pass.accesses[j];
+            if (!isAttachment(access.usage, pass.type))
+                continue;
+
+            MgImageState state;
+            getUsageState(access.usage, pass.type, state);
+
+            VkAttachmentReference reference =
+            {
+                (uint32_t)renderPass.attachments.indexOf(access.resource),  // uint32_t         attachment;
+                state.layout                                                // VkImageLayout    layout;
+            };
+
+            if (access.usage == VKC_GRAPH_USAGE_COLOR_ATTACHMENT)
+                colorReferences[i].append(reference);
+            else if (access.usage == VKC_GRAPH_USAGE_INPUT_ATTACHMENT)
+                inputReferences[i].append(reference);
+            else
+                depthReferences[i] = reference;
+        }
+
+        // Attachments used before and after this subpass must survive it.
+        for (int j = 0; j < attachmentCount; j++)
+        {
+            if (used[j][i])
+                continue;
+
+            bool before = false;
+            bool after = false;
+
+            for (int k = 0; k < i; k++)
+                before |= used[j][k];
+            for (int k = i + 1; k < subpassCount; k++)
+                after |= used[j][k];
+
+            if (before && after)
+                preserveReferences[i].append(j);
+        }
+    }
+
+    // Fill subpass descriptions.
+    QVector<VkSubpassDescription> subpassDescriptions;
+
+    for (int i = 0; i < subpassCount; i++)
+    {
+        VkSubpassDescription subpassDescription =
+        {
+            0,                                                  // VkSubpassDescriptionFlags       flags;
+            VK_PIPELINE_BIND_POINT_GRAPHICS,                    // VkPipelineBindPoint             pipelineBindPoint;
+
+            (uint32_t)inputReferences[i].size(),                // uint32_t                        inputAttachmentCount;
+            inputReferences[i].data(),                          // const VkAttachmentReference*    pInputAttachments;
+
+            (uint32_t)colorReferences[i].size(),                // uint32_t                        colorAttachmentCount;
+            colorReferences[i].data(),                          // const VkAttachmentReference*    pColorAttachments;
+
+            nullptr,                                            // const VkAttachmentReference*    pResolveAttachments;
+
+            depthReferences[i].attachment == VK_ATTACHMENT_UNUSED ?     // const VkAttachmentReference*    pDepthStencilAttachment;
+                        nullptr : &depthReferences[i],
+
+            (uint32_t)preserveReferences[i].size(),             // uint32_t                        preserveAttachmentCount;
+            preserveReferences[i].data()                        // const uint32_t*                 pPreserveAttachments;
+        };
+
+        subpassDescriptions.append(subpassDescription);
+    }
+
+    // Fill subpass dependencies, one per pair of subpasses sharing a hazard.
+    QVector<VkSubpassDependency> dependencies;
+
+    for (int i = 1; i < subpassCount; i++)
+    {
+        const VkcGraphPass &pass = passes[renderPass.passes[i]];
+
+        for (int j = 0; j < pass.accesses.size(); j++)
+        {
+            const VkcGraphAccess &access = pass.accesses[j];
+
+            // Find the latest earlier subpass touching the same resource.
+            for (int k = i - 1; k >= 0; k--)
+            {
+                const VkcGraphPass &previousPass = passes[renderPass.passes[k]];
+                const VkcGraphAccess *previous = nullptr;
+
+                for (int l = 0; l < previousPass.accesses.size(); l++)
+                    if (previousPass.accesses[l].resource == access.resource)
+                        previous = &previousPass.accesses[l];
+
+                if (previous == nullptr)
+                    continue;
+
+                if (isWrite(previous->usage) || isWrite(access.usage))
+                {
+                    MgImageState srcState;
+                    MgImageState dstState;
+                    getUsageState(previous->usage, previousPass.type, srcState);
+                    getUsageState(access.usage, pass.type, dstState);
+
+                    VkAccessFlags srcAccess = isWrite(previous->usage) ? srcState.access : 0;
+
+                    int dependencyIdx = -1;
+                    for (int l = 0; l < dependencies.size(); l++)
+                        if (dependencies[l].srcSubpass == (uint32_t)k && dependencies[l].dstSubpass == (uint32_t)i)
+                            dependencyIdx = l;
+
+                    if (dependencyIdx < 0)
+                    {
+                        VkSubpassDependency dependency =
+                        {
+                            (uint32_t)k,                        // uint32_t                srcSubpass;
+                            (uint32_t)i,                        // uint32_t                dstSubpass;
+                            0,                                  // VkPipelineStageFlags    srcStageMask;
+                            0,                                  // VkPipelineStageFlags    dstStageMask;
+                            0,                                  // VkAccessFlags           srcAccessMask;
+                            0,                                  // VkAccessFlags           dstAccessMask;
+                            VK_DEPENDENCY_BY_REGION_BIT         // VkDependencyFlags       dependencyFlags;
+                        };
+
+                        dependencies.append(dependency);
+                        dependencyIdx = dependencies.size() - 1;
+                    }
+
+                    dependencies[dependencyIdx].srcStageMask |=     srcState.stages;
+                    dependencies[dependencyIdx].dstStageMask |=     dstState.stages;
+                    dependencies[dependencyIdx].srcAccessMask |=    srcAccess;
+                    dependencies[dependencyIdx].dstAccessMask |=    dstState.access;
+                }
+
+                break;
+            }
+        }
+    }
+
+    // Describe the render pass, equal descriptions share a handle.
+    QByteArray key;
+    key.append((const char*)attachmentDescriptions.constData(), attachmentDescriptions.size() * sizeof(VkAttachmentDescription));
+
+    for (int i = 0; i < subpassCount; i++)
+    {
+        uint32_t counts[3] = {(uint32_t)inputReferences[i].size(), (uint32_t)colorReferences[i].size(), (uint32_t)preserveReferences[i].size()};
+
+        key.append((const char*)counts, sizeof(counts));
+        key.append((const char*)inputReferences[i].constData(), inputReferences[i].size() * sizeof(VkAttachmentReference));
+        key.append((const char*)colorReferences[i].constData(), colorReferences[i].size() * sizeof(VkAttachmentReference));
+        key.append((const char*)&depthReferences[i], sizeof(VkAttachmentReference));
+        key.append((const char*)preserveReferences[i].constData(), preserveReferences[i].size() * sizeof(uint32_t));
+    }
+
+    key.append((const char*)dependencies.constData(), dependencies.size() * sizeof(VkSubpassDependency));
+
+    // Fill render pass create info.
+    VkRenderPassCreateInfo renderPassInfo =
+    {
+        VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,      // VkStructureType                   sType;
+        nullptr,                                        // const void*                       pNext;
+        0,                                              // VkRenderPassCreateFlags           flags;
+
+        (uint32_t)attachmentDescriptions.size(),        // uint32_t                          attachmentCount;
+        attachmentDescriptions.data(),                  // const VkAttachmentDescription*    pAttachments;
+
+        (uint32_t)subpassDescriptions.size(),           // uint32_t                          subpassCount;
+        subpassDescriptions.data(),                     // const VkSubpassDescription*       pSubpasses;
+
+        (uint32_t)dependencies.size(),                  // uint32_t                          dependencyCount;
+        dependencies.data()                             // const VkSubpassDependency*        pDependencies;
+    };
+
+    // Get the render pass shared by every graph with the same description.
+    mgAssert(device->renderPassCache->getRenderPass(key, renderPassInfo, renderPass.handle));
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Create the transient images and bind them to shared memory.
+ *
+ * Images are placed from the largest down into the first memory block whose
+ * residents all have disjoint lifetimes. Attachments that live inside a
+ * single render pass use lazily allocated memory when the device has it.
+ */
+VkResult VkcRenderGraph::createTransients()
+{
+    QVector<int> transients;
+    QVector<VkMemoryRequirements> requirements(resources.size());
+    QVector<bool> lazy(resources.size(), false);
+
+    transientMemorySize = 0;
+    allocatedMemorySize = 0;
+
+    // Get queue families.
+    QVector<uint32_t> queueFamilies;
+    device->getQueueFamilies(queueFamilies);
+
+    for (int i = 0; i < resources.size(); i++)
+    {
+        VkcGraphResource &resource = resources[i];
+
+        if (resource.imported || resource.firstPass < 0)
+            continue;
+
+        // Check whether the image never leaves a render pass.
+        const VkImageUsageFlags attachmentUsage =
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+        int renderPass = passes[resource.firstPass].renderPass;
+        lazy[i] = renderPass >= 0 && renderPass == passes[resource.lastPass].renderPass &&
+                !(resource.usage & ~attachmentUsage);
+
+        VkExtent2D imageExtent = getExtent(i);
+
+        // Fill image create info.
+        VkImageCreateInfo imageInfo =
+        {
+            VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,            // VkStructureType          sType;
+            nullptr,                                        // const void*              pNext;
+            0,                                              // VkImageCreateFlags       flags;
+
+            VK_IMAGE_TYPE_2D,                               // VkImageType              imageType;
+            resource.format,                                // VkFormat                 format;
+
+            {imageExtent.width, imageExtent.height, 1},     // VkExtent3D               extent;
+            1,                                              // uint32_t                 mipLevels;
+            1,                                              // uint32_t                 arrayLayers;
+
+            VK_SAMPLE_COUNT_1_BIT,                          // VkSampleCountFlagBits    samples;
+            VK_IMAGE_TILING_OPTIMAL,                        // VkImageTiling            tiling;
+            resource.usage | (lazy[i] ?                     // VkImageUsageFlags        usage;
+                VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0),
+            VK_SHARING_MODE_EXCLUSIVE,                      // VkSharingMode            sharingMode;
+
+            (uint32_t)queueFamilies.size(),                 // uint32_t                 queueFamilyIndexCount;
+            queueFamilies.data(),                           // const uint32_t*          pQueueFamilyIndices;
+
+            VK_IMAGE_LAYOUT_UNDEFINED,                      // VkImageLayout            initialLayout;
+        };
+
+        // Create image.
+        mgAssert(vkCreateImage(device->logical, &imageInfo, nullptr, &resource.handle));
+
+        // Get image memory requirements.
+        vkGetImageMemoryRequirements(device->logical, resource.handle, &requirements[i]);
+
+        uint32_t memoryTypeIdx;
+        if (lazy[i] && device->getMemoryTypeIndex(VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, requirements[i], &memoryTypeIdx) != VK_SUCCESS)
+            lazy[i] = false;
+
+        transientMemorySize += requirements[i].size;
+        transients.append(i);
+    }
+
+    // Place the largest images first.
+    std::sort(transients.begin(), transients.end(), [&requirements](int a, int b)
+    {
+        return requirements[a].size > requirements[b].size;
+    });
+
+    for (int i = 0; i < transients.size(); i++)
+    {
+        int resourceIdx = transients[i];
+        VkcGraphResource &resource = resources[resourceIdx];
+        const VkMemoryRequirements &requirement = requirements[resourceIdx];
+
+        int blockIdx = -1;
+        for (int j = 0; j < memoryBlocks.size() && blockIdx < 0 && !lazy[resourceIdx]; j++)
+        {
+            const VkcGraphMemoryBlock &block = memoryBlocks[j];
+
+            if (block.lazy || !(block.typeBits & requirement.memoryTypeBits))
+                continue;
+
+            // Attachments of the same render pass are all bound at its start,
+            // so their lifetimes overlap even in different subpasses.
+            bool disjoint = true;
+            for (int k = 0; k < block.residents.size() && disjoint; k++)
+            {
+                const VkcGraphResource &resident = resources[block.residents[k]];
+                disjoint = (resident.lastPass < resource.firstPass && !isSameRenderPass(resident.lastPass, resource.firstPass)) ||
+                           (resource.lastPass < resident.firstPass && !isSameRenderPass(resource.lastPass, resident.firstPass));
+            }
+
+            if (disjoint)
+                blockIdx = j;
+        }
+
+        if (blockIdx < 0)
+        {
+            VkcGraphMemoryBlock block;
+            block.lazy = lazy[resourceIdx];
+
+            memoryBlocks.append(block);
+            blockIdx = memoryBlocks.size() - 1;
+        }
+
+        VkcGraphMemoryBlock &block = memoryBlocks[blockIdx];
+        block.size =        qMax(block.size, requirement.size);
+        block.typeBits &=   requirement.memoryTypeBits;
+        block.residents.append(resourceIdx);
+
+        resource.memoryBlock = blockIdx;
+    }
+
+    // Allocate the memory blocks and bind their residents.
+    for (int i = 0; i < memoryBlocks.size(); i++)
+    {
+        VkcGraphMemoryBlock &block = memoryBlocks[i];
+
+        VkMemoryRequirements blockRequirements =
+        {
+            block.size,             // VkDeviceSize    size;
+            0,                      // VkDeviceSize    alignment;
+            block.typeBits          // uint32_t        memoryTypeBits;
+        };
+
+        // Get memory type index.
+        uint32_t memoryTypeIdx = 0;
+        VkMemoryPropertyFlags memoryType = block.lazy ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        mgAssert(device->getMemoryTypeIndex(memoryType, blockRequirements, &memoryTypeIdx));
+
+        // Fill memory allocate info.
+        VkMemoryAllocateInfo memoryInfo =
+        {
+            VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, // VkStructureType    sType;
+            nullptr,                                // const void*        pNext;
+
+            block.size,                             // VkDeviceSize       allocationSize;
+            memoryTypeIdx                           // uint32_t           memoryTypeIndex;
+        };
+
+        // Allocate memory.
+        mgAssert(vkAllocateMemory(device->logical, &memoryInfo, nullptr, &block.memory));
+        allocatedMemorySize += block.size;
+
+        // Hand the memory over in lifetime order.
+        std::sort(block.residents.begin(), block.residents.end(), [this](int a, int b)
+        {
+            return resources[a].firstPass < resources[b].firstPass;
+        });
+
+        block.lastState = MgImageState();
+
+        for (int j = 0; j < block.residents.size(); j++)
+        {
+            VkcGraphResource &resource = resources[block.residents[j]];
+            VkExtent2D imageExtent = getExtent(block.residents[j]);
+
+            // Bind memory to image.
+            mgAssert(vkBindImageMemory(device->logical, resource.handle, block.memory, 0));
+
+            MgImageInfo imageInfo =
+            {
+                VK_IMAGE_TYPE_2D,                               // VkImageType               type;
+                {imageExtent.width, imageExtent.height, 1},     // VkExtent3D                extent;
+                resource.format,                                // VkFormat                  format;
+                VK_IMAGE_LAYOUT_UNDEFINED,                      // VkImageLayout             layout;
+                resource.usage,                                 // VkImageUsageFlags         usage;
+                {                                               // VkImageSubresourceRange   resourceRange;
+                    resource.aspect,                                // VkImageAspectFlags    aspectMask;
+                    0,                                              // uint32_t              baseMipLevel;
+                    1,                                              // uint32_t              levelCount;
+                    0,                                              // uint32_t              baseArrayLayer;
+                    1                                               // uint32_t              layerCount;
+                },
+
+                resource.handle,                                // const VkImage             image;
+                true,                                           // bool                      createView;
+                (resource.usage & VK_IMAGE_USAGE_SAMPLED_BIT) != 0  // bool                  createSampler;
+            };
+
+            // Create the view, the image itself stays owned by the graph.
+            resource.image = new MgImage();
+            mgAssert(resource.image->create(device, &imageInfo));
+        }
+    }
+
+    return VK_SUCCESS;
+}
+
+
+/**
+ * Retire the transient images and their memory.
+ *
+ * Frames in flight may still use them, so they are destroyed through the
+ * deletion queue.
+ */
+void VkcRenderGraph::destroyTransients()
+{
+    for (int i = 0; i < resources.size(); i++)
+    {
+        VkcGraphResource &resource = resources[i];
+
+        if (resource.imported)
+            continue;
+
+        if (resource.image != nullptr)
+        {
+            resource.image->destroy(device);
+            delete resource.image;
+            resource.image = nullptr;
+        }
+
+        device->deletionQueue->retire(VKC_DELETION_IMAGE, (uint64_t)resource.handle);
+        resource.handle = VK_NULL_HANDLE;
+    }
+
+    // Memory is retired after the images bound to it.
+    for (int i = 0; i < memoryBlocks.size(); i++)
+        device->deletionQueue->retire(VKC_DELETION_MEMORY, (uint64_t)memoryBlocks[i].memory);
+
+    memoryBlocks.clear();
+}
+
+
+/**
+ * Retire the cached framebuffers.
+ */
+void VkcRenderGraph::destroyFramebuffers()
+{
+    for (int i = 0; i < renderPasses.size(); i++)
+    {
+        QHash<QByteArray, VkFramebuffer> &framebuffers = renderPasses[i].framebuffers;
+
+        for (auto it = framebuffers.constBegin(); it != framebuffers.constEnd(); ++it)
+            device->deletionQueue->retire(VKC_DELETION_FRAMEBUFFER, (uint64_t)it.value());
+
+        framebuffers.clear();
+    }
+}
+
+
+/**
+ * Get the framebuffer of a render pass for the current attachment views.
+ *
+ * Framebuffers are cached by their views, so swapchain images each get their
+ * own framebuffer the first time they are rendered to.
+ */
+VkFramebuffer VkcRenderGraph::getFramebuffer(VkcGraphRenderPass &renderPass)
+{
+    QVector<VkImageView> views;
+    for (int i = 0; i < renderPass.attachments.size(); i++)
+        views.append(resources[renderPass.attachments[i]].image->view);
+
+    QByteArray key((const char*)views.constData(), views.size() * sizeof(VkImageView));
+
+    auto it = renderPass.framebuffers.constFind(key);
+    if (it != renderPass.framebuffers.constEnd())
+        return it.value();
+
+    // Fill framebuffer info.
+    VkFramebufferCreateInfo framebufferInfo =
+    {
+        VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,  // VkStructureType             sType;
+        nullptr,                                    // const void*                 pNext;
+        0,                                          // VkFramebufferCreateFlags    flags;
+
+        renderPass.handle,                          // VkRenderPass                renderPass;
+        (uint32_t)views.size(),                     // uint32_t                    attachmentCount;
+        views.data(),                               // const VkImageView*          pAttachments;
+
+        renderPass.extent.width,                    // uint32_t                    width;
+        renderPass.extent.height,                   // uint32_t                    height;
+        1                                           // uint32_t                    layers;
+    };
+
+    // Create framebuffer.
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    vkCreateFramebuffer(device->logical, &framebufferInfo, nullptr, &framebuffer);
+    renderPass.framebuffers.insert(key, framebuffer);
+
+    return framebuffer;
+}
+
+
+/**
+ * Hand the memory of the transient images first used by a pass over from its previous user.
+ *
+ * Their old contents are discarded, but the previous resident of the memory
+ * block must be done with it first.
+ */
+void VkcRenderGraph::beginLifetimes(int pass)
+{
+    const VkcGraphPass &graphPass = passes[pass];
+
+    for (int i = 0; i < graphPass.accesses.size(); i++)
+    {
+        const VkcGraphResource &resource = resources[graphPass.accesses[i].resource];
+
+        if (resource.imported || resource.firstPass != pass)
+            continue;
+
+        const MgImageState &previous = memoryBlocks[resource.memoryBlock].lastState;
+        resource.image->reset(VK_IMAGE_LAYOUT_UNDEFINED, previous.stages, previous.access);
+    }
+}
+
+
+/**
+ * Remember the last access of the transient images last used by a pass.
+ */
+void VkcRenderGraph::endLifetimes(int pass)
+{
+    const VkcGraphPass &graphPass = passes[pass];
+
+    for (int i = 0; i < graphPass.accesses.size(); i++)
+    {
+        const VkcGraphResource &resource = resources[graphPass.accesses[i].resource];
+
+        if (resource.imported || resource.lastPass != pass)
+            continue;
+
+        memoryBlocks[resource.memoryBlock].lastState = resource.image->getState();
+    }
+}
+
+
+/**
+ * Get the extent of a resource.
+ */
+VkExtent2D VkcRenderGraph::getExtent(int resource) const
+{
+    const VkcGraphResource &graphResource = resources[resource];
+
+    if (graphResource.imported && graphResource.image != nullptr)
+        return {graphResource.image->info.extent.width, graphResource.image->info.extent.height};
+
+    if (graphResource.extent.width == 0 || graphResource.extent.height == 0)
+        return extent;
+
+    return graphResource.extent;
+}
+
+
+/**
+ * Check if two passes are subpasses of the same render pass.
+ */
+bool VkcRenderGraph::isSameRenderPass(int passA, int passB) const
+{
+    return passes[passA].renderPass >= 0 && passes[passA].renderPass == passes[passB].renderPass;
+}
+
+
+/**
+ * Check whether a usage modifies the resource.
+ */
+bool VkcRenderGraph::isWrite(VkcGraphUsage usage)
+{
+    return usage == VKC_GRAPH_USAGE_COLOR_ATTACHMENT ||
+            usage == VKC_GRAPH_USAGE_DEPTH_ATTACHMENT ||
+            usage == VKC_GRAPH_USAGE_STORAGE_WRITE ||
+            usage == VKC_GRAPH_USAGE_TRANSFER_DST;
+}
+
+
+/**
+ * Check whether a usage binds the resource as a framebuffer attachment.
+ */
+bool VkcRenderGraph::isAttachment(VkcGraphUsage usage, VkcGraphPassType type)
+{
+    if (type != VKC_GRAPH_PASS_GRAPHICS)
+        return false;
+
+    return usage == VKC_GRAPH_USAGE_COLOR_ATTACHMENT ||
+            usage == VKC_GRAPH_USAGE_DEPTH_ATTACHMENT ||
+            usage == VKC_GRAPH_USAGE_DEPTH_READ ||
+            usage == VKC_GRAPH_USAGE_INPUT_ATTACHMENT;
+}
+
+
+/**
+ * Get the image usage flags a resource needs for a usage.
+ */
+VkImageUsageFlags VkcRenderGraph::getImageUsage(VkcGraphUsage usage, VkcGraphPassType type)
+{
+    switch (usage)
+    {
+    case VKC_GRAPH_USAGE_COLOR_ATTACHMENT:
+        return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+    case VKC_GRAPH_USAGE_DEPTH_ATTACHMENT:
+        return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+
+    case VKC_GRAPH_USAGE_DEPTH_READ:
+        return type == VKC_GRAPH_PASS_GRAPHICS ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_SAMPLED_BIT;
+
+    case VKC_GRAPH_USAGE_INPUT_ATTACHMENT:
+        return VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+    case VKC_GRAPH_USAGE_SAMPLED:
+        return VK_IMAGE_USAGE_SAMPLED_BIT;
+
+    case VKC_GRAPH_USAGE_STORAGE_READ:
+    case VKC_GRAPH_USAGE_STORAGE_WRITE:
+        return VK_IMAGE_USAGE_STORAGE_BIT;
+
+    case VKC_GRAPH_USAGE_TRANSFER_SRC:
+        return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+    case VKC_GRAPH_USAGE_TRANSFER_DST:
+        return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Get the layout, stages and access a usage puts a resource in.
+ */
+void VkcRenderGraph::getUsageState(VkcGraphUsage usage, VkcGraphPassType type, MgImageState &state)
+{
+    VkPipelineStageFlags shaderStages;
+    switch (type)
+    {
+    case VKC_GRAPH_PASS_GRAPHICS:
+        shaderStages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        break;
+    case VKC_GRAPH_PASS_COMPUTE:
+        shaderStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        break;
+    default:
+        shaderStages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        break;
+    }
+
+    switch (usage)
+    {
+    case VKC_GRAPH_USAGE_COLOR_ATTACHMENT:
+        state.layout =  VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        state.stages =  VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        state.access =  VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        break;
+
+    case VKC_GRAPH_USAGE_DEPTH_ATTACHMENT:
+        state.layout =  VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        state.stages =  VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        state.access =  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        break;
+
+    case VKC_GRAPH_USAGE_DEPTH_READ:
+        state.layout =  VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        if (type == VKC_GRAPH_PASS_GRAPHICS)
+        {
+            state.stages =  VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+            state.access =  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+        }
+        else
+        {
+            state.stages =  shaderStages;
+            state.access =  VK_ACCESS_SHADER_READ_BIT;
+        }
+        break;
+
+    case VKC_GRAPH_USAGE_INPUT_ATTACHMENT:
+        state.layout =  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        state.stages =  VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        state.access =  VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+        break;
+
+    case VKC_GRAPH_USAGE_SAMPLED:
+        state.layout =  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        state.stages =  shaderStages;
+        state.access =  VK_ACCESS_SHADER_READ_BIT;
+        break;
+
+    case VKC_GRAPH_USAGE_STORAGE_READ:
+        state.layout =  VK_IMAGE_LAYOUT_GENERAL;
+        state.stages =  shaderStages;
+        state.access =  VK_ACCESS_SHADER_READ_BIT;
+        break;
+
+    case VKC_GRAPH_USAGE_STORAGE_WRITE:
+        state.layout =  VK_IMAGE_LAYOUT_GENERAL;
+        state.stages =  shaderStages;
+        state.access =  VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        break;
+
+    case VKC_GRAPH_USAGE_TRANSFER_SRC:
+        state.layout =  VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        state.stages =  VK_PIPELINE_STAGE_TRANSFER_BIT;
+        state.access =  VK_ACCESS_TRANSFER_READ_BIT;
+        break;
+
+    case VKC_GRAPH_USAGE_TRANSFER_DST:
+        state.layout =  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        state.stages =  VK_PIPELINE_STAGE_TRANSFER_BIT;
+        state.access =  VK_ACCESS_TRANSFER_WRITE_BIT;
+        break;
+    }
+}
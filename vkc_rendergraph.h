@@ -0,0 +1,293 @@
+#ifndef VKC_RENDERGRAPH_H
+#define VKC_RENDERGRAPH_H
+
+#include "stable.h"
+#include "vkc_device.h"
+#include "mgimage.h"
+
+#include <functional>
+
+
+/**
+ * Ways a pass can use a graph resource.
+ */
+enum VkcGraphUsage
+{
+    VKC_GRAPH_USAGE_COLOR_ATTACHMENT,
+    VKC_GRAPH_USAGE_DEPTH_ATTACHMENT,
+    VKC_GRAPH_USAGE_DEPTH_READ,
+    VKC_GRAPH_USAGE_INPUT_ATTACHMENT,
+    VKC_GRAPH_USAGE_SAMPLED,
+    VKC_GRAPH_USAGE_STORAGE_READ,
+    VKC_GRAPH_USAGE_STORAGE_WRITE,
+    VKC_GRAPH_USAGE_TRANSFER_SRC,
+    VKC_GRAPH_USAGE_TRANSFER_DST
+};
+
+/**
+ * Kinds of passes.
+ */
+enum VkcGraphPassType
+{
+    VKC_GRAPH_PASS_GRAPHICS,
+    VKC_GRAPH_PASS_COMPUTE,
+    VKC_GRAPH_PASS_TRANSFER
+};
+
+/**
+ * Struct handed to a pass while it records its commands.
+ */
+struct VkcGraphPassContext
+{
+    VkRenderPass                renderPass =    VK_NULL_HANDLE;
+    uint32_t                    subpass =       0;
+    VkFramebuffer               framebuffer =   VK_NULL_HANDLE;
+    VkExtent2D                  extent =        {0, 0};
+};
+
+/**
+ * Function recording the commands of a pass.
+ */
+typedef std::function<void(VkCommandBuffer, const VkcGraphPassContext&)> VkcGraphRecord;
+
+/**
+ * Struct used for a resource access declared by a pass.
+ */
+struct VkcGraphAccess
+{
+    int                         resource =      -1;
+    VkcGraphUsage               usage =         VKC_GRAPH_USAGE_SAMPLED;
+};
+
+/**
+ * Struct used for an image known to the graph.
+ *
+ * Imported images are owned elsewhere; transient images are created by the
+ * graph when it is compiled and may share memory with each other.
+ */
+struct VkcGraphResource
+{
+    QString                     name =          "";
+    MgImage                     *image =        nullptr;
+
+    bool                        imported =      false;
+    bool                        preserve =      false;
+    bool                        output =        false;
+    VkImageLayout               outputLayout =  VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkFormat                    format =        VK_FORMAT_UNDEFINED;
+    VkImageAspectFlags          aspect =        0;
+    VkExtent2D                  extent =        {0, 0};
+
+    bool                        clear =         false;
+    VkClearValue                clearValue =    {};
+
+    // Filled by compile().
+    VkImageUsageFlags           usage =         0;
+    int                         firstPass =     -1;
+    int                         lastPass =      -1;
+    int                         memoryBlock =   -1;
+    VkImage                     handle =        VK_NULL_HANDLE;
+};
+
+/**
+ * Struct used for a pass.
+ */
+struct VkcGraphPass
+{
+    QString                     name =          "";
+    VkcGraphPassType            type =          VKC_GRAPH_PASS_GRAPHICS;
+    VkcGraphRecord              record =        nullptr;
+    VkSubpassContents           contents =      VK_SUBPASS_CONTENTS_INLINE;
+
+    QVector<VkcGraphAccess>     accesses =      {};
+
+    // Filled by compile().
+    bool                        culled =        false;
+    int                         renderPass =    -1;
+    uint32_t                    subpass =       0;
+};
+
+/**
+ * Struct used for a Vulkan render pass built from merged graphics passes.
+ */
+struct VkcGraphRenderPass
+{
+    QVector<int>                passes =        {};
+    QVector<int>                attachments =   {};
+    QVector<VkClearValue>       clearValues =   {};
+    QVector<MgImageState>       finalStates =   {};
+
+    VkExtent2D                  extent =        {0, 0};
+    VkRenderPass                handle =        VK_NULL_HANDLE;
+
+    QHash<QByteArray, VkFramebuffer> framebuffers;
+};
+
+/**
+ * Struct used for device memory shared by transient images with disjoint lifetimes.
+ */
+struct VkcGraphMemoryBlock
+{
+    VkDeviceMemory              memory =        VK_NULL_HANDLE;
+    VkDeviceSize                size =          0;
+    uint32_t                    typeBits =      UINT32_MAX;
+    bool                        lazy =          false;
+
+    QVector<int>                residents =     {};
+    MgImageState                lastState;
+};
+
+/**
+ * Struct used for the result of the last compilation of a graph.
+ */
+struct VkcGraphStats
+{
+    uint32_t                    passCount =             0;
+    uint32_t                    culledPassCount =       0;
+    uint32_t                    renderPassCount =       0;
+    VkDeviceSize                transientMemorySize =   0;
+    VkDeviceSize                allocatedMemorySize =   0;
+};
+
+
+/**
+ * Class used to describe a frame as passes reading and writing images.
+ *
+ * Compiling the graph culls passes that do not contribute to an output,
+ * merges consecutive compatible graphics passes into subpasses of one render
+ * pass and lets transient images with disjoint lifetimes alias the same
+ * memory. Executing it records every pass with the barriers it needs.
+ *
+ * Classes named "Vkc[class]" stand for "Vulkan custom class".
+ */
+class VkcRenderGraph
+{
+    // Objects:
+public:
+    uint32_t                        culledPassCount;
+    VkDeviceSize                    transientMemorySize;
+    VkDeviceSize                    allocatedMemorySize;
+
+private:
+    QVector<VkcGraphResource>       resources;
+    QVector<VkcGraphPass>           passes;
+
+    QVector<VkcGraphRenderPass>     renderPasses;
+    QVector<VkcGraphMemoryBlock>    memoryBlocks;
+
+    VkExtent2D                      extent;
+    bool                            compiled;
+
+    const VkcDevice                 *device;
+
+    // Functions:
+public:
+    VkcRenderGraph(
+            const VkcDevice         *device
+            );
+    ~VkcRenderGraph();
+
+    int importImage(
+            const QString           &name,
+            MgImage                 *image,
+            bool                    preserve
+            );
+    int createImage(
+            const QString           &name,
+            VkFormat                format,
+            VkImageAspectFlags      aspect,
+            VkExtent2D              extent = {0, 0}
+            );
+    int findResource(
+            const QString           &name
+            ) const;
+    void setImage(
+            int                     resource,
+            MgImage                 *image
+            );
+    void setClearValue(
+            int                     resource,
+            VkClearValue            clearValue
+            );
+    void setOutput(
+            int                     resource,
+            VkImageLayout           layout
+            );
+
+    int addPass(
+            const QString           &name,
+            VkcGraphPassType        type,
+            VkcGraphRecord          record
+            );
+    void addAccess(
+            int                     pass,
+            int                     resource,
+            VkcGraphUsage           usage
+            );
+    void setPassContents(
+            int                     pass,
+            VkSubpassContents       contents
+            );
+
+    VkResult compile(
+            VkExtent2D              extent
+            );
+    void execute(
+            VkCommandBuffer         commandBuffer
+            );
+
+    void getRenderPass(
+            int                     pass,
+            VkRenderPass            &renderPass,
+            uint32_t                &subpass
+            ) const;
+    void getStats(
+            VkcGraphStats           &stats
+            ) const;
+
+private:
+    void cullPasses();
+    void mergePasses();
+    VkResult createRenderPass(
+            VkcGraphRenderPass      &renderPass
+            );
+    VkResult createTransients();
+    void destroyTransients();
+    void destroyFramebuffers();
+    VkFramebuffer getFramebuffer(
+            VkcGraphRenderPass      &renderPass
+            );
+    void beginLifetimes(
+            int                     pass
+            );
+    void endLifetimes(
+            int                     pass
+            );
+    VkExtent2D getExtent(
+            int                     resource
+            ) const;
+    bool isSameRenderPass(
+            int                     passA,
+            int                     passB
+            ) const;
+
+    static bool isWrite(
+            VkcGraphUsage           usage
+            );
+    static bool isAttachment(
+            VkcGraphUsage           usage,
+            VkcGraphPassType        type
+            );
+    static VkImageUsageFlags getImageUsage(
+            VkcGraphUsage           usage,
+            VkcGraphPassType        type
+            );
+    static void getUsageState(
+            VkcGraphUsage           usage,
+            VkcGraphPassType        type,
+            MgImageState            &state
+            );
+};
+
+#endif // VKC_RENDERGRAPH_H
@@ -0,0 +1,47 @@
+#include "vkc_renderpasscache.h"
+
+
+/**
+ * Create an empty render pass cache.
+ */
+VkcRenderPassCache::VkcRenderPassCache(VkDevice device)
+{
+    this->device = device;
+}
+
+
+/**
+ * Destroy all render passes.
+ *
+ * Called once no framebuffer or command buffer uses them anymore.
+ */
+VkcRenderPassCache::~VkcRenderPassCache()
+{
+    for (auto it = renderPasses.constBegin(); it != renderPasses.constEnd(); ++it)
+        vkDestroyRenderPass(device, it.value(), nullptr);
+}
+
+
+/**
+ * Get the render pass for a description, creating it from the info if needed.
+ *
+ * The key has to hold everything the info describes.
+ */
+VkResult VkcRenderPassCache::getRenderPass(const QByteArray &key, const VkRenderPassCreateInfo &renderPassInfo, VkRenderPass &renderPass)
+{
+    QMutexLocker locker(&mutex);
+
+    auto it = renderPasses.constFind(key);
+    if (it != renderPasses.constEnd())
+    {
+        renderPass = it.value();
+        return VK_SUCCESS;
+    }
+
+    // Create render pass.
+    mgAssert(vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass));
+
+    renderPasses.insert(key, renderPass);
+
+    return VK_SUCCESS;
+}
@@ -0,0 +1,40 @@
+#ifndef VKC_RENDERPASSCACHE_H
+#define VKC_RENDERPASSCACHE_H
+
+#include "stable.h"
+
+
+/**
+ * Class used to share render passes between render graphs.
+ *
+ * Render passes are hashed by their description, so every context asking
+ * for the same passes gets the same handles, and pipelines built against
+ * them are shared through the pipeline cache. Render passes are small and
+ * few, so they live as long as the device.
+ *
+ * Classes named "Vkc[class]" stand for "Vulkan custom class".
+ */
+class VkcRenderPassCache
+{
+    // Objects:
+private:
+    QMutex                                      mutex;
+    QHash<QByteArray, VkRenderPass>             renderPasses;
+
+    VkDevice                                    device;
+
+    // Functions:
+public:
+    VkcRenderPassCache(
+            VkDevice                            device
+            );
+    ~VkcRenderPassCache();
+
+    VkResult getRenderPass(
+            const QByteArray                    &key,
+            const VkRenderPassCreateInfo        &renderPassInfo,
+            VkRenderPass                        &renderPass
+            );
+};
+
+#endif // VKC_RENDERPASSCACHE_H
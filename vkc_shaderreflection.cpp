@@ -0,0 +1,405 @@
+#include "vkc_shaderreflection.h"
+
+#define SPV_MAGIC                   0x07230203
+#define SPV_HEADER_SIZE             5
+
+#define SPV_OP_NAME                 5
+#define SPV_OP_TYPE_INT             21
+#define SPV_OP_TYPE_FLOAT           22
+#define SPV_OP_TYPE_VECTOR          23
+#define SPV_OP_TYPE_MATRIX          24
+#define SPV_OP_TYPE_IMAGE           25
+#define SPV_OP_TYPE_SAMPLER         26
+#define SPV_OP_TYPE_SAMPLED_IMAGE   27
+#define SPV_OP_TYPE_ARRAY           28
+#define SPV_OP_TYPE_RUNTIME_ARRAY   29
+#define SPV_OP_TYPE_STRUCT          30
+#define SPV_OP_TYPE_POINTER         32
+#define SPV_OP_CONSTANT             43
+#define SPV_OP_SPEC_CONSTANT_TRUE   48
+#define SPV_OP_SPEC_CONSTANT_FALSE  49
+#define SPV_OP_VARIABLE             59
+#define SPV_OP_DECORATE             71
+#define SPV_OP_MEMBER_DECORATE      72
+
+#define SPV_DECORATION_BLOCK            2
+#define SPV_DECORATION_SPEC_ID          1
+#define SPV_DECORATION_BUFFER_BLOCK     3
+#define SPV_DECORATION_ARRAY_STRIDE     6
+#define SPV_DECORATION_BUILT_IN         11
+#define SPV_DECORATION_LOCATION         30
+#define SPV_DECORATION_BINDING          33
+#define SPV_DECORATION_DESCRIPTOR_SET   34
+#define SPV_DECORATION_OFFSET           35
+
+#define SPV_STORAGE_UNIFORM_CONSTANT    0
+#define SPV_STORAGE_INPUT               1
+#define SPV_STORAGE_UNIFORM             2
+#define SPV_STORAGE_PUSH_CONSTANT       9
+#define SPV_STORAGE_STORAGE_BUFFER      12
+
+#define SPV_DIM_BUFFER                  5
+#define SPV_DIM_SUBPASS_DATA            6
+
+
+/**
+ * Initialize with empty fields.
+ */
+VkcShaderReflection::VkcShaderReflection()
+{
+    stages =                0;
+    pushConstantSize =      0;
+    pushConstantStages =    0;
+    featureMask =           0;
+}
+
+
+/**
+ * Read the interface of a SPIR-V module used by a stage.
+ *
+ * Returns false if the code is not valid SPIR-V.
+ */
+bool VkcShaderReflection::parse(const QByteArray &code, VkShaderStageFlagBits stage)
+{
+    const uint32_t *words = (const uint32_t*)code.constData();
+    uint32_t wordCount = code.size() / sizeof(uint32_t);
+
+    if (wordCount < SPV_HEADER_SIZE || words[0] != SPV_MAGIC)
+        return false;
+
+    types.clear();
+    constants.clear();
+    names.clear();
+    memberOffsets.clear();
+    arrayStrides.clear();
+
+    QHash<uint32_t, uint32_t> sets;
+    QHash<uint32_t, uint32_t> bindingNumbers;
+    QHash<uint32_t, uint32_t> locations;
+    QSet<uint32_t> builtIns;
+    QSet<uint32_t> bufferBlocks;
+    QHash<uint32_t, uint32_t> specIds;
+    QVector<uint32_t> featureIds;
+
+    QVector<VkcSpirvVariable> variables;
+
+    // Gather names, decorations, types and variables.
+    for (uint32_t i = SPV_HEADER_SIZE; i < wordCount;)
+    {
+        uint32_t opcode = words[i] & 0xffff;
+        uint32_t length = words[i] >> 16;
+
+        if (length == 0 || i + length > wordCount)
+            return false;
+
+        const uint32_t *operands = words + i + 1;
+
+        switch (opcode)
+        {
+        case SPV_OP_NAME:
+            names.insert(operands[0], QByteArray((const char*)(operands + 1)));
+            break;
+
+        case SPV_OP_DECORATE:
+            switch (operands[1])
+            {
+            case SPV_DECORATION_SPEC_ID:        specIds.insert(operands[0], operands[2]);       break;
+            case SPV_DECORATION_BUFFER_BLOCK:   bufferBlocks.insert(operands[0]);               break;
+            case SPV_DECORATION_ARRAY_STRIDE:   arrayStrides.insert(operands[0], operands[2]);  break;
+            case SPV_DECORATION_BUILT_IN:       builtIns.insert(operands[0]);                   break;
+            case SPV_DECORATION_LOCATION:       locations.insert(operands[0], operands[2]);     break;
+            case SPV_DECORATION_BINDING:        bindingNumbers.insert(operands[0], operands[2]); break;
+            case SPV_DECORATION_DESCRIPTOR_SET: sets.insert(operands[0], operands[2]);          break;
+            }
+            break;
+
+        case SPV_OP_MEMBER_DECORATE:
+            if (operands[2] == SPV_DECORATION_OFFSET)
+                memberOffsets.insert(((uint64_t)operands[0] << 32) | operands[1], operands[3]);
+            break;
+
+        case SPV_OP_TYPE_INT:
+        case SPV_OP_TYPE_FLOAT:
+        case SPV_OP_TYPE_VECTOR:
+        case SPV_OP_TYPE_MATRIX:
+        case SPV_OP_TYPE_IMAGE:
+        case SPV_OP_TYPE_SAMPLER:
+        case SPV_OP_TYPE_SAMPLED_IMAGE:
+        case SPV_OP_TYPE_ARRAY:
+        case SPV_OP_TYPE_RUNTIME_ARRAY:
+        case SPV_OP_TYPE_STRUCT:
+        case SPV_OP_TYPE_POINTER:
+        {
+            VkcSpirvType type;
+            type.opcode = opcode;
+
+            for (uint32_t j = 1; j < length - 1; j++)
+                type.operands.append(operands[j]);
+
+            types.insert(operands[0], type);
+            break;
+        }
+
+        case SPV_OP_CONSTANT:
+            constants.insert(operands[1], operands[2]);
+            break;
+
+        case SPV_OP_SPEC_CONSTANT_TRUE:
+        case SPV_OP_SPEC_CONSTANT_FALSE:
+            featureIds.append(operands[1]);
+            break;
+
+        case SPV_OP_VARIABLE:
+            variables.append({operands[1], operands[0], operands[2]});
+            break;
+        }
+
+        i += length;
+    }
+
+    stages |= stage;
+
+    // Boolean specialization constants toggle features, their ids are the feature bits.
+    for (int i = 0; i < featureIds.size(); i++)
+    {
+        auto it = specIds.find(featureIds[i]);
+        if (it != specIds.end() && it.value() < 32)
+            featureMask |= 1u << it.value();
+    }
+
+    // Turn the variables into bindings, push constants and inputs.
+    for (int i = 0; i < variables.size(); i++)
+    {
+        uint32_t id =           variables[i].id;
+        uint32_t storageClass = variables[i].storageClass;
+
+        // Variables are pointers, look at what they point to.
+        uint32_t typeId =       types.value(variables[i].typeId).operands.value(1);
+
+        switch (storageClass)
+        {
+        case SPV_STORAGE_INPUT:
+        {
+            if (stage != VK_SHADER_STAGE_VERTEX_BIT || !locations.contains(id) || builtIns.contains(id))
+                break;
+
+            VkcShaderInput input;
+            input.location =    locations.value(id);
+            input.format =      getFormat(typeId, input.size);
+
+            inputs.append(input);
+            break;
+        }
+
+        case SPV_STORAGE_PUSH_CONSTANT:
+            pushConstantSize = qMax(pushConstantSize, getSize(typeId));
+            pushConstantStages |= stage;
+            break;
+
+        case SPV_STORAGE_UNIFORM_CONSTANT:
+        case SPV_STORAGE_UNIFORM:
+        case SPV_STORAGE_STORAGE_BUFFER:
+        {
+            if (!bindingNumbers.contains(id))
+                break;
+
+            VkcShaderBinding binding;
+            binding.set =       sets.value(id, 0);
+            binding.binding =   bindingNumbers.value(id);
+            binding.stages =    stage;
+            binding.name =      names.value(id);
+
+            // Arrays of descriptors, unsized ones are left to the user to size.
+            const VkcSpirvType type = types.value(typeId);
+
+            if (type.opcode == SPV_OP_TYPE_ARRAY)
+            {
+                binding.count = constants.value(type.operands[1], 1);
+                typeId = type.operands[0];
+            }
+            else if (type.opcode == SPV_OP_TYPE_RUNTIME_ARRAY)
+            {
+                binding.count = 0;
+                typeId = type.operands[0];
+            }
+
+            binding.typeName =  names.value(typeId);
+            binding.type =      getDescriptorType(typeId, storageClass, bufferBlocks.contains(typeId));
+
+            if (binding.type != VK_DESCRIPTOR_TYPE_MAX_ENUM)
+                merge(binding);
+            break;
+        }
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * Add the interface of another stage.
+ *
+ * Bindings shared by both become visible to both stages.
+ */
+void VkcShaderReflection::merge(const VkcShaderReflection &other)
+{
+    stages |= other.stages;
+    pushConstantSize = qMax(pushConstantSize, other.pushConstantSize);
+    pushConstantStages |= other.pushConstantStages;
+    featureMask |= other.featureMask;
+
+    for (int i = 0; i < other.bindings.size(); i++)
+        merge(other.bindings[i]);
+
+    inputs.append(other.inputs);
+}
+
+
+/**
+ * Find a binding by its variable or block name.
+ *
+ * Returns null if no stage declares it.
+ */
+const VkcShaderBinding* VkcShaderReflection::findBinding(const QByteArray &name) const
+{
+    for (int i = 0; i < bindings.size(); i++)
+        if (bindings[i].name == name || bindings[i].typeName == name)
+            return &bindings[i];
+
+    return nullptr;
+}
+
+
+/**
+ * Add a binding, or widen the stages of the one already at its slot.
+ */
+void VkcShaderReflection::merge(const VkcShaderBinding &binding)
+{
+    for (int i = 0; i < bindings.size(); i++)
+    {
+        if (bindings[i].set == binding.set && bindings[i].binding == binding.binding)
+        {
+            bindings[i].stages |= binding.stages;
+            return;
+        }
+    }
+
+    bindings.append(binding);
+}
+
+
+/**
+ * Get the size in bytes of a type, as laid out in a buffer or push constant block.
+ */
+uint32_t VkcShaderReflection::getSize(uint32_t typeId) const
+{
+    const VkcSpirvType type = types.value(typeId);
+
+    switch (type.opcode)
+    {
+    case SPV_OP_TYPE_INT:
+    case SPV_OP_TYPE_FLOAT:
+        return type.operands[0] / 8;
+
+    case SPV_OP_TYPE_VECTOR:
+    case SPV_OP_TYPE_MATRIX:
+        return type.operands[1] * getSize(type.operands[0]);
+
+    case SPV_OP_TYPE_ARRAY:
+        return constants.value(type.operands[1], 1) * arrayStrides.value(typeId, getSize(type.operands[0]));
+
+    case SPV_OP_TYPE_STRUCT:
+    {
+        // The block ends with the member reaching furthest.
+        uint32_t size = 0;
+        uint32_t offset = 0;
+
+        for (int i = 0; i < type.operands.size(); i++)
+        {
+            offset = memberOffsets.value(((uint64_t)typeId << 32) | i, offset);
+            offset += getSize(type.operands[i]);
+
+            size = qMax(size, offset);
+        }
+
+        return size;
+    }
+    }
+
+    return 0;
+}
+
+
+/**
+ * Get the vertex format of an input type along with its size.
+ */
+VkFormat VkcShaderReflection::getFormat(uint32_t typeId, uint32_t &size) const
+{
+    static const VkFormat floatFormats[] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+    static const VkFormat intFormats[] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+    static const VkFormat uintFormats[] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+
+    size = getSize(typeId);
+
+    // Get the component type and count.
+    VkcSpirvType type = types.value(typeId);
+    uint32_t componentCount = 1;
+
+    if (type.opcode == SPV_OP_TYPE_VECTOR)
+    {
+        componentCount = type.operands[1];
+        type = types.value(type.operands[0]);
+    }
+
+    if (componentCount < 1 || componentCount > 4 || type.operands.value(0) != 32)
+        return VK_FORMAT_UNDEFINED;
+
+    if (type.opcode == SPV_OP_TYPE_FLOAT)
+        return floatFormats[componentCount - 1];
+    if (type.opcode == SPV_OP_TYPE_INT)
+        return type.operands[1] ? intFormats[componentCount - 1] : uintFormats[componentCount - 1];
+
+    return VK_FORMAT_UNDEFINED;
+}
+
+
+/**
+ * Get the descriptor type of a resource variable.
+ */
+VkDescriptorType VkcShaderReflection::getDescriptorType(uint32_t typeId, uint32_t storageClass, bool bufferBlock) const
+{
+    if (storageClass == SPV_STORAGE_STORAGE_BUFFER)
+        return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    if (storageClass == SPV_STORAGE_UNIFORM)
+        return bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+    const VkcSpirvType type = types.value(typeId);
+
+    switch (type.opcode)
+    {
+    case SPV_OP_TYPE_SAMPLER:
+        return VK_DESCRIPTOR_TYPE_SAMPLER;
+
+    case SPV_OP_TYPE_SAMPLED_IMAGE:
+        if (types.value(type.operands[0]).operands.value(1) == SPV_DIM_BUFFER)
+            return VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+        return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    case SPV_OP_TYPE_IMAGE:
+    {
+        // Operands: sampled type, dim, depth, arrayed, multisampled, sampled, format.
+        uint32_t dim = type.operands[1];
+        bool storage = type.operands[5] == 2;
+
+        if (dim == SPV_DIM_SUBPASS_DATA)
+            return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        if (dim == SPV_DIM_BUFFER)
+            return storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+
+        return storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    }
+    }
+
+    return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+}
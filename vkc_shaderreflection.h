@@ -0,0 +1,115 @@
+#ifndef VKC_SHADERREFLECTION_H
+#define VKC_SHADERREFLECTION_H
+
+#include "stable.h"
+
+
+/**
+ * Struct used for a descriptor binding declared by a shader.
+ */
+struct VkcShaderBinding
+{
+    uint32_t                    set =           0;
+    uint32_t                    binding =       0;
+    VkDescriptorType            type =          VK_DESCRIPTOR_TYPE_MAX_ENUM;
+    uint32_t                    count =         1;
+    VkShaderStageFlags          stages =        0;
+
+    QByteArray                  name =          "";
+    QByteArray                  typeName =      "";
+};
+
+/**
+ * Struct used for a vertex input declared by a shader.
+ */
+struct VkcShaderInput
+{
+    uint32_t                    location =      0;
+    VkFormat                    format =        VK_FORMAT_UNDEFINED;
+    uint32_t                    size =          0;
+};
+
+
+/**
+ * Struct used for a type declared by a SPIR-V module.
+ */
+struct VkcSpirvType
+{
+    uint32_t                    opcode =        0;
+    QVector<uint32_t>           operands =      {};
+};
+
+/**
+ * Struct used for a variable declared by a SPIR-V module.
+ */
+struct VkcSpirvVariable
+{
+    uint32_t                    id =            0;
+    uint32_t                    typeId =        0;
+    uint32_t                    storageClass =  0;
+};
+
+
+/**
+ * Class used to read the interface of a SPIR-V module.
+ *
+ * Only the instructions describing descriptor bindings, push constants,
+ * stage inputs and feature constants are looked at; everything else is
+ * skipped.
+ *
+ * Classes named "Vkc[class]" stand for "Vulkan custom class".
+ */
+class VkcShaderReflection
+{
+    // Objects:
+public:
+    VkShaderStageFlags          stages;
+
+    QVector<VkcShaderBinding>   bindings;
+    QVector<VkcShaderInput>     inputs;
+    uint32_t                    pushConstantSize;
+    VkShaderStageFlags          pushConstantStages;
+    uint32_t                    featureMask;
+
+private:
+    QHash<uint32_t, VkcSpirvType> types;
+    QHash<uint32_t, uint32_t>   constants;
+    QHash<uint32_t, QByteArray> names;
+    QHash<uint64_t, uint32_t>   memberOffsets;
+    QHash<uint32_t, uint32_t>   arrayStrides;
+
+    // Functions:
+public:
+    VkcShaderReflection();
+
+    bool parse(
+            const QByteArray        &code,
+            VkShaderStageFlagBits   stage
+            );
+    void merge(
+            const VkcShaderReflection &other
+            );
+
+    const VkcShaderBinding* findBinding(
+            const QByteArray        &name
+            ) const;
+
+private:
+    void merge(
+            const VkcShaderBinding  &binding
+            );
+    uint32_t getSize(
+            uint32_t                typeId
+            ) const;
+    VkFormat getFormat(
+            uint32_t                typeId,
+            uint32_t                &size
+            ) const;
+    VkDescriptorType getDescriptorType(
+            uint32_t                typeId,
+            uint32_t                storageClass,
+            bool                    bufferBlock
+            ) const;
+};
+
+#endif // VKC_SHADERREFLECTION_H
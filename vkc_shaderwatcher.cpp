@@ -0,0 +1,238 @@
+#include "vkc_shaderwatcher.h"
+
+
+/**
+ * Start watching the shader sources.
+ *
+ * Nothing is watched if no compiler is found.
+ */
+VkcShaderWatcher::VkcShaderWatcher(MgJobSystem *jobSystem, QObject *parent) : QObject(parent)
+{
+    this->jobSystem = jobSystem;
+    pendingCounter.value.store(0);
+
+    watcher = new QFileSystemWatcher(this);
+
+    // Compile once the changes have settled.
+    delayTimer = new QTimer(this);
+    delayTimer->setSingleShot(true);
+    delayTimer->setInterval(VKC_SHADER_RELOAD_DELAY);
+
+    connect(watcher, SIGNAL(directoryChanged(QString)), this, SLOT(directoryChanged()));
+    connect(watcher, SIGNAL(fileChanged(QString)), this, SLOT(fileChanged(QString)));
+    connect(delayTimer, SIGNAL(timeout()), this, SLOT(compileChanged()));
+
+    compiler = findCompiler();
+
+    if (compiler.isEmpty())
+    {
+        qDebug() << "WARNING: [@qDebug]              - glslangValidator not found, shaders will not be reloaded.";
+        return;
+    }
+
+    QDir().mkpath(VKC_SHADER_CACHE_DIR);
+
+    // New sources show up as directory changes.
+    watcher->addPath(VKC_SHADER_DIR);
+    scan(false);
+}
+
+
+/**
+ * Stop watching, after the compile jobs have finished.
+ */
+VkcShaderWatcher::~VkcShaderWatcher()
+{
+    jobSystem->wait(&pendingCounter);
+}
+
+
+/**
+ * Get the SPIR-V names of the shaders compiled since the last call.
+ *
+ * Called on the render thread.
+ */
+QStringList VkcShaderWatcher::takeCompiled()
+{
+    QMutexLocker locker(&mutex);
+
+    QStringList shaders = compiledShaders;
+    compiledShaders.clear();
+
+    return shaders;
+}
+
+
+/**
+ * Check if any shader was compiled since the last call to takeCompiled().
+ */
+bool VkcShaderWatcher::hasCompiled()
+{
+    QMutexLocker locker(&mutex);
+
+    return !compiledShaders.isEmpty();
+}
+
+
+/**
+ * Look for added and modified sources.
+ */
+void VkcShaderWatcher::directoryChanged()
+{
+    scan(true);
+}
+
+
+/**
+ * Queue a modified source.
+ */
+void VkcShaderWatcher::fileChanged(const QString &path)
+{
+    // Editors saving through a new file make the watcher drop the old one.
+    if (QFile::exists(path) && !watcher->files().contains(path))
+        watcher->addPath(path);
+
+    QFileInfo fileInfo(path);
+    modifiedTimes.insert(fileInfo.fileName(), fileInfo.lastModified());
+
+    changedSources.insert(fileInfo.fileName());
+    delayTimer->start();
+}
+
+
+/**
+ * Compile every queued source on the job system.
+ */
+void VkcShaderWatcher::compileChanged()
+{
+    for (const QString &source : changedSources)
+        jobSystem->submit([this, source]() { compile(source); }, &pendingCounter, "compileShader");
+
+    changedSources.clear();
+}
+
+
+/**
+ * Watch the sources in the shader folder, queueing the ones that changed.
+ *
+ * The first scan only records them.
+ */
+void VkcShaderWatcher::scan(bool notify)
+{
+    QFileInfoList files = QDir(VKC_SHADER_DIR).entryInfoList(QDir::Files);
+
+    for (int i = 0; i < files.size(); i++)
+    {
+        const QFileInfo &fileInfo = files[i];
+        QString source = fileInfo.fileName();
+
+        if (!isSource(source))
+            continue;
+
+        if (!watcher->files().contains(fileInfo.filePath()))
+            watcher->addPath(fileInfo.filePath());
+
+        auto it = modifiedTimes.find(source);
+        if (it != modifiedTimes.end() && it.value() == fileInfo.lastModified())
+            continue;
+
+        modifiedTimes.insert(source, fileInfo.lastModified());
+
+        if (notify)
+        {
+            changedSources.insert(source);
+            delayTimer->start();
+        }
+    }
+}
+
+
+/**
+ * Compile a source to SPIR-V and put it where the pipelines load it from.
+ *
+ * Runs on a worker. The code is taken from the cache if the same source was
+ * compiled before.
+ */
+void VkcShaderWatcher::compile(const QString &source)
+{
+    QFile sourceFile(VKC_SHADER_DIR + source);
+
+    if (!sourceFile.open(QIODevice::ReadOnly))
+        return;
+
+    // The stage comes from the extension, so it is part of the hash.
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QFileInfo(source).suffix().toUtf8());
+    hash.addData(sourceFile.readAll());
+    sourceFile.close();
+
+    QString cacheName = VKC_SHADER_CACHE_DIR + QString(hash.result().toHex()) + ".spv";
+
+    if (!QFile::exists(cacheName))
+    {
+        // Write to a temporary file, so a failed compile leaves no cache entry.
+        QString tempName = cacheName + ".tmp";
+
+        QProcess process;
+        process.setProcessChannelMode(QProcess::MergedChannels);
+        process.start(compiler, QStringList() << "-V" << sourceFile.fileName() << "-o" << tempName);
+
+        bool finished = process.waitForFinished(VKC_SHADER_COMPILE_TIMEOUT);
+
+        if (!finished || process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+        {
+            qDebug() << "ERROR:   [@qDebug]              - Shader \"" << source << "\" failed to compile:";
+            qDebug().noquote() << process.readAll();
+
+            QFile::remove(tempName);
+            return;
+        }
+
+        QFile::remove(cacheName);
+        QFile::rename(tempName, cacheName);
+    }
+
+    // Replace the code the pipelines load.
+    QString shader = source + ".spv";
+
+    QFile::remove(VKC_SHADER_DIR + shader);
+    if (!QFile::copy(cacheName, VKC_SHADER_DIR + shader))
+    {
+        qDebug() << "ERROR:   [@qDebug]              - Shader \"" << shader << "\" could not be written.";
+        return;
+    }
+
+    QMutexLocker locker(&mutex);
+
+    if (!compiledShaders.contains(shader))
+        compiledShaders.append(shader);
+}
+
+
+/**
+ * Check if a file is a GLSL source, by its extension.
+ */
+bool VkcShaderWatcher::isSource(const QString &fileName)
+{
+    static const QStringList extensions = {"vert", "frag", "comp", "geom", "tesc", "tese"};
+
+    return extensions.contains(QFileInfo(fileName).suffix());
+}
+
+
+/**
+ * Find the shader compiler, preferring the one of the Vulkan SDK.
+ */
+QString VkcShaderWatcher::findCompiler()
+{
+    QString sdk = qgetenv("VULKAN_SDK");
+    QString compiler;
+
+    if (!sdk.isEmpty())
+        compiler = QStandardPaths::findExecutable("glslangValidator", QStringList() << sdk + "/Bin" << sdk + "/bin");
+
+    if (compiler.isEmpty())
+        compiler = QStandardPaths::findExecutable("glslangValidator");
+
+    return compiler;
+}
@@ -0,0 +1,77 @@
+#ifndef VKC_SHADERWATCHER_H
+#define VKC_SHADERWATCHER_H
+
+#include "stable.h"
+#include "mgjobsystem.h"
+
+#define VKC_SHADER_DIR "data/shaders/"
+#define VKC_SHADER_CACHE_DIR "data/shaders/cache/"
+#define VKC_SHADER_RELOAD_DELAY 100
+#define VKC_SHADER_COMPILE_TIMEOUT 30000
+
+
+/**
+ * Class used to recompile shaders when their GLSL sources change.
+ *
+ * Sources are kept next to their SPIR-V, "shader.frag" compiling to
+ * "shader.frag.spv". Changes are gathered for a short delay, since editors
+ * save in several steps, then every changed source is compiled on the job
+ * system. Compiled code is cached by the hash of the source, so reverting an
+ * edit needs no compiler run. The SPIR-V names of the shaders that compiled
+ * are handed to the render thread, which rebuilds the pipelines using them.
+ *
+ * Sources are compiled with glslangValidator, from the Vulkan SDK or the path.
+ *
+ * Classes named "Vkc[class]" stand for "Vulkan custom class".
+ */
+class VkcShaderWatcher : public QObject
+{
+    Q_OBJECT
+
+    // Objects:
+private:
+    QFileSystemWatcher          *watcher;
+    QTimer                      *delayTimer;
+    QHash<QString, QDateTime>   modifiedTimes;
+    QSet<QString>               changedSources;
+    QString                     compiler;
+
+    QMutex                      mutex;
+    QStringList                 compiledShaders;
+
+    MgJobSystem                 *jobSystem;
+    MgJobCounter                pendingCounter;
+
+    // Functions:
+public:
+    VkcShaderWatcher(
+            MgJobSystem         *jobSystem,
+            QObject             *parent = 0
+            );
+    ~VkcShaderWatcher();
+
+    QStringList takeCompiled();
+    bool hasCompiled();
+
+private slots:
+    void directoryChanged();
+    void fileChanged(
+            const QString       &path
+            );
+    void compileChanged();
+
+private:
+    void scan(
+            bool                notify
+            );
+    void compile(
+            const QString       &source
+            );
+
+    static bool isSource(
+            const QString       &fileName
+            );
+    static QString findCompiler();
+};
+
+#endif // VKC_SHADERWATCHER_H
@@ -7,36 +7,22 @@
 VkcSwapchain::VkcSwapchain()
 {
     handle =                VK_NULL_HANDLE;
-    renderPass =            VK_NULL_HANDLE;
-
-    clearValues[0] =        {0.8f, 0.8f, 1.0f, 1.0f};
-    clearValues[1] =        {0.0f, 0};
 
+    presentMode =           VK_PRESENT_MODE_FIFO_KHR;
     imageCount =            0;
 }
 
 
 /**
  * Initialize the swapchain.
+ *
+ * Passing the swapchain being replaced lets the driver recycle its resources.
  */
-VkcSwapchain::VkcSwapchain(VkSurfaceKHR surface, const VkcDevice *device) : VkcSwapchain()
-{
-    createSwapchain(surface, device);
-    createImages();
-    createRenderPass();
-    createFramebuffers();
-}
-
-
-/**
- * Initialize the swapchain using existent renderpass.
- */
-VkcSwapchain::VkcSwapchain(VkRenderPass renderPass, VkSurfaceKHR surface, const VkcDevice *device) : VkcSwapchain()
+VkcSwapchain::VkcSwapchain(VkSurfaceKHR surface, const VkcDevice *device, const VkcPresentPolicy &policy,
+                           VkSwapchainKHR oldSwapchain) : VkcSwapchain()
 {
-    createSwapchain(surface, device);
+    createSwapchain(surface, device, policy, oldSwapchain);
     createImages();
-    this->renderPass = renderPass;
-    createFramebuffers();
 }
 
 
@@ -47,21 +33,6 @@ VkcSwapchain::~VkcSwapchain()
 {
     if (device->logical != VK_NULL_HANDLE)
     {
-        if (renderPass != VK_NULL_HANDLE)
-        {
-            vkDestroyRenderPass(device->logical, renderPass, nullptr);
-        }
-
-        while (framebuffers.size() > 0)
-        {
-            if (framebuffers[0] != VK_NULL_HANDLE)
-            {
-                vkDestroyFramebuffer(device->logical, framebuffers[0], nullptr);
-            }
-
-            framebuffers.removeFirst();
-        }
-
         while (colorImages.size() > 0)
         {
             colorImages[0]->destroy(device);
@@ -70,10 +41,28 @@ VkcSwapchain::~VkcSwapchain()
 
         depthStencilImage.destroy(device);
 
-        if (handle != VK_NULL_HANDLE)
-        {
-            vkDestroySwapchainKHR(device->logical, handle, nullptr);
-        }
+        device->deletionQueue->retire(VKC_DELETION_SWAPCHAIN, (uint64_t)handle);
+    }
+}
+
+
+/**
+ * Get the printable name of a present mode.
+ */
+const char* VkcSwapchain::getPresentModeName(VkPresentModeKHR mode)
+{
+    switch (mode)
+    {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return "IMMEDIATE";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        return "MAILBOX";
+    case VK_PRESENT_MODE_FIFO_KHR:
+        return "FIFO";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        return "FIFO_RELAXED";
+    default:
+        return "UNKNOWN";
     }
 }
 
@@ -81,7 +70,7 @@ VkcSwapchain::~VkcSwapchain()
 /**
  * Create the swapchain.
  */
-void VkcSwapchain::createSwapchain(VkSurfaceKHR surface, const VkcDevice *device)
+void VkcSwapchain::createSwapchain(VkSurfaceKHR surface, const VkcDevice *device, const VkcPresentPolicy &policy, VkSwapchainKHR oldSwapchain)
 {
     // Fill data fields.
     this->device = device;
@@ -129,17 +118,13 @@ void VkcSwapchain::createSwapchain(VkSurfaceKHR surface, const VkcDevice *device
     presentModes.resize(modeCount);
     vkGetPhysicalDeviceSurfacePresentModesKHR(device->physical, surface, &modeCount, presentModes.data());
 
-    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
-    imageCount = 2;
-    for (int i = 0; i < presentModes.size(); i++)
-    {
-        if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
-        {
-            presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
-            imageCount = 3;
-            break;
-        }
-    }
+    // Use the requested mode if supported, FIFO always is.
+    presentMode = presentModes.contains(policy.mode) ? policy.mode : VK_PRESENT_MODE_FIFO_KHR;
+
+    // Mailbox needs a spare image to replace the queued one.
+    imageCount = policy.imageCount;
+    if (imageCount == 0)
+        imageCount = presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? 3 : 2;
 
     if (imageCount < surfaceCapabilities.minImageCount)
     {
@@ -180,7 +165,7 @@ void VkcSwapchain::createSwapchain(VkSurfaceKHR surface, const VkcDevice *device
         VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,              // VkCompositeAlphaFlagBitsKHR      compositeAlpha;
         presentMode,                                    // VkPresentModeKHR                 presentMode;
         VK_TRUE,                                        // VkBool32                         clipped;
-        VK_NULL_HANDLE                                  // VkSwapchainKHR                   oldSwapchain;
+        oldSwapchain                                    // VkSwapchainKHR                   oldSwapchain;
     };
 
     // Create swap chain.
@@ -243,7 +228,8 @@ void VkcSwapchain::createImages()
         },
         VK_FORMAT_D32_SFLOAT_S8_UINT,                       // VkFormat                  format;
         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,   // VkImageLayout             layout;
-        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,        // VkImageUsageFlags         usage;
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |       // VkImageUsageFlags         usage;
+        VK_IMAGE_USAGE_SAMPLED_BIT,
         {                                                   // VkImageSubresourceRange   resourceRange;
             VK_IMAGE_ASPECT_DEPTH_BIT |                         // VkImageAspectFlags    aspectMask;
             VK_IMAGE_ASPECT_STENCIL_BIT,
@@ -262,134 +248,3 @@ void VkcSwapchain::createImages()
     depthStencilImage.create(device, &depthStencilImageInfo);
 }
 
-
-/**
- * Creates the render pass.
- */
-void VkcSwapchain::createRenderPass()
-{
-    // Fill attachment descriptions.
-    VkAttachmentDescription attachmentDescription[2] =
-    {
-        {
-            0,                                                  // VkAttachmentDescriptionFlags    flags;
-
-            surfaceFormats[0].format,                           // VkFormat                        format;
-            VK_SAMPLE_COUNT_1_BIT,                              // VkSampleCountFlagBits           samples;
-
-            VK_ATTACHMENT_LOAD_OP_CLEAR,                        // VkAttachmentLoadOp              loadOp;
-            VK_ATTACHMENT_STORE_OP_STORE,                       // VkAttachmentStoreOp             storeOp;
-            VK_ATTACHMENT_LOAD_OP_CLEAR,                        // VkAttachmentLoadOp              stencilLoadOp;
-            VK_ATTACHMENT_STORE_OP_STORE,                       // VkAttachmentStoreOp             stencilStoreOp;
-
-            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,           // VkImageLayout                   initialLayout;
-            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,           // VkImageLayout                   finalLayout;
-
-        },
-
-        {
-            0,                                                  // VkAttachmentDescriptionFlags    flags;
-
-            depthStencilImage.info.format,                      // VkFormat                        format;
-            VK_SAMPLE_COUNT_1_BIT,                              // VkSampleCountFlagBits           samples;
-
-            VK_ATTACHMENT_LOAD_OP_CLEAR,                        // VkAttachmentLoadOp              loadOp;
-            VK_ATTACHMENT_STORE_OP_STORE,                       // VkAttachmentStoreOp             storeOp;
-            VK_ATTACHMENT_LOAD_OP_CLEAR,                        // VkAttachmentLoadOp              stencilLoadOp;
-            VK_ATTACHMENT_STORE_OP_STORE,                       // VkAttachmentStoreOp             stencilStoreOp;
-
-            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,   // VkImageLayout                   initialLayout;
-            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,   // VkImageLayout                   finalLayout;
-
-        }
-    };
-
-    // Fill attachment references.
-    VkAttachmentReference attachmentReference[2] =
-    {
-        {
-            0,                                                  // uint32_t         attachment;
-            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL            // VkImageLayout    layout;
-        },
-
-        {
-            1,                                                  // uint32_t         attachment;
-            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,   // VkImageLayout    layout;
-        }
-    };
-
-    // Fill subpass description.
-    VkSubpassDescription subpassDescription =
-    {
-        0,                                  // VkSubpassDescriptionFlags       flags;
-        VK_PIPELINE_BIND_POINT_GRAPHICS,    // VkPipelineBindPouint32_t        pipelineBindPoint;
-
-        0,                                  // uint32_t                        inputAttachmentCount;
-        nullptr,                            // const VkAttachmentReference*    pInputAttachments;
-
-        1,                                  // uint32_t                        colorAttachmentCount;
-        &attachmentReference[0],            // const VkAttachmentReference*    pColorAttachments;
-
-        nullptr,                            // const VkAttachmentReference*    pResolveAttachments;
-
-        &attachmentReference[1],            // const VkAttachmentReference*    pDepthStencilAttachment;
-
-        0,                                  // uint32_t                        preserveAttachmentCount;
-        nullptr,                            // const uint32_t*                 pPreserveAttachments;
-    };
-
-    // Fill render pass create info.
-    VkRenderPassCreateInfo renderPassInfo =
-    {
-        VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,  // VkStructureType                   sType;
-        nullptr,                                    // const void*                       pNext;
-        0,                                          // VkRenderPassCreateFlags           flags;
-
-        2,                                          // uint32_t                          attachmentCount;
-        attachmentDescription,                      // const VkAttachmentDescription*    pAttachments;
-
-        1,                                          // uint32_t                          subpassCount;
-        &subpassDescription,                        // const VkSubpassDescription*       pSubpasses;
-
-        0,                                          // uint32_t                          dependencyCount;
-        nullptr                                     // const VkSubpassDependency*        pDependencies;
-    };
-
-    // Create render pass.
-    vkCreateRenderPass(device->logical, &renderPassInfo, nullptr, &renderPass);
-}
-
-
-/**
- * Creates the framebuffers.
- */
-void VkcSwapchain::createFramebuffers()
-{
-    // Fill framebuffer info.
-    VkImageView attachments[2];
-    attachments[1] = depthStencilImage.view;
-
-    VkFramebufferCreateInfo framebufferInfo =
-    {
-        VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,  // VkStructureType             sType;
-        nullptr,                                    // const void*                 pNext;
-        0,                                          // VkFramebufferCreateFlags    flags;
-
-        renderPass,                                 // VkRenderPass                renderPass;
-        2,                                          // uint32_t                    attachmentCount;
-        attachments,                                // const VkImageView*          pAttachments;
-
-        extent.width,                               // uint32_t                    width;
-        extent.height,                              // uint32_t                    height;
-        1                                           // uint32_t                    layers;
-    };
-
-    // Create a framebuffer for each image in the swap chain.
-    framebuffers.resize(imageCount);
-    for (uint32_t i = 0; i < imageCount; i++)
-    {
-        attachments[0] = colorImages[i]->view;
-
-        vkCreateFramebuffer(device->logical, &framebufferInfo, nullptr, &framebuffers[i]);
-    }
-}
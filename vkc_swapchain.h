@@ -6,6 +6,18 @@
 #include "mgimage.h"
 
 
+/**
+ * Struct used to choose how swapchain images are presented.
+ *
+ * Unsupported modes fall back to FIFO, an image count of 0 picks one suited to the mode.
+ */
+struct VkcPresentPolicy
+{
+    VkPresentModeKHR                mode =          VK_PRESENT_MODE_MAILBOX_KHR;
+    uint32_t                        imageCount =    0;
+};
+
+
 /**
  * Class used for swap chains.
  *
@@ -16,19 +28,16 @@ class VkcSwapchain
     // Objects:
 public:
     VkSwapchainKHR                  handle;
-    VkRenderPass                    renderPass;
 
     QVector<MgImage*>               colorImages;
     MgImage                         depthStencilImage;
 
-    QVector<VkFramebuffer>          framebuffers;
-
     VkExtent2D                      extent;
-    VkClearValue                    clearValues[2];
+    VkPresentModeKHR                presentMode;
+    uint32_t                        imageCount;
 
 protected:
     QVector<VkSurfaceFormatKHR>     surfaceFormats;
-    uint32_t                        imageCount;
     const VkcDevice                 *device;
 
     // Functions:
@@ -37,23 +46,24 @@ public:
 
     VkcSwapchain(
             VkSurfaceKHR            surface,
-            const VkcDevice         *device
-            );
-    VkcSwapchain(
-            VkRenderPass            renderPass,
-            VkSurfaceKHR            surface,
-            const VkcDevice         *device
+            const VkcDevice         *device,
+            const VkcPresentPolicy  &policy,
+            VkSwapchainKHR          oldSwapchain = VK_NULL_HANDLE
             );
     ~VkcSwapchain();
 
+    static const char* getPresentModeName(
+            VkPresentModeKHR        mode
+            );
+
 protected:
     void createSwapchain(
             VkSurfaceKHR            surface,
-            const VkcDevice         *device
+            const VkcDevice         *device,
+            const VkcPresentPolicy  &policy,
+            VkSwapchainKHR          oldSwapchain
             );
     void createImages();
-    void createRenderPass();
-    void createFramebuffers();
 };
 
 #endif // VKC_SWAPCHAIN_H